@@ -0,0 +1,998 @@
+/**
+ * batch.c
+ *
+ * Implementation of the batch pipeline
+ *
+ * Stages hand files to each other through bounded queues. A full queue
+ * blocks its producers, so a slow stage throttles the ones before it
+ * instead of letting files pile up in memory. Each queue records how
+ * deep it got and how long its producers and consumers waited, which
+ * shows where the pipeline stalls.
+ *
+ * I/O stages have threads of their own. The CPU-bound stages (parse and
+ * generate) run as one task per file on a work-stealing scheduler, and
+ * a large file splits further into per-norm annotation tasks that idle
+ * workers steal, so one huge schema does not leave the other cores
+ * waiting.
+ *
+ * NDJSON records are serialized into a buffer owned by the thread that
+ * finishes the file, with no lock held. A thread hands its buffer to
+ * stdout when it grows past a few KB or before the thread waits for more
+ * work. Buffers that fit in PIPE_BUF go out in one atomic write(); only
+ * larger ones (usually records with inline code) take the output lock.
+ */
+
+#define _GNU_SOURCE
+#include "batch.h"
+#include "config_validator.h"
+#include "context_manager.h"
+#include "json_writer.h"
+#include "kelsen_optimizer.h"
+#include "parallel_parser.h"
+#include "parser_defs.h"
+#include "schema_image.h"
+#include "schema_json.h"
+#include "schema_types.h"
+#include "task_scheduler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char** environ;
+
+/* Queue slots (and files in flight on the scheduler) per worker of the consuming stage */
+#define BATCH_SLOTS_PER_WORKER 2
+
+/* Files the reader asks the kernel to prefetch ahead of the one it reads */
+#define BATCH_READAHEAD 8
+
+/* Maximum number of stages */
+#define BATCH_MAX_STAGES 5
+
+/* Buffered NDJSON output a thread writes out without waiting to go idle */
+#define BATCH_RECORD_FLUSH 2048
+
+/* One file on its way through the pipeline */
+typedef struct {
+    int index;                  // Position in the input list
+    const char* input;
+    char* output;
+    char* text;                 // Schema text, until parsed
+    size_t length;
+    Schema* schema;             // Parsed schema, until generated
+    char* code;                 // Kelsen code, until written (or recorded, with inline code)
+    SchemaDiagnostics diagnostics;  // Parse diagnostics, for the NDJSON record
+    uint64_t start_ns;          // When the file entered the pipeline
+    uint64_t stage_ns[BATCH_MAX_STAGES];    // Time spent in each stage
+    uint64_t output_hash;       // FNV-1a hash of the written code
+    bool written;
+} BatchItem;
+
+/* Bounded FIFO of items between two stages */
+typedef struct {
+    BatchItem** slots;
+    int capacity;
+    int head;
+    int count;
+    int producers;              // Workers still pushing; the queue closes when none are left
+    bool aborted;               // Set when the pipeline could not be started
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint64_t pushes;            // Metrics, updated under the lock
+    uint64_t depth_sum;         // Sum of the depth seen by each push, pushed item included
+    int max_depth;
+    uint64_t full_wait_ns;      // Time producers were blocked on a full queue
+    uint64_t empty_wait_ns;     // Time consumers were blocked on an empty queue
+} BatchQueue;
+
+typedef struct batch_run BatchRun;
+
+/* Work a stage does on one item; false drops the item as failed */
+typedef bool (*BatchStep)(BatchRun* run, BatchItem* item);
+
+/* One stage of the pipeline */
+typedef struct batch_stage {
+    const char* name;
+    BatchStep step;
+    BatchQueue* input;          // NULL for the reader and for stages chained to a pooled one
+    BatchQueue* output;         // NULL for the last stage and for stages with a chained successor
+    struct batch_stage* chain;  // Pooled stage run next within the same task
+    bool pooled;                // Runs as scheduler tasks rather than on threads of its own
+    int threads;                // Threads of the stage (a pooled stage with an input has one dispatcher)
+    int workers;                // Threads doing the stage's work, for utilization
+    uint64_t items;             // Items processed (updated atomically)
+    uint64_t busy_ns;           // Time spent in step (updated atomically)
+} BatchStage;
+
+struct batch_run {
+    const BatchOptions* options;
+    TaskScheduler* scheduler;   // Runs the pooled stages
+    SharedSnapshot* config;     // Configuration and context every stage works with
+    SharedSnapshot* context;
+    int next_input;             // Next entry of the input list (updated atomically)
+    int failures;               // Files that failed (updated atomically)
+    uint64_t declarations_before;   // Optimizer totals (updated atomically)
+    uint64_t declarations_after;
+    uint64_t bytes_before;
+    uint64_t bytes_after;
+    BatchStage stages[BATCH_MAX_STAGES];
+    BatchQueue queues[BATCH_MAX_STAGES - 1];
+    int stage_count;
+    int queue_count;
+    pthread_mutex_t output_lock;    // Serializes NDJSON writes larger than PIPE_BUF
+};
+
+/* A thread of a stage */
+typedef struct {
+    BatchRun* run;
+    BatchStage* stage;
+} BatchWorker;
+
+/* NDJSON records finished by this thread and not yet written (stage threads only) */
+static __thread JsonWriter* record_buffer = NULL;
+
+/* One file handed to a pooled stage */
+typedef struct {
+    BatchRun* run;
+    BatchStage* stage;
+    BatchItem* item;
+} BatchTask;
+
+/**
+ * Monotonic time in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Initialize a queue
+ */
+static bool queue_init(BatchQueue* queue, int capacity, int producers) {
+    memset(queue, 0, sizeof(BatchQueue));
+    queue->slots = (BatchItem**)calloc(capacity, sizeof(BatchItem*));
+    if (queue->slots == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    queue->capacity = capacity;
+    queue->producers = producers;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return true;
+}
+
+/**
+ * Destroy a queue (it must be empty)
+ */
+static void queue_destroy(BatchQueue* queue) {
+    if (queue->slots == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+/**
+ * Append an item, blocking while the queue is full
+ *
+ * @return false if the pipeline was aborted (the item was not queued)
+ */
+static bool queue_push(BatchQueue* queue, BatchItem* item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity && !queue->aborted) {
+        uint64_t start = now_ns();
+        while (queue->count == queue->capacity && !queue->aborted) {
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        }
+        queue->full_wait_ns += now_ns() - start;
+    }
+    if (queue->aborted) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    queue->slots[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    queue->pushes++;
+    queue->depth_sum += queue->count;
+    if (queue->count > queue->max_depth) {
+        queue->max_depth = queue->count;
+    }
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+/**
+ * Take the oldest item, blocking while the queue is empty but open
+ *
+ * @return The item, or NULL once the queue is closed and drained
+ */
+static BatchItem* queue_pop(BatchQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0 && queue->producers > 0 && !queue->aborted) {
+        uint64_t start = now_ns();
+        while (queue->count == 0 && queue->producers > 0 && !queue->aborted) {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        queue->empty_wait_ns += now_ns() - start;
+    }
+
+    BatchItem* item = NULL;
+    if (queue->count > 0) {
+        item = queue->slots[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+/**
+ * Record that one producer has finished
+ */
+static void queue_close(BatchQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    if (--queue->producers == 0) {
+        pthread_cond_broadcast(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Make every push fail and every blocked worker return
+ */
+static void queue_abort(BatchQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->aborted = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Check whether a queue is empty
+ */
+static bool queue_empty(BatchQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    bool empty = queue->count == 0;
+    pthread_mutex_unlock(&queue->lock);
+    return empty;
+}
+
+/**
+ * Free an item and whatever it still holds
+ */
+static void free_item(BatchItem* item) {
+    schema_diagnostics_clear(&item->diagnostics);
+    free(item->output);
+    free(item->text);
+    if (item->schema != NULL) {
+        free_schema(item->schema);
+    }
+    free(item->code);
+    free(item);
+}
+
+/**
+ * Get the output file of an input: its name with the extension replaced by .kelsen
+ */
+static char* output_path(const char* input) {
+    const char* base = strrchr(input, '/');
+    const char* dot = strrchr(base != NULL ? base + 1 : input, '.');
+    size_t stem = dot != NULL && dot != (base != NULL ? base + 1 : input) ? (size_t)(dot - input) : strlen(input);
+
+    char* path = (char*)malloc(stem + sizeof(".kelsen"));
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, input, stem);
+    strcpy(path + stem, ".kelsen");
+    return path;
+}
+
+/**
+ * Ask the kernel to start reading an input file in the background
+ */
+static void prefetch_input(const BatchRun* run, int index) {
+    if (index >= run->options->input_count) {
+        return;
+    }
+    int fd = open(run->options->inputs[index], O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+/**
+ * Take the next file of the input list
+ */
+static BatchItem* next_input(BatchRun* run) {
+    for (;;) {
+        int index = __atomic_fetch_add(&run->next_input, 1, __ATOMIC_RELAXED);
+        if (index >= run->options->input_count) {
+            return NULL;
+        }
+
+        BatchItem* item = (BatchItem*)calloc(1, sizeof(BatchItem));
+        if (item != NULL) {
+            item->index = index;
+            item->input = run->options->inputs[index];
+            item->output = output_path(item->input);
+            item->start_ns = now_ns();
+            if (item->output != NULL) {
+                return item;
+            }
+            free(item);
+        }
+        fprintf(stderr, "Memory allocation error\n");
+        __atomic_add_fetch(&run->failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Reader: load the whole file into memory
+ */
+static bool read_step(BatchRun* run, BatchItem* item) {
+    /* Keep the kernel a window of files ahead of the reader */
+    if (item->index == 0) {
+        for (int i = 1; i < BATCH_READAHEAD; i++) {
+            prefetch_input(run, i);
+        }
+    }
+    prefetch_input(run, item->index + BATCH_READAHEAD);
+
+    int fd = open(item->input, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Failed to open input file %s\n", item->input);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    item->text = (char*)malloc((size_t)info.st_size + 1);
+    if (item->text == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        close(fd);
+        return false;
+    }
+
+    size_t length = 0;
+    while (length < (size_t)info.st_size) {
+        ssize_t got = read(fd, item->text + length, (size_t)info.st_size - length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    close(fd);
+
+    if (length != (size_t)info.st_size) {
+        fprintf(stderr, "Error: Failed to read input file %s\n", item->input);
+        return false;
+    }
+
+    item->text[length] = '\0';
+    item->length = length;
+    return true;
+}
+
+/**
+ * Report a parse diagnostic with the name of the file
+ */
+static void report_diagnostic(void* user, ParseSeverity severity, int line, const char* message) {
+    const BatchItem* item = (const BatchItem*)user;
+    if (severity == PARSE_ERROR) {
+        fprintf(stderr, "%s: Parse error at line %d: %s\n", item->input, line, message);
+    } else {
+        fprintf(stderr, "%s: Warning: %s\n", item->input, message);
+    }
+}
+
+/**
+ * Parser: build the schema from the text
+ */
+static bool parse_step(BatchRun* run, BatchItem* item) {
+    /* An AST image written by --emit=ast needs no parsing */
+    if (schema_image_detect(item->text, item->length)) {
+        SchemaImage* image = schema_image_view(item->text, item->length);
+        if (image != NULL) {
+            item->schema = schema_image_load(image);
+            schema_image_close(image);
+        }
+    } else if (item->length > 0) {
+        ParseOptions options = { NULL, report_diagnostic, item };
+        if (run->options->ndjson) {
+            options.diagnostic = schema_diagnostics_collect;
+            options.user = &item->diagnostics;
+        }
+
+        /* A large file is split into pieces that idle workers steal */
+        if (run->options->parallel_parse) {
+            item->schema = parse_schema_parallel(item->text, item->length, &options, 0);
+        } else {
+            FILE* input = fmemopen(item->text, item->length, "r");
+            if (input != NULL) {
+                item->schema = parse_schema_with(input, &options);
+                fclose(input);
+            }
+        }
+    }
+
+    free(item->text);
+    item->text = NULL;
+
+    if (item->schema == NULL) {
+        fprintf(stderr, "Error: Failed to parse schema %s\n", item->input);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Code generator: produce the Kelsen code of the schema
+ */
+static bool generate_step(BatchRun* run, BatchItem* item) {
+    const BatchOptions* options = run->options;
+
+    if (options->with_context) {
+        item->code = generate_kelsen_code_with_context(item->schema);
+    } else {
+        item->code = generate_kelsen_code(item->schema);
+    }
+
+    /* Annotation tasks go to this worker's scheduler, where idle workers steal them */
+    if (item->code != NULL && options->annotate && options->with_context) {
+        char* annotations = generate_context_annotations(item->schema, 0);
+        if (annotations != NULL) {
+            char* combined = (char*)realloc(item->code, strlen(item->code) + strlen(annotations) + 1);
+            if (combined != NULL) {
+                strcat(combined, annotations);
+                item->code = combined;
+            }
+            free(annotations);
+        }
+    }
+
+    free_schema(item->schema);
+    item->schema = NULL;
+
+    if (item->code != NULL && options->optimize) {
+        KelsenOptimizerStats stats;
+        char* optimized = kelsen_optimize(item->code, &stats);
+        free(item->code);
+        item->code = optimized;
+        if (optimized != NULL) {
+            __atomic_add_fetch(&run->declarations_before, stats.declarations_before, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&run->declarations_after, stats.declarations_after, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&run->bytes_before, stats.bytes_before, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&run->bytes_after, stats.bytes_after, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (item->code == NULL) {
+        fprintf(stderr, "Error: Failed to generate Kelsen code for %s\n", item->input);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writer: store the code in the output file
+ */
+static bool write_step(BatchRun* run, BatchItem* item) {
+    FILE* output = fopen(item->output, "w");
+    if (output == NULL) {
+        fprintf(stderr, "Error: Failed to open output file %s\n", item->output);
+        return false;
+    }
+
+    fputs(item->code, output);
+    bool ok = fclose(output) == 0;
+
+    /* Records identify the output by its hash */
+    if (run->options->ndjson) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const unsigned char* p = (const unsigned char*)item->code; *p; p++) {
+            hash ^= *p;
+            hash *= 1099511628211ull;
+        }
+        item->output_hash = hash;
+        item->written = ok;
+    }
+    if (!run->options->inline_code) {
+        free(item->code);
+        item->code = NULL;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write %s\n", item->output);
+    }
+    return ok;
+}
+
+/**
+ * Validator: run the Kelsen compiler on the output file
+ */
+static bool validate_step(BatchRun* run, BatchItem* item) {
+    char* argv[] = { "kelsen", "-e", "kelsen_data.json", item->output, NULL };
+    pid_t pid;
+    int error = posix_spawnp(&pid, "kelsen", NULL, NULL, argv, environ);
+    if (error != 0) {
+        fprintf(stderr, "Error: Failed to run kelsen on %s: %s\n", item->output, strerror(error));
+        return false;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error: Failed to wait for kelsen on %s\n", item->output);
+            return false;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Kelsen validation of %s failed with exit code %d\n", item->output,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write out buffered NDJSON records
+ */
+static void flush_records(BatchRun* run, JsonWriter* writer) {
+    size_t length;
+    const char* data = json_writer_data(writer, &length);
+    if (length == 0) {
+        return;
+    }
+
+    /* Writes up to PIPE_BUF are atomic; larger ones must not interleave */
+    bool locked = length > PIPE_BUF;
+    if (locked) {
+        pthread_mutex_lock(&run->output_lock);
+    }
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            fprintf(stderr, "Error: Failed to write batch records\n");
+            break;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    if (locked) {
+        pthread_mutex_unlock(&run->output_lock);
+    }
+
+    json_writer_reset(writer);
+}
+
+/**
+ * Write the NDJSON record of a finished file
+ *
+ * @param failed Stage the file failed in, or NULL if it went through
+ */
+static void record_item(BatchRun* run, const BatchStage* failed, const BatchItem* item) {
+    JsonWriter* writer = record_buffer != NULL ? record_buffer : json_writer_open(NULL);
+    if (writer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return;
+    }
+
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "index");
+    json_writer_int(writer, item->index);
+    json_writer_key(writer, "file");
+    json_writer_string(writer, item->input);
+    json_writer_key(writer, "output");
+    json_writer_string(writer, item->written ? item->output : NULL);
+    json_writer_key(writer, "status");
+    json_writer_string(writer, failed == NULL ? "ok" : "error");
+    json_writer_key(writer, "failed_stage");
+    json_writer_string(writer, failed != NULL ? failed->name : NULL);
+    json_writer_key(writer, "diagnostics");
+    schema_json_write_diagnostics(writer, &item->diagnostics);
+
+    json_writer_key(writer, "timings_us");
+    json_writer_begin_object(writer);
+    for (int i = 0; i < run->stage_count; i++) {
+        if (item->stage_ns[i] > 0) {
+            json_writer_key(writer, run->stages[i].name);
+            json_writer_int(writer, (int64_t)(item->stage_ns[i] / 1000));
+        }
+    }
+    json_writer_key(writer, "total");
+    json_writer_int(writer, (int64_t)((now_ns() - item->start_ns) / 1000));
+    json_writer_end_object(writer);
+
+    json_writer_key(writer, "output_hash");
+    if (item->written) {
+        char hash[24];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)item->output_hash);
+        json_writer_string(writer, hash);
+    } else {
+        json_writer_null(writer);
+    }
+    if (run->options->inline_code) {
+        json_writer_key(writer, "code");
+        json_writer_string(writer, item->code);
+    }
+    json_writer_end_object(writer);
+    json_writer_newline(writer);
+
+    /* Scheduler workers have no buffer of their own; their (failure) records go out at once */
+    if (writer != record_buffer) {
+        flush_records(run, writer);
+        json_writer_close(writer);
+        return;
+    }
+
+    size_t length;
+    json_writer_data(writer, &length);
+    if (length >= BATCH_RECORD_FLUSH) {
+        flush_records(run, writer);
+    }
+}
+
+/**
+ * Run an item through a stage and the pooled stages chained to it
+ */
+static void process_item(BatchRun* run, BatchStage* stage, BatchItem* item) {
+    uint64_t start = now_ns();
+    bool ok = stage->step(run, item);
+    uint64_t elapsed = now_ns() - start;
+    item->stage_ns[stage - run->stages] = elapsed;
+    __atomic_add_fetch(&stage->busy_ns, elapsed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stage->items, 1, __ATOMIC_RELAXED);
+
+    if (ok && stage->chain != NULL) {
+        process_item(run, stage->chain, item);
+        return;
+    }
+    if (ok && stage->output != NULL) {
+        ok = queue_push(stage->output, item);
+        if (ok) return;
+    }
+    if (!ok) {
+        __atomic_add_fetch(&run->failures, 1, __ATOMIC_RELAXED);
+    }
+    if (run->options->ndjson) {
+        record_item(run, ok ? NULL : stage, item);
+    }
+    free_item(item);
+}
+
+/**
+ * Run a file through a pooled stage on a scheduler worker
+ */
+static void pooled_task(void* arg) {
+    BatchTask* task = (BatchTask*)arg;
+    BatchRun* run = task->run;
+
+    /* Swap rather than pin: a worker may run this while helping with another file */
+    SharedSnapshot* previous_config = config_use(run->config);
+    SharedSnapshot* previous_context = context_use(run->context);
+    process_item(run, task->stage, task->item);
+    context_use(previous_context);
+    config_use(previous_config);
+
+    free(task);
+}
+
+/**
+ * Hand the files of a pooled stage's input to the scheduler
+ *
+ * At most as many files as the input queue holds are in flight, so the
+ * queue still fills up and throttles the stages before it.
+ */
+static void dispatch(BatchRun* run, BatchStage* stage) {
+    TaskGroup group;
+    task_group_init(&group);
+
+    BatchItem* item;
+    while ((item = queue_pop(stage->input)) != NULL) {
+        BatchTask* task = (BatchTask*)malloc(sizeof(BatchTask));
+        if (task == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            __atomic_add_fetch(&run->failures, 1, __ATOMIC_RELAXED);
+            free_item(item);
+            continue;
+        }
+        task->run = run;
+        task->stage = stage;
+        task->item = item;
+
+        task_group_wait(run->scheduler, &group, stage->input->capacity - 1);
+        task_spawn(run->scheduler, &group, pooled_task, task);
+    }
+
+    task_group_wait(run->scheduler, &group, 0);
+    task_group_destroy(&group);
+}
+
+/**
+ * Run one thread of a stage until its input is exhausted
+ */
+static void* stage_worker(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    BatchRun* run = worker->run;
+    BatchStage* stage = worker->stage;
+
+    config_use(run->config);
+    context_use(run->context);
+    if (run->options->ndjson && !stage->pooled) {
+        record_buffer = json_writer_open(NULL);
+    }
+
+    if (stage->pooled) {
+        dispatch(run, stage);
+    } else {
+        for (;;) {
+            /* Hand finished records out before waiting for more files */
+            if (record_buffer != NULL && stage->input != NULL && queue_empty(stage->input)) {
+                flush_records(run, record_buffer);
+            }
+
+            BatchItem* item = stage->input != NULL ? queue_pop(stage->input) : next_input(run);
+            if (item == NULL) {
+                break;
+            }
+            process_item(run, stage, item);
+        }
+    }
+
+    /* The last stage of a pooled chain pushes on behalf of its dispatcher */
+    BatchStage* last = stage;
+    while (last->chain != NULL) {
+        last = last->chain;
+    }
+    if (last->output != NULL) {
+        queue_close(last->output);
+    }
+
+    if (record_buffer != NULL) {
+        flush_records(run, record_buffer);
+        json_writer_close(record_buffer);
+        record_buffer = NULL;
+    }
+
+    context_use(NULL);
+    config_use(NULL);
+    return NULL;
+}
+
+/**
+ * Append a stage, connecting it to the previous one
+ *
+ * Consecutive pooled stages are chained within one task; any other pair
+ * of stages gets a queue between them.
+ */
+static bool add_stage(BatchRun* run, const char* name, BatchStep step, int threads, bool pooled) {
+    BatchStage* stage = &run->stages[run->stage_count];
+    stage->name = name;
+    stage->step = step;
+    stage->pooled = pooled;
+    stage->threads = pooled ? 1 : threads;
+    stage->workers = pooled ? task_scheduler_workers(run->scheduler) : threads;
+
+    if (run->stage_count > 0) {
+        BatchStage* previous = &run->stages[run->stage_count - 1];
+        if (pooled && previous->pooled) {
+            previous->chain = stage;
+            stage->threads = 0;
+            run->stage_count++;
+            return true;
+        }
+
+        /* The head of a pooled chain produces through its dispatcher */
+        BatchStage* head = previous;
+        while (head > run->stages && (head - 1)->chain == head) {
+            head--;
+        }
+
+        BatchQueue* queue = &run->queues[run->queue_count];
+        if (!queue_init(queue, stage->workers * BATCH_SLOTS_PER_WORKER, head->threads)) {
+            return false;
+        }
+        run->queue_count++;
+        previous->output = queue;
+        stage->input = queue;
+    }
+
+    run->stage_count++;
+    return true;
+}
+
+/**
+ * Print the per-stage metrics
+ *
+ * A queue that stays full feeds a stage that cannot keep up; the stage
+ * with the highest utilization is the bottleneck.
+ */
+static void print_metrics(const BatchRun* run, double elapsed_ms) {
+    fprintf(stderr, "Batch: %d files, %d failed in %.1f ms\n",
+            run->options->input_count, run->failures, elapsed_ms);
+    fprintf(stderr, "  %-9s %7s %7s %9s %6s %15s %9s %9s\n",
+            "stage", "workers", "items", "busy ms", "util", "queue avg/max", "full ms", "empty ms");
+
+    const BatchStage* bottleneck = NULL;
+    double bottleneck_util = -1;
+    for (int i = 0; i < run->stage_count; i++) {
+        const BatchStage* stage = &run->stages[i];
+        double busy_ms = stage->busy_ns / 1e6;
+        /* Pooled stages share the scheduler's workers */
+        double util = elapsed_ms > 0 ? 100.0 * busy_ms / (elapsed_ms * stage->workers) : 0;
+        if (util > bottleneck_util) {
+            bottleneck_util = util;
+            bottleneck = stage;
+        }
+
+        fprintf(stderr, "  %-9s %7d %7llu %9.1f %5.0f%%", stage->name, stage->workers,
+                (unsigned long long)stage->items, busy_ms, util);
+
+        const BatchQueue* queue = stage->input;
+        if (queue == NULL) {
+            fprintf(stderr, " %15s %9s %9s\n", "-", "-", "-");
+            continue;
+        }
+        char depth[32];
+        snprintf(depth, sizeof(depth), "%.1f/%d/%d",
+                 queue->pushes > 0 ? (double)queue->depth_sum / queue->pushes : 0.0,
+                 queue->max_depth, queue->capacity);
+        fprintf(stderr, " %15s %9.1f %9.1f\n", depth, queue->full_wait_ns / 1e6, queue->empty_wait_ns / 1e6);
+    }
+
+    if (bottleneck != NULL) {
+        fprintf(stderr, "  Bottleneck: %s (%.0f%% busy)\n", bottleneck->name, bottleneck_util);
+    }
+    if (run->options->optimize) {
+        fprintf(stderr, "  Optimized: %llu -> %llu declarations, %llu -> %llu bytes\n",
+                (unsigned long long)run->declarations_before, (unsigned long long)run->declarations_after,
+                (unsigned long long)run->bytes_before, (unsigned long long)run->bytes_after);
+    }
+}
+
+/**
+ * Transpile a batch of schema files
+ */
+bool batch_run(const BatchOptions* options) {
+    if (options->input_count <= 0) {
+        return true;
+    }
+
+    /* Records bypass stdio; anything printed before them must come first */
+    if (options->ndjson) {
+        fflush(stdout);
+    }
+
+    int jobs = options->jobs;
+    if (jobs <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = online > 0 ? (int)online : 1;
+    }
+
+    BatchRun* run = (BatchRun*)calloc(1, sizeof(BatchRun));
+    if (run == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    run->options = options;
+    pthread_mutex_init(&run->output_lock, NULL);
+
+    run->scheduler = task_scheduler_create(jobs);
+    if (run->scheduler == NULL) {
+        pthread_mutex_destroy(&run->output_lock);
+        free(run);
+        return false;
+    }
+
+    /* Take a reference to the published snapshots for the whole run */
+    config_pin();
+    run->config = config_use(NULL);
+    context_pin();
+    run->context = context_use(NULL);
+
+    bool ok = add_stage(run, "read", read_step, 1, false) &&
+              add_stage(run, "parse", parse_step, 0, true) &&
+              add_stage(run, "generate", generate_step, 0, true) &&
+              add_stage(run, "write", write_step, 1, false) &&
+              (!options->validate || add_stage(run, "validate", validate_step, jobs, false));
+
+    int total = 0;
+    for (int i = 0; i < run->stage_count; i++) {
+        total += run->stages[i].threads;
+    }
+
+    BatchWorker* workers = ok ? (BatchWorker*)calloc(total, sizeof(BatchWorker)) : NULL;
+    pthread_t* handles = ok ? (pthread_t*)calloc(total, sizeof(pthread_t)) : NULL;
+    bool* started = ok ? (bool*)calloc(total, sizeof(bool)) : NULL;
+    if (ok && (workers == NULL || handles == NULL || started == NULL)) {
+        fprintf(stderr, "Memory allocation error\n");
+        ok = false;
+    }
+
+    uint64_t start = now_ns();
+    if (ok) {
+        int w = 0;
+        for (int i = 0; i < run->stage_count; i++) {
+            for (int j = 0; j < run->stages[i].threads; j++, w++) {
+                workers[w].run = run;
+                workers[w].stage = &run->stages[i];
+                started[w] = pthread_create(&handles[w], NULL, stage_worker, &workers[w]) == 0;
+                if (!started[w]) {
+                    ok = false;
+                }
+            }
+        }
+
+        /* A thread that cannot be started would leave its queue stuck */
+        if (!ok) {
+            fprintf(stderr, "Error: Failed to start the batch workers\n");
+            for (int i = 0; i < run->queue_count; i++) {
+                queue_abort(&run->queues[i]);
+            }
+        }
+
+        for (w = 0; w < total; w++) {
+            if (started[w]) {
+                pthread_join(handles[w], NULL);
+            }
+        }
+
+        /* Drop whatever an abort left behind */
+        for (int i = 0; i < run->queue_count; i++) {
+            BatchQueue* queue = &run->queues[i];
+            while (queue->count > 0) {
+                free_item(queue->slots[queue->head]);
+                queue->head = (queue->head + 1) % queue->capacity;
+                queue->count--;
+            }
+        }
+
+        if (ok) {
+            print_metrics(run, (now_ns() - start) / 1e6);
+        }
+    }
+
+    ok = ok && run->failures == 0;
+
+    for (int i = 0; i < run->queue_count; i++) {
+        queue_destroy(&run->queues[i]);
+    }
+    task_scheduler_destroy(run->scheduler);
+    shared_snapshot_release(run->context);
+    shared_snapshot_release(run->config);
+    free(workers);
+    free(handles);
+    free(started);
+    pthread_mutex_destroy(&run->output_lock);
+    free(run);
+    return ok;
+}
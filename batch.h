@@ -0,0 +1,49 @@
+/**
+ * batch.h
+ *
+ * Pipelined transpilation of many schema files: a reader, parser
+ * workers, code generation workers, a writer and validator workers,
+ * connected by bounded queues so disk I/O, CPU work and the external
+ * kelsen validator overlap
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+/**
+ * Options of a batch run
+ */
+typedef struct {
+    char* const* inputs;        // Schema files; each foo.txt is written to foo.kelsen
+    int input_count;
+    bool with_context;          // Enhance the code with the loaded legal context
+    bool annotate;              // Append per-norm context annotations (needs with_context)
+    bool validate;              // Run kelsen on every written file
+    int jobs;                   // Scheduler workers and validator threads (0 = one per online CPU)
+    bool ndjson;                // Write one JSON record per file on stdout
+    bool inline_code;           // Include the Kelsen code in each record (needs ndjson)
+    bool optimize;              // Run the Kelsen optimizer on the generated code
+    bool parallel_parse;        // Split large files across the scheduler's workers while parsing
+} BatchOptions;
+
+/**
+ * Transpile a batch of schema files
+ *
+ * Uses the published configuration and legal context. Per-file errors
+ * are reported on stderr and do not stop the batch; per-stage metrics
+ * are printed on stderr at the end.
+ *
+ * With ndjson, a line is written on stdout as soon as each file is done
+ * (in completion order): {"index", "file", "output", "status",
+ * "failed_stage", "diagnostics", "timings_us", "output_hash" and, with
+ * inline_code, "code"}. Parse diagnostics go into the records instead
+ * of stderr.
+ *
+ * @param options Batch options
+ * @return true if every file was transpiled (and validated), false otherwise
+ */
+bool batch_run(const BatchOptions* options);
+
+#endif /* BATCH_H */
@@ -0,0 +1,882 @@
+/**
+ * config_tables.c
+ *
+ * Implementation of the configuration lookup tables
+ */
+
+#include "config_tables.h"
+#include "schema_types.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <cJSON.h>
+
+/**
+ * Hash a name case-insensitively (FNV-1a over ASCII-lowercased bytes)
+ */
+uint32_t config_hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        unsigned char c = (*p >= 'A' && *p <= 'Z') ? (unsigned char)(*p + ('a' - 'A')) : *p;
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+/* Marks the end of a norm hash field, so "ab"+"c" and "a"+"bc" differ */
+#define NORM_FIELD_END 0xff
+
+/* A NULL field (e.g. no scope) */
+#define NORM_FIELD_ABSENT 0xfe
+
+/**
+ * Mix one byte into a 64-bit FNV-1a hash
+ */
+static uint64_t hash_byte(uint64_t hash, unsigned char byte) {
+    return (hash ^ byte) * 1099511628211ull;
+}
+
+/**
+ * Add a text field (action, scope or one condition) to a norm content hash
+ */
+uint64_t config_hash_norm_field(uint64_t hash, const char* text) {
+    if (text == NULL) {
+        return hash_byte(hash, NORM_FIELD_ABSENT);
+    }
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        hash = hash_byte(hash, *p);
+    }
+    return hash_byte(hash, NORM_FIELD_END);
+}
+
+/**
+ * Start the content hash of a norm
+ */
+uint64_t config_hash_norm(const char* role, uint32_t deontic) {
+    uint64_t hash = config_hash_norm_field(14695981039346656037ull, role);
+    return hash_byte(hash, (unsigned char)deontic);
+}
+
+/**
+ * Find a name in a set (ASCII case-insensitive)
+ */
+int config_name_set_find(const ConfigNameSet* set, const char* name) {
+    if (set->bucket_count == 0 || name == NULL) {
+        return -1;
+    }
+
+    uint32_t hash = config_hash_name(name);
+    uint32_t mask = set->bucket_count - 1;
+
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = set->buckets[slot];
+        if (entry == 0) {
+            return -1;
+        }
+        const ConfigName* candidate = &set->names[entry - 1];
+        if (candidate->hash == hash && strcasecmp(candidate->name, name) == 0) {
+            return (int)(entry - 1);
+        }
+    }
+}
+
+/**
+ * Free the arrays of a set built at runtime
+ */
+static void free_name_set(ConfigNameSet* set) {
+    for (uint32_t i = 0; i < set->count; i++) {
+        free((char*)set->names[i].name);
+    }
+    free((ConfigName*)set->names);
+    free((uint32_t*)set->buckets);
+    set->names = NULL;
+    set->buckets = NULL;
+    set->count = 0;
+    set->bucket_count = 0;
+}
+
+/**
+ * Build a set from the strings of a JSON array, or from the keys of a JSON object
+ *
+ * Non-string array items are skipped; a missing section gives an empty set.
+ */
+static bool build_name_set(ConfigNameSet* set, const cJSON* section, bool use_keys) {
+    memset(set, 0, sizeof(ConfigNameSet));
+
+    uint32_t count = 0;
+    for (const cJSON* item = section != NULL ? section->child : NULL; item != NULL; item = item->next) {
+        if (use_keys ? item->string != NULL : cJSON_IsString(item)) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    uint32_t bucket_count = 1;
+    while (bucket_count < count * 2) {
+        bucket_count <<= 1;
+    }
+
+    ConfigName* names = (ConfigName*)calloc(count, sizeof(ConfigName));
+    uint32_t* buckets = (uint32_t*)calloc(bucket_count, sizeof(uint32_t));
+    set->names = names;
+    set->buckets = buckets;
+    if (names == NULL || buckets == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free_name_set(set);
+        return false;
+    }
+
+    for (const cJSON* item = section->child; item != NULL; item = item->next) {
+        const char* name = use_keys ? item->string : (cJSON_IsString(item) ? item->valuestring : NULL);
+        if (name == NULL) continue;
+
+        uint32_t index = set->count;
+        names[index].name = strdup(name);
+        if (names[index].name == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            free_name_set(set);
+            return false;
+        }
+        names[index].hash = config_hash_name(name);
+        set->count++;
+
+        /* Duplicates probe past the first occurrence, which therefore wins lookups */
+        uint32_t slot = names[index].hash & (bucket_count - 1);
+        while (buckets[slot] != 0) {
+            slot = (slot + 1) & (bucket_count - 1);
+        }
+        buckets[slot] = index + 1;
+    }
+
+    set->bucket_count = bucket_count;
+    return true;
+}
+
+/* Roles recognized whatever the configuration (generic parties and earlier built-in roles) */
+static const char* const builtin_roles[] = {
+    "comprador", "vendedor", "arrendador", "arrendatario", "acreedor", "deudor", "juez",
+    "quejoso", "autoridad", "trabajador", "empleador", "parte1", "parte2"
+};
+
+/**
+ * Build the role lexicon: the built-in roles and every role of every institution, once each
+ */
+static bool build_role_lexicon(ConfigNameSet* set, const ConfigTables* tables) {
+    memset(set, 0, sizeof(ConfigNameSet));
+
+    uint32_t builtin_count = sizeof(builtin_roles) / sizeof(builtin_roles[0]);
+    uint32_t count = builtin_count;
+    for (uint32_t i = 0; i < tables->role_owners.count; i++) {
+        count += tables->roles[i].count;
+    }
+
+    uint32_t bucket_count = 1;
+    while (bucket_count < count * 2) {
+        bucket_count <<= 1;
+    }
+
+    ConfigName* names = (ConfigName*)calloc(count, sizeof(ConfigName));
+    uint32_t* buckets = (uint32_t*)calloc(bucket_count, sizeof(uint32_t));
+    set->names = names;
+    set->buckets = buckets;
+    set->bucket_count = bucket_count;
+    if (names == NULL || buckets == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free_name_set(set);
+        return false;
+    }
+
+    for (uint32_t owner = 0; owner <= tables->role_owners.count; owner++) {
+        /* The built-in roles first, then each institution's */
+        const ConfigNameSet* roles = owner > 0 ? &tables->roles[owner - 1] : NULL;
+        uint32_t role_count = owner > 0 ? roles->count : builtin_count;
+
+        for (uint32_t i = 0; i < role_count; i++) {
+            const char* name = owner > 0 ? roles->names[i].name : builtin_roles[i];
+            if (config_name_set_find(set, name) >= 0) continue;
+
+            uint32_t index = set->count;
+            names[index].name = strdup(name);
+            if (names[index].name == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                free_name_set(set);
+                return false;
+            }
+            names[index].hash = config_hash_name(name);
+            set->count++;
+
+            uint32_t slot = names[index].hash & (bucket_count - 1);
+            while (buckets[slot] != 0) {
+                slot = (slot + 1) & (bucket_count - 1);
+            }
+            buckets[slot] = index + 1;
+        }
+    }
+
+    return true;
+}
+
+/* Deontic operators by keyword and by the categories "deonticos" maps keywords to */
+static const struct {
+    const char* name;
+    DeonticOperator deontic;
+} deontic_names[] = {
+    { "debe", DEONTIC_OBLIGATION },
+    { "no-debe", DEONTIC_PROHIBITION },
+    { "puede", DEONTIC_PRIVILEGE },
+    { "tiene-derecho-a", DEONTIC_CLAIM_RIGHT },
+    { "obligacion", DEONTIC_OBLIGATION },
+    { "prohibicion", DEONTIC_PROHIBITION },
+    { "privilegio", DEONTIC_PRIVILEGE },
+    { "derecho", DEONTIC_CLAIM_RIGHT }
+};
+
+/**
+ * Resolve the deontic operator of a default norm; false if unknown
+ */
+static bool resolve_deontic(const cJSON* config, const char* text, uint32_t* deontic) {
+    /* A keyword configured under "deonticos" stands for its category */
+    const cJSON* category = cJSON_GetObjectItem(cJSON_GetObjectItem(config, "deonticos"), text);
+    if (cJSON_IsString(category)) {
+        text = category->valuestring;
+    }
+
+    for (size_t i = 0; i < sizeof(deontic_names) / sizeof(deontic_names[0]); i++) {
+        if (strcasecmp(deontic_names[i].name, text) == 0) {
+            *deontic = (uint32_t)deontic_names[i].deontic;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Get a string member of a default norm (NULL if missing or empty)
+ */
+static const char* template_field(const cJSON* norm, const char* key) {
+    const cJSON* item = cJSON_GetObjectItem(norm, key);
+    return cJSON_IsString(item) && item->valuestring[0] != '\0' ? item->valuestring : NULL;
+}
+
+/**
+ * Free the templates of a list built at runtime
+ */
+static void free_norm_list(ConfigNormList* list) {
+    for (uint32_t i = 0; i < list->count; i++) {
+        ConfigNormTemplate* norm = (ConfigNormTemplate*)&list->norms[i];
+        free((char*)norm->role);
+        free((char*)norm->action);
+        free((char*)norm->scope);
+        free((char*)norm->condition);
+    }
+    free((ConfigNormTemplate*)list->norms);
+    list->norms = NULL;
+    list->count = 0;
+}
+
+/**
+ * Build the default norms of one domain from a JSON array
+ *
+ * Entries without a role or an action (such as blank placeholders) are
+ * skipped, as are those with an unknown deontic operator. A "reference"
+ * is not read: a Norm has no field to hold a legal citation.
+ */
+static bool build_norm_list(ConfigNormList* list, const cJSON* config, const cJSON* section) {
+    memset(list, 0, sizeof(ConfigNormList));
+
+    int size = cJSON_IsArray(section) ? cJSON_GetArraySize(section) : 0;
+    if (size == 0) {
+        return true;
+    }
+
+    ConfigNormTemplate* norms = (ConfigNormTemplate*)calloc(size, sizeof(ConfigNormTemplate));
+    if (norms == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    list->norms = norms;
+
+    for (const cJSON* item = section->child; item != NULL; item = item->next) {
+        const char* role = template_field(item, "role");
+        const char* action = template_field(item, "action");
+        const char* deontic_text = template_field(item, "deontic");
+        if (role == NULL || action == NULL) continue;
+
+        uint32_t deontic;
+        if (deontic_text == NULL || !resolve_deontic(config, deontic_text, &deontic)) {
+            fprintf(stderr, "Warning: Default norm '%s' has an unknown deontic operator; skipped\n", action);
+            continue;
+        }
+
+        const char* scope = template_field(item, "scope");
+        const char* condition = cJSON_IsTrue(cJSON_GetObjectItem(item, "conditional")) ?
+                                template_field(item, "condition") : NULL;
+
+        ConfigNormTemplate* norm = &norms[list->count++];
+        norm->role = strdup(role);
+        norm->deontic = deontic;
+        norm->action = strdup(action);
+        norm->scope = scope != NULL ? strdup(scope) : NULL;
+        norm->condition = condition != NULL ? strdup(condition) : NULL;
+        if (norm->role == NULL || norm->action == NULL ||
+            (scope != NULL && norm->scope == NULL) || (condition != NULL && norm->condition == NULL)) {
+            fprintf(stderr, "Memory allocation error\n");
+            free_norm_list(list);
+            return false;
+        }
+
+        norm->hash = config_hash_norm(role, deontic);
+        norm->hash = config_hash_norm_field(norm->hash, action);
+        norm->hash = config_hash_norm_field(norm->hash, scope);
+        if (condition != NULL) {
+            norm->hash = config_hash_norm_field(norm->hash, condition);
+        }
+    }
+
+    return true;
+}
+
+/* Keywords used when the configuration has no "clasificacion" section */
+static const char builtin_classification[] =
+    "{"
+    "\"inmueble\": [\"inmueble\"],"
+    "\"mueble\": [\"propiedad\"],"
+    "\"omision\": [\"no \", \"abstenerse\", \"evitar\"],"
+    "\"objeto-inmueble\": [\"inmueble\", \"propiedad\", \"bien\"],"
+    "\"objeto-mueble\": [\"documento\", \"precio\", \"pago\"]"
+    "}";
+
+/* Missing transition while the automaton is built */
+#define CLASSIFIER_NONE 0xffff
+
+/**
+ * Free the arrays of a classifier built at runtime
+ */
+static void free_classifier(ConfigClassifier* classifier) {
+    free_name_set(&classifier->categories);
+    free((uint8_t*)classifier->byte_classes);
+    free((uint16_t*)classifier->transitions);
+    free((uint32_t*)classifier->outputs);
+    memset(classifier, 0, sizeof(ConfigClassifier));
+}
+
+/**
+ * Find the categories with a keyword in a text
+ */
+uint32_t config_classifier_match(const ConfigClassifier* classifier, const char* text) {
+    if (classifier->state_count == 0 || text == NULL) {
+        return 0;
+    }
+
+    const uint8_t* byte_classes = classifier->byte_classes;
+    const uint16_t* transitions = classifier->transitions;
+    const uint32_t* outputs = classifier->outputs;
+    uint32_t class_count = classifier->class_count;
+    uint32_t state = 0;
+    uint32_t mask = 0;
+
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        state = transitions[state * class_count + byte_classes[*p]];
+        mask |= outputs[state];
+    }
+    return mask;
+}
+
+/**
+ * Build the classifier from an object mapping categories to keyword arrays
+ *
+ * Keywords go into a trie whose missing transitions are then filled in
+ * breadth-first from the failure links, giving a DFA. Non-string and
+ * empty keywords are skipped, as are categories past
+ * CONFIG_MAX_CATEGORIES.
+ */
+static bool build_classifier(ConfigClassifier* classifier, const cJSON* section) {
+    memset(classifier, 0, sizeof(ConfigClassifier));
+    if (!build_name_set(&classifier->categories, section, true)) {
+        return false;
+    }
+    if (classifier->categories.count == 0) {
+        return true;
+    }
+
+    uint8_t* byte_classes = (uint8_t*)calloc(256, sizeof(uint8_t));
+    classifier->byte_classes = byte_classes;
+    if (byte_classes == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free_classifier(classifier);
+        return false;
+    }
+
+    /* Give each keyword byte a class; a trie has at most one state per keyword byte */
+    uint32_t class_count = 1;
+    size_t max_states = 1;
+    uint32_t category = 0;
+    for (const cJSON* item = section->child; item != NULL; item = item->next) {
+        if (item->string == NULL) continue;
+        if (category++ == CONFIG_MAX_CATEGORIES) {
+            fprintf(stderr, "Warning: More than %d keyword categories; category '%s' and later ones ignored\n",
+                    CONFIG_MAX_CATEGORIES, item->string);
+        }
+        if (category > CONFIG_MAX_CATEGORIES) continue;
+
+        for (const cJSON* keyword = cJSON_IsArray(item) ? item->child : NULL; keyword != NULL; keyword = keyword->next) {
+            if (!cJSON_IsString(keyword)) continue;
+            for (const unsigned char* p = (const unsigned char*)keyword->valuestring; *p; p++) {
+                if (byte_classes[*p] == 0) {
+                    byte_classes[*p] = (uint8_t)class_count++;
+                }
+                max_states++;
+            }
+        }
+    }
+
+    if (max_states >= CLASSIFIER_NONE) {
+        fprintf(stderr, "Error: Keyword categories are too large (%zu bytes of keywords)\n", max_states - 1);
+        free_classifier(classifier);
+        return false;
+    }
+
+    uint16_t* transitions = (uint16_t*)malloc(max_states * class_count * sizeof(uint16_t));
+    uint32_t* outputs = (uint32_t*)calloc(max_states, sizeof(uint32_t));
+    uint16_t* fail = (uint16_t*)malloc(max_states * sizeof(uint16_t));
+    uint16_t* queue = (uint16_t*)malloc(max_states * sizeof(uint16_t));
+    classifier->transitions = transitions;
+    classifier->outputs = outputs;
+    classifier->class_count = class_count;
+    if (transitions == NULL || outputs == NULL || fail == NULL || queue == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(fail);
+        free(queue);
+        free_classifier(classifier);
+        return false;
+    }
+    memset(transitions, 0xff, max_states * class_count * sizeof(uint16_t));
+
+    /* Trie of the keywords */
+    uint32_t state_count = 1;
+    category = 0;
+    for (const cJSON* item = section->child; item != NULL; item = item->next) {
+        if (item->string == NULL) continue;
+        if (category == CONFIG_MAX_CATEGORIES) break;
+        uint32_t bit = 1u << category++;
+
+        for (const cJSON* keyword = cJSON_IsArray(item) ? item->child : NULL; keyword != NULL; keyword = keyword->next) {
+            if (!cJSON_IsString(keyword) || keyword->valuestring[0] == '\0') continue;
+            uint32_t state = 0;
+            for (const unsigned char* p = (const unsigned char*)keyword->valuestring; *p; p++) {
+                uint16_t* next = &transitions[state * class_count + byte_classes[*p]];
+                if (*next == CLASSIFIER_NONE) {
+                    *next = (uint16_t)state_count++;
+                }
+                state = *next;
+            }
+            outputs[state] |= bit;
+        }
+    }
+
+    /* Failure links, breadth-first so a state's failure state is complete before it */
+    size_t head = 0;
+    size_t tail = 0;
+    for (uint32_t c = 0; c < class_count; c++) {
+        if (transitions[c] == CLASSIFIER_NONE) {
+            transitions[c] = 0;
+        } else {
+            fail[transitions[c]] = 0;
+            queue[tail++] = transitions[c];
+        }
+    }
+    while (head < tail) {
+        uint32_t state = queue[head++];
+        uint16_t* row = &transitions[state * class_count];
+        const uint16_t* fail_row = &transitions[fail[state] * class_count];
+        outputs[state] |= outputs[fail[state]];
+        for (uint32_t c = 0; c < class_count; c++) {
+            if (row[c] == CLASSIFIER_NONE) {
+                row[c] = fail_row[c];
+            } else {
+                fail[row[c]] = fail_row[c];
+                queue[tail++] = row[c];
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    classifier->state_count = state_count;
+    return true;
+}
+
+/**
+ * Build the tables from a parsed configuration
+ */
+static ConfigTables* build_tables(const cJSON* config) {
+    ConfigTables* tables = (ConfigTables*)calloc(1, sizeof(ConfigTables));
+    if (tables == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    const cJSON* roles = cJSON_GetObjectItem(config, "roles");
+    if (!build_name_set(&tables->institutions, cJSON_GetObjectItem(config, "instituciones"), false) ||
+        !build_name_set(&tables->types, cJSON_GetObjectItem(config, "tipos"), false) ||
+        !build_name_set(&tables->domains, cJSON_GetObjectItem(config, "dominios"), false) ||
+        !build_name_set(&tables->role_owners, cJSON_IsObject(roles) ? roles : NULL, true)) {
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    ConfigNameSet* role_sets = (ConfigNameSet*)calloc(tables->role_owners.count + 1, sizeof(ConfigNameSet));
+    tables->roles = role_sets;
+    if (role_sets == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    uint32_t index = 0;
+    for (const cJSON* item = cJSON_IsObject(roles) ? roles->child : NULL; item != NULL; item = item->next) {
+        if (item->string == NULL) continue;
+        if (!build_name_set(&role_sets[index++], cJSON_IsArray(item) ? item : NULL, false)) {
+            config_tables_free(tables);
+            return NULL;
+        }
+    }
+
+    if (!build_role_lexicon(&tables->role_lexicon, tables)) {
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    /* Default norms, keyed by legal domain like roles are by institution */
+    const cJSON* defaults = cJSON_GetObjectItem(config, "default-norms");
+    if (!build_name_set(&tables->norm_domains, cJSON_IsObject(defaults) ? defaults : NULL, true)) {
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    ConfigNormList* norm_lists = (ConfigNormList*)calloc(tables->norm_domains.count + 1, sizeof(ConfigNormList));
+    tables->default_norms = norm_lists;
+    if (norm_lists == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    index = 0;
+    for (const cJSON* item = cJSON_IsObject(defaults) ? defaults->child : NULL; item != NULL; item = item->next) {
+        if (item->string == NULL) continue;
+        if (!build_norm_list(&norm_lists[index++], config, item)) {
+            config_tables_free(tables);
+            return NULL;
+        }
+    }
+
+    /* Keyword classifier; configurations without one get the built-in keywords */
+    const cJSON* classification = cJSON_GetObjectItem(config, "clasificacion");
+    cJSON* builtin = NULL;
+    if (!cJSON_IsObject(classification)) {
+        builtin = cJSON_Parse(builtin_classification);
+        classification = builtin;
+    }
+    bool classifier_ok = build_classifier(&tables->classifier, classification);
+    cJSON_Delete(builtin);
+    if (!classifier_ok) {
+        config_tables_free(tables);
+        return NULL;
+    }
+
+    return tables;
+}
+
+/**
+ * Parse JSON configuration text into lookup tables
+ */
+ConfigTables* config_tables_parse(const char* json, size_t length) {
+    /* cJSON needs a terminated string */
+    char* buffer = (char*)malloc(length + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    memcpy(buffer, json, length);
+    buffer[length] = '\0';
+
+    cJSON* config = cJSON_Parse(buffer);
+    free(buffer);
+
+    if (config == NULL) {
+        fprintf(stderr, "Error parsing configuration file\n");
+        return NULL;
+    }
+
+    ConfigTables* tables = build_tables(config);
+    cJSON_Delete(config);
+    return tables;
+}
+
+/**
+ * Load a JSON configuration file into lookup tables
+ */
+ConfigTables* config_tables_load(const char* config_file) {
+    FILE* file = fopen(config_file, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening configuration file: %s\n", config_file);
+        return NULL;
+    }
+
+    /* Get file size */
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    /* Read file content */
+    char* buffer = (char*)malloc(file_size + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read_size = fread(buffer, 1, file_size, file);
+    fclose(file);
+
+    if (read_size != (size_t)file_size) {
+        fprintf(stderr, "Error reading configuration file\n");
+        free(buffer);
+        return NULL;
+    }
+
+    ConfigTables* tables = config_tables_parse(buffer, read_size);
+    free(buffer);
+    return tables;
+}
+
+/**
+ * Free tables returned by config_tables_load()
+ */
+void config_tables_free(ConfigTables* tables) {
+    if (tables == NULL) {
+        return;
+    }
+
+    if (tables->roles != NULL) {
+        for (uint32_t i = 0; i < tables->role_owners.count; i++) {
+            free_name_set((ConfigNameSet*)&tables->roles[i]);
+        }
+        free((ConfigNameSet*)tables->roles);
+    }
+    if (tables->default_norms != NULL) {
+        for (uint32_t i = 0; i < tables->norm_domains.count; i++) {
+            free_norm_list((ConfigNormList*)&tables->default_norms[i]);
+        }
+        free((ConfigNormList*)tables->default_norms);
+    }
+    free_classifier(&tables->classifier);
+    free_name_set(&tables->role_lexicon);
+    free_name_set(&tables->norm_domains);
+    free_name_set(&tables->institutions);
+    free_name_set(&tables->types);
+    free_name_set(&tables->domains);
+    free_name_set(&tables->role_owners);
+    free(tables);
+}
+
+/**
+ * Write a string as a C literal (non-ASCII bytes as octal escapes)
+ */
+static void write_literal(FILE* output, const char* text) {
+    fputc('"', output);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(output, "\\%c", *p);
+        } else if (*p < 0x20 || *p >= 0x7F) {
+            fprintf(output, "\\%03o", *p);
+        } else {
+            fputc(*p, output);
+        }
+    }
+    fputc('"', output);
+}
+
+/**
+ * Write the arrays of one set
+ */
+static void write_set_arrays(FILE* output, const ConfigNameSet* set, const char* prefix) {
+    if (set->count == 0) {
+        return;
+    }
+
+    fprintf(output, "static const ConfigName %s_names[] = {\n", prefix);
+    for (uint32_t i = 0; i < set->count; i++) {
+        fprintf(output, "    { ");
+        write_literal(output, set->names[i].name);
+        fprintf(output, ", 0x%08xu },\n", set->names[i].hash);
+    }
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "static const uint32_t %s_buckets[] = {", prefix);
+    for (uint32_t i = 0; i < set->bucket_count; i++) {
+        fprintf(output, "%s%u", i == 0 ? "\n    " : (i % 16 == 0 ? ",\n    " : ", "), set->buckets[i]);
+    }
+    fprintf(output, "\n};\n\n");
+}
+
+/**
+ * Write the initializer of one set
+ */
+static void write_set(FILE* output, const ConfigNameSet* set, const char* prefix) {
+    if (set->count == 0) {
+        fprintf(output, "{ NULL, 0, NULL, 0 }");
+    } else {
+        fprintf(output, "{ %s_names, %u, %s_buckets, %u }", prefix, set->count, prefix, set->bucket_count);
+    }
+}
+
+/**
+ * Write a string as a C literal, or NULL
+ */
+static void write_optional_literal(FILE* output, const char* text) {
+    if (text == NULL) {
+        fprintf(output, "NULL");
+    } else {
+        write_literal(output, text);
+    }
+}
+
+/**
+ * Write the template array of one default norm list
+ */
+static void write_norm_array(FILE* output, const ConfigNormList* list, const char* prefix) {
+    if (list->count == 0) {
+        return;
+    }
+
+    fprintf(output, "static const ConfigNormTemplate %s[] = {\n", prefix);
+    for (uint32_t i = 0; i < list->count; i++) {
+        const ConfigNormTemplate* norm = &list->norms[i];
+        fprintf(output, "    { ");
+        write_literal(output, norm->role);
+        fprintf(output, ", %u, ", norm->deontic);
+        write_literal(output, norm->action);
+        fprintf(output, ", ");
+        write_optional_literal(output, norm->scope);
+        fprintf(output, ", ");
+        write_optional_literal(output, norm->condition);
+        fprintf(output, ", 0x%016llxull },\n", (unsigned long long)norm->hash);
+    }
+    fprintf(output, "};\n\n");
+}
+
+/**
+ * Write an array of integers, 16 to a line
+ */
+static void write_integers(FILE* output, const char* type, const char* name, const void* values,
+                           size_t size, size_t count) {
+    fprintf(output, "static const %s %s[] = {", type, name);
+    for (size_t i = 0; i < count; i++) {
+        unsigned long value = size == 1 ? ((const uint8_t*)values)[i] :
+                              size == 2 ? ((const uint16_t*)values)[i] : ((const uint32_t*)values)[i];
+        fprintf(output, "%s%lu", i == 0 ? "\n    " : (i % 16 == 0 ? ",\n    " : ", "), value);
+    }
+    fprintf(output, "\n};\n\n");
+}
+
+/**
+ * Write the arrays of the classifier
+ */
+static void write_classifier_arrays(FILE* output, const ConfigClassifier* classifier) {
+    write_set_arrays(output, &classifier->categories, "categories");
+    if (classifier->state_count == 0) {
+        return;
+    }
+
+    write_integers(output, "uint8_t", "classifier_byte_classes", classifier->byte_classes, 1, 256);
+    write_integers(output, "uint16_t", "classifier_transitions", classifier->transitions, 2,
+                   (size_t)classifier->state_count * classifier->class_count);
+    write_integers(output, "uint32_t", "classifier_outputs", classifier->outputs, 4, classifier->state_count);
+}
+
+/**
+ * Write the initializer of the classifier
+ */
+static void write_classifier(FILE* output, const ConfigClassifier* classifier) {
+    fprintf(output, "{ ");
+    write_set(output, &classifier->categories, "categories");
+    if (classifier->state_count == 0) {
+        fprintf(output, ", NULL, 0, NULL, NULL, 0 }");
+    } else {
+        fprintf(output, ", classifier_byte_classes, %u, classifier_transitions, classifier_outputs, %u }",
+                classifier->class_count, classifier->state_count);
+    }
+}
+
+/**
+ * Write tables as a C source file defining config_default_tables
+ */
+bool config_tables_write_source(const ConfigTables* tables, FILE* output, const char* origin) {
+    fprintf(output, "/**\n * config_default.c\n *\n * Generated by embed_config from %s -- do not edit\n */\n\n",
+            origin);
+    fprintf(output, "#include \"config_tables.h\"\n#include <stddef.h>\n\n");
+
+    write_set_arrays(output, &tables->institutions, "institutions");
+    write_set_arrays(output, &tables->types, "types");
+    write_set_arrays(output, &tables->domains, "domains");
+    write_set_arrays(output, &tables->role_owners, "role_owners");
+    write_set_arrays(output, &tables->role_lexicon, "role_lexicon");
+    write_set_arrays(output, &tables->norm_domains, "norm_domains");
+    write_classifier_arrays(output, &tables->classifier);
+
+    char prefix[32];
+    for (uint32_t i = 0; i < tables->role_owners.count; i++) {
+        snprintf(prefix, sizeof(prefix), "roles_%u", i);
+        write_set_arrays(output, &tables->roles[i], prefix);
+    }
+
+    if (tables->role_owners.count > 0) {
+        fprintf(output, "static const ConfigNameSet role_sets[] = {\n");
+        for (uint32_t i = 0; i < tables->role_owners.count; i++) {
+            snprintf(prefix, sizeof(prefix), "roles_%u", i);
+            fprintf(output, "    ");
+            write_set(output, &tables->roles[i], prefix);
+            fprintf(output, ",\n");
+        }
+        fprintf(output, "};\n\n");
+    }
+
+    for (uint32_t i = 0; i < tables->norm_domains.count; i++) {
+        snprintf(prefix, sizeof(prefix), "default_norms_%u", i);
+        write_norm_array(output, &tables->default_norms[i], prefix);
+    }
+
+    if (tables->norm_domains.count > 0) {
+        fprintf(output, "static const ConfigNormList norm_lists[] = {\n");
+        for (uint32_t i = 0; i < tables->norm_domains.count; i++) {
+            if (tables->default_norms[i].count == 0) {
+                fprintf(output, "    { NULL, 0 },\n");
+            } else {
+                fprintf(output, "    { default_norms_%u, %u },\n", i, tables->default_norms[i].count);
+            }
+        }
+        fprintf(output, "};\n\n");
+    }
+
+    fprintf(output, "const ConfigTables config_default_tables = {\n    ");
+    write_set(output, &tables->institutions, "institutions");
+    fprintf(output, ",\n    ");
+    write_set(output, &tables->types, "types");
+    fprintf(output, ",\n    ");
+    write_set(output, &tables->domains, "domains");
+    fprintf(output, ",\n    ");
+    write_set(output, &tables->role_owners, "role_owners");
+    fprintf(output, ",\n    %s,\n    ", tables->role_owners.count > 0 ? "role_sets" : "NULL");
+    write_set(output, &tables->role_lexicon, "role_lexicon");
+    fprintf(output, ",\n    ");
+    write_set(output, &tables->norm_domains, "norm_domains");
+    fprintf(output, ",\n    %s,\n    ", tables->norm_domains.count > 0 ? "norm_lists" : "NULL");
+    write_classifier(output, &tables->classifier);
+    fprintf(output, "\n};\n");
+
+    return !ferror(output);
+}
@@ -0,0 +1,188 @@
+/**
+ * config_tables.h
+ *
+ * Hashed lookup tables for the schema configuration (institutions,
+ * types, domains, per-institution roles, the role lexicon of the
+ * tokenizer, per-domain default norm
+ * templates and the keyword classifier), built from the JSON
+ * configuration file at startup or compiled into the binary as constant
+ * data by the embed_config build step
+ */
+
+#ifndef CONFIG_TABLES_H
+#define CONFIG_TABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * One configured name with its precomputed hash
+ */
+typedef struct {
+    const char* name;
+    uint32_t hash;                  // config_hash_name(name)
+} ConfigName;
+
+/**
+ * A set of names with case-insensitive lookup
+ *
+ * Names keep the order of the configuration file. The bucket array is an
+ * open-addressing hash table (linear probing, power-of-two size) holding
+ * name index + 1, with 0 marking an empty bucket.
+ */
+typedef struct {
+    const ConfigName* names;
+    uint32_t count;
+    const uint32_t* buckets;
+    uint32_t bucket_count;
+} ConfigNameSet;
+
+/**
+ * A default norm, ready to be copied into schemas of its domain
+ */
+typedef struct {
+    const char* role;
+    uint32_t deontic;               // DeonticOperator
+    const char* action;
+    const char* scope;              // NULL if none
+    const char* condition;          // NULL unless the norm is conditional
+    uint64_t hash;                  // Content hash (see config_hash_norm())
+} ConfigNormTemplate;
+
+/**
+ * The default norms of one legal domain, in configuration order
+ */
+typedef struct {
+    const ConfigNormTemplate* norms;
+    uint32_t count;
+} ConfigNormList;
+
+/* Most keyword categories a classifier can have (one bit of a mask each) */
+#define CONFIG_MAX_CATEGORIES 32
+
+/**
+ * Keyword classifier: an Aho-Corasick automaton over the keywords of
+ * every category, flattened into a DFA over byte classes
+ *
+ * Each byte that occurs in some keyword has a class of its own; all
+ * other bytes share class 0. From state s, byte b leads to
+ * transitions[s * class_count + byte_classes[b]], so a text is
+ * classified in one pass whatever the number of keywords and
+ * categories. outputs[s] is the mask of the categories with a keyword
+ * ending at s (bit i is category i).
+ */
+typedef struct {
+    ConfigNameSet categories;       // Keys of "clasificacion"
+    const uint8_t* byte_classes;    // 256 entries
+    uint32_t class_count;
+    const uint16_t* transitions;    // state_count * class_count entries; state 0 is the root
+    const uint32_t* outputs;        // state_count entries
+    uint32_t state_count;
+} ConfigClassifier;
+
+/**
+ * Lookup tables for one configuration
+ */
+typedef struct config_tables {
+    ConfigNameSet institutions;     // "instituciones"
+    ConfigNameSet types;            // "tipos"
+    ConfigNameSet domains;          // "dominios"
+    ConfigNameSet role_owners;      // Institutions listed under "roles"
+    const ConfigNameSet* roles;     // Role set of each role owner, by index
+    ConfigNameSet role_lexicon;     // Words the tokenizer reads as roles: every configured role and the built-in ones
+    ConfigNameSet norm_domains;     // Domains listed under "default-norms"
+    const ConfigNormList* default_norms;    // Default norms of each norm domain, by index
+    ConfigClassifier classifier;    // "clasificacion", or the built-in keywords if absent
+} ConfigTables;
+
+/**
+ * The default configuration compiled into the binary (config_default.c)
+ */
+extern const ConfigTables config_default_tables;
+
+/**
+ * Hash a name case-insensitively (FNV-1a over ASCII-lowercased bytes)
+ *
+ * @param name The name
+ * @return The hash
+ */
+uint32_t config_hash_name(const char* name);
+
+/**
+ * Start the content hash of a norm
+ *
+ * Norms with the same role, deontic operator, action, scope and
+ * conditions hash the same; feed them in that order.
+ *
+ * @param role Role
+ * @param deontic Deontic operator (a DeonticOperator)
+ * @return The hash so far
+ */
+uint64_t config_hash_norm(const char* role, uint32_t deontic);
+
+/**
+ * Add a text field (action, scope or one condition) to a norm content hash
+ *
+ * @param hash The hash so far
+ * @param text Field text, or NULL if absent
+ * @return The updated hash
+ */
+uint64_t config_hash_norm_field(uint64_t hash, const char* text);
+
+/**
+ * Find a name in a set (ASCII case-insensitive)
+ *
+ * @param set The set
+ * @param name Name to look up
+ * @return Index of the name in set->names, or -1 if absent
+ */
+int config_name_set_find(const ConfigNameSet* set, const char* name);
+
+/**
+ * Find the categories with a keyword in a text
+ *
+ * Matching is byte for byte (case-sensitive), like strstr().
+ *
+ * @param classifier The classifier
+ * @param text Text to classify
+ * @return Mask of the matching categories (bit i is classifier->categories.names[i])
+ */
+uint32_t config_classifier_match(const ConfigClassifier* classifier, const char* text);
+
+/**
+ * Load a JSON configuration file into lookup tables
+ *
+ * @param config_file Path to the JSON configuration file
+ * @return The tables (free with config_tables_free()), or NULL on error
+ */
+ConfigTables* config_tables_load(const char* config_file);
+
+/**
+ * Parse JSON configuration text into lookup tables
+ *
+ * @param json Configuration text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @return The tables (free with config_tables_free()), or NULL on error
+ */
+ConfigTables* config_tables_parse(const char* json, size_t length);
+
+/**
+ * Free tables returned by config_tables_load() or config_tables_parse()
+ *
+ * @param tables Tables to free
+ */
+void config_tables_free(ConfigTables* tables);
+
+/**
+ * Write tables as a C source file defining config_default_tables
+ *
+ * @param tables The tables
+ * @param output File to write to
+ * @param origin Name of the configuration file, for the header comment
+ * @return true on success, false on a write error
+ */
+bool config_tables_write_source(const ConfigTables* tables, FILE* output, const char* origin);
+
+#endif /* CONFIG_TABLES_H */
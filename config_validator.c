@@ -9,11 +9,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <cJSON.h> /* Third-party JSON parsing library */
+#include "config_tables.h"
+#include "shared_snapshot.h"
 
-/* Configuration data */
-static cJSON* config = NULL;
-static const char* current_institution = NULL;
+/* The published configuration snapshot (ConfigTables) */
+static SnapshotSlot config_slot = SNAPSHOT_SLOT_INIT;
+
+/* Snapshot pinned by the calling thread, if any */
+static __thread SharedSnapshot* pinned_config = NULL;
+
+/* Institution of the schema the calling thread is parsing (owned copy) */
+static __thread char* current_institution = NULL;
+
+/**
+ * Free a configuration snapshot loaded from a file
+ */
+static void free_config_snapshot(void* data) {
+    config_tables_free((ConfigTables*)data);
+}
+
+/**
+ * Get the configuration used by the calling thread: its pinned one, or else the published one
+ */
+static const ConfigTables* active_config(void) {
+    SharedSnapshot* shared = pinned_config != NULL ? pinned_config : shared_snapshot_peek(&config_slot);
+    return shared != NULL ? (const ConfigTables*)shared->data : NULL;
+}
 
 /* Helper function to calculate string similarity (Levenshtein distance) */
 static int levenshtein_distance(const char* s1, const char* s2) {
@@ -60,48 +81,68 @@ static int levenshtein_distance(const char* s1, const char* s2) {
 }
 
 /**
- * Initialize the configuration validator
+ * Wrap tables loaded at runtime in a snapshot
  */
-bool config_init(const char* config_file) {
-    FILE* file = fopen(config_file, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening configuration file: %s\n", config_file);
-        return false;
+static SharedSnapshot* wrap_tables(ConfigTables* tables) {
+    if (tables == NULL) {
+        return NULL;
     }
     
-    /* Get file size */
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    /* Read file content */
-    char* buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        fclose(file);
-        return false;
+    SharedSnapshot* snapshot = shared_snapshot_create(tables, free_config_snapshot);
+    if (snapshot == NULL) {
+        config_tables_free(tables);
     }
-    
-    size_t read_size = fread(buffer, 1, file_size, file);
-    fclose(file);
-    
-    if (read_size != file_size) {
-        fprintf(stderr, "Error reading configuration file\n");
-        free(buffer);
+    return snapshot;
+}
+
+/**
+ * Load a configuration file into an unpublished snapshot
+ */
+SharedSnapshot* config_snapshot_load(const char* config_file) {
+    return wrap_tables(config_tables_load(config_file));
+}
+
+/**
+ * Parse configuration text into an unpublished snapshot
+ */
+SharedSnapshot* config_snapshot_parse(const char* json, size_t length) {
+    return wrap_tables(config_tables_parse(json, length));
+}
+
+/**
+ * Get a snapshot of the built-in configuration
+ */
+SharedSnapshot* config_snapshot_builtin(void) {
+    /* The tables are constant data; nothing to free */
+    return shared_snapshot_create((void*)&config_default_tables, NULL);
+}
+
+/**
+ * Initialize the configuration validator
+ * 
+ * The configuration is loaded before it is published, so this also
+ * reloads it while other threads keep working on the previous one.
+ */
+bool config_init(const char* config_file) {
+    SharedSnapshot* snapshot = config_snapshot_load(config_file);
+    if (snapshot == NULL) {
         return false;
     }
     
-    buffer[file_size] = '\0';
-    
-    /* Parse JSON */
-    config = cJSON_Parse(buffer);
-    free(buffer);
-    
-    if (config == NULL) {
-        fprintf(stderr, "Error parsing configuration file\n");
+    shared_snapshot_publish(&config_slot, snapshot);
+    return true;
+}
+
+/**
+ * Initialize the configuration validator with the built-in configuration
+ */
+bool config_init_default(void) {
+    SharedSnapshot* snapshot = config_snapshot_builtin();
+    if (snapshot == NULL) {
         return false;
     }
     
+    shared_snapshot_publish(&config_slot, snapshot);
     return true;
 }
 
@@ -109,18 +150,58 @@ bool config_init(const char* config_file) {
  * Clean up resources used by the configuration validator
  */
 void config_cleanup(void) {
-    if (config != NULL) {
-        cJSON_Delete(config);
-        config = NULL;
-    }
+    shared_snapshot_publish(&config_slot, NULL);
+    free(current_institution);
     current_institution = NULL;
 }
 
+/**
+ * Pin the published configuration to the calling thread
+ */
+void config_pin(void) {
+    if (pinned_config == NULL) {
+        pinned_config = shared_snapshot_acquire(&config_slot);
+    }
+}
+
+/**
+ * Release the calling thread's pinned configuration
+ */
+void config_unpin(void) {
+    shared_snapshot_release(pinned_config);
+    pinned_config = NULL;
+}
+
+/**
+ * Get a reference to the configuration the calling thread uses
+ */
+SharedSnapshot* config_acquire(void) {
+    return pinned_config != NULL ? shared_snapshot_retain(pinned_config) : shared_snapshot_acquire(&config_slot);
+}
+
+/**
+ * Make the calling thread use a given configuration snapshot
+ */
+SharedSnapshot* config_use(SharedSnapshot* snapshot) {
+    SharedSnapshot* previous = pinned_config;
+    pinned_config = snapshot;
+    return previous;
+}
+
+/**
+ * Identify the configuration the calling thread uses
+ */
+uint64_t config_snapshot_id(void) {
+    SharedSnapshot* shared = pinned_config != NULL ? pinned_config : shared_snapshot_peek(&config_slot);
+    return shared != NULL ? shared->id : 0;
+}
+
 /**
  * Set current institution context
  */
 void config_set_current_institution(const char* institution) {
-    current_institution = institution;
+    free(current_institution);
+    current_institution = institution != NULL ? strdup(institution) : NULL;
 }
 
 /**
@@ -134,72 +215,36 @@ const char* config_get_current_institution(void) {
  * Validate an institution name
  */
 bool config_is_valid_institution(const char* institution) {
+    const ConfigTables* config = active_config();
     if (config == NULL || institution == NULL) {
         return false;
     }
     
-    cJSON* instituciones = cJSON_GetObjectItem(config, "instituciones");
-    if (instituciones == NULL) {
-        return false;
-    }
-    
-    int size = cJSON_GetArraySize(instituciones);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(instituciones, i);
-        if (cJSON_IsString(item) && strcasecmp(item->valuestring, institution) == 0) {
-            return true;
-        }
-    }
-    
-    return false;
+    return config_name_set_find(&config->institutions, institution) >= 0;
 }
 
 /**
  * Validate an institution type
  */
 bool config_is_valid_type(const char* type) {
+    const ConfigTables* config = active_config();
     if (config == NULL || type == NULL) {
         return false;
     }
     
-    cJSON* tipos = cJSON_GetObjectItem(config, "tipos");
-    if (tipos == NULL) {
-        return false;
-    }
-    
-    int size = cJSON_GetArraySize(tipos);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(tipos, i);
-        if (cJSON_IsString(item) && strcasecmp(item->valuestring, type) == 0) {
-            return true;
-        }
-    }
-    
-    return false;
+    return config_name_set_find(&config->types, type) >= 0;
 }
 
 /**
  * Validate a legal domain
  */
 bool config_is_valid_domain(const char* domain) {
+    const ConfigTables* config = active_config();
     if (config == NULL || domain == NULL) {
         return false;
     }
     
-    cJSON* dominios = cJSON_GetObjectItem(config, "dominios");
-    if (dominios == NULL) {
-        return false;
-    }
-    
-    int size = cJSON_GetArraySize(dominios);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(dominios, i);
-        if (cJSON_IsString(item) && strcasecmp(item->valuestring, domain) == 0) {
-            return true;
-        }
-    }
-    
-    return false;
+    return config_name_set_find(&config->domains, domain) >= 0;
 }
 
 /**
@@ -213,33 +258,29 @@ bool config_is_valid_role(const char* role) {
     return config_is_valid_role_for_institution(current_institution, role);
 }
 
+/**
+ * Check if the tokenizer should read a word as a role
+ */
+bool config_is_role_word(const char* word) {
+    const ConfigTables* config = active_config();
+    return config != NULL && config_name_set_find(&config->role_lexicon, word) >= 0;
+}
+
 /**
  * Validate a role for a specific institution
  */
 bool config_is_valid_role_for_institution(const char* institution, const char* role) {
+    const ConfigTables* config = active_config();
     if (config == NULL || institution == NULL || role == NULL) {
         return false;
     }
     
-    cJSON* roles = cJSON_GetObjectItem(config, "roles");
-    if (roles == NULL) {
+    int owner = config_name_set_find(&config->role_owners, institution);
+    if (owner < 0) {
         return false;
     }
     
-    cJSON* inst_roles = cJSON_GetObjectItem(roles, institution);
-    if (inst_roles == NULL) {
-        return false;
-    }
-    
-    int size = cJSON_GetArraySize(inst_roles);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(inst_roles, i);
-        if (cJSON_IsString(item) && strcasecmp(item->valuestring, role) == 0) {
-            return true;
-        }
-    }
-    
-    return false;
+    return config_name_set_find(&config->roles[owner], role) >= 0;
 }
 
 /**
@@ -325,30 +366,162 @@ ComplianceType config_get_compliance_type(const char* text) {
 }
 
 /**
- * Suggest a correction for a possibly misspelled institution
+ * Compute the content hash of a norm (see config_hash_norm())
  */
-const char* config_suggest_institution(const char* institution) {
-    if (config == NULL || institution == NULL) {
-        return NULL;
+static uint64_t hash_norm(const Norm* norm) {
+    uint64_t hash = config_hash_norm(norm->role, (uint32_t)norm->deontic);
+    hash = config_hash_norm_field(hash, norm->action);
+    hash = config_hash_norm_field(hash, norm->scope != NULL ? norm->scope->description : NULL);
+    for (const Condition* condition = norm->condition; condition != NULL; condition = condition->next) {
+        hash = config_hash_norm_field(hash, condition->description);
+    }
+    return hash;
+}
+
+/**
+ * Check whether a norm has the same content as a template
+ */
+static bool norm_matches_template(const Norm* norm, const ConfigNormTemplate* template) {
+    const char* scope = norm->scope != NULL ? norm->scope->description : NULL;
+    const Condition* condition = norm->condition;
+    
+    if ((uint32_t)norm->deontic != template->deontic ||
+        strcmp(norm->role, template->role) != 0 || strcmp(norm->action, template->action) != 0 ||
+        (scope == NULL) != (template->scope == NULL) || (scope != NULL && strcmp(scope, template->scope) != 0)) {
+        return false;
+    }
+    if (template->condition == NULL) {
+        return condition == NULL;
+    }
+    return condition != NULL && condition->next == NULL && strcmp(condition->description, template->condition) == 0;
+}
+
+/**
+ * Compare two optional strings
+ */
+static bool same_text(const char* a, const char* b) {
+    return a == NULL ? b == NULL : b != NULL && strcmp(a, b) == 0;
+}
+
+/**
+ * Check whether two templates have the same content
+ */
+static bool templates_match(const ConfigNormTemplate* a, const ConfigNormTemplate* b) {
+    return a->hash == b->hash && a->deontic == b->deontic &&
+           strcmp(a->role, b->role) == 0 && strcmp(a->action, b->action) == 0 &&
+           same_text(a->scope, b->scope) && same_text(a->condition, b->condition);
+}
+
+/**
+ * Classify a text by the configured keywords
+ */
+uint32_t config_classify(const char* text) {
+    const ConfigTables* config = active_config();
+    return config != NULL ? config_classifier_match(&config->classifier, text) : 0;
+}
+
+/**
+ * Get the bit of a keyword category in config_classify() masks
+ */
+uint32_t config_get_category(const char* category) {
+    const ConfigTables* config = active_config();
+    if (config == NULL) {
+        return 0;
     }
     
-    cJSON* instituciones = cJSON_GetObjectItem(config, "instituciones");
-    if (instituciones == NULL) {
-        return NULL;
+    int index = config_name_set_find(&config->classifier.categories, category);
+    return index >= 0 && index < CONFIG_MAX_CATEGORIES ? 1u << index : 0;
+}
+
+/**
+ * Add the configured default norms of a schema's legal domain
+ */
+int config_add_default_norms(Schema* schema) {
+    const ConfigTables* config = active_config();
+    if (config == NULL || schema == NULL || schema->institution.legal_domain == NULL) {
+        return 0;
+    }
+    
+    int domain = config_name_set_find(&config->norm_domains, schema->institution.legal_domain);
+    if (domain < 0 || config->default_norms[domain].count == 0) {
+        return 0;
+    }
+    
+    const ConfigNormList* templates = &config->default_norms[domain];
+    bool* present = (bool*)calloc(templates->count, sizeof(bool));
+    if (present == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 0;
     }
     
+    /* One pass over the schema: mark templates it already has, find the last norm */
+    Norm* last = NULL;
+    int number = 0;
+    for (Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        uint64_t hash = hash_norm(norm);
+        for (uint32_t i = 0; i < templates->count; i++) {
+            if (templates->norms[i].hash == hash && norm_matches_template(norm, &templates->norms[i])) {
+                present[i] = true;
+            }
+        }
+        if (norm->number > number) {
+            number = norm->number;
+        }
+        last = norm;
+    }
+    
+    int added = 0;
+    for (uint32_t i = 0; i < templates->count; i++) {
+        const ConfigNormTemplate* template = &templates->norms[i];
+        if (present[i]) {
+            continue;
+        }
+        
+        /* Norm constructors copy their strings */
+        Norm* norm = create_norm(++number, (char*)template->role, (DeonticOperator)template->deontic,
+                                 (char*)template->action);
+        if (norm == NULL) {
+            break;
+        }
+        if (template->scope != NULL) {
+            add_scope_to_norm(norm, (char*)template->scope);
+        }
+        if (template->condition != NULL) {
+            add_condition_to_norm(norm, (char*)template->condition);
+        }
+        
+        if (last == NULL) {
+            schema->norms = norm;
+        } else {
+            last->next = norm;
+        }
+        last = norm;
+        added++;
+        
+        /* A template repeated in the configuration is added once */
+        for (uint32_t j = i + 1; j < templates->count; j++) {
+            if (templates_match(&templates->norms[j], template)) {
+                present[j] = true;
+            }
+        }
+    }
+    
+    free(present);
+    return added;
+}
+
+/**
+ * Find the name of a set closest to a possibly misspelled one (at most 3 edits away)
+ */
+static const char* closest_name(const ConfigNameSet* set, const char* name) {
     int min_distance = 1000;
     const char* suggestion = NULL;
     
-    int size = cJSON_GetArraySize(instituciones);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(instituciones, i);
-        if (cJSON_IsString(item)) {
-            int distance = levenshtein_distance(institution, item->valuestring);
-            if (distance < min_distance && distance <= 3) { /* Max 3 edits */
-                min_distance = distance;
-                suggestion = item->valuestring;
-            }
+    for (uint32_t i = 0; i < set->count; i++) {
+        int distance = levenshtein_distance(name, set->names[i].name);
+        if (distance < min_distance && distance <= 3) { /* Max 3 edits */
+            min_distance = distance;
+            suggestion = set->names[i].name;
         }
     }
     
@@ -356,37 +529,42 @@ const char* config_suggest_institution(const char* institution) {
 }
 
 /**
- * Suggest a correction for a possibly misspelled role
+ * Suggest a correction for a possibly misspelled institution
  */
-const char* config_suggest_role(const char* role) {
-    if (config == NULL || current_institution == NULL || role == NULL) {
+const char* config_suggest_institution(const char* institution) {
+    const ConfigTables* config = active_config();
+    if (config == NULL || institution == NULL) {
         return NULL;
     }
     
-    cJSON* roles = cJSON_GetObjectItem(config, "roles");
-    if (roles == NULL) {
+    return closest_name(&config->institutions, institution);
+}
+
+/**
+ * Suggest a correction for a possibly misspelled legal domain
+ */
+const char* config_suggest_domain(const char* domain) {
+    const ConfigTables* config = active_config();
+    if (config == NULL || domain == NULL) {
         return NULL;
     }
     
-    cJSON* inst_roles = cJSON_GetObjectItem(roles, current_institution);
-    if (inst_roles == NULL) {
+    return closest_name(&config->domains, domain);
+}
+
+/**
+ * Suggest a correction for a possibly misspelled role
+ */
+const char* config_suggest_role(const char* role) {
+    const ConfigTables* config = active_config();
+    if (config == NULL || current_institution == NULL || role == NULL) {
         return NULL;
     }
     
-    int min_distance = 1000;
-    const char* suggestion = NULL;
-    
-    int size = cJSON_GetArraySize(inst_roles);
-    for (int i = 0; i < size; i++) {
-        cJSON* item = cJSON_GetArrayItem(inst_roles, i);
-        if (cJSON_IsString(item)) {
-            int distance = levenshtein_distance(role, item->valuestring);
-            if (distance < min_distance && distance <= 3) { /* Max 3 edits */
-                min_distance = distance;
-                suggestion = item->valuestring;
-            }
-        }
+    int owner = config_name_set_find(&config->role_owners, current_institution);
+    if (owner < 0) {
+        return NULL;
     }
     
-    return suggestion;
+    return closest_name(&config->roles[owner], role);
 }
@@ -8,30 +8,119 @@
 #define CONFIG_VALIDATOR_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "schema_types.h"
+#include "shared_snapshot.h"
 
 /**
  * Initialize the configuration validator
  * 
+ * Calling it again reloads the configuration: the new snapshot is
+ * published atomically and threads that pinned the previous one keep
+ * using it until they unpin. On failure the current configuration stays
+ * in place.
+ * 
  * @param config_file Path to the JSON configuration file
  * @return true if initialization succeeded, false otherwise
  */
 bool config_init(const char* config_file);
 
+/**
+ * Initialize the configuration validator with the built-in configuration
+ * 
+ * The tables were compiled into the binary from the configuration chosen
+ * at build time, so this does no file I/O or parsing. Like config_init(),
+ * it replaces any configuration already published.
+ * 
+ * @return true if initialization succeeded, false otherwise
+ */
+bool config_init_default(void);
+
 /**
  * Clean up resources used by the configuration validator
  */
 void config_cleanup(void);
 
 /**
- * Set the current institution context
+ * Pin the published configuration to the calling thread
+ * 
+ * Until config_unpin(), every lookup made by the thread sees this
+ * snapshot, even if a reload publishes a newer one. Pins do not nest.
+ */
+void config_pin(void);
+
+/**
+ * Release the calling thread's pinned configuration
+ */
+void config_unpin(void);
+
+/**
+ * Load a configuration file into a snapshot without publishing it
+ * 
+ * @param config_file Path to the JSON configuration file
+ * @return The snapshot (one reference, owned by the caller), or NULL on error
+ */
+SharedSnapshot* config_snapshot_load(const char* config_file);
+
+/**
+ * Parse configuration text into a snapshot without publishing it
+ * 
+ * @param json JSON configuration text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @return The snapshot (one reference, owned by the caller), or NULL on error
+ */
+SharedSnapshot* config_snapshot_parse(const char* json, size_t length);
+
+/**
+ * Get a snapshot of the built-in configuration
+ * 
+ * @return The snapshot (one reference, owned by the caller), or NULL on error
+ */
+SharedSnapshot* config_snapshot_builtin(void);
+
+/**
+ * Get a reference to the configuration the calling thread uses
+ * 
+ * Lets work handed to other threads see the same configuration through
+ * config_use().
+ * 
+ * @return The pinned snapshot, or else the published one (one reference,
+ *         owned by the caller), or NULL if there is none
+ */
+SharedSnapshot* config_acquire(void);
+
+/**
+ * Make the calling thread use a given configuration snapshot
+ * 
+ * Replaces the thread's pin without touching reference counts; the
+ * caller keeps the snapshot alive while it is in use and restores the
+ * previous value when done.
+ * 
+ * @param snapshot Snapshot to use, or NULL to go back to the published one
+ * @return The snapshot the thread used before
+ */
+SharedSnapshot* config_use(SharedSnapshot* snapshot);
+
+/**
+ * Identify the configuration the calling thread uses
+ * 
+ * Unlike the tables' address, the id of a snapshot is never reused, so
+ * it can key data cached from a configuration beyond the snapshot's life.
+ * 
+ * @return Id of the pinned or else the published snapshot, or 0 if there is none
+ */
+uint64_t config_snapshot_id(void);
+
+/**
+ * Set the current institution context of the calling thread
  * 
- * @param institution Name of the institution to set as current
+ * @param institution Name of the institution to set as current (copied)
  */
 void config_set_current_institution(const char* institution);
 
 /**
- * Get the current institution context
+ * Get the current institution context of the calling thread
  * 
  * @return The current institution name or NULL if not set
  */
@@ -69,6 +158,18 @@ bool config_is_valid_domain(const char* domain);
  */
 bool config_is_valid_role(const char* role);
 
+/**
+ * Check if the tokenizer should read a word as a role
+ * 
+ * The lexicon holds every role configured under "roles" plus the
+ * built-in generic ones, so roles of new institutions are recognized
+ * as soon as they are configured.
+ * 
+ * @param word Word to check (ASCII case-insensitive)
+ * @return true if it is a role, false otherwise
+ */
+bool config_is_role_word(const char* word);
+
 /**
  * Validate a role for a specific institution
  * 
@@ -110,6 +211,38 @@ Multiplicity config_get_multiplicity(const char* text);
  */
 ComplianceType config_get_compliance_type(const char* text);
 
+/**
+ * Add the configured default norms of a schema's legal domain
+ * 
+ * The templates are copied after the schema's own norms, numbered from
+ * its highest norm number on. Templates whose content (role, deontic
+ * operator, action, scope and conditions) matches a norm already in the
+ * schema are skipped.
+ * 
+ * @param schema The schema
+ * @return Number of norms added
+ */
+int config_add_default_norms(Schema* schema);
+
+/**
+ * Classify a text by the configured keywords ("clasificacion")
+ * 
+ * A single pass over the text finds every category with a keyword in
+ * it, however many keywords and categories are configured.
+ * 
+ * @param text Text to classify (NULL matches nothing)
+ * @return Mask of the matching categories (see config_get_category())
+ */
+uint32_t config_classify(const char* text);
+
+/**
+ * Get the bit of a keyword category in config_classify() masks
+ * 
+ * @param category Category name
+ * @return The bit, or 0 if no such category is configured
+ */
+uint32_t config_get_category(const char* category);
+
 /**
  * Suggest a correction for a possibly misspelled institution
  * 
@@ -118,6 +251,14 @@ ComplianceType config_get_compliance_type(const char* text);
  */
 const char* config_suggest_institution(const char* institution);
 
+/**
+ * Suggest a correction for a possibly misspelled legal domain
+ * 
+ * @param domain Potentially misspelled legal domain
+ * @return A suggested correction or NULL if none found
+ */
+const char* config_suggest_domain(const char* domain);
+
 /**
  * Suggest a correction for a possibly misspelled role
  * 
@@ -5,97 +5,328 @@
  */
 
 #include "context_manager.h"
+#include "schema_types.h"
+#include "context_search.h"
+#include "shared_snapshot.h"
+#include "task_scheduler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <cJSON.h>
 
-/* The loaded context database */
-static cJSON* legal_context = NULL;
+/* Domains queried that the context does not name, resolved on first use */
+typedef struct domain_memo {
+    char* domain;
+    uint32_t* norms;
+    uint32_t count;
+    struct domain_memo* next;
+} DomainMemo;
+
+/* Number of related articles listed per annotated norm */
+#define CONTEXT_ANNOTATION_TOP_K 5
+
+/* Data derived from a context, built once per key (see context_get_derived()) */
+typedef struct context_derived {
+    char* key;
+    uint64_t version;
+    void* (*build)(const ContextStore* store, const char* key);
+    void (*destroy)(void* data);
+    void* data;
+    struct context_derived* next;
+} ContextDerived;
 
 /**
- * Initialize the context manager with a JSON file
+ * One loaded context database with the state derived from it
+ *
+ * The store is immutable. Derived state is filled in lazily under the
+ * lock and, once added, never changes until the snapshot is freed, so
+ * any number of threads may query through the same snapshot.
  */
-bool context_init(const char* context_file) {
-    FILE* file = fopen(context_file, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening context file: %s\n", context_file);
-        return false;
-    }
+typedef struct {
+    ContextStore* store;
+    pthread_mutex_t lock;                   // Guards the lists and the spare scratch below
+    DomainMemo* domain_memos;
+    ContextDerived* derived;
+    ContextSearchScratch* search_scratch;   // Spare working memory for ranking articles
+} ContextSnapshot;
+
+/* The published context snapshot */
+static SnapshotSlot context_slot = SNAPSHOT_SLOT_INIT;
+
+/* Snapshot pinned by the calling thread, if any */
+static __thread SharedSnapshot* pinned_context = NULL;
+
+static char* related_articles(Norm* norm, ContextSearchScratch* scratch);
+static ContextSearchScratch* borrow_scratch(ContextSnapshot* snapshot);
+static void return_scratch(ContextSnapshot* snapshot, ContextSearchScratch* scratch);
+
+/**
+ * Free a context snapshot and its derived state
+ */
+static void free_context_snapshot(void* data) {
+    ContextSnapshot* snapshot = (ContextSnapshot*)data;
     
-    /* Get file size */
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    context_search_scratch_free(snapshot->search_scratch);
     
-    /* Read file content */
-    char* buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        fclose(file);
-        return false;
+    while (snapshot->derived != NULL) {
+        ContextDerived* next = snapshot->derived->next;
+        snapshot->derived->destroy(snapshot->derived->data);
+        free(snapshot->derived->key);
+        free(snapshot->derived);
+        snapshot->derived = next;
     }
     
-    size_t read_size = fread(buffer, 1, file_size, file);
-    fclose(file);
+    while (snapshot->domain_memos != NULL) {
+        DomainMemo* next = snapshot->domain_memos->next;
+        free(snapshot->domain_memos->domain);
+        free(snapshot->domain_memos->norms);
+        free(snapshot->domain_memos);
+        snapshot->domain_memos = next;
+    }
     
-    if (read_size != file_size) {
-        fprintf(stderr, "Error reading context file\n");
-        free(buffer);
+    context_store_free(snapshot->store);
+    pthread_mutex_destroy(&snapshot->lock);
+    free(snapshot);
+}
+
+/**
+ * Get the snapshot used by the calling thread: its pinned one, or else the published one
+ */
+static ContextSnapshot* current_context(void) {
+    SharedSnapshot* shared = pinned_context != NULL ? pinned_context : shared_snapshot_peek(&context_slot);
+    return shared != NULL ? (ContextSnapshot*)shared->data : NULL;
+}
+
+/**
+ * Get the store used by the calling thread
+ */
+static const ContextStore* current_store(void) {
+    ContextSnapshot* snapshot = current_context();
+    return snapshot != NULL ? snapshot->store : NULL;
+}
+
+/**
+ * Initialize the context manager with a JSON file
+ * 
+ * The file is streamed straight into compact tables, so peak memory
+ * tracks the retained fields rather than the size of the file. The new
+ * context is built before it is published, so this also reloads a
+ * context while other threads keep working on the previous one.
+ */
+bool context_init(const char* context_file) {
+    SharedSnapshot* shared = context_snapshot_load(context_file);
+    if (shared == NULL) {
         return false;
     }
     
-    buffer[file_size] = '\0';
-    
-    /* Parse JSON */
-    legal_context = cJSON_Parse(buffer);
-    free(buffer);
+    shared_snapshot_publish(&context_slot, shared);
+    return true;
+}
+
+/**
+ * Load a legal context file into a snapshot without publishing it
+ */
+SharedSnapshot* context_snapshot_load(const char* context_file) {
+    ContextStore* store = context_store_load(context_file);
+    if (store == NULL) {
+        return NULL;
+    }
     
-    if (legal_context == NULL) {
-        fprintf(stderr, "Error parsing context file: %s\n", cJSON_GetErrorPtr());
-        return false;
+    ContextSnapshot* snapshot = (ContextSnapshot*)calloc(1, sizeof(ContextSnapshot));
+    SharedSnapshot* shared = snapshot != NULL ? shared_snapshot_create(snapshot, free_context_snapshot) : NULL;
+    if (shared == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(snapshot);
+        context_store_free(store);
+        return NULL;
     }
     
-    return true;
+    snapshot->store = store;
+    pthread_mutex_init(&snapshot->lock, NULL);
+    return shared;
+}
+
+/**
+ * Initialize the legal context module
+ */
+bool legal_context_init(const char* filename) {
+    return context_init(filename);
+}
+
+/**
+ * Clean up resources used by the legal context module
+ */
+void legal_context_cleanup(void) {
+    context_cleanup();
 }
 
+/**
+ * Check if legal context is initialized
+ */
+bool context_is_initialized(void) {
+    return current_context() != NULL;
+}
 
 /**
  * Clean up resources used by the context manager
  */
 void context_cleanup(void) {
-    if (legal_context != NULL) {
-        cJSON_Delete(legal_context);
-        legal_context = NULL;
+    shared_snapshot_publish(&context_slot, NULL);
+}
+
+/**
+ * Pin the published context to the calling thread
+ */
+void context_pin(void) {
+    if (pinned_context == NULL) {
+        pinned_context = shared_snapshot_acquire(&context_slot);
     }
 }
 
+/**
+ * Release the calling thread's pinned context
+ */
+void context_unpin(void) {
+    shared_snapshot_release(pinned_context);
+    pinned_context = NULL;
+}
+
+/**
+ * Make the calling thread use a given context snapshot
+ */
+SharedSnapshot* context_use(SharedSnapshot* snapshot) {
+    SharedSnapshot* previous = pinned_context;
+    pinned_context = snapshot;
+    return previous;
+}
+
+/**
+ * Get the loaded context tables
+ */
+const ContextStore* context_get_store(void) {
+    return current_store();
+}
+
+/**
+ * Get data derived from the calling thread's context, building it on first use
+ */
+const void* context_get_derived(const char* key, uint64_t version,
+                                void* (*build)(const ContextStore* store, const char* key),
+                                void (*destroy)(void* data)) {
+    ContextSnapshot* snapshot = current_context();
+    if (snapshot == NULL || key == NULL) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&snapshot->lock);
+    
+    ContextDerived* entry = snapshot->derived;
+    while (entry != NULL && !(entry->build == build && entry->version == version && strcmp(entry->key, key) == 0)) {
+        entry = entry->next;
+    }
+    
+    /* Built under the lock, so concurrent first uses build it once */
+    if (entry == NULL) {
+        entry = (ContextDerived*)calloc(1, sizeof(ContextDerived));
+        if (entry != NULL) {
+            entry->key = strdup(key);
+            entry->data = entry->key != NULL ? build(snapshot->store, key) : NULL;
+        }
+        
+        if (entry != NULL && entry->data != NULL) {
+            entry->build = build;
+            entry->version = version;
+            entry->destroy = destroy;
+            entry->next = snapshot->derived;
+            snapshot->derived = entry;
+        } else {
+            if (entry != NULL) {
+                free(entry->key);
+                free(entry);
+            }
+            entry = NULL;
+        }
+    }
+    
+    pthread_mutex_unlock(&snapshot->lock);
+    return entry != NULL ? entry->data : NULL;
+}
+
 /**
  * Get a legal norm definition from the context
  */
-cJSON* context_get_norm(const char* source, const char* norm_id) {
+const ContextNorm* context_get_norm(const char* source, const char* norm_id) {
+    const ContextStore* legal_context = current_store();
     if (legal_context == NULL || source == NULL || norm_id == NULL) {
         return NULL;
     }
     
-    /* Navigate to the source */
-    cJSON* sources = cJSON_GetObjectItemCaseSensitive(legal_context, "sources");
-    if (!cJSON_IsObject(sources)) {
+    return context_store_find_norm(legal_context, source, norm_id);
+}
+
+/**
+ * Add a list of strings from the ref table to a cJSON array
+ */
+static cJSON* string_list_to_json(uint32_t first, uint32_t count) {
+    const ContextStore* legal_context = current_store();
+    cJSON* array = cJSON_CreateArray();
+    if (array == NULL) {
         return NULL;
     }
     
-    cJSON* source_obj = cJSON_GetObjectItemCaseSensitive(sources, source);
-    if (!cJSON_IsObject(source_obj)) {
-        return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        cJSON_AddItemToArray(array, cJSON_CreateString(
+            context_store_str(legal_context, legal_context->refs[first + i])));
     }
     
-    /* Navigate to norms and find the specified norm */
-    cJSON* norms = cJSON_GetObjectItemCaseSensitive(source_obj, "normas");
-    if (!cJSON_IsObject(norms)) {
+    return array;
+}
+
+/**
+ * Materialize a norm from the context tables as a cJSON object
+ */
+static cJSON* norm_to_json(const ContextNorm* norm) {
+    const ContextStore* legal_context = current_store();
+    cJSON* object = cJSON_CreateObject();
+    if (object == NULL) {
         return NULL;
     }
     
-    return cJSON_GetObjectItemCaseSensitive(norms, norm_id);
+    const char* id = context_store_str(legal_context, norm->id);
+    if (id != NULL) {
+        cJSON_AddStringToObject(object, "id", id);
+    }
+    
+    if (norm->flags & CONTEXT_NORM_HAS_ESTRUCTURA) {
+        cJSON* estructura = cJSON_CreateObject();
+        const struct { const char* name; ContextStr ref; } fields[] = {
+            {"accion", norm->accion}, {"activo", norm->activo}, {"pasivo", norm->pasivo},
+            {"deontico", norm->deontico}, {"objeto", norm->objeto}
+        };
+        
+        cJSON_AddItemToObject(estructura, "condiciones",
+                              string_list_to_json(norm->conditions, norm->condition_count));
+        for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            const char* value = context_store_str(legal_context, fields[i].ref);
+            if (value != NULL) {
+                cJSON_AddStringToObject(estructura, fields[i].name, value);
+            }
+        }
+        cJSON_AddItemToObject(object, "estructura", estructura);
+    }
+    
+    if (norm->context_count > 0) {
+        cJSON_AddItemToObject(object, "contexto", string_list_to_json(norm->contexts, norm->context_count));
+    }
+    
+    const char* derivada = context_store_str(legal_context, norm->derivada);
+    if (derivada != NULL) {
+        cJSON_AddStringToObject(object, "derivadaDe", derivada);
+    }
+    
+    return object;
 }
 
 /**
@@ -103,18 +334,24 @@ cJSON* context_get_norm(const char* source, const char* norm_id) {
  */
 bool context_has_relationship(const char* source1, const char* norm_id1, 
                               const char* source2, const char* norm_id2) {
-    cJSON* norm1 = context_get_norm(source1, norm_id1);
+    const ContextStore* legal_context = current_store();
+    const ContextNorm* norm1 = context_get_norm(source1, norm_id1);
     if (norm1 == NULL) {
         return false;
     }
     
-    /* Check if norm1 is derived from norm2 */
-    cJSON* derived_from = cJSON_GetObjectItemCaseSensitive(norm1, "derivadaDe");
-    if (cJSON_IsString(derived_from)) {
+    /* Check if norm1 is derived from norm2, by index when the reference was resolved at load */
+    if (norm1->derived_from != CONTEXT_NO_NORM && strchr(source2, '.') == NULL) {
+        const ContextNorm* norm2 = context_get_norm(source2, norm_id2);
+        return norm2 != NULL && (uint32_t)(norm2 - legal_context->norms) == norm1->derived_from;
+    }
+    
+    const char* derived_from = context_store_str(legal_context, norm1->derivada);
+    if (derived_from != NULL) {
         char full_id[256];
         snprintf(full_id, sizeof(full_id), "%s.%s", source2, norm_id2);
         
-        if (strcmp(derived_from->valuestring, full_id) == 0) {
+        if (strcmp(derived_from, full_id) == 0) {
             return true;
         }
     }
@@ -129,28 +366,15 @@ bool context_has_relationship(const char* source1, const char* norm_id1,
  * Updated function to map roles using either explicit mappings or inference
  */
 const char* context_map_role(const char* contract_type, const char* generic_role) {
+    const ContextStore* legal_context = current_store();
     if (legal_context == NULL || contract_type == NULL || generic_role == NULL) {
         return NULL;
     }
     
-    /* First try using explicit mappings if available */
-    cJSON* role_mappings = cJSON_GetObjectItemCaseSensitive(legal_context, "roleMappings");
-    if (cJSON_IsObject(role_mappings)) {
-        cJSON* contract_mappings = cJSON_GetObjectItemCaseSensitive(role_mappings, contract_type);
-        if (cJSON_IsObject(contract_mappings)) {
-            /* Check for direct mapping */
-            cJSON* specific_role = cJSON_GetObjectItemCaseSensitive(contract_mappings, generic_role);
-            if (cJSON_IsString(specific_role)) {
-                return specific_role->valuestring;
-            } 
-            else if (cJSON_IsArray(specific_role)) {
-                /* Return the first role in the array */
-                cJSON* first_role = cJSON_GetArrayItem(specific_role, 0);
-                if (cJSON_IsString(first_role)) {
-                    return first_role->valuestring;
-                }
-            }
-        }
+    /* First try using explicit mappings if available (first role if several) */
+    const ContextRoleMapping* mapping = context_store_find_mapping(legal_context, contract_type, generic_role);
+    if (mapping != NULL) {
+        return context_store_str(legal_context, legal_context->refs[mapping->roles]);
     }
     
     /* If explicit mapping not found, try inferring the mapping */
@@ -185,6 +409,7 @@ const char* context_map_role(const char* contract_type, const char* generic_role
  * Validate that a norm is legally consistent with the context
  */
 bool context_validate_norm(Norm* norm) {
+    const ContextStore* legal_context = current_store();
     if (norm == NULL || legal_context == NULL) {
         return false;
     }
@@ -197,29 +422,19 @@ bool context_validate_norm(Norm* norm) {
     if (norm->role != NULL) {
         const char* institution = "Arrendamiento"; /* Example - you would get this from the schema */
         
-        /* Check if the role is valid for this institution */
-        cJSON* role_mappings = cJSON_GetObjectItemCaseSensitive(legal_context, "roleMappings");
-        if (cJSON_IsObject(role_mappings)) {
-            cJSON* inst_mappings = cJSON_GetObjectItemCaseSensitive(role_mappings, institution);
-            
-            if (cJSON_IsObject(inst_mappings)) {
-                /* Check each mapping */
-                cJSON* mapping;
-                cJSON_ArrayForEach(mapping, inst_mappings) {
-                    if (cJSON_IsString(mapping) && strcmp(mapping->valuestring, norm->role) == 0) {
-                        /* Role is valid */
-                        return true;
-                    }
-                    else if (cJSON_IsArray(mapping)) {
-                        /* Check array of roles */
-                        cJSON* role_item;
-                        cJSON_ArrayForEach(role_item, mapping) {
-                            if (cJSON_IsString(role_item) && strcmp(role_item->valuestring, norm->role) == 0) {
-                                /* Role is valid */
-                                return true;
-                            }
-                        }
-                    }
+        /* Check each mapped role of this institution; mappings of one
+           institution are stored contiguously */
+        const ContextRoleMapping* first = context_store_find_mapping(legal_context, institution, NULL);
+        const ContextRoleMapping* end = legal_context->role_mappings + legal_context->role_mapping_count;
+        
+        for (const ContextRoleMapping* mapping = first;
+             mapping != NULL && mapping < end && mapping->institution == first->institution;
+             mapping++) {
+            for (uint32_t i = 0; i < mapping->role_count; i++) {
+                const char* role = context_store_str(legal_context, legal_context->refs[mapping->roles + i]);
+                if (strcmp(role, norm->role) == 0) {
+                    /* Role is valid */
+                    return true;
                 }
             }
         }
@@ -230,19 +445,108 @@ bool context_validate_norm(Norm* norm) {
 }
 
 /**
- * Get context information for a specific legal domain
+ * Order norm indices
  */
-cJSON* context_get_domain_info(const char* domain) {
-    if (legal_context == NULL || domain == NULL) {
+static int compare_norm_index(const void* a, const void* b) {
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * Resolve a domain the context does not name by merging the lists of
+ * every named domain that is a substring of it (snapshot lock held)
+ */
+static DomainMemo* resolve_domain(ContextSnapshot* snapshot, const char* domain) {
+    const ContextStore* legal_context = snapshot->store;
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < legal_context->domain_count; i++) {
+        const ContextPostingList* list = &legal_context->domains[i];
+        if (strstr(domain, context_store_str(legal_context, list->key)) != NULL) {
+            total += list->count;
+        }
+    }
+    
+    DomainMemo* memo = (DomainMemo*)calloc(1, sizeof(DomainMemo));
+    if (memo == NULL) {
         return NULL;
     }
     
-    /* This function would extract domain-specific information
-       from the context database */
+    memo->domain = strdup(domain);
+    memo->norms = (uint32_t*)malloc((total ? total : 1) * sizeof(uint32_t));
+    if (memo->domain == NULL || memo->norms == NULL) {
+        free(memo->domain);
+        free(memo->norms);
+        free(memo);
+        return NULL;
+    }
     
-    /* Check each source for relevant domain information */
-    cJSON* sources = cJSON_GetObjectItemCaseSensitive(legal_context, "sources");
-    if (!cJSON_IsObject(sources)) {
+    for (uint32_t i = 0; i < legal_context->domain_count; i++) {
+        const ContextPostingList* list = &legal_context->domains[i];
+        if (strstr(domain, context_store_str(legal_context, list->key)) != NULL) {
+            memcpy(memo->norms + memo->count, legal_context->postings + list->first,
+                   list->count * sizeof(uint32_t));
+            memo->count += list->count;
+        }
+    }
+    
+    /* Back to document order, without duplicates */
+    qsort(memo->norms, memo->count, sizeof(uint32_t), compare_norm_index);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < memo->count; i++) {
+        if (unique == 0 || memo->norms[unique - 1] != memo->norms[i]) {
+            memo->norms[unique++] = memo->norms[i];
+        }
+    }
+    memo->count = unique;
+    
+    memo->next = snapshot->domain_memos;
+    snapshot->domain_memos = memo;
+    return memo;
+}
+
+/**
+ * Get the norms relevant to a legal domain
+ */
+ContextNormView context_get_domain_norms(const char* domain) {
+    ContextNormView view = { NULL, 0 };
+    ContextSnapshot* snapshot = current_context();
+    if (snapshot == NULL || domain == NULL) {
+        return view;
+    }
+    
+    const ContextStore* legal_context = snapshot->store;
+    
+    const ContextPostingList* list = context_store_find_domain(legal_context, domain);
+    if (list != NULL) {
+        view.norms = legal_context->postings + list->first;
+        view.count = list->count;
+        return view;
+    }
+    
+    pthread_mutex_lock(&snapshot->lock);
+    DomainMemo* memo = snapshot->domain_memos;
+    while (memo != NULL && strcmp(memo->domain, domain) != 0) {
+        memo = memo->next;
+    }
+    if (memo == NULL) {
+        memo = resolve_domain(snapshot, domain);
+    }
+    pthread_mutex_unlock(&snapshot->lock);
+    
+    if (memo != NULL) {
+        view.norms = memo->norms;
+        view.count = memo->count;
+    }
+    return view;
+}
+
+/**
+ * Get context information for a specific legal domain
+ */
+cJSON* context_get_domain_info(const char* domain) {
+    const ContextStore* legal_context = current_store();
+    if (legal_context == NULL || domain == NULL) {
         return NULL;
     }
     
@@ -252,40 +556,13 @@ cJSON* context_get_domain_info(const char* domain) {
         return NULL;
     }
     
-    /* For each source, check if it's relevant to the domain */
-    cJSON* source;
-    cJSON_ArrayForEach(source, sources) {
-        if (!cJSON_IsObject(source)) continue;
-        
-        cJSON* norms = cJSON_GetObjectItemCaseSensitive(source, "normas");
-        if (!cJSON_IsObject(norms)) continue;
-        
-        cJSON* norm_obj;
-        cJSON_ArrayForEach(norm_obj, norms) {
-            if (!cJSON_IsObject(norm_obj)) continue;
-            
-            /* Check if this norm is relevant to the domain */
-            cJSON* contexto = cJSON_GetObjectItemCaseSensitive(norm_obj, "contexto");
-            if (!cJSON_IsArray(contexto)) continue;
-            
-            cJSON* ctx_item;
-            cJSON_ArrayForEach(ctx_item, contexto) {
-                if (!cJSON_IsString(ctx_item)) continue;
-                
-                /* If domain matches a context item, add this norm to domain_info */
-                if (strcmp(ctx_item->valuestring, domain) == 0 || 
-                    strstr(domain, ctx_item->valuestring) != NULL) {
-                    
-                    /* Add this norm to our domain info */
-                    cJSON* norm_id = cJSON_GetObjectItemCaseSensitive(norm_obj, "id");
-                    if (cJSON_IsString(norm_id)) {
-                        /* Add a reference to this norm */
-                        cJSON_AddItemReferenceToObject(domain_info, norm_id->valuestring, norm_obj);
-                    }
-                    
-                    break; /* Move to next norm */
-                }
-            }
+    /* Add every relevant norm, in document order */
+    ContextNormView view = context_get_domain_norms(domain);
+    for (uint32_t i = 0; i < view.count; i++) {
+        const ContextNorm* norm = &legal_context->norms[view.norms[i]];
+        const char* norm_id = context_store_str(legal_context, norm->id);
+        if (norm_id != NULL) {
+            cJSON_AddItemToObject(domain_info, norm_id, norm_to_json(norm));
         }
     }
     
@@ -294,128 +571,105 @@ cJSON* context_get_domain_info(const char* domain) {
 }
 
 /**
- * Improved implementation for context_get_kelsen_annotations
+ * Get additional annotations for a Kelsen clause based on context
  * 
- * This version uses more sophisticated matching to find relevant legal articles
+ * The norm's action and scope are matched against the legal norms'
+ * accion/objeto text with BM25 ranking; the best articles are listed.
  */
 char* context_get_kelsen_annotations(Norm* norm) {
-    if (norm == NULL || legal_context == NULL) {
+    ContextSnapshot* snapshot = current_context();
+    if (norm == NULL || norm->action == NULL || snapshot == NULL) {
         return NULL;
     }
     
-    /* Buffer for the annotations */
-    char* annotations = (char*)malloc(1024);
-    if (annotations == NULL) {
+    ContextSearchScratch* scratch = borrow_scratch(snapshot);
+    if (scratch == NULL) {
         return NULL;
     }
     
-    annotations[0] = '\0'; /* Initialize as empty string */
+    char* annotations = related_articles(norm, scratch);
+    return_scratch(snapshot, scratch);
     
-    /* Get the sources from the context */
-    cJSON* sources = cJSON_GetObjectItemCaseSensitive(legal_context, "sources");
-    if (!cJSON_IsObject(sources)) {
-        free(annotations);
-        return NULL;
+    return annotations;
+}
+
+/**
+ * Borrow the spare scratch area, or make one if another thread has it
+ */
+static ContextSearchScratch* borrow_scratch(ContextSnapshot* snapshot) {
+    pthread_mutex_lock(&snapshot->lock);
+    ContextSearchScratch* scratch = snapshot->search_scratch;
+    snapshot->search_scratch = NULL;
+    pthread_mutex_unlock(&snapshot->lock);
+    
+    return scratch != NULL ? scratch : context_search_scratch_create(snapshot->store);
+}
+
+/**
+ * Give back a borrowed scratch area, keeping it as the spare if there is none
+ */
+static void return_scratch(ContextSnapshot* snapshot, ContextSearchScratch* scratch) {
+    pthread_mutex_lock(&snapshot->lock);
+    if (snapshot->search_scratch == NULL) {
+        snapshot->search_scratch = scratch;
+        scratch = NULL;
     }
+    pthread_mutex_unlock(&snapshot->lock);
+    context_search_scratch_free(scratch);
+}
+
+/**
+ * List the legal articles related to a norm, using the caller's scratch area
+ */
+static char* related_articles(Norm* norm, ContextSearchScratch* scratch) {
+    const ContextStore* legal_context = current_store();
+    /* Query with the action and what it acts upon */
+    char query[1024];
+    snprintf(query, sizeof(query), "%s %s", norm->action,
+             norm->scope != NULL && norm->scope->description != NULL ? norm->scope->description : "");
     
-    /* Look for matches to our norm */
-    cJSON* source;
-    cJSON_ArrayForEach(source, sources) {
-        if (!cJSON_IsObject(source)) continue;
-        
-        /* Get source name and type */
-        cJSON* source_name = cJSON_GetObjectItemCaseSensitive(source, "nombre");
-        cJSON* source_type = cJSON_GetObjectItemCaseSensitive(source, "tipo");
-        
-        if (!cJSON_IsString(source_name) || !cJSON_IsString(source_type)) continue;
-        
-        /* Process norms in this source */
-        cJSON* norms = cJSON_GetObjectItemCaseSensitive(source, "normas");
-        if (!cJSON_IsObject(norms)) continue;
+    ContextSearchHit hits[CONTEXT_ANNOTATION_TOP_K];
+    int hit_count = context_search_top(legal_context, scratch, query, hits, CONTEXT_ANNOTATION_TOP_K);
+    
+    /* Size, then write, one line per related article */
+    size_t length = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        char* annotations = NULL;
+        if (pass == 1) {
+            if (length == 0) {
+                return NULL;
+            }
+            annotations = (char*)malloc(length + 1);
+            if (annotations == NULL) {
+                return NULL;
+            }
+        }
         
-        cJSON* norm_obj;
-        cJSON_ArrayForEach(norm_obj, norms) {
-            if (!cJSON_IsObject(norm_obj)) continue;
-            
-            /* Get the norm ID */
-            cJSON* norm_id = cJSON_GetObjectItemCaseSensitive(norm_obj, "id");
-            if (!cJSON_IsString(norm_id)) continue;
-            
-            /* Get the structure */
-            cJSON* estructura = cJSON_GetObjectItemCaseSensitive(norm_obj, "estructura");
-            if (!cJSON_IsObject(estructura)) continue;
+        size_t pos = 0;
+        for (int i = 0; i < hit_count; i++) {
+            const ContextNorm* norm_entry = &legal_context->norms[hits[i].norm];
+            const ContextSource* source = &legal_context->sources[norm_entry->source];
+            context_store_load_source(legal_context, norm_entry->source);
             
-            /* Get action and passive */
-            cJSON* accion = cJSON_GetObjectItemCaseSensitive(estructura, "accion");
-            cJSON* pasivo = cJSON_GetObjectItemCaseSensitive(estructura, "pasivo");
-            cJSON* objeto = cJSON_GetObjectItemCaseSensitive(estructura, "objeto");
+            const char* source_name = context_store_str(legal_context, source->nombre);
+            const char* norm_id = context_store_str(legal_context, norm_entry->id);
+            const char* accion = context_store_str(legal_context, norm_entry->accion);
             
-            if (!cJSON_IsString(accion)) continue;
-            
-            /* Check if this norm is related to our norm */
-            bool matched = false;
-            
-            /* Check action similarity - look for key words */
-            if (norm->action) {
-                /* Look for key verbs that might indicate similarity */
-                const char* action_verbs[] = {"entregar", "pagar", "reparar", "garantizar", "transferir"};
-                for (int i = 0; i < 5; i++) {
-                    if (strstr(norm->action, action_verbs[i]) && strstr(accion->valuestring, action_verbs[i])) {
-                        matched = true;
-                        break;
-                    }
-                }
-                
-                /* Also match based on objects if available */
-                if (cJSON_IsString(objeto) && norm->scope) {
-                    const char* objects[] = {"bien", "producto", "precio", "pago", "servicio", "inmueble"};
-                    for (int i = 0; i < 6; i++) {
-                        if (strstr(norm->scope->description, objects[i]) && strstr(objeto->valuestring, objects[i])) {
-                            matched = true;
-                            break;
-                        }
-                    }
-                }
-                
-                /* Look for role matching if we have passive */
-                if (cJSON_IsString(pasivo) && norm->role) {
-                    /* Direct role match */
-                    if (strcasecmp(pasivo->valuestring, norm->role) == 0) {
-                        matched = true;
-                    }
-                    
-                    /* Or match via role mapping */
-                    const char* mapped_role = context_map_role("compraventa", pasivo->valuestring);
-                    if (mapped_role && strcasecmp(mapped_role, norm->role) == 0) {
-                        matched = true;
-                    }
-                }
-            }
+            if (source_name == NULL || source->tipo == 0 || norm_id == NULL || accion == NULL) continue;
             
-            /* If we found a match, add an annotation */
-            if (matched) {
-                char annotation[512];
-                sprintf(annotation, "// Related to %s: %s - ", 
-                        source_name->valuestring, 
-                        norm_id->valuestring);
-                
-                /* Add a description of the legal principle */
-                strcat(annotation, accion->valuestring);
-                strcat(annotation, "\n");
-                
-                /* Add to our annotations */
-                strcat(annotations, annotation);
-            }
+            pos += snprintf(annotations != NULL ? annotations + pos : NULL,
+                            annotations != NULL ? length + 1 - pos : 0,
+                            "// Related to %s: %s - %s\n", source_name, norm_id, accion);
+        }
+        
+        if (pass == 0) {
+            length = pos;
+        } else {
+            return annotations;
         }
     }
     
-    /* Check if we found any annotations */
-    if (strlen(annotations) == 0) {
-        free(annotations);
-        return NULL;
-    }
-    
-    return annotations;
+    return NULL;
 }
 
 /**
@@ -424,6 +678,7 @@ char* context_get_kelsen_annotations(Norm* norm) {
  * This eliminates the need for explicit roleMappings in the JSON database
  */
 cJSON* context_infer_role_mappings(const char* contract_type) {
+    const ContextStore* legal_context = current_store();
     if (legal_context == NULL || contract_type == NULL) {
         return NULL;
     }
@@ -434,137 +689,115 @@ cJSON* context_infer_role_mappings(const char* contract_type) {
         return NULL;
     }
     
-    /* Navigate to sources */
-    cJSON* sources = cJSON_GetObjectItemCaseSensitive(legal_context, "sources");
-    if (!cJSON_IsObject(sources)) {
-        cJSON_Delete(inferred_mappings);
-        return NULL;
-    }
-    
-    /* For each source, look at its norms */
-    cJSON* source;
-    cJSON_ArrayForEach(source, sources) {
-        if (!cJSON_IsObject(source)) continue;
-        
-        cJSON* norms = cJSON_GetObjectItemCaseSensitive(source, "normas");
-        if (!cJSON_IsObject(norms)) continue;
+    /* Examine each norm of each source */
+    for (uint32_t n = 0; n < legal_context->norm_count; n++) {
+        const ContextNorm* norm_entry = &legal_context->norms[n];
         
-        /* Examine each norm */
-        cJSON* norm_obj;
-        cJSON_ArrayForEach(norm_obj, norms) {
-            if (!cJSON_IsObject(norm_obj)) continue;
+        /* Check if this norm relates to our contract type */
+        bool relevant_context = false;
+        for (uint32_t i = 0; i < norm_entry->context_count; i++) {
+            const char* context_item = context_store_str(legal_context, legal_context->refs[norm_entry->contexts + i]);
             
-            /* Check if this norm relates to our contract type */
-            cJSON* contexto = cJSON_GetObjectItemCaseSensitive(norm_obj, "contexto");
-            if (!cJSON_IsArray(contexto)) continue;
-            
-            bool relevant_context = false;
-            cJSON* context_item;
-            cJSON_ArrayForEach(context_item, contexto) {
-                if (!cJSON_IsString(context_item)) continue;
-                
-                if (strcasecmp(context_item->valuestring, contract_type) == 0) {
-                    relevant_context = true;
-                    break;
-                }
+            if (strcasecmp(context_item, contract_type) == 0) {
+                relevant_context = true;
+                break;
             }
+        }
+        
+        if (!relevant_context) continue;
+        
+        /* Get the estructura of the norm */
+        if (!(norm_entry->flags & CONTEXT_NORM_HAS_ESTRUCTURA)) continue;
+        
+        /* Extract passive subject */
+        const char* pasivo = context_store_str(legal_context, norm_entry->pasivo);
+        if (pasivo == NULL) continue;
+        
+        /* Extract action text to find additional roles */
+        const char* accion = context_store_str(legal_context, norm_entry->accion);
+        if (accion == NULL) continue;
+        
+        /* Infer generic role type based on context and action */
+        const char* pasivo_role = pasivo;
+        const char* generic_role = NULL;
+        
+        /* Simple heuristics to map passive subject to generic role */
+        /* For example, if action contains "pagar" and passive is "comprador" */
+        if (strstr(accion, "pagar") != NULL) {
+            generic_role = "deudor";
+        } 
+        else if (strstr(accion, "entregar") != NULL) {
+            generic_role = "obligado_entrega";
+        }
+        else if (strstr(accion, "mantener") != NULL || 
+                 strstr(accion, "reparar") != NULL) {
+            generic_role = "obligado_mantenimiento";
+        }
+        /* Default case */
+        else {
+            generic_role = "contratante";
+        }
+        
+        /* Add or update role in inferred mappings */
+        if (generic_role != NULL) {
+            cJSON* existing_role = cJSON_GetObjectItemCaseSensitive(inferred_mappings, generic_role);
             
-            if (!relevant_context) continue;
-            
-            /* Get the estructura of the norm */
-            cJSON* estructura = cJSON_GetObjectItemCaseSensitive(norm_obj, "estructura");
-            if (!cJSON_IsObject(estructura)) continue;
-            
-            /* Extract passive subject */
-            cJSON* pasivo = cJSON_GetObjectItemCaseSensitive(estructura, "pasivo");
-            if (!cJSON_IsString(pasivo)) continue;
-            
-            /* Extract action text to find additional roles */
-            cJSON* accion = cJSON_GetObjectItemCaseSensitive(estructura, "accion");
-            if (!cJSON_IsString(accion)) continue;
-            
-            /* Infer generic role type based on context and action */
-            const char* pasivo_role = pasivo->valuestring;
-            const char* generic_role = NULL;
-            
-            /* Simple heuristics to map passive subject to generic role */
-            /* For example, if action contains "pagar" and passive is "comprador" */
-            if (strstr(accion->valuestring, "pagar") != NULL) {
-                generic_role = "deudor";
+            if (existing_role == NULL) {
+                /* Add new role mapping */
+                cJSON_AddStringToObject(inferred_mappings, generic_role, pasivo_role);
             } 
-            else if (strstr(accion->valuestring, "entregar") != NULL) {
-                generic_role = "obligado_entrega";
-            }
-            else if (strstr(accion->valuestring, "mantener") != NULL || 
-                     strstr(accion->valuestring, "reparar") != NULL) {
-                generic_role = "obligado_mantenimiento";
-            }
-            /* Default case */
-            else {
-                generic_role = "contratante";
-            }
-            
-            /* Add or update role in inferred mappings */
-            if (generic_role != NULL) {
-                cJSON* existing_role = cJSON_GetObjectItemCaseSensitive(inferred_mappings, generic_role);
-                
-                if (existing_role == NULL) {
-                    /* Add new role mapping */
-                    cJSON_AddStringToObject(inferred_mappings, generic_role, pasivo_role);
-                } 
-                else if (cJSON_IsString(existing_role)) {
-                    /* Convert to array if different from existing */
-                    if (strcmp(existing_role->valuestring, pasivo_role) != 0) {
-                        /* Replace with array containing both values */
-                        cJSON* array = cJSON_CreateArray();
-                        if (array != NULL) {
-                            cJSON_AddItemToArray(array, cJSON_CreateString(existing_role->valuestring));
-                            cJSON_AddItemToArray(array, cJSON_CreateString(pasivo_role));
-                            
-                            /* Replace existing item with array */
-                            cJSON_ReplaceItemInObject(inferred_mappings, generic_role, array);
-                        }
+            else if (cJSON_IsString(existing_role)) {
+                /* Convert to array if different from existing */
+                if (strcmp(existing_role->valuestring, pasivo_role) != 0) {
+                    /* Replace with array containing both values */
+                    cJSON* array = cJSON_CreateArray();
+                    if (array != NULL) {
+                        cJSON_AddItemToArray(array, cJSON_CreateString(existing_role->valuestring));
+                        cJSON_AddItemToArray(array, cJSON_CreateString(pasivo_role));
+                        
+                        /* Replace existing item with array */
+                        cJSON_ReplaceItemInObject(inferred_mappings, generic_role, array);
                     }
                 }
-                else if (cJSON_IsArray(existing_role)) {
-                    /* Check if value already in array */
-                    bool found = false;
-                    cJSON* item;
-                    cJSON_ArrayForEach(item, existing_role) {
-                        if (cJSON_IsString(item) && strcmp(item->valuestring, pasivo_role) == 0) {
-                            found = true;
-                            break;
-                        }
-                    }
-                    
-                    /* Add to array if not found */
-                    if (!found) {
-                        cJSON_AddItemToArray(existing_role, cJSON_CreateString(pasivo_role));
+            }
+            else if (cJSON_IsArray(existing_role)) {
+                /* Check if value already in array */
+                bool found = false;
+                cJSON* item;
+                cJSON_ArrayForEach(item, existing_role) {
+                    if (cJSON_IsString(item) && strcmp(item->valuestring, pasivo_role) == 0) {
+                        found = true;
+                        break;
                     }
                 }
+                
+                /* Add to array if not found */
+                if (!found) {
+                    cJSON_AddItemToArray(existing_role, cJSON_CreateString(pasivo_role));
+                }
             }
-            
-            /* Extract other roles from action text */
-            /* This is a simple approach - in reality you would use NLP techniques */
-            if (strstr(accion->valuestring, "comprador") != NULL && 
-                strcmp(pasivo_role, "comprador") != 0) {
-                cJSON_AddStringToObject(inferred_mappings, "receptor", "comprador");
-            }
-            
-            if (strstr(accion->valuestring, "vendedor") != NULL && 
-                strcmp(pasivo_role, "vendedor") != 0) {
-                cJSON_AddStringToObject(inferred_mappings, "proveedor", "vendedor");
-            }
-            
-            if (strstr(accion->valuestring, "arrendador") != NULL && 
-                strcmp(pasivo_role, "arrendador") != 0) {
-                cJSON_AddStringToObject(inferred_mappings, "propietario", "arrendador");
-            }
-            
-            if (strstr(accion->valuestring, "arrendatario") != NULL && 
-                strcmp(pasivo_role, "arrendatario") != 0) {
-                cJSON_AddStringToObject(inferred_mappings, "usuario", "arrendatario");
-            }
+        }
+        
+        /* Extract other roles from action text */
+        /* This is a simple approach - in reality you would use NLP techniques */
+        if (strstr(accion, "comprador") != NULL && 
+            strcmp(pasivo_role, "comprador") != 0) {
+            cJSON_AddStringToObject(inferred_mappings, "receptor", "comprador");
+        }
+        
+        if (strstr(accion, "vendedor") != NULL && 
+            strcmp(pasivo_role, "vendedor") != 0) {
+            cJSON_AddStringToObject(inferred_mappings, "proveedor", "vendedor");
+        }
+        
+        if (strstr(accion, "arrendador") != NULL && 
+            strcmp(pasivo_role, "arrendador") != 0) {
+            cJSON_AddStringToObject(inferred_mappings, "propietario", "arrendador");
+        }
+        
+        if (strstr(accion, "arrendatario") != NULL && 
+            strcmp(pasivo_role, "arrendatario") != 0) {
+            cJSON_AddStringToObject(inferred_mappings, "usuario", "arrendatario");
         }
     }
     
@@ -612,3 +845,229 @@ cJSON* context_infer_role_mappings(const char* contract_type) {
     return inferred_mappings;
 }
 
+/* Norms per annotation task, in tasks per worker: enough for idle workers to steal */
+#define ANNOTATION_TASKS_PER_WORKER 4
+
+/* One annotation task: a run of consecutive norms, annotated with its own scratch */
+typedef struct {
+    Norm** norms;
+    int first;
+    int end;
+    const char* institution;
+    SharedSnapshot* context;        // Snapshot all tasks annotate against
+    ContextAnnotation* results;     // Shared array; each task writes only its own slots
+    bool ok;
+} AnnotationTask;
+
+/**
+ * Map a generic role to a specific one, returning an owned copy
+ */
+static char* map_role_owned(const char* contract_type, const char* generic_role) {
+    const ContextStore* legal_context = current_store();
+    if (contract_type == NULL || generic_role == NULL) {
+        return NULL;
+    }
+    
+    const ContextRoleMapping* mapping = context_store_find_mapping(legal_context, contract_type, generic_role);
+    if (mapping != NULL) {
+        return strdup(context_store_str(legal_context, legal_context->refs[mapping->roles]));
+    }
+    
+    char* result = NULL;
+    cJSON* inferred_mappings = context_infer_role_mappings(contract_type);
+    if (inferred_mappings != NULL) {
+        cJSON* specific_role = cJSON_GetObjectItemCaseSensitive(inferred_mappings, generic_role);
+        if (cJSON_IsArray(specific_role)) {
+            specific_role = cJSON_GetArrayItem(specific_role, 0);
+        }
+        if (cJSON_IsString(specific_role)) {
+            result = strdup(specific_role->valuestring);
+        }
+        cJSON_Delete(inferred_mappings);
+    }
+    
+    return result != NULL ? result : strdup(generic_role);
+}
+
+/**
+ * Annotate one norm, using the caller's scratch area
+ */
+static void annotate_norm(const char* institution, Norm* norm, ContextSearchScratch* scratch,
+                          ContextAnnotation* annotation) {
+    annotation->mapped_role = map_role_owned(institution, norm->role);
+    annotation->valid = context_validate_norm(norm);
+    annotation->related = norm->action != NULL ? related_articles(norm, scratch) : NULL;
+}
+
+/**
+ * Annotate the norms of one task
+ */
+static void annotate_task(void* arg) {
+    AnnotationTask* task = (AnnotationTask*)arg;
+    
+    /* Work on the caller's snapshot even if a newer one is published meanwhile */
+    SharedSnapshot* previous = pinned_context;
+    pinned_context = task->context;
+    
+    ContextSearchScratch* scratch = context_search_scratch_create(current_store());
+    if (scratch == NULL) {
+        pinned_context = previous;
+        task->ok = false;
+        return;
+    }
+    
+    for (int i = task->first; i < task->end; i++) {
+        annotate_norm(task->institution, task->norms[i], scratch, &task->results[i]);
+    }
+    
+    context_search_scratch_free(scratch);
+    pinned_context = previous;
+    task->ok = true;
+}
+
+/**
+ * Annotate every norm of a schema against the loaded context
+ */
+ContextAnnotation* context_annotate_schema(Schema* schema, int threads, int* count) {
+    *count = 0;
+    if (schema == NULL || current_context() == NULL) {
+        return NULL;
+    }
+    
+    int norm_count = 0;
+    for (Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        norm_count++;
+    }
+    if (norm_count == 0) {
+        return NULL;
+    }
+    
+    /* Results are written in place, so they come back in norm order */
+    Norm** norms = (Norm**)malloc(norm_count * sizeof(Norm*));
+    ContextAnnotation* results = (ContextAnnotation*)calloc(norm_count, sizeof(ContextAnnotation));
+    if (norms == NULL || results == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(norms);
+        free(results);
+        return NULL;
+    }
+    
+    int i = 0;
+    for (Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        norms[i++] = norm;
+    }
+    
+    /* Inside a task the norms go to the caller's pool, where idle workers steal them */
+    TaskScheduler* scheduler = task_scheduler_current();
+    TaskScheduler* own_scheduler = NULL;
+    if (scheduler == NULL) {
+        if (threads <= 0) {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = online > 0 ? (int)online : 1;
+        }
+        if (threads > norm_count) {
+            threads = norm_count;
+        }
+        if (threads > 1) {
+            own_scheduler = task_scheduler_create(threads);
+            scheduler = own_scheduler;
+        }
+    }
+    
+    int task_count = 1;
+    if (scheduler != NULL) {
+        task_count = task_scheduler_workers(scheduler) * ANNOTATION_TASKS_PER_WORKER;
+        if (task_count > norm_count) {
+            task_count = norm_count;
+        }
+    }
+    
+    AnnotationTask* tasks = (AnnotationTask*)calloc(task_count, sizeof(AnnotationTask));
+    if (tasks == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        task_scheduler_destroy(own_scheduler);
+        free(norms);
+        free(results);
+        return NULL;
+    }
+    
+    /* Hold the snapshot for the tasks until they are all done */
+    SharedSnapshot* context = pinned_context != NULL ? shared_snapshot_retain(pinned_context)
+                                                     : shared_snapshot_acquire(&context_slot);
+    
+    for (int t = 0; t < task_count; t++) {
+        tasks[t].norms = norms;
+        tasks[t].first = (int)((long)norm_count * t / task_count);
+        tasks[t].end = (int)((long)norm_count * (t + 1) / task_count);
+        tasks[t].institution = schema->institution.name;
+        tasks[t].context = context;
+        tasks[t].results = results;
+    }
+    
+    if (scheduler != NULL) {
+        TaskGroup group;
+        task_group_init(&group);
+        for (int t = 0; t < task_count; t++) {
+            task_spawn(scheduler, &group, annotate_task, &tasks[t]);
+        }
+        task_group_wait(scheduler, &group, 0);
+        task_group_destroy(&group);
+    } else {
+        annotate_task(&tasks[0]);
+    }
+    
+    bool ok = true;
+    for (int t = 0; t < task_count; t++) {
+        ok = ok && tasks[t].ok;
+    }
+    
+    shared_snapshot_release(context);
+    task_scheduler_destroy(own_scheduler);
+    free(tasks);
+    free(norms);
+    
+    if (!ok) {
+        context_free_annotations(results, norm_count);
+        return NULL;
+    }
+    
+    *count = norm_count;
+    return results;
+}
+
+/**
+ * Annotate one norm against the loaded context
+ */
+ContextAnnotation* context_annotate_norm(const char* institution, Norm* norm) {
+    ContextSnapshot* snapshot = current_context();
+    if (norm == NULL || snapshot == NULL) {
+        return NULL;
+    }
+    
+    ContextAnnotation* annotation = (ContextAnnotation*)calloc(1, sizeof(ContextAnnotation));
+    ContextSearchScratch* scratch = annotation != NULL ? borrow_scratch(snapshot) : NULL;
+    if (scratch == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(annotation);
+        return NULL;
+    }
+    
+    annotate_norm(institution, norm, scratch, annotation);
+    return_scratch(snapshot, scratch);
+    return annotation;
+}
+
+/**
+ * Free the annotations returned by context_annotate_schema()
+ */
+void context_free_annotations(ContextAnnotation* annotations, int count) {
+    if (annotations == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        free(annotations[i].mapped_role);
+        free(annotations[i].related);
+    }
+    free(annotations);
+}
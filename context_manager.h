@@ -13,6 +13,8 @@
 #include <stdbool.h>
 #include <cJSON.h>
 #include "schema_types.h"
+#include "context_store.h"
+#include "shared_snapshot.h"
 
 
 
@@ -43,11 +45,36 @@ char* generate_kelsen_code_with_context(Schema* schema);
 /**
  * Initialize the context manager with a JSON file
  * 
+ * Calling it again reloads the context: the new snapshot is built first
+ * and then published atomically, and threads that pinned the previous
+ * snapshot keep using it until they unpin. On failure the current
+ * context stays in place.
+ * 
  * @param context_file Path to the JSON context file
  * @return true if initialization succeeded, false otherwise
  */
 bool context_init(const char* context_file);
 
+/**
+ * Load a legal context file into a snapshot without publishing it
+ * 
+ * @param context_file Path to the JSON context file or compiled snapshot
+ * @return The snapshot (one reference, owned by the caller), or NULL on error
+ */
+SharedSnapshot* context_snapshot_load(const char* context_file);
+
+/**
+ * Make the calling thread use a given context snapshot
+ * 
+ * Replaces the thread's pin without touching reference counts; the
+ * caller keeps the snapshot alive while it is in use and restores the
+ * previous value when done.
+ * 
+ * @param snapshot Snapshot to use, or NULL to go back to the published one
+ * @return The snapshot the thread used before
+ */
+SharedSnapshot* context_use(SharedSnapshot* snapshot);
+
 /**
  * Check if the context manager is initialized
  * 
@@ -60,14 +87,53 @@ bool context_is_initialized(void);
  */
 void context_cleanup(void);
 
+/**
+ * Pin the published context to the calling thread
+ * 
+ * Until context_unpin(), every query made by the thread sees this
+ * snapshot, even if a reload publishes a newer one. Pins do not nest.
+ */
+void context_pin(void);
+
+/**
+ * Release the calling thread's pinned context
+ */
+void context_unpin(void);
+
+/**
+ * Get the loaded context tables
+ * 
+ * @return The context store, or NULL if no context is loaded
+ */
+const ContextStore* context_get_store(void);
+
+/**
+ * Get data derived from the calling thread's context, building it on first use
+ * 
+ * Entries are keyed by the build function, the key and the version. The
+ * data is built once per loaded context and version, is shared by every
+ * thread using that context and is destroyed with it, so it must not be
+ * modified after it is built. Entries of other versions are kept (a
+ * thread may still be using them) until the context is freed.
+ * 
+ * @param key Key passed to the build function (e.g., an institution name)
+ * @param version Version of the other state the build reads (e.g., config_snapshot_id())
+ * @param build Builds the data from the store, returning NULL on failure
+ * @param destroy Frees the data
+ * @return The data, or NULL if no context is loaded or the build failed
+ */
+const void* context_get_derived(const char* key, uint64_t version,
+                                void* (*build)(const ContextStore* store, const char* key),
+                                void (*destroy)(void* data));
+
 /**
  * Get a legal norm definition from the context
  * 
  * @param source The source identifier (e.g., "CODIGO_CIVIL")
  * @param norm_id The norm identifier (e.g., "Art1545")
- * @return A cJSON object representing the norm, or NULL if not found
+ * @return The norm entry in the context store, or NULL if not found
  */
-cJSON* context_get_norm(const char* source, const char* norm_id);
+const ContextNorm* context_get_norm(const char* source, const char* norm_id);
 
 /**
  * Check if a norm has a direct relationship with another norm
@@ -107,6 +173,29 @@ bool context_enrich_norm(Norm* norm, cJSON* context);
  */
 bool context_validate_norm(Norm* norm);
 
+/**
+ * Borrowed view of the norms relevant to a legal domain
+ */
+typedef struct {
+    const uint32_t* norms;      // Indices into the store's norm table, in document order
+    uint32_t count;             // Number of norms
+} ContextNormView;
+
+/**
+ * Get the norms relevant to a legal domain
+ * 
+ * A norm is relevant when one of its "contexto" entries is a substring
+ * of the domain. Domains named in the context are answered from the
+ * load-time index; any other domain is resolved on its first query and
+ * remembered. The view is borrowed from the calling thread's snapshot
+ * and stays valid while that snapshot is pinned (or, without a pin,
+ * until the context is cleaned up or replaced).
+ * 
+ * @param domain The legal domain (e.g., "derecho-patrimonial-privado")
+ * @return The relevant norms (empty if none or no context is loaded)
+ */
+ContextNormView context_get_domain_norms(const char* domain);
+
 /**
  * Get context information for a specific legal domain
  * 
@@ -123,6 +212,49 @@ cJSON* context_get_domain_info(const char* domain);
  */
 char* context_get_kelsen_annotations(Norm* norm);
 
+/**
+ * Context annotation of one schema norm
+ */
+typedef struct {
+    char* mapped_role;          // Specific role for the norm's role in the institution, or NULL
+    bool valid;                 // Result of context_validate_norm()
+    char* related;              // Related legal articles as comment lines, or NULL
+} ContextAnnotation;
+
+/**
+ * Annotate every norm of a schema against the loaded context
+ * 
+ * Norms are split into tasks, each with its own search scratch; the
+ * context itself is only read. Called from a task_scheduler worker, the
+ * tasks go to that scheduler so idle workers can steal them; otherwise
+ * a pool of the given size runs them. Annotations come back in norm
+ * order.
+ * 
+ * @param schema The schema whose norms to annotate
+ * @param threads Number of worker threads when not called from a worker
+ *                (0 = one per online CPU, 1 = annotate on the calling thread)
+ * @param count Receives the number of annotations
+ * @return Array of annotations (free with context_free_annotations()), or NULL
+ */
+ContextAnnotation* context_annotate_schema(Schema* schema, int threads, int* count);
+
+/**
+ * Annotate one norm against the loaded context
+ * 
+ * @param institution Institution whose roles the norm's role maps to
+ * @param norm The norm
+ * @return The annotation (free with context_free_annotations(annotation, 1)),
+ *         or NULL if no context is loaded
+ */
+ContextAnnotation* context_annotate_norm(const char* institution, Norm* norm);
+
+/**
+ * Free the annotations returned by context_annotate_schema()
+ * 
+ * @param annotations Annotations to free
+ * @param count Number of annotations
+ */
+void context_free_annotations(ContextAnnotation* annotations, int count);
 
 cJSON* context_infer_role_mappings(const char* contract_type);
 #endif /* CONTEXT_MANAGER_H */
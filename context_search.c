@@ -0,0 +1,254 @@
+/**
+ * context_search.c
+ *
+ * Implementation of term analysis and BM25 ranking of legal norms
+ */
+
+#include "context_search.h"
+#include "custom_tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* BM25 parameters */
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+/* Shortest stem left after removing a suffix */
+#define MIN_STEM_LENGTH 3
+
+/* Scratch state for one searcher */
+struct context_search_scratch {
+    double* scores;             // Accumulated score per norm (0 = untouched)
+    uint32_t* touched;          // Norms with a non-zero score
+    uint32_t norm_count;
+};
+
+/* Spanish suffixes removed by the stemmer, longest first (accents already folded) */
+static const char* suffixes[] = {
+    "amientos", "imientos", "aciones", "uciones", "amiento", "imiento", "adoras", "adores",
+    "ancias", "idades", "acion", "ucion", "adora", "ador", "ancia", "mente", "idad", "iendo",
+    "ieron", "ando", "aron", "aban", "ados", "idos", "adas", "idas", "ante", "aria", "aran",
+    "eran", "iran", "ado", "ido", "ada", "ida", "ara", "era", "ira", "aba", "ia", "ar", "er",
+    "ir", "os", "as", "es", "o", "a", "e", "s"
+};
+
+static const int num_suffixes = sizeof(suffixes) / sizeof(suffixes[0]);
+
+/**
+ * Check if a byte is part of a word (letters, digits, any UTF-8 sequence)
+ */
+static bool is_word_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+/**
+ * Lowercase a Latin-1 letter encoded as 0xC3 followed by `c`
+ */
+static unsigned char lower_latin1(unsigned char c) {
+    return (c >= 0x80 && c <= 0x9E && c != 0x97) ? (unsigned char)(c + 0x20) : c;
+}
+
+/**
+ * Plain vowel for an accented lowercase Latin-1 vowel, or 0 to keep it (e.g., ñ)
+ */
+static char fold_latin1(unsigned char c) {
+    if (c >= 0xA0 && c <= 0xA5) return 'a';
+    if (c >= 0xA8 && c <= 0xAB) return 'e';
+    if (c >= 0xAC && c <= 0xAF) return 'i';
+    if (c >= 0xB2 && c <= 0xB6) return 'o';
+    if (c >= 0xB9 && c <= 0xBC) return 'u';
+    return 0;
+}
+
+/**
+ * Remove the longest known suffix that leaves a long enough stem
+ */
+static void stem_term(char* term) {
+    size_t length = strlen(term);
+
+    for (int i = 0; i < num_suffixes; i++) {
+        size_t suffix_length = strlen(suffixes[i]);
+        if (length >= suffix_length + MIN_STEM_LENGTH &&
+            strcmp(term + length - suffix_length, suffixes[i]) == 0) {
+            term[length - suffix_length] = '\0';
+            return;
+        }
+    }
+}
+
+/**
+ * Read the next index term from a text
+ */
+bool context_search_next_term(const char** cursor, char* term) {
+    const unsigned char* p = (const unsigned char*)*cursor;
+
+    for (;;) {
+        /* Skip separators */
+        while (*p != '\0' && !is_word_byte(*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            *cursor = (const char*)p;
+            return false;
+        }
+
+        /* Lowercase the word (over-long words are truncated) */
+        char word[CONTEXT_SEARCH_MAX_TERM];
+        size_t length = 0;
+        while (*p != '\0' && is_word_byte(*p)) {
+            if (*p == 0xC3 && p[1] >= 0x80 && p[1] <= 0xBF) {
+                if (length + 2 < sizeof(word)) {
+                    word[length++] = (char)0xC3;
+                    word[length++] = (char)lower_latin1(p[1]);
+                }
+                p += 2;
+            } else {
+                if (length + 1 < sizeof(word)) {
+                    word[length++] = (char)((*p >= 'A' && *p <= 'Z') ? *p + ('a' - 'A') : *p);
+                }
+                p++;
+            }
+        }
+        word[length] = '\0';
+
+        if (is_noise_word(word)) {
+            continue;
+        }
+
+        /* Fold accented vowels */
+        size_t out = 0;
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = (unsigned char)word[i];
+            char folded = (c == 0xC3 && i + 1 < length) ? fold_latin1((unsigned char)word[i + 1]) : 0;
+            if (folded != 0) {
+                term[out++] = folded;
+                i++;
+            } else {
+                term[out++] = (char)c;
+            }
+        }
+        term[out] = '\0';
+
+        stem_term(term);
+        *cursor = (const char*)p;
+        return true;
+    }
+}
+
+/**
+ * Create a scratch area for searching a store
+ */
+ContextSearchScratch* context_search_scratch_create(const ContextStore* store) {
+    ContextSearchScratch* scratch = (ContextSearchScratch*)malloc(sizeof(ContextSearchScratch));
+    if (scratch == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    size_t count = store->norm_count > 0 ? store->norm_count : 1;
+    scratch->scores = (double*)calloc(count, sizeof(double));
+    scratch->touched = (uint32_t*)malloc(count * sizeof(uint32_t));
+    scratch->norm_count = store->norm_count;
+
+    if (scratch->scores == NULL || scratch->touched == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        context_search_scratch_free(scratch);
+        return NULL;
+    }
+
+    return scratch;
+}
+
+/**
+ * Free a scratch area
+ */
+void context_search_scratch_free(ContextSearchScratch* scratch) {
+    if (scratch == NULL) {
+        return;
+    }
+    free(scratch->scores);
+    free(scratch->touched);
+    free(scratch);
+}
+
+/**
+ * Check whether a hit ranks above another (ties keep document order)
+ */
+static bool ranks_above(const ContextSearchHit* a, const ContextSearchHit* b) {
+    return a->score > b->score || (a->score == b->score && a->norm < b->norm);
+}
+
+/**
+ * Find the norms whose action and object text best match a query
+ */
+int context_search_top(const ContextStore* store, ContextSearchScratch* scratch, const char* query,
+                       ContextSearchHit* hits, int max_hits) {
+    if (store == NULL || scratch == NULL || query == NULL || max_hits <= 0 ||
+        scratch->norm_count != store->norm_count || store->norm_count == 0) {
+        return 0;
+    }
+
+    double average_length = (double)store->term_total / store->norm_count;
+    if (average_length <= 0) {
+        return 0;
+    }
+
+    /* Distinct query terms */
+    char terms[32][CONTEXT_SEARCH_MAX_TERM];
+    int term_count = 0;
+    const char* cursor = query;
+    char term[CONTEXT_SEARCH_MAX_TERM];
+    while (term_count < 32 && context_search_next_term(&cursor, term)) {
+        bool seen = false;
+        for (int i = 0; i < term_count && !seen; i++) {
+            seen = strcmp(terms[i], term) == 0;
+        }
+        if (!seen) {
+            strcpy(terms[term_count++], term);
+        }
+    }
+
+    /* Accumulate BM25 scores over the terms' posting lists */
+    uint32_t touched_count = 0;
+    for (int t = 0; t < term_count; t++) {
+        const ContextPostingList* list = context_store_find_term(store, terms[t]);
+        if (list == NULL) continue;
+
+        double idf = log(1.0 + (store->norm_count - list->count + 0.5) / (list->count + 0.5));
+
+        for (uint32_t i = 0; i < list->count; i++) {
+            const ContextTermPosting* posting = &store->term_postings[list->first + i];
+            double frequency = posting->frequency;
+            double length = store->norms[posting->norm].term_count;
+            double weight = idf * frequency * (BM25_K1 + 1) /
+                            (frequency + BM25_K1 * (1 - BM25_B + BM25_B * length / average_length));
+
+            if (scratch->scores[posting->norm] == 0) {
+                scratch->touched[touched_count++] = posting->norm;
+            }
+            scratch->scores[posting->norm] += weight;
+        }
+    }
+
+    /* Keep the best hits by insertion, then reset the touched scores */
+    int hit_count = 0;
+    for (uint32_t i = 0; i < touched_count; i++) {
+        ContextSearchHit hit = { scratch->touched[i], scratch->scores[scratch->touched[i]] };
+        scratch->scores[hit.norm] = 0;
+
+        if (hit_count == max_hits && !ranks_above(&hit, &hits[hit_count - 1])) {
+            continue;
+        }
+
+        int at = hit_count < max_hits ? hit_count++ : hit_count - 1;
+        while (at > 0 && ranks_above(&hit, &hits[at - 1])) {
+            hits[at] = hits[at - 1];
+            at--;
+        }
+        hits[at] = hit;
+    }
+
+    return hit_count;
+}
@@ -0,0 +1,78 @@
+/**
+ * context_search.h
+ *
+ * Full-text retrieval of legal norms by the text of their action and
+ * object: Spanish-aware term analysis and BM25 ranking over the term
+ * index stored with the legal context
+ */
+
+#ifndef CONTEXT_SEARCH_H
+#define CONTEXT_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "context_store.h"
+
+/**
+ * Size of the buffer needed for one analyzed term
+ */
+#define CONTEXT_SEARCH_MAX_TERM 64
+
+/**
+ * One ranked search result
+ */
+typedef struct {
+    uint32_t norm;              // Index into the store's norm table
+    double score;               // BM25 score
+} ContextSearchHit;
+
+/**
+ * Per-caller working memory for searches
+ *
+ * A scratch area belongs to one thread at a time; the store itself is
+ * only read, so concurrent searches each use their own scratch.
+ */
+typedef struct context_search_scratch ContextSearchScratch;
+
+/**
+ * Read the next index term from a text
+ *
+ * Words are lowercased, accents are folded, stop words (the tokenizer's
+ * noise words) are skipped and the remaining words are stemmed.
+ *
+ * @param cursor In/out position in the text
+ * @param term Buffer receiving the term (CONTEXT_SEARCH_MAX_TERM bytes)
+ * @return true if a term was read, false at the end of the text
+ */
+bool context_search_next_term(const char** cursor, char* term);
+
+/**
+ * Create a scratch area for searching a store
+ *
+ * @param store The store to search
+ * @return A new scratch area, or NULL on allocation failure
+ */
+ContextSearchScratch* context_search_scratch_create(const ContextStore* store);
+
+/**
+ * Free a scratch area
+ *
+ * @param scratch Scratch area to free
+ */
+void context_search_scratch_free(ContextSearchScratch* scratch);
+
+/**
+ * Find the norms whose action and object text best match a query
+ *
+ * @param store The store to search
+ * @param scratch Scratch area created for this store
+ * @param query Free query text
+ * @param hits Array receiving the results, best first
+ * @param max_hits Size of the hits array
+ * @return Number of results stored in hits
+ */
+int context_search_top(const ContextStore* store, ContextSearchScratch* scratch, const char* query,
+                       ContextSearchHit* hits, int max_hits);
+
+#endif /* CONTEXT_SEARCH_H */
@@ -0,0 +1,1754 @@
+/**
+ * context_store.c
+ *
+ * Implementation of the compact legal context tables, their streaming
+ * loader and the binary snapshot image
+ */
+
+#include "context_store.h"
+#include "json_stream.h"
+#include "context_search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Snapshot image framing; every section starts on an aligned offset */
+#define CONTEXT_IMAGE_ALIGN 8
+#define CONTEXT_IMAGE_BYTE_ORDER 0x01020304u
+
+enum {
+    SECTION_STRINGS,
+    SECTION_REFS,
+    SECTION_SOURCES,
+    SECTION_NORMS,
+    SECTION_NORM_INDEX,
+    SECTION_ROLE_LISTS,
+    SECTION_ROLE_MAPPINGS,
+    SECTION_INSTITUTIONS,
+    SECTION_DOMAINS,
+    SECTION_POSTINGS,
+    SECTION_TERMS,
+    SECTION_TERM_POSTINGS,
+    SECTION_COUNT
+};
+
+/* Size of one item of each section (the string pool counts bytes) */
+static const size_t section_item_size[SECTION_COUNT] = {
+    1, sizeof(ContextStr), sizeof(ContextSource), sizeof(ContextNorm), sizeof(uint32_t),
+    sizeof(ContextRoleList), sizeof(ContextRoleMapping), sizeof(ContextPostingList),
+    sizeof(ContextPostingList), sizeof(uint32_t), sizeof(ContextPostingList), sizeof(ContextTermPosting)
+};
+
+typedef struct {
+    uint32_t offset;              // Byte offset from the start of the image
+    uint32_t count;               // Number of items
+} ContextSection;
+
+typedef struct {
+    char magic[8];                // CONTEXT_SNAPSHOT_MAGIC
+    uint32_t version;             // CONTEXT_SNAPSHOT_VERSION
+    uint32_t byte_order;          // CONTEXT_IMAGE_BYTE_ORDER as written by the producer
+    uint32_t total_size;          // Size of the whole image in bytes
+    uint32_t section_count;       // SECTION_COUNT
+    uint64_t content_hash;        // FNV-1a hash of everything after the header
+    uint64_t term_total;          // Sum of the norms' term counts
+    ContextSection sections[SECTION_COUNT];
+} ContextImageHeader;
+
+/* Longest name folded for institution lookups or split into domain substrings */
+#define CONTEXT_MAX_KEY 256
+
+/* Sort entry used while building the indexes */
+typedef struct {
+    ContextStr key;
+    uint32_t norm;
+} IndexEntry;
+
+/* Builder state used while streaming a context file into tables */
+typedef struct {
+    JsonStream* stream;
+
+    char* strings;
+    uint32_t strings_size;
+    uint32_t strings_capacity;
+
+    /* Open-addressing intern table of string offsets (0 = empty slot) */
+    uint32_t* slots;
+    uint32_t slot_capacity;
+    uint32_t slot_count;
+
+    ContextStr* refs;
+    uint32_t ref_count;
+    uint32_t ref_capacity;
+
+    ContextSource* sources;
+    uint32_t source_count;
+    uint32_t source_capacity;
+
+    ContextNorm* norms;
+    uint32_t norm_count;
+    uint32_t norm_capacity;
+
+    ContextRoleList* role_lists;
+    uint32_t role_list_count;
+    uint32_t role_list_capacity;
+
+    ContextRoleMapping* role_mappings;
+    uint32_t role_mapping_count;
+    uint32_t role_mapping_capacity;
+
+    /* Indexes built once parsing is complete */
+    uint32_t* norm_index;
+    ContextPostingList* institutions;
+    uint32_t institution_count;
+    ContextPostingList* domains;
+    uint32_t domain_count;
+    uint32_t* postings;
+    uint32_t posting_count;
+    ContextPostingList* terms;
+    uint32_t term_list_count;
+    ContextTermPosting* term_postings;
+    uint32_t term_posting_count;
+    uint64_t term_total;
+} ContextBuilder;
+
+/**
+ * FNV-1a hash of a string
+ */
+static uint32_t hash_string(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Make room for at least `needed` items in a growable array
+ */
+static bool reserve(void** items, uint32_t* capacity, uint32_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    uint32_t new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    void* grown = realloc(*items, (size_t)new_capacity * item_size);
+    if (grown == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Grow the intern table and rehash existing entries
+ */
+static bool grow_slots(ContextBuilder* builder) {
+    uint32_t capacity = builder->slot_capacity ? builder->slot_capacity * 2 : 1024;
+    uint32_t* slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < builder->slot_capacity; i++) {
+        uint32_t offset = builder->slots[i];
+        if (offset == 0) continue;
+
+        const char* text = builder->strings + offset;
+        uint32_t index = hash_string(text, strlen(text)) & (capacity - 1);
+        while (slots[index] != 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = offset;
+    }
+
+    free(builder->slots);
+    builder->slots = slots;
+    builder->slot_capacity = capacity;
+    return true;
+}
+
+/**
+ * Intern a string in the pool
+ */
+static bool intern(ContextBuilder* builder, const char* text, size_t length, ContextStr* out) {
+    if ((builder->slot_count + 1) * 2 > builder->slot_capacity && !grow_slots(builder)) {
+        return false;
+    }
+
+    uint32_t mask = builder->slot_capacity - 1;
+    uint32_t index = hash_string(text, length) & mask;
+
+    while (builder->slots[index] != 0) {
+        const char* existing = builder->strings + builder->slots[index];
+        if (strncmp(existing, text, length) == 0 && existing[length] == '\0') {
+            *out = builder->slots[index];
+            return true;
+        }
+        index = (index + 1) & mask;
+    }
+
+    if (!reserve((void**)&builder->strings, &builder->strings_capacity,
+                 builder->strings_size + (uint32_t)length + 1, 1)) {
+        return false;
+    }
+
+    uint32_t offset = builder->strings_size;
+    memcpy(builder->strings + offset, text, length);
+    builder->strings[offset + length] = '\0';
+    builder->strings_size += (uint32_t)length + 1;
+
+    builder->slots[index] = offset;
+    builder->slot_count++;
+
+    *out = offset;
+    return true;
+}
+
+/**
+ * Intern the text of the current token
+ */
+static bool intern_token(ContextBuilder* builder, ContextStr* out) {
+    return intern(builder, json_stream_text(builder->stream),
+                  json_stream_length(builder->stream), out);
+}
+
+/**
+ * Read the next member key of an object
+ *
+ * @return 1 if a key was read, 0 at the end of the object, -1 on error
+ */
+static int next_member(ContextBuilder* builder) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token == JSON_TOK_KEY) {
+        return 1;
+    }
+    if (token == JSON_TOK_OBJECT_END) {
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Skip the next value
+ */
+static bool skip_value(ContextBuilder* builder) {
+    return json_stream_skip(builder->stream, json_stream_next(builder->stream));
+}
+
+/**
+ * Read a string value; non-string values are skipped and leave `out` unchanged
+ */
+static bool read_string_value(ContextBuilder* builder, ContextStr* out) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token == JSON_TOK_STRING) {
+        return intern_token(builder, out);
+    }
+    return json_stream_skip(builder->stream, token);
+}
+
+/**
+ * Read a list of strings starting at an already-read token into the ref table
+ *
+ * Non-string array items are skipped. A bare string counts as a one-item
+ * list only when `allow_single` is set.
+ */
+static bool read_string_list(ContextBuilder* builder, JsonToken token, bool allow_single,
+                             uint32_t* first, uint32_t* count) {
+    *first = builder->ref_count;
+    *count = 0;
+
+    if (token == JSON_TOK_STRING && allow_single) {
+        if (!reserve((void**)&builder->refs, &builder->ref_capacity,
+                     builder->ref_count + 1, sizeof(ContextStr)) ||
+            !intern_token(builder, &builder->refs[builder->ref_count])) {
+            return false;
+        }
+        builder->ref_count++;
+        *count = 1;
+        return true;
+    }
+
+    if (token != JSON_TOK_ARRAY_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    for (;;) {
+        token = json_stream_next(builder->stream);
+        if (token == JSON_TOK_ARRAY_END) {
+            return true;
+        }
+
+        if (token == JSON_TOK_STRING) {
+            if (!reserve((void**)&builder->refs, &builder->ref_capacity,
+                         builder->ref_count + 1, sizeof(ContextStr)) ||
+                !intern_token(builder, &builder->refs[builder->ref_count])) {
+                return false;
+            }
+            builder->ref_count++;
+            (*count)++;
+        } else if (!json_stream_skip(builder->stream, token)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Parse a norm's "estructura" object
+ */
+static bool parse_estructura(ContextBuilder* builder, uint32_t norm_index) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    builder->norms[norm_index].flags |= CONTEXT_NORM_HAS_ESTRUCTURA;
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        const char* field = json_stream_text(builder->stream);
+        ContextNorm* norm = &builder->norms[norm_index];
+        bool ok;
+
+        if (strcmp(field, "condiciones") == 0) {
+            ok = read_string_list(builder, json_stream_next(builder->stream), false,
+                                  &norm->conditions, &norm->condition_count);
+        } else if (strcmp(field, "accion") == 0) {
+            ok = read_string_value(builder, &norm->accion);
+        } else if (strcmp(field, "activo") == 0) {
+            ok = read_string_value(builder, &norm->activo);
+        } else if (strcmp(field, "pasivo") == 0) {
+            ok = read_string_value(builder, &norm->pasivo);
+        } else if (strcmp(field, "deontico") == 0) {
+            ok = read_string_value(builder, &norm->deontico);
+        } else if (strcmp(field, "objeto") == 0) {
+            ok = read_string_value(builder, &norm->objeto);
+        } else {
+            ok = skip_value(builder);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return member == 0;
+}
+
+/**
+ * Parse one norm object under "normas"
+ */
+static bool parse_norm(ContextBuilder* builder, ContextStr key, uint32_t source_index) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    if (!reserve((void**)&builder->norms, &builder->norm_capacity,
+                 builder->norm_count + 1, sizeof(ContextNorm))) {
+        return false;
+    }
+
+    uint32_t norm_index = builder->norm_count;
+    memset(&builder->norms[norm_index], 0, sizeof(ContextNorm));
+    builder->norms[norm_index].key = key;
+    builder->norms[norm_index].source = source_index;
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        const char* field = json_stream_text(builder->stream);
+        ContextNorm* norm = &builder->norms[norm_index];
+        bool ok;
+
+        if (strcmp(field, "id") == 0) {
+            ok = read_string_value(builder, &norm->id);
+        } else if (strcmp(field, "estructura") == 0) {
+            ok = parse_estructura(builder, norm_index);
+        } else if (strcmp(field, "contexto") == 0) {
+            token = json_stream_next(builder->stream);
+            if (token == JSON_TOK_ARRAY_BEGIN) {
+                norm->flags |= CONTEXT_NORM_HAS_CONTEXTO;
+            }
+            ok = read_string_list(builder, token, false, &norm->contexts, &norm->context_count);
+        } else if (strcmp(field, "derivadaDe") == 0) {
+            ok = read_string_value(builder, &norm->derivada);
+        } else {
+            ok = skip_value(builder);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (member < 0) {
+        return false;
+    }
+
+    builder->norm_count++;
+    return true;
+}
+
+/**
+ * Parse one source object under "sources"
+ */
+static bool parse_source(ContextBuilder* builder, ContextStr key) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    if (!reserve((void**)&builder->sources, &builder->source_capacity,
+                 builder->source_count + 1, sizeof(ContextSource))) {
+        return false;
+    }
+
+    uint32_t source_index = builder->source_count++;
+    memset(&builder->sources[source_index], 0, sizeof(ContextSource));
+    builder->sources[source_index].key = key;
+    builder->sources[source_index].first_norm = builder->norm_count;
+    builder->sources[source_index].first_ref = builder->ref_count;
+    builder->sources[source_index].first_string = builder->strings_size;
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        const char* field = json_stream_text(builder->stream);
+        bool ok;
+
+        if (strcmp(field, "nombre") == 0) {
+            ok = read_string_value(builder, &builder->sources[source_index].nombre);
+        } else if (strcmp(field, "tipo") == 0) {
+            ok = read_string_value(builder, &builder->sources[source_index].tipo);
+        } else if (strcmp(field, "normas") == 0) {
+            token = json_stream_next(builder->stream);
+            if (token != JSON_TOK_OBJECT_BEGIN) {
+                ok = json_stream_skip(builder->stream, token);
+            } else {
+                int norm_member = 0;
+                ok = true;
+                while (ok && (norm_member = next_member(builder)) > 0) {
+                    ContextStr norm_key;
+                    ok = intern_token(builder, &norm_key) &&
+                         parse_norm(builder, norm_key, source_index);
+                }
+                ok = ok && norm_member == 0;
+            }
+        } else {
+            ok = skip_value(builder);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    builder->sources[source_index].norm_count =
+        builder->norm_count - builder->sources[source_index].first_norm;
+    builder->sources[source_index].ref_count =
+        builder->ref_count - builder->sources[source_index].first_ref;
+    builder->sources[source_index].string_size =
+        builder->strings_size - builder->sources[source_index].first_string;
+
+    return member == 0;
+}
+
+/**
+ * Parse the "sources" object
+ */
+static bool parse_sources(ContextBuilder* builder) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        ContextStr key;
+        if (!intern_token(builder, &key) || !parse_source(builder, key)) {
+            return false;
+        }
+    }
+
+    return member == 0;
+}
+
+/**
+ * Parse the "roles" object (institution -> list of roles)
+ */
+static bool parse_roles(ContextBuilder* builder) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        ContextStr institution;
+        if (!intern_token(builder, &institution) ||
+            !reserve((void**)&builder->role_lists, &builder->role_list_capacity,
+                     builder->role_list_count + 1, sizeof(ContextRoleList))) {
+            return false;
+        }
+
+        ContextRoleList list = { institution, 0, 0 };
+        if (!read_string_list(builder, json_stream_next(builder->stream), false,
+                              &list.roles, &list.role_count)) {
+            return false;
+        }
+        builder->role_lists[builder->role_list_count++] = list;
+    }
+
+    return member == 0;
+}
+
+/**
+ * Parse the "roleMappings" object (institution -> generic role -> role(s))
+ */
+static bool parse_role_mappings(ContextBuilder* builder) {
+    JsonToken token = json_stream_next(builder->stream);
+    if (token != JSON_TOK_OBJECT_BEGIN) {
+        return json_stream_skip(builder->stream, token);
+    }
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        ContextStr institution;
+        if (!intern_token(builder, &institution)) {
+            return false;
+        }
+
+        token = json_stream_next(builder->stream);
+        if (token != JSON_TOK_OBJECT_BEGIN) {
+            if (!json_stream_skip(builder->stream, token)) {
+                return false;
+            }
+            continue;
+        }
+
+        int mapping_member;
+        while ((mapping_member = next_member(builder)) > 0) {
+            ContextRoleMapping mapping = { institution, 0, 0, 0 };
+            if (!intern_token(builder, &mapping.generic_role) ||
+                !read_string_list(builder, json_stream_next(builder->stream), true,
+                                  &mapping.roles, &mapping.role_count)) {
+                return false;
+            }
+
+            if (mapping.role_count == 0) continue;
+
+            if (!reserve((void**)&builder->role_mappings, &builder->role_mapping_capacity,
+                         builder->role_mapping_count + 1, sizeof(ContextRoleMapping))) {
+                return false;
+            }
+            builder->role_mappings[builder->role_mapping_count++] = mapping;
+        }
+
+        if (mapping_member < 0) {
+            return false;
+        }
+    }
+
+    return member == 0;
+}
+
+/**
+ * Parse the whole document
+ */
+static bool parse_document(ContextBuilder* builder) {
+    if (json_stream_next(builder->stream) != JSON_TOK_OBJECT_BEGIN) {
+        return false;
+    }
+
+    int member;
+    while ((member = next_member(builder)) > 0) {
+        const char* field = json_stream_text(builder->stream);
+        bool ok;
+
+        if (strcmp(field, "sources") == 0) {
+            ok = parse_sources(builder);
+        } else if (strcmp(field, "roles") == 0) {
+            ok = parse_roles(builder);
+        } else if (strcmp(field, "roleMappings") == 0) {
+            ok = parse_role_mappings(builder);
+        } else {
+            ok = skip_value(builder);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return member == 0 && json_stream_next(builder->stream) == JSON_TOK_EOF;
+}
+
+/**
+ * Release the builder's working memory
+ */
+static void builder_free(ContextBuilder* builder) {
+    free(builder->strings);
+    free(builder->slots);
+    free(builder->refs);
+    free(builder->sources);
+    free(builder->norms);
+    free(builder->role_lists);
+    free(builder->role_mappings);
+    free(builder->norm_index);
+    free(builder->institutions);
+    free(builder->domains);
+    free(builder->postings);
+    free(builder->terms);
+    free(builder->term_postings);
+}
+
+/**
+ * Stable merge sort of index entries by key string, then by norm index
+ */
+static void sort_entries(IndexEntry* entries, IndexEntry* scratch, uint32_t count, const char* strings) {
+    if (count < 2) {
+        return;
+    }
+
+    uint32_t half = count / 2;
+    sort_entries(entries, scratch, half, strings);
+    sort_entries(entries + half, scratch, count - half, strings);
+
+    uint32_t left = 0, right = half, out = 0;
+    while (left < half && right < count) {
+        if (strcmp(strings + entries[right].key, strings + entries[left].key) < 0) {
+            scratch[out++] = entries[right++];
+        } else {
+            scratch[out++] = entries[left++];
+        }
+    }
+    while (left < half) {
+        scratch[out++] = entries[left++];
+    }
+    while (right < count) {
+        scratch[out++] = entries[right++];
+    }
+
+    memcpy(entries, scratch, (size_t)count * sizeof(IndexEntry));
+}
+
+/**
+ * Find the first norm of a source range in the key-sorted norm index
+ */
+static uint32_t lower_bound_norm(const char* strings, const ContextNorm* norms, const uint32_t* norm_index,
+                                 uint32_t first, uint32_t count, const char* key) {
+    uint32_t low = first, high = first + count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (strcmp(strings + norms[norm_index[middle]].key, key) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Build the key-sorted norm index of every source
+ */
+static bool build_norm_index(ContextBuilder* builder, IndexEntry* entries, IndexEntry* scratch) {
+    if (builder->norm_count == 0) {
+        return true;
+    }
+
+    builder->norm_index = (uint32_t*)malloc((size_t)builder->norm_count * sizeof(uint32_t));
+    if (builder->norm_index == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    for (uint32_t s = 0; s < builder->source_count; s++) {
+        const ContextSource* source = &builder->sources[s];
+        for (uint32_t n = 0; n < source->norm_count; n++) {
+            entries[n].key = builder->norms[source->first_norm + n].key;
+            entries[n].norm = source->first_norm + n;
+        }
+        sort_entries(entries, scratch, source->norm_count, builder->strings);
+        for (uint32_t n = 0; n < source->norm_count; n++) {
+            builder->norm_index[source->first_norm + n] = entries[n].norm;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Resolve "derivadaDe" references ("SOURCE.NormKey") to norm indices
+ *
+ * References whose source part is ambiguous or unknown stay unresolved.
+ */
+static void resolve_derivations(ContextBuilder* builder) {
+    for (uint32_t i = 0; i < builder->norm_count; i++) {
+        ContextNorm* norm = &builder->norms[i];
+        norm->derived_from = CONTEXT_NO_NORM;
+        if (norm->derivada == 0) continue;
+
+        const char* reference = builder->strings + norm->derivada;
+        const char* dot = strchr(reference, '.');
+        if (dot == NULL) continue;
+
+        size_t source_length = (size_t)(dot - reference);
+        for (uint32_t s = 0; s < builder->source_count; s++) {
+            const ContextSource* source = &builder->sources[s];
+            const char* source_key = builder->strings + source->key;
+            if (strncmp(source_key, reference, source_length) != 0 || source_key[source_length] != '\0') {
+                continue;
+            }
+
+            uint32_t at = lower_bound_norm(builder->strings, builder->norms, builder->norm_index,
+                                           source->first_norm, source->norm_count, dot + 1);
+            if (at < source->first_norm + source->norm_count &&
+                strcmp(builder->strings + builder->norms[builder->norm_index[at]].key, dot + 1) == 0) {
+                norm->derived_from = builder->norm_index[at];
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Turn (key, norm) entries into sorted posting lists appended to the postings table
+ */
+static bool build_postings(ContextBuilder* builder, IndexEntry* entries, IndexEntry* scratch, uint32_t count,
+                           ContextPostingList** lists, uint32_t* list_count) {
+    sort_entries(entries, scratch, count, builder->strings);
+
+    uint32_t capacity = 0;
+    uint32_t posting_capacity = builder->posting_count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0 || entries[i].key != entries[i - 1].key) {
+            if (!reserve((void**)lists, &capacity, *list_count + 1, sizeof(ContextPostingList))) {
+                return false;
+            }
+            ContextPostingList list = { entries[i].key, builder->posting_count, 0 };
+            (*lists)[(*list_count)++] = list;
+        }
+
+        if (!reserve((void**)&builder->postings, &posting_capacity,
+                     builder->posting_count + 1, sizeof(uint32_t))) {
+            return false;
+        }
+        builder->postings[builder->posting_count++] = entries[i].norm;
+        (*lists)[*list_count - 1].count++;
+    }
+
+    return true;
+}
+
+/**
+ * ASCII-lowercase a string into a buffer; returns false if it does not fit
+ */
+static bool fold_key(const char* text, char* folded, size_t size) {
+    size_t length = strlen(text);
+    if (length >= size) {
+        return false;
+    }
+
+    for (size_t k = 0; k <= length; k++) {
+        unsigned char ch = (unsigned char)text[k];
+        folded[k] = (char)(ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch);
+    }
+    return true;
+}
+
+/**
+ * Build the per-institution applicability lists from "condiciones"
+ *
+ * Keys are ASCII-lowercased so lookups match case-insensitively.
+ */
+static bool build_institution_index(ContextBuilder* builder, IndexEntry* entries, IndexEntry* scratch) {
+    uint32_t count = 0;
+    char folded[CONTEXT_MAX_KEY];
+
+    for (uint32_t i = 0; i < builder->norm_count; i++) {
+        const ContextNorm* norm = &builder->norms[i];
+        uint32_t norm_first = count;
+
+        for (uint32_t c = 0; c < norm->condition_count; c++) {
+            const char* condition = builder->strings + builder->refs[norm->conditions + c];
+            if (!fold_key(condition, folded, sizeof(folded))) continue;
+
+            ContextStr key;
+            if (!intern(builder, folded, strlen(folded), &key)) {
+                return false;
+            }
+
+            /* Each norm appears at most once per institution */
+            bool seen = false;
+            for (uint32_t k = norm_first; k < count && !seen; k++) {
+                seen = (entries[k].key == key);
+            }
+            if (seen) continue;
+
+            entries[count].key = key;
+            entries[count].norm = i;
+            count++;
+        }
+    }
+
+    return build_postings(builder, entries, scratch, count,
+                          &builder->institutions, &builder->institution_count);
+}
+
+/**
+ * Compare a pooled string with a (not NUL-terminated) substring
+ */
+static int compare_part(const char* key, const char* part, size_t length) {
+    int order = strncmp(key, part, length);
+    if (order != 0) {
+        return order;
+    }
+    return key[length] == '\0' ? 0 : 1;
+}
+
+/**
+ * Find a substring among the sorted distinct domain names
+ */
+static uint32_t find_domain_name(const char* strings, const ContextStr* names, uint32_t count,
+                                 const char* part, size_t length) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int order = compare_part(strings + names[middle], part, length);
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return CONTEXT_NO_NORM;
+}
+
+/**
+ * Link every domain name to the longer domain names that contain it
+ *
+ * Produces a compact adjacency: the names containing names[i] are
+ * wholes[starts[i]] .. wholes[starts[i + 1] - 1].
+ */
+static bool link_domain_names(const char* strings, const ContextStr* names, uint32_t count,
+                              uint32_t** starts_out, uint32_t** wholes_out) {
+    uint32_t* starts = (uint32_t*)calloc((size_t)count + 1, sizeof(uint32_t));
+    uint32_t* marks = (uint32_t*)malloc((size_t)count * sizeof(uint32_t));
+    uint32_t* wholes = NULL;
+    if (starts == NULL || marks == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(starts);
+        free(marks);
+        return false;
+    }
+
+    /* First pass counts the links of each part, second pass fills them in */
+    for (int pass = 0; pass < 2; pass++) {
+        memset(marks, 0xFF, (size_t)count * sizeof(uint32_t));
+
+        for (uint32_t whole = 0; whole < count; whole++) {
+            const char* text = strings + names[whole];
+            size_t length = strlen(text);
+
+            for (size_t i = 0; i <= length; i++) {
+                /* Long names only match themselves, to bound the enumeration */
+                if (length >= CONTEXT_MAX_KEY && i > 0) break;
+
+                for (size_t n = (i == 0 ? 0 : 1); i + n <= length; n++) {
+                    if (length >= CONTEXT_MAX_KEY && n != length) continue;
+
+                    uint32_t part = find_domain_name(strings, names, count, text + i, n);
+                    if (part == CONTEXT_NO_NORM || marks[part] == whole) continue;
+                    marks[part] = whole;
+
+                    if (pass == 0) {
+                        starts[part + 1]++;
+                    } else {
+                        wholes[starts[part]++] = whole;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (uint32_t i = 0; i < count; i++) {
+                starts[i + 1] += starts[i];
+            }
+            wholes = (uint32_t*)malloc((size_t)(starts[count] ? starts[count] : 1) * sizeof(uint32_t));
+            if (wholes == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                free(starts);
+                free(marks);
+                return false;
+            }
+        }
+    }
+
+    /* The fill pass advanced each start to the next part's start */
+    for (uint32_t i = count; i > 0; i--) {
+        starts[i] = starts[i - 1];
+    }
+    starts[0] = 0;
+
+    free(marks);
+    *starts_out = starts;
+    *wholes_out = wholes;
+    return true;
+}
+
+/**
+ * Build the per-domain lists from "contexto"
+ *
+ * A domain's list holds every norm with a contexto entry that is a
+ * substring of the domain name (so the exact match is included), which
+ * is the relevance rule of context_get_domain_info().
+ */
+static bool build_domain_index(ContextBuilder* builder, IndexEntry* entries, IndexEntry* scratch) {
+    /* Distinct domain names, sorted */
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < builder->norm_count; i++) {
+        const ContextNorm* norm = &builder->norms[i];
+        for (uint32_t c = 0; c < norm->context_count; c++) {
+            entries[count].key = builder->refs[norm->contexts + c];
+            entries[count].norm = 0;
+            count++;
+        }
+    }
+    sort_entries(entries, scratch, count, builder->strings);
+
+    ContextStr* names = (ContextStr*)malloc((size_t)(count ? count : 1) * sizeof(ContextStr));
+    if (names == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    uint32_t name_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (name_count == 0 || names[name_count - 1] != entries[i].key) {
+            names[name_count++] = entries[i].key;
+        }
+    }
+
+    uint32_t* starts;
+    uint32_t* wholes;
+    if (!link_domain_names(builder->strings, names, name_count, &starts, &wholes)) {
+        free(names);
+        return false;
+    }
+
+    /* One (domain, norm) entry per domain reached from the norm's contexto */
+    uint32_t needed = 0;
+    for (uint32_t i = 0; i < builder->norm_count; i++) {
+        const ContextNorm* norm = &builder->norms[i];
+        for (uint32_t c = 0; c < norm->context_count; c++) {
+            const char* text = builder->strings + builder->refs[norm->contexts + c];
+            uint32_t part = find_domain_name(builder->strings, names, name_count, text, strlen(text));
+            needed += starts[part + 1] - starts[part];
+        }
+    }
+
+    IndexEntry* links = (IndexEntry*)malloc((size_t)(needed ? needed : 1) * sizeof(IndexEntry));
+    IndexEntry* link_scratch = (IndexEntry*)malloc((size_t)(needed ? needed : 1) * sizeof(IndexEntry));
+    bool ok = links != NULL && link_scratch != NULL;
+
+    if (ok) {
+        uint32_t link_count = 0;
+        for (uint32_t i = 0; i < builder->norm_count; i++) {
+            const ContextNorm* norm = &builder->norms[i];
+            uint32_t norm_first = link_count;
+
+            for (uint32_t c = 0; c < norm->context_count; c++) {
+                const char* text = builder->strings + builder->refs[norm->contexts + c];
+                uint32_t part = find_domain_name(builder->strings, names, name_count, text, strlen(text));
+
+                for (uint32_t w = starts[part]; w < starts[part + 1]; w++) {
+                    ContextStr key = names[wholes[w]];
+
+                    bool seen = false;
+                    for (uint32_t k = norm_first; k < link_count && !seen; k++) {
+                        seen = (links[k].key == key);
+                    }
+                    if (seen) continue;
+
+                    links[link_count].key = key;
+                    links[link_count].norm = i;
+                    link_count++;
+                }
+            }
+        }
+
+        ok = build_postings(builder, links, link_scratch, link_count,
+                            &builder->domains, &builder->domain_count);
+    } else {
+        fprintf(stderr, "Memory allocation error\n");
+    }
+
+    free(links);
+    free(link_scratch);
+    free(starts);
+    free(wholes);
+    free(names);
+    return ok;
+}
+
+/**
+ * Add the analyzed terms of a text to the (term, norm) entry list
+ */
+static bool add_text_terms(ContextBuilder* builder, ContextStr text, uint32_t norm_index,
+                           IndexEntry** entries, uint32_t* count, uint32_t* capacity) {
+    if (text == 0) {
+        return true;
+    }
+
+    /* The pool may move while interning, so analyze a private copy */
+    char* copy = strdup(builder->strings + text);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    const char* cursor = copy;
+    char term[CONTEXT_SEARCH_MAX_TERM];
+    bool ok = true;
+    while (ok && context_search_next_term(&cursor, term)) {
+        ok = reserve((void**)entries, capacity, *count + 1, sizeof(IndexEntry)) &&
+             intern(builder, term, strlen(term), &(*entries)[*count].key);
+        if (ok) {
+            (*entries)[(*count)++].norm = norm_index;
+            builder->norms[norm_index].term_count++;
+            builder->term_total++;
+        }
+    }
+
+    free(copy);
+    return ok;
+}
+
+/**
+ * Build the full-text term index over each norm's accion and objeto
+ */
+static bool build_term_index(ContextBuilder* builder) {
+    IndexEntry* entries = NULL;
+    uint32_t count = 0, capacity = 0;
+    bool ok = true;
+
+    for (uint32_t i = 0; ok && i < builder->norm_count; i++) {
+        ok = add_text_terms(builder, builder->norms[i].accion, i, &entries, &count, &capacity) &&
+             add_text_terms(builder, builder->norms[i].objeto, i, &entries, &count, &capacity);
+    }
+
+    IndexEntry* scratch = NULL;
+    if (ok && count > 0) {
+        /* A term's postings never outnumber its occurrences */
+        scratch = (IndexEntry*)malloc((size_t)count * sizeof(IndexEntry));
+        builder->term_postings = (ContextTermPosting*)malloc((size_t)count * sizeof(ContextTermPosting));
+        ok = scratch != NULL && builder->term_postings != NULL;
+        if (!ok) {
+            fprintf(stderr, "Memory allocation error\n");
+        }
+    }
+
+    if (ok && count > 0) {
+        /* Stable sort keeps each term's norms in document order */
+        sort_entries(entries, scratch, count, builder->strings);
+
+        uint32_t list_capacity = 0;
+        for (uint32_t i = 0; ok && i < count; i++) {
+            bool new_term = (i == 0 || entries[i].key != entries[i - 1].key);
+            if (new_term) {
+                ok = reserve((void**)&builder->terms, &list_capacity, builder->term_list_count + 1,
+                             sizeof(ContextPostingList));
+                if (!ok) break;
+                ContextPostingList list = { entries[i].key, builder->term_posting_count, 0 };
+                builder->terms[builder->term_list_count++] = list;
+            }
+
+            if (!new_term && entries[i].norm == entries[i - 1].norm) {
+                builder->term_postings[builder->term_posting_count - 1].frequency++;
+            } else {
+                ContextTermPosting posting = { entries[i].norm, 1 };
+                builder->term_postings[builder->term_posting_count++] = posting;
+                builder->terms[builder->term_list_count - 1].count++;
+            }
+        }
+    }
+
+    free(entries);
+    free(scratch);
+    return ok;
+}
+
+/**
+ * Build all lookup indexes once parsing is complete
+ */
+static bool build_indexes(ContextBuilder* builder) {
+    /* Scratch space large enough for any of the entry lists */
+    uint32_t entry_count = builder->norm_count > builder->ref_count ? builder->norm_count : builder->ref_count;
+    if (entry_count == 0) {
+        return true;
+    }
+
+    IndexEntry* entries = (IndexEntry*)malloc((size_t)entry_count * sizeof(IndexEntry));
+    IndexEntry* scratch = (IndexEntry*)malloc((size_t)entry_count * sizeof(IndexEntry));
+    if (entries == NULL || scratch == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(entries);
+        free(scratch);
+        return false;
+    }
+
+    bool ok = build_norm_index(builder, entries, scratch);
+    if (ok) {
+        resolve_derivations(builder);
+        ok = build_institution_index(builder, entries, scratch) &&
+             build_domain_index(builder, entries, scratch) &&
+             build_term_index(builder);
+    }
+
+    free(entries);
+    free(scratch);
+    return ok;
+}
+
+/**
+ * Round a section size up to the image alignment
+ */
+static size_t align_section(size_t size) {
+    return (size + (CONTEXT_IMAGE_ALIGN - 1)) & ~(size_t)(CONTEXT_IMAGE_ALIGN - 1);
+}
+
+/**
+ * Hash the contents of an image (everything after the header)
+ */
+static uint64_t hash_image(const char* image, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = align_section(sizeof(ContextImageHeader)); i < size; i++) {
+        hash ^= (unsigned char)image[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Serialize the builder's tables into a single image
+ */
+static void* build_image(const ContextBuilder* builder, size_t* image_size) {
+    const void* data[SECTION_COUNT] = {
+        builder->strings, builder->refs, builder->sources, builder->norms, builder->norm_index,
+        builder->role_lists, builder->role_mappings, builder->institutions, builder->domains,
+        builder->postings, builder->terms, builder->term_postings
+    };
+    const uint32_t counts[SECTION_COUNT] = {
+        builder->strings_size, builder->ref_count, builder->source_count, builder->norm_count,
+        builder->norm_index != NULL ? builder->norm_count : 0,
+        builder->role_list_count, builder->role_mapping_count, builder->institution_count,
+        builder->domain_count, builder->posting_count, builder->term_list_count,
+        builder->term_posting_count
+    };
+
+    size_t size = align_section(sizeof(ContextImageHeader));
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        size += align_section((size_t)counts[i] * section_item_size[i]);
+    }
+
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "Context too large for a snapshot image\n");
+        return NULL;
+    }
+
+    char* image = (char*)calloc(1, size);
+    if (image == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    ContextImageHeader* header = (ContextImageHeader*)image;
+    memcpy(header->magic, CONTEXT_SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = CONTEXT_SNAPSHOT_VERSION;
+    header->byte_order = CONTEXT_IMAGE_BYTE_ORDER;
+    header->total_size = (uint32_t)size;
+    header->section_count = SECTION_COUNT;
+
+    size_t offset = align_section(sizeof(ContextImageHeader));
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        size_t bytes = (size_t)counts[i] * section_item_size[i];
+        header->sections[i].offset = (uint32_t)offset;
+        header->sections[i].count = counts[i];
+        if (bytes > 0) {
+            memcpy(image + offset, data[i], bytes);
+        }
+        offset += align_section(bytes);
+    }
+
+    header->content_hash = hash_image(image, size);
+    header->term_total = builder->term_total;
+
+    *image_size = size;
+    return image;
+}
+
+/**
+ * Check that a range of entries lies inside a table of count entries
+ */
+static bool in_table(uint32_t first, uint32_t length, uint32_t count) {
+    return (uint64_t)first + length <= count;
+}
+
+/**
+ * Check that a string reference is inside the pool (0 is the absent string)
+ */
+static bool valid_ref(const ContextStore* store, ContextStr ref) {
+    return ref < store->strings_size;
+}
+
+/**
+ * Check that a string reference names a string of the pool
+ */
+static bool present_ref(const ContextStore* store, ContextStr ref) {
+    return ref != 0 && ref < store->strings_size;
+}
+
+/**
+ * Check that a posting list is keyed and lies inside its table
+ */
+static bool valid_list(const ContextStore* store, const ContextPostingList* list, uint32_t count) {
+    return present_ref(store, list->key) && in_table(list->first, list->count, count);
+}
+
+/**
+ * Check every record of an attached image
+ *
+ * Lookups follow string references, norm indices and table ranges
+ * without checking them, so a snapshot whose contents do not hash to
+ * its header, or whose records point outside their tables, is rejected
+ * as a whole. Keys and list entries, which the builder always interns,
+ * must be present; other strings may be absent.
+ */
+static bool check_records(const ContextStore* store) {
+    for (uint32_t i = 0; i < store->ref_count; i++) {
+        if (!present_ref(store, store->refs[i])) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < store->source_count; i++) {
+        const ContextSource* source = &store->sources[i];
+        if (!present_ref(store, source->key) || !valid_ref(store, source->nombre) ||
+            !valid_ref(store, source->tipo) ||
+            !in_table(source->first_norm, source->norm_count, store->norm_count) ||
+            !in_table(source->first_ref, source->ref_count, store->ref_count) ||
+            !in_table(source->first_string, source->string_size, store->strings_size)) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < store->norm_count; i++) {
+        const ContextNorm* norm = &store->norms[i];
+        if (!present_ref(store, norm->key) || !valid_ref(store, norm->id) ||
+            !valid_ref(store, norm->accion) || !valid_ref(store, norm->activo) ||
+            !valid_ref(store, norm->pasivo) || !valid_ref(store, norm->deontico) ||
+            !valid_ref(store, norm->objeto) || !valid_ref(store, norm->derivada) ||
+            norm->source >= store->source_count ||
+            (norm->derived_from != CONTEXT_NO_NORM && norm->derived_from >= store->norm_count) ||
+            !in_table(norm->conditions, norm->condition_count, store->ref_count) ||
+            !in_table(norm->contexts, norm->context_count, store->ref_count) ||
+            store->norm_index[i] >= store->norm_count) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < store->role_list_count; i++) {
+        const ContextRoleList* list = &store->role_lists[i];
+        if (!present_ref(store, list->institution) || !in_table(list->roles, list->role_count, store->ref_count)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < store->role_mapping_count; i++) {
+        const ContextRoleMapping* mapping = &store->role_mappings[i];
+        if (!present_ref(store, mapping->institution) || !present_ref(store, mapping->generic_role) ||
+            !in_table(mapping->roles, mapping->role_count, store->ref_count)) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < store->institution_count; i++) {
+        if (!valid_list(store, &store->institutions[i], store->posting_count)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < store->domain_count; i++) {
+        if (!valid_list(store, &store->domains[i], store->posting_count)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < store->posting_count; i++) {
+        if (store->postings[i] >= store->norm_count) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < store->term_list_count; i++) {
+        if (!valid_list(store, &store->terms[i], store->term_posting_count)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < store->term_posting_count; i++) {
+        if (store->term_postings[i].norm >= store->norm_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Point a store's tables into an image, checking it first
+ *
+ * The header and section extents are checked, then the contents hash
+ * and every record (see check_records()). That reads the whole image
+ * once; sources are still only prefetched as lookups use them.
+ */
+static bool attach_image(ContextStore* store, const void* image, size_t image_size) {
+    const ContextImageHeader* header = (const ContextImageHeader*)image;
+
+    if (image_size < sizeof(ContextImageHeader) ||
+        memcmp(header->magic, CONTEXT_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CONTEXT_SNAPSHOT_VERSION ||
+        header->byte_order != CONTEXT_IMAGE_BYTE_ORDER ||
+        header->total_size != image_size ||
+        header->section_count != SECTION_COUNT) {
+        return false;
+    }
+
+    const char* base = (const char*)image;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        uint64_t offset = header->sections[i].offset;
+        uint64_t bytes = (uint64_t)header->sections[i].count * section_item_size[i];
+        if (offset % CONTEXT_IMAGE_ALIGN != 0 || offset + bytes > image_size) {
+            return false;
+        }
+    }
+
+    /* The string pool must start with the empty string and end with a terminator */
+    const ContextSection* strings = &header->sections[SECTION_STRINGS];
+    if (strings->count == 0 || base[strings->offset] != '\0' ||
+        base[strings->offset + strings->count - 1] != '\0') {
+        return false;
+    }
+
+    store->strings = base + strings->offset;
+    store->strings_size = strings->count;
+    store->refs = (const ContextStr*)(base + header->sections[SECTION_REFS].offset);
+    store->ref_count = header->sections[SECTION_REFS].count;
+    store->sources = (const ContextSource*)(base + header->sections[SECTION_SOURCES].offset);
+    store->source_count = header->sections[SECTION_SOURCES].count;
+    store->norms = (const ContextNorm*)(base + header->sections[SECTION_NORMS].offset);
+    store->norm_count = header->sections[SECTION_NORMS].count;
+    store->norm_index = (const uint32_t*)(base + header->sections[SECTION_NORM_INDEX].offset);
+    store->role_lists = (const ContextRoleList*)(base + header->sections[SECTION_ROLE_LISTS].offset);
+    store->role_list_count = header->sections[SECTION_ROLE_LISTS].count;
+    store->role_mappings = (const ContextRoleMapping*)(base + header->sections[SECTION_ROLE_MAPPINGS].offset);
+    store->role_mapping_count = header->sections[SECTION_ROLE_MAPPINGS].count;
+    store->institutions = (const ContextPostingList*)(base + header->sections[SECTION_INSTITUTIONS].offset);
+    store->institution_count = header->sections[SECTION_INSTITUTIONS].count;
+    store->domains = (const ContextPostingList*)(base + header->sections[SECTION_DOMAINS].offset);
+    store->domain_count = header->sections[SECTION_DOMAINS].count;
+    store->postings = (const uint32_t*)(base + header->sections[SECTION_POSTINGS].offset);
+    store->posting_count = header->sections[SECTION_POSTINGS].count;
+    store->terms = (const ContextPostingList*)(base + header->sections[SECTION_TERMS].offset);
+    store->term_list_count = header->sections[SECTION_TERMS].count;
+    store->term_postings = (const ContextTermPosting*)(base + header->sections[SECTION_TERM_POSTINGS].offset);
+    store->term_posting_count = header->sections[SECTION_TERM_POSTINGS].count;
+    store->term_total = header->term_total;
+
+    if (header->sections[SECTION_NORM_INDEX].count != store->norm_count ||
+        hash_image(base, image_size) != header->content_hash || !check_records(store)) {
+        return false;
+    }
+
+    store->image = image;
+    store->image_size = (uint32_t)image_size;
+    store->content_hash = header->content_hash;
+    return true;
+}
+
+/**
+ * Map a binary snapshot read-only
+ */
+static ContextStore* map_snapshot(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening context file: %s\n", filename);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > UINT32_MAX) {
+        fprintf(stderr, "Invalid context snapshot: %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* image = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Error mapping context snapshot: %s\n", filename);
+        return NULL;
+    }
+
+    /* Only read what lookups touch; sources are paged in as they are used */
+    madvise(image, size, MADV_RANDOM);
+
+    ContextStore* store = (ContextStore*)calloc(1, sizeof(ContextStore));
+    if (store == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        munmap(image, size);
+        return NULL;
+    }
+
+    if (!attach_image(store, image, size)) {
+        fprintf(stderr, "Invalid context snapshot: %s\n", filename);
+        munmap(image, size);
+        free(store);
+        return NULL;
+    }
+
+    store->source_loaded = (unsigned char*)calloc(store->source_count ? store->source_count : 1, 1);
+    if (store->source_loaded == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        munmap(image, size);
+        free(store);
+        return NULL;
+    }
+
+    store->mapped = true;
+    return store;
+}
+
+/**
+ * Check whether a file starts with the snapshot magic number
+ */
+static bool is_snapshot(FILE* file) {
+    char magic[sizeof(CONTEXT_SNAPSHOT_MAGIC) - 1];
+    bool match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                 memcmp(magic, CONTEXT_SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+    rewind(file);
+    return match;
+}
+
+/**
+ * Load a legal context file
+ */
+ContextStore* context_store_load(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening context file: %s\n", filename);
+        return NULL;
+    }
+
+    if (is_snapshot(file)) {
+        fclose(file);
+        return map_snapshot(filename);
+    }
+
+    ContextBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+
+    builder.stream = json_stream_open(file);
+    if (builder.stream == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    /* Offset 0 of the pool is reserved for absent strings */
+    bool ok = reserve((void**)&builder.strings, &builder.strings_capacity, 1, 1);
+    if (ok) {
+        builder.strings[0] = '\0';
+        builder.strings_size = 1;
+        ok = parse_document(&builder);
+
+        if (!ok) {
+            const char* error = json_stream_error(builder.stream);
+            fprintf(stderr, "Error parsing context file at line %d: %s\n",
+                    json_stream_line(builder.stream), error != NULL ? error : "unexpected structure");
+        }
+    }
+
+    json_stream_close(builder.stream);
+    fclose(file);
+
+    size_t image_size = 0;
+    void* image = NULL;
+    if (ok && build_indexes(&builder)) {
+        image = build_image(&builder, &image_size);
+    }
+    builder_free(&builder);
+
+    if (image == NULL) {
+        return NULL;
+    }
+
+    ContextStore* store = (ContextStore*)calloc(1, sizeof(ContextStore));
+    if (store == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(image);
+        return NULL;
+    }
+
+    attach_image(store, image, image_size);
+    return store;
+}
+
+/**
+ * Write a store's image to a binary snapshot file
+ */
+bool context_store_save(const ContextStore* store, const char* filename) {
+    if (store == NULL || filename == NULL) {
+        return false;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening snapshot file for writing: %s\n", filename);
+        return false;
+    }
+
+    bool ok = fwrite(store->image, 1, store->image_size, file) == store->image_size;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error writing snapshot file: %s\n", filename);
+        remove(filename);
+    }
+
+    return ok;
+}
+
+/**
+ * Free a context store
+ */
+void context_store_free(ContextStore* store) {
+    if (store == NULL) {
+        return;
+    }
+
+    if (store->mapped) {
+        munmap((void*)store->image, store->image_size);
+    } else {
+        free((void*)store->image);
+    }
+    free(store->source_loaded);
+    free(store);
+}
+
+/**
+ * Resolve a string reference
+ */
+const char* context_store_str(const ContextStore* store, ContextStr ref) {
+    if (store == NULL || ref == 0 || ref >= store->strings_size) {
+        return NULL;
+    }
+    return store->strings + ref;
+}
+
+/**
+ * Ask the kernel to read a byte range of a mapped image
+ */
+static void prefetch_range(const void* start, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)start & ~(page - 1);
+    uintptr_t end = (uintptr_t)start + length;
+    madvise((void*)first, end - first, MADV_WILLNEED);
+}
+
+/**
+ * Make sure a source's tables are paged in
+ */
+void context_store_load_source(const ContextStore* store, uint32_t source) {
+    if (store == NULL || !store->mapped || source >= store->source_count ||
+        __atomic_exchange_n(&store->source_loaded[source], 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    const ContextSource* src = &store->sources[source];
+    prefetch_range(store->norms + src->first_norm, (size_t)src->norm_count * sizeof(ContextNorm));
+    prefetch_range(store->refs + src->first_ref, (size_t)src->ref_count * sizeof(ContextStr));
+    prefetch_range(store->strings + src->first_string, src->string_size);
+}
+
+/**
+ * Count the sources paged in so far
+ */
+uint32_t context_store_loaded_sources(const ContextStore* store) {
+    if (store == NULL) {
+        return 0;
+    }
+    if (!store->mapped) {
+        return store->source_count;
+    }
+
+    uint32_t loaded = 0;
+    for (uint32_t i = 0; i < store->source_count; i++) {
+        loaded += __atomic_load_n(&store->source_loaded[i], __ATOMIC_ACQUIRE);
+    }
+    return loaded;
+}
+
+/**
+ * Find a source by key
+ */
+const ContextSource* context_store_find_source(const ContextStore* store, const char* key) {
+    if (store == NULL || key == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < store->source_count; i++) {
+        if (strcmp(context_store_str(store, store->sources[i].key), key) == 0) {
+            return &store->sources[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Find a norm by source key and norm key
+ */
+const ContextNorm* context_store_find_norm(const ContextStore* store, const char* source, const char* norm_key) {
+    const ContextSource* src = context_store_find_source(store, source);
+    if (src == NULL || norm_key == NULL) {
+        return NULL;
+    }
+
+    context_store_load_source(store, (uint32_t)(src - store->sources));
+
+    uint32_t at = lower_bound_norm(store->strings, store->norms, store->norm_index,
+                                   src->first_norm, src->norm_count, norm_key);
+    if (at < src->first_norm + src->norm_count) {
+        const ContextNorm* norm = &store->norms[store->norm_index[at]];
+        if (strcmp(context_store_str(store, norm->key), norm_key) == 0) {
+            return norm;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Find the role list of an institution
+ */
+const ContextRoleList* context_store_find_roles(const ContextStore* store, const char* institution) {
+    if (store == NULL || institution == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < store->role_list_count; i++) {
+        if (strcasecmp(context_store_str(store, store->role_lists[i].institution), institution) == 0) {
+            return &store->role_lists[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Find a role mapping for an institution and generic role
+ */
+const ContextRoleMapping* context_store_find_mapping(const ContextStore* store, const char* institution,
+                                                     const char* generic_role) {
+    if (store == NULL || institution == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < store->role_mapping_count; i++) {
+        const ContextRoleMapping* mapping = &store->role_mappings[i];
+        if (strcmp(context_store_str(store, mapping->institution), institution) != 0) {
+            continue;
+        }
+        if (generic_role == NULL ||
+            strcmp(context_store_str(store, mapping->generic_role), generic_role) == 0) {
+            return mapping;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Binary search a sorted table of posting lists
+ */
+static const ContextPostingList* find_posting_list(const ContextStore* store, const ContextPostingList* lists,
+                                                   uint32_t count, const char* key) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int order = strcmp(store->strings + lists[middle].key, key);
+        if (order == 0) {
+            return &lists[middle];
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the norms whose conditions name an institution
+ */
+const ContextPostingList* context_store_find_institution(const ContextStore* store, const char* institution) {
+    char folded[CONTEXT_MAX_KEY];
+    if (store == NULL || institution == NULL || !fold_key(institution, folded, sizeof(folded))) {
+        return NULL;
+    }
+
+    return find_posting_list(store, store->institutions, store->institution_count, folded);
+}
+
+/**
+ * Find the norms relevant to a domain name
+ */
+const ContextPostingList* context_store_find_domain(const ContextStore* store, const char* domain) {
+    if (store == NULL || domain == NULL) {
+        return NULL;
+    }
+
+    return find_posting_list(store, store->domains, store->domain_count, domain);
+}
+
+/**
+ * Find the posting list of an analyzed full-text term
+ */
+const ContextPostingList* context_store_find_term(const ContextStore* store, const char* term) {
+    if (store == NULL || term == NULL) {
+        return NULL;
+    }
+
+    return find_posting_list(store, store->terms, store->term_list_count, term);
+}
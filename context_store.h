@@ -0,0 +1,294 @@
+/**
+ * context_store.h
+ *
+ * Compact in-memory tables holding the parts of a legal context file
+ * that the context subsystem uses (sources, norms, roles, role mappings),
+ * and the binary snapshot format they are stored in
+ */
+
+#ifndef CONTEXT_STORE_H
+#define CONTEXT_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Reference to a string in the store's string pool
+ *
+ * Strings are interned; 0 means the field was absent (or not a string).
+ */
+typedef uint32_t ContextStr;
+
+/**
+ * Marker for an unresolved norm index
+ */
+#define CONTEXT_NO_NORM UINT32_MAX
+
+/**
+ * Norm flags
+ */
+#define CONTEXT_NORM_HAS_ESTRUCTURA 0x1  // The norm had an "estructura" object
+#define CONTEXT_NORM_HAS_CONTEXTO   0x2  // The norm had a "contexto" array
+
+/**
+ * Structure for a legal norm (one entry under a source's "normas")
+ */
+typedef struct context_norm {
+    ContextStr key;               // Key under "normas" (e.g., "Art2398")
+    ContextStr id;                // "id" field
+    uint32_t source;              // Index of the owning source
+    uint32_t flags;               // CONTEXT_NORM_* flags
+    ContextStr accion;            // estructura.accion
+    ContextStr activo;            // estructura.activo
+    ContextStr pasivo;            // estructura.pasivo
+    ContextStr deontico;          // estructura.deontico
+    ContextStr objeto;            // estructura.objeto
+    ContextStr derivada;          // "derivadaDe" field
+    uint32_t derived_from;        // Index of the norm named by derivadaDe, or CONTEXT_NO_NORM
+    uint32_t conditions;          // First entry of estructura.condiciones in the ref table
+    uint32_t condition_count;     // Number of conditions
+    uint32_t contexts;            // First entry of "contexto" in the ref table
+    uint32_t context_count;       // Number of context entries
+    uint32_t term_count;          // Number of indexed terms in accion and objeto
+} ContextNorm;
+
+/**
+ * Structure for a legal source (e.g., "CODIGO_CIVIL")
+ */
+typedef struct context_source {
+    ContextStr key;               // Key under "sources"
+    ContextStr nombre;            // "nombre" field
+    ContextStr tipo;              // "tipo" field
+    uint32_t first_norm;          // Index of the first norm of this source
+    uint32_t norm_count;          // Number of norms in this source
+    uint32_t first_ref;           // First ref table entry added by this source
+    uint32_t ref_count;           // Number of ref table entries added by this source
+    uint32_t first_string;        // Pool offset of the first string added by this source
+    uint32_t string_size;         // Bytes of pool added by this source
+} ContextSource;
+
+/**
+ * Structure for the role list of an institution ("roles" section)
+ */
+typedef struct context_role_list {
+    ContextStr institution;       // Institution name
+    uint32_t roles;               // First role in the ref table
+    uint32_t role_count;          // Number of roles
+} ContextRoleList;
+
+/**
+ * Structure for one generic-to-specific role mapping ("roleMappings" section)
+ */
+typedef struct context_role_mapping {
+    ContextStr institution;       // Institution (contract type)
+    ContextStr generic_role;      // Generic role (e.g., "deudor")
+    uint32_t roles;               // First mapped role in the ref table
+    uint32_t role_count;          // Number of mapped roles
+} ContextRoleMapping;
+
+/**
+ * Structure for a list of norm indices keyed by a string
+ *
+ * Used for the per-institution applicability lists (keyed by the
+ * lowercased institution named in "condiciones") and the per-domain
+ * lists (keyed by "contexto" entries, holding every norm with a contexto
+ * entry that is a substring of the key). Lists are sorted by key and the
+ * norms of a list are in document order.
+ */
+typedef struct context_posting_list {
+    ContextStr key;               // Lookup key
+    uint32_t first;               // First norm index in the postings table
+    uint32_t count;               // Number of norms
+} ContextPostingList;
+
+/**
+ * Structure for one norm in a term's posting list
+ */
+typedef struct context_term_posting {
+    uint32_t norm;                // Norm index
+    uint32_t frequency;           // Occurrences of the term in the norm's accion and objeto
+} ContextTermPosting;
+
+/**
+ * Structure for a loaded legal context
+ *
+ * All tables live in a single position-independent image: every
+ * cross-reference is an offset or an index, so the image can be written
+ * to disk as-is and mapped back read-only. Norms of a source are stored
+ * contiguously in document order, and so are the refs and strings it
+ * introduced, so the source table doubles as a table of contents: a
+ * mapped snapshot only reads a source's pages once it is used.
+ */
+typedef struct context_store {
+    const char* strings;              // String pool
+    uint32_t strings_size;            // Size of the string pool in bytes
+    const ContextStr* refs;           // Shared table of string lists
+    uint32_t ref_count;
+    const ContextSource* sources;
+    uint32_t source_count;
+    const ContextNorm* norms;
+    uint32_t norm_count;
+    const uint32_t* norm_index;       // Norm indices sorted by key within each source
+    const ContextRoleList* role_lists;
+    uint32_t role_list_count;
+    const ContextRoleMapping* role_mappings;
+    uint32_t role_mapping_count;
+    const ContextPostingList* institutions;   // Applicability lists from "condiciones"
+    uint32_t institution_count;
+    const ContextPostingList* domains;        // Domain lists from "contexto"
+    uint32_t domain_count;
+    const uint32_t* postings;                 // Norm indices referenced by posting lists
+    uint32_t posting_count;
+    const ContextPostingList* terms;          // Full-text term lists (into term_postings)
+    uint32_t term_list_count;
+    const ContextTermPosting* term_postings;
+    uint32_t term_posting_count;
+    uint64_t term_total;                      // Sum of the norms' term counts
+
+    const void* image;                // Backing image
+    uint32_t image_size;
+    uint64_t content_hash;            // Hash of the image contents, to key derived caches
+    bool mapped;                      // Image is a read-only file mapping
+    unsigned char* source_loaded;     // Per-source "paged in" flags (mapped images only)
+} ContextStore;
+
+/**
+ * Snapshot file identification
+ */
+#define CONTEXT_SNAPSHOT_MAGIC "SVCTXIMG"
+#define CONTEXT_SNAPSHOT_VERSION 5
+
+/**
+ * Load a legal context file
+ *
+ * Binary snapshots (recognized by their magic number) are mapped
+ * read-only with no parsing; anything else is read as JSON with the
+ * streaming reader, retaining only the fields used by the context
+ * subsystem.
+ *
+ * @param filename Path to the JSON context file or snapshot
+ * @return The loaded store, or NULL on error
+ */
+ContextStore* context_store_load(const char* filename);
+
+/**
+ * Write a store's image to a binary snapshot file
+ *
+ * @param store The store to save
+ * @param filename Path of the snapshot to write
+ * @return true on success, false otherwise
+ */
+bool context_store_save(const ContextStore* store, const char* filename);
+
+/**
+ * Free a context store
+ *
+ * @param store Store to free
+ */
+void context_store_free(ContextStore* store);
+
+/**
+ * Resolve a string reference
+ *
+ * @param store The store
+ * @param ref String reference
+ * @return The string, or NULL if the reference is absent
+ */
+const char* context_store_str(const ContextStore* store, ContextStr ref);
+
+/**
+ * Make sure a source's tables are paged in
+ *
+ * For mapped snapshots the first call for a source asks the kernel to
+ * read the source's norms, refs and strings in one go; later calls and
+ * in-memory stores do nothing. Safe to call from several threads.
+ *
+ * @param store The store
+ * @param source Source index
+ */
+void context_store_load_source(const ContextStore* store, uint32_t source);
+
+/**
+ * Count the sources paged in so far
+ *
+ * @param store The store
+ * @return Number of sources loaded (all of them for in-memory stores)
+ */
+uint32_t context_store_loaded_sources(const ContextStore* store);
+
+/**
+ * Find a source by key
+ *
+ * @param store The store
+ * @param key Source key (e.g., "CODIGO_CIVIL")
+ * @return The source, or NULL if not found
+ */
+const ContextSource* context_store_find_source(const ContextStore* store, const char* key);
+
+/**
+ * Find a norm by source key and norm key
+ *
+ * @param store The store
+ * @param source Source key
+ * @param norm_key Norm key (e.g., "Art2398")
+ * @return The norm, or NULL if not found
+ */
+const ContextNorm* context_store_find_norm(const ContextStore* store, const char* source, const char* norm_key);
+
+/**
+ * Find the role list of an institution (case-insensitive)
+ *
+ * @param store The store
+ * @param institution Institution name
+ * @return The role list, or NULL if not found
+ */
+const ContextRoleList* context_store_find_roles(const ContextStore* store, const char* institution);
+
+/**
+ * Find a role mapping for an institution and generic role
+ *
+ * @param store The store
+ * @param institution Institution (contract type)
+ * @param generic_role Generic role, or NULL for the first mapping of the institution
+ * @return The mapping, or NULL if not found
+ */
+const ContextRoleMapping* context_store_find_mapping(const ContextStore* store, const char* institution,
+                                                     const char* generic_role);
+
+/**
+ * Find the norms whose "condiciones" name an institution (case-insensitive)
+ *
+ * The norm indices of the list are store->postings[list->first] onwards,
+ * in document order (and therefore grouped by source).
+ *
+ * @param store The store
+ * @param institution Institution name
+ * @return The applicability list, or NULL if no norm applies
+ */
+const ContextPostingList* context_store_find_institution(const ContextStore* store, const char* institution);
+
+/**
+ * Find the norms relevant to a domain that appears in some "contexto"
+ *
+ * A norm is relevant when one of its contexto entries is a substring of
+ * the domain. Domains that no norm names directly are not indexed.
+ *
+ * @param store The store
+ * @param domain Domain name
+ * @return The domain's norm list, or NULL if the domain is not indexed
+ */
+const ContextPostingList* context_store_find_domain(const ContextStore* store, const char* domain);
+
+/**
+ * Find the posting list of an analyzed full-text term
+ *
+ * Terms are produced by context_search_next_term() from each norm's
+ * estructura.accion and estructura.objeto.
+ *
+ * @param store The store
+ * @param term Analyzed term
+ * @return The term's postings, or NULL if no norm contains it
+ */
+const ContextPostingList* context_store_find_term(const ContextStore* store, const char* term);
+
+#endif /* CONTEXT_STORE_H */
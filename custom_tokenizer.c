@@ -5,27 +5,38 @@
  */
 
 #include "custom_tokenizer.h"
+#include "config_validator.h"
 #include "schema_parser.tab.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 
-/* Global variable for semantic values */
-extern YYSTYPE yylval;
+/* Buffer size for the current line */
+#define MAX_LINE_LENGTH 4096
 
 /* Tokenizer state */
-static FILE* input_file = NULL;
-static int current_line = 1;
-static int current_column = 1;
-static char* current_token_text = NULL;
+struct tokenizer {
+    FILE* input_file;
+    FILE* trace;                        // Token trace output, or NULL
+    int current_line;
+    int current_column;
+    char* current_token_text;
+    const char* correction;             // Keyword the current word was read as, or NULL
+    int candidate;                      // Keyword token the current STRING may be a misspelling of, or 0
+    bool lookahead;                     // A copy reading ahead, kept to the current line
+    
+    /* Buffer for the current line */
+    char line_buffer[MAX_LINE_LENGTH];
+    int line_position;
+    int line_length;
+};
 
-/* Buffer for the current line */
-#define MAX_LINE_LENGTH 4096
-static char line_buffer[MAX_LINE_LENGTH];
-static int line_position = 0;
-static int line_length = 0;
+/* Write a token trace line if tracing is enabled */
+#define TRACE(t, ...) do { if ((t)->trace != NULL) fprintf((t)->trace, __VA_ARGS__); } while (0)
 
 /* Noise word list */
 static const char* noise_words[] = {
@@ -61,15 +72,15 @@ bool is_noise_word(const char* word) {
 /**
  * Read a new line from input
  */
-static bool read_line() {
-    if (fgets(line_buffer, MAX_LINE_LENGTH, input_file) == NULL) {
+static bool read_line(Tokenizer* t) {
+    if (t->lookahead || fgets(t->line_buffer, MAX_LINE_LENGTH, t->input_file) == NULL) {
         return false;
     }
     
-    line_length = strlen(line_buffer);
-    line_position = 0;
-    current_line++;
-    current_column = 1;
+    t->line_length = strlen(t->line_buffer);
+    t->line_position = 0;
+    t->current_line++;
+    t->current_column = 1;
     
     return true;
 }
@@ -77,16 +88,16 @@ static bool read_line() {
 /**
  * Skip whitespace and other separators
  */
-static void skip_separators() {
-    while (line_position < line_length) {
-        if (is_separator(line_buffer[line_position])) {
-            if (line_buffer[line_position] == '\n') {
-                if (!read_line()) {
+static void skip_separators(Tokenizer* t) {
+    while (t->line_position < t->line_length) {
+        if (is_separator(t->line_buffer[t->line_position])) {
+            if (t->line_buffer[t->line_position] == '\n') {
+                if (!read_line(t)) {
                     return;
                 }
             } else {
-                line_position++;
-                current_column++;
+                t->line_position++;
+                t->current_column++;
             }
         } else {
             break;
@@ -97,33 +108,33 @@ static void skip_separators() {
 /**
  * Free the current token text
  */
-static void free_current_token() {
-    if (current_token_text != NULL) {
-        free(current_token_text);
-        current_token_text = NULL;
+static void free_current_token(Tokenizer* t) {
+    if (t->current_token_text != NULL) {
+        free(t->current_token_text);
+        t->current_token_text = NULL;
     }
 }
 
 /**
  * Extract a word from the current position
  */
-static char* extract_word() {
-    int start = line_position;
+static char* extract_word(Tokenizer* t) {
+    int start = t->line_position;
     
     /* Find the end of the word */
-    while (line_position < line_length && !is_separator(line_buffer[line_position])) {
-        line_position++;
-        current_column++;
+    while (t->line_position < t->line_length && !is_separator(t->line_buffer[t->line_position])) {
+        t->line_position++;
+        t->current_column++;
     }
     
     /* Extract the word */
-    int length = line_position - start;
+    int length = t->line_position - start;
     char* word = (char*)malloc(length + 1);
     if (word == NULL) {
         return NULL;
     }
     
-    strncpy(word, line_buffer + start, length);
+    strncpy(word, t->line_buffer + start, length);
     word[length] = '\0';
     
     return word;
@@ -132,33 +143,33 @@ static char* extract_word() {
 /**
  * Extract a quoted string
  */
-static char* extract_quoted_string() {
+static char* extract_quoted_string(Tokenizer* t) {
     /* Skip the opening quote */
-    line_position++;
-    current_column++;
+    t->line_position++;
+    t->current_column++;
     
-    int start = line_position;
+    int start = t->line_position;
     
     /* Find the end of the string */
-    while (line_position < line_length && line_buffer[line_position] != '"') {
-        line_position++;
-        current_column++;
+    while (t->line_position < t->line_length && t->line_buffer[t->line_position] != '"') {
+        t->line_position++;
+        t->current_column++;
     }
     
     /* Extract the string */
-    int length = line_position - start;
+    int length = t->line_position - start;
     char* string = (char*)malloc(length + 1);
     if (string == NULL) {
         return NULL;
     }
     
-    strncpy(string, line_buffer + start, length);
+    strncpy(string, t->line_buffer + start, length);
     string[length] = '\0';
     
     /* Skip the closing quote */
-    if (line_position < line_length && line_buffer[line_position] == '"') {
-        line_position++;
-        current_column++;
+    if (t->line_position < t->line_length && t->line_buffer[t->line_position] == '"') {
+        t->line_position++;
+        t->current_column++;
     }
     
     return string;
@@ -222,34 +233,223 @@ static bool starts_with(const char* word, const char* prefix) {
     return strncasecmp(word, prefix, strlen(prefix)) == 0;
 }
 
+/* Keywords a misspelled word is matched against when it is no token, and the tokens that may follow them */
+static const struct {
+    const char* keyword;
+    int token;
+    int follows[2];
+} fuzzy_keywords[] = {
+    { "regla", REGLA, { NUMBER } },
+    { "debe", DEBE, { STRING } },
+    { "no-debe", NO_DEBE, { STRING } },
+    { "puede", PUEDE, { STRING } },
+    { "tiene-derecho-a", TIENE_DERECHO, { STRING } },
+    { "en-caso-que", EN_CASO_QUE, { STRING, REGLA } },
+    { "violación", VIOLACION, { NUMBER } },
+    { "violacion", VIOLACION, { NUMBER } },
+    { "entonces", ENTONCES, { ROL } },
+    { "hecho", HECHO, { STRING } },
+    { "evidencia", EVIDENCIA, { STRING } },
+    { "busca", BUSCA_ACTO, { ESTABLEZCA } },
+    { "establezca", ESTABLEZCA, { CUMPLIMIENTO, INCUMPLIMIENTO } },
+    { "cumplimiento", CUMPLIMIENTO, { NOMBRE_INSTITUCION } },
+    { "incumplimiento", INCUMPLIMIENTO, { NOMBRE_INSTITUCION } },
+    { "adjudique", ADJUDIQUE, { ROL } }
+};
+
+#define FUZZY_KEYWORD_COUNT (sizeof(fuzzy_keywords) / sizeof(fuzzy_keywords[0]))
+
+/* Shortest word matched approximately */
+#define FUZZY_MIN_LENGTH 4
+
+/* Keywords as bit-parallel match masks: bit i of a byte's mask is set if byte i of the keyword is that byte */
+static uint64_t fuzzy_masks[FUZZY_KEYWORD_COUNT][256];
+static pthread_once_t fuzzy_masks_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Build the match masks of the keywords (once per process)
+ */
+static void compile_fuzzy_keywords(void) {
+    for (size_t k = 0; k < FUZZY_KEYWORD_COUNT; k++) {
+        const unsigned char* keyword = (const unsigned char*)fuzzy_keywords[k].keyword;
+        for (int i = 0; keyword[i] != '\0'; i++) {
+            fuzzy_masks[k][tolower(keyword[i])] |= (uint64_t)1 << i;
+        }
+    }
+}
+
+/**
+ * Edit distance between a keyword and a word, ignoring ASCII case
+ * 
+ * Myers' bit-parallel algorithm, in Hyyro's form for whole strings with
+ * transpositions of adjacent bytes counted as one edit: each byte of the
+ * word advances one column of the edit matrix, held as bit vectors of
+ * its vertical differences. Stops early once the distance can no longer
+ * come down to the bound.
+ * 
+ * @return The distance, or bound + 1 if it exceeds the bound
+ */
+static int keyword_distance(size_t k, const char* word, size_t length, int bound) {
+    const uint64_t* masks = fuzzy_masks[k];
+    int score = (int)strlen(fuzzy_keywords[k].keyword);
+    uint64_t last = (uint64_t)1 << (score - 1);
+    uint64_t plus = ~(uint64_t)0;       // Vertical differences of +1
+    uint64_t minus = 0;                 // Vertical differences of -1
+    uint64_t zero = 0;                  // Diagonal differences of 0 in the previous column
+    uint64_t previous_eq = 0;
+    
+    for (size_t j = 0; j < length; j++) {
+        uint64_t eq = masks[tolower((unsigned char)word[j])];
+        uint64_t transposed = ((~zero & eq) << 1) & previous_eq;
+        zero = (((eq & plus) + plus) ^ plus) | eq | minus | transposed;
+        uint64_t horizontal_plus = minus | ~(zero | plus);
+        uint64_t horizontal_minus = plus & zero;
+        
+        if (horizontal_plus & last) {
+            score++;
+        } else if (horizontal_minus & last) {
+            score--;
+        }
+        
+        /* Row 0 of the matrix grows by one per byte */
+        horizontal_plus = (horizontal_plus << 1) | 1;
+        horizontal_minus <<= 1;
+        plus = horizontal_minus | ~(zero | horizontal_plus);
+        minus = horizontal_plus & zero;
+        previous_eq = eq;
+        
+        if (score - (int)(length - j - 1) > bound) {
+            return bound + 1;
+        }
+    }
+    
+    return score;
+}
+
 /**
- * Initialize the tokenizer
+ * Find the keyword a misspelled word stands for
+ * 
+ * Keywords of up to 7 bytes allow one edit, longer ones two. The closest
+ * keyword wins; a word equally close to keywords of different tokens is
+ * left alone.
+ * 
+ * @return Index of the keyword in fuzzy_keywords, or -1 if none is close enough
  */
-bool tokenizer_init(FILE* file) {
+static int fuzzy_keyword(const char* word) {
+    size_t length = strlen(word);
+    if (length < FUZZY_MIN_LENGTH || strpbrk(word, "0123456789$\"") != NULL) {
+        return -1;
+    }
+    
+    pthread_once(&fuzzy_masks_once, compile_fuzzy_keywords);
+    
+    int best_distance = 3;
+    int best_token = 0;
+    int best = -1;
+    bool ambiguous = false;
+    for (size_t k = 0; k < FUZZY_KEYWORD_COUNT; k++) {
+        size_t keyword_length = strlen(fuzzy_keywords[k].keyword);
+        int bound = keyword_length >= 8 ? 2 : 1;
+        if (bound > best_distance) {
+            bound = best_distance;
+        }
+        if (length + bound < keyword_length || keyword_length + bound < length) {
+            continue;
+        }
+        
+        int distance = keyword_distance(k, word, length, bound);
+        if (distance > bound) {
+            continue;
+        }
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_token = fuzzy_keywords[k].token;
+            best = (int)k;
+            ambiguous = false;
+        } else if (fuzzy_keywords[k].token != best_token) {
+            ambiguous = true;
+        }
+    }
+    
+    return ambiguous ? -1 : best;
+}
+
+/**
+ * Check whether the token after the current word, on the same line, may follow a keyword
+ * 
+ * The rest of the line is read by a copy of the tokenizer, which does
+ * not look further ahead itself; a misspelled keyword there counts as
+ * the keyword.
+ */
+static bool followed_as_keyword(const Tokenizer* t, int k) {
+    Tokenizer ahead = *t;
+    ahead.current_token_text = NULL;
+    ahead.trace = NULL;
+    ahead.lookahead = true;
+    
+    YYSTYPE value;
+    value.string = NULL;
+    int token = tokenizer_next(&ahead, &value);
+    if (token != NUMBER) {
+        free(value.string);
+    }
+    free(ahead.current_token_text);
+    
+    for (int i = 0; i < 2; i++) {
+        int follow = fuzzy_keywords[k].follows[i];
+        if (follow != 0 && (follow == token || (token == STRING && follow == ahead.candidate))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Create a tokenizer for an input file
+ */
+Tokenizer* tokenizer_create(FILE* file, FILE* trace) {
+    return tokenizer_create_at(file, trace, 1);
+}
+
+/**
+ * Create a tokenizer for a part of a larger input
+ */
+Tokenizer* tokenizer_create_at(FILE* file, FILE* trace, int first_line) {
     if (file == NULL) {
-        return false;
+        return NULL;
     }
     
-    input_file = file;
-    current_line = 0;
-    current_column = 1;
-    line_position = 0;
-    line_length = 0;
+    Tokenizer* t = (Tokenizer*)calloc(1, sizeof(Tokenizer));
+    if (t == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    
+    t->input_file = file;
+    t->trace = trace;
+    t->current_line = first_line - 1;
+    t->current_column = 1;
+    t->line_position = 0;
+    t->line_length = 0;
     
     /* Read the first line */
-    if (!read_line()) {
-        return false;
+    if (!read_line(t)) {
+        free(t);
+        return NULL;
     }
     
-    return true;
+    return t;
 }
 
 /**
- * Clean up the tokenizer
+ * Free a tokenizer
  */
-void tokenizer_cleanup() {
-    input_file = NULL;
-    free_current_token();
+void tokenizer_free(Tokenizer* t) {
+    if (t == NULL) {
+        return;
+    }
+    free_current_token(t);
+    free(t);
 }
 
 /**
@@ -278,37 +478,39 @@ int recognize_norm_reference(const char* text) {
     return 0;  /* Not a norm reference */
 }
 
-int yylex() {
-    free_current_token();
+int tokenizer_next(Tokenizer* t, union YYSTYPE* value) {
+    free_current_token(t);
+    t->correction = NULL;
+    t->candidate = 0;
     
     /* Skip separators and noise words */
     bool found_token = false;
     while (!found_token) {
-        skip_separators();
+        skip_separators(t);
         
         /* Check for end of file */
-        if (line_position >= line_length && feof(input_file)) {
-            printf("DEBUG: Token = EOF\n");
+        if (t->line_position >= t->line_length && feof(t->input_file)) {
+            TRACE(t, "DEBUG: Token = EOF\n");
             return 0;  /* Return 0 for EOF */
         }
         
         /* Check for quoted string */
-        if (line_position < line_length && line_buffer[line_position] == '"') {
-            char* quoted_string = extract_quoted_string();
+        if (t->line_position < t->line_length && t->line_buffer[t->line_position] == '"') {
+            char* quoted_string = extract_quoted_string(t);
             if (quoted_string != NULL) {
-                current_token_text = quoted_string;
-                yylval.string = strdup(quoted_string);
-                printf("DEBUG: Token = STRING (quoted: %s)\n", quoted_string);
+                t->current_token_text = quoted_string;
+                value->string = strdup(quoted_string);
+                TRACE(t, "DEBUG: Token = STRING (quoted: %s)\n", quoted_string);
                 return STRING;
             }
         }
 
         /* Extract a word */
-        char* word = extract_word();
+        char* word = extract_word(t);
         if (word == NULL || strlen(word) == 0) {
             free(word);
-            if (!read_line()) {
-                printf("DEBUG: Token = EOF\n");
+            if (!read_line(t)) {
+                TRACE(t, "DEBUG: Token = EOF\n");
                 return 0;  /* Return 0 for EOF */
             }
             continue;
@@ -316,202 +518,207 @@ int yylex() {
         
         /* Check if it's a noise word */
         if (is_noise_word(word)) {
-            printf("DEBUG: Skipping noise word: %s\n", word);
+            TRACE(t, "DEBUG: Skipping noise word: %s\n", word);
             free(word);
             continue;
         }
         
         /* Found a real token */
-        current_token_text = word;
+        t->current_token_text = word;
         found_token = true;
     }
     
-    printf("DEBUG: Processing token: %s\n", current_token_text);
+    TRACE(t, "DEBUG: Processing token: %s\n", t->current_token_text);
     
     /* Check for institution marker */
-    if (strcasecmp(current_token_text, "[Institution]") == 0) {
-        printf("DEBUG: Token = INSTITUTION\n");
+    if (strcasecmp(t->current_token_text, "[Institution]") == 0) {
+        TRACE(t, "DEBUG: Token = INSTITUTION\n");
         return INSTITUTION;
     }
     /* Check for number */
-    if (is_number(current_token_text)) {
-        yylval.number = word_to_number(current_token_text);
-        printf("DEBUG: Token = NUMBER (%d)\n", yylval.number);
+    if (is_number(t->current_token_text)) {
+        value->number = word_to_number(t->current_token_text);
+        TRACE(t, "DEBUG: Token = NUMBER (%d)\n", value->number);
         return NUMBER;
     }
     
-	if (current_token_text != NULL && strcasecmp(current_token_text, "regla") == 0) {
-		printf("DEBUG: Token = REGLA\n");
+	if (t->current_token_text != NULL && strcasecmp(t->current_token_text, "regla") == 0) {
+		TRACE(t, "DEBUG: Token = REGLA\n");
 		return REGLA;  /* Make sure REGLA is defined in schema_parser.tab.h */
 	}
 
     
 /* Check for deontic operators */
-    if (match_keyword(current_token_text, "debe")) {
-        printf("DEBUG: Token = DEBE\n");
+    if (match_keyword(t->current_token_text, "debe")) {
+        TRACE(t, "DEBUG: Token = DEBE\n");
         return DEBE;
-    } else if (match_keyword(current_token_text, "no-debe")) {
-        printf("DEBUG: Token = NO_DEBE\n");
+    } else if (match_keyword(t->current_token_text, "no-debe")) {
+        TRACE(t, "DEBUG: Token = NO_DEBE\n");
         return NO_DEBE;
-    } else if (match_keyword(current_token_text, "puede")) {
-        printf("DEBUG: Token = PUEDE\n");
+    } else if (match_keyword(t->current_token_text, "puede")) {
+        TRACE(t, "DEBUG: Token = PUEDE\n");
         return PUEDE;
-    } else if (match_keyword(current_token_text, "tiene-derecho-a")) {
-        printf("DEBUG: Token = TIENE_DERECHO\n");
+    } else if (match_keyword(t->current_token_text, "tiene-derecho-a")) {
+        TRACE(t, "DEBUG: Token = TIENE_DERECHO\n");
         return TIENE_DERECHO;
     }
     
     /* Check for conditional operator */
-    if (match_keyword(current_token_text, "en-caso-que")) {
+    if (match_keyword(t->current_token_text, "en-caso-que")) {
         return EN_CASO_QUE;
     }
     
     /* Check for conjunction */
-    if (match_keyword(current_token_text, "y")) {
+    if (match_keyword(t->current_token_text, "y")) {
         return Y;
     }
     
 /* Check for violation markers */
-    if (match_keyword(current_token_text, "violación") || 
-        starts_with(current_token_text, "violacion")) {
-        printf("DEBUG: Token = VIOLACION\n");
+    if (match_keyword(t->current_token_text, "violación") || 
+        starts_with(t->current_token_text, "violacion")) {
+        TRACE(t, "DEBUG: Token = VIOLACION\n");
         return VIOLACION;
-    } else if (match_keyword(current_token_text, "entonces")) {
-        printf("DEBUG: Token = ENTONCES\n");
+    } else if (match_keyword(t->current_token_text, "entonces")) {
+        TRACE(t, "DEBUG: Token = ENTONCES\n");
         return ENTONCES;
     }
     
 /* Check for fact markers */
-    if (match_keyword(current_token_text, "hecho") || 
-        starts_with(current_token_text, "hecho-juridico")) {
-        printf("DEBUG: Token = HECHO\n");
+    if (match_keyword(t->current_token_text, "hecho") || 
+        starts_with(t->current_token_text, "hecho-juridico")) {
+        TRACE(t, "DEBUG: Token = HECHO\n");
         return HECHO;
-    } else if (match_keyword(current_token_text, "evidencia")) {
-        printf("DEBUG: Token = EVIDENCIA\n");
+    } else if (match_keyword(t->current_token_text, "evidencia")) {
+        TRACE(t, "DEBUG: Token = EVIDENCIA\n");
         return EVIDENCIA;
     }
     
     /* Check for agenda markers */
-    if (match_keyword(current_token_text, "busca")) {
+    if (match_keyword(t->current_token_text, "busca")) {
         return BUSCA_ACTO;
-    } else if (match_keyword(current_token_text, "establezca")) {
+    } else if (match_keyword(t->current_token_text, "establezca")) {
         return ESTABLEZCA;
-    } else if (match_keyword(current_token_text, "cumplimiento")) {
+    } else if (match_keyword(t->current_token_text, "cumplimiento")) {
         return CUMPLIMIENTO;
-    } else if (match_keyword(current_token_text, "incumplimiento")) {
+    } else if (match_keyword(t->current_token_text, "incumplimiento")) {
         return INCUMPLIMIENTO;
-    } else if (match_keyword(current_token_text, "adjudique")) {
+    } else if (match_keyword(t->current_token_text, "adjudique")) {
         return ADJUDIQUE;
-    } else if (starts_with(current_token_text, "lo-esencial") ||
-               match_keyword(current_token_text, "esencial")) {
+    } else if (starts_with(t->current_token_text, "lo-esencial") ||
+               match_keyword(t->current_token_text, "esencial")) {
         return LO_ESENCIAL;
-    } else if (starts_with(current_token_text, "lo-siguiente") ||
-               match_keyword(current_token_text, "siguiente")) {
+    } else if (starts_with(t->current_token_text, "lo-siguiente") ||
+               match_keyword(t->current_token_text, "siguiente")) {
         return LO_SIGUIENTE;
     }
     
 /* Check for scope marker */
-    if (starts_with(current_token_text, "actua")) {
-        printf("DEBUG: Token = ACTUA_SOBRE\n");
+    if (starts_with(t->current_token_text, "actua")) {
+        TRACE(t, "DEBUG: Token = ACTUA_SOBRE\n");
         return ACTUA_SOBRE;
     }
     
     /* Check for institution marker */
-    if (strcasecmp(current_token_text, "[Institution]") == 0 || 
-        strcasecmp(current_token_text, "Institution") == 0) {  // Accept without brackets too
-        printf("DEBUG: Token = INSTITUTION\n");
+    if (strcasecmp(t->current_token_text, "[Institution]") == 0 || 
+        strcasecmp(t->current_token_text, "Institution") == 0) {  // Accept without brackets too
+        TRACE(t, "DEBUG: Token = INSTITUTION\n");
         return INSTITUTION;
     }
     
 /* Check for institution types */
-    if (match_keyword(current_token_text, "contrato") || 
-        match_keyword(current_token_text, "procedimiento") || 
-        match_keyword(current_token_text, "acto-juridico") || 
-        match_keyword(current_token_text, "hecho-juridico") ||
-        match_keyword(current_token_text, "acto") || 
-        match_keyword(current_token_text, "hecho")) {
-        yylval.string = strdup(current_token_text);
-        printf("DEBUG: Token = TIPO_INSTITUCION (%s)\n", current_token_text);
+    if (match_keyword(t->current_token_text, "contrato") || 
+        match_keyword(t->current_token_text, "procedimiento") || 
+        match_keyword(t->current_token_text, "acto-juridico") || 
+        match_keyword(t->current_token_text, "hecho-juridico") ||
+        match_keyword(t->current_token_text, "acto") || 
+        match_keyword(t->current_token_text, "hecho")) {
+        value->string = strdup(t->current_token_text);
+        TRACE(t, "DEBUG: Token = TIPO_INSTITUCION (%s)\n", t->current_token_text);
         return TIPO_INSTITUCION;
     }
     
     /* Check for multiplicity */
-    if (match_keyword(current_token_text, "múltiples") || 
-        match_keyword(current_token_text, "multiples") ||
-        match_keyword(current_token_text, "multiple") ||
-        match_keyword(current_token_text, "una") ||
-        match_keyword(current_token_text, "single")) {
-        yylval.string = strdup(current_token_text);
-        printf("DEBUG: Token = MULTIPLICIDAD (%s)\n", current_token_text);
+    if (match_keyword(t->current_token_text, "múltiples") || 
+        match_keyword(t->current_token_text, "multiples") ||
+        match_keyword(t->current_token_text, "multiple") ||
+        match_keyword(t->current_token_text, "una") ||
+        match_keyword(t->current_token_text, "single")) {
+        value->string = strdup(t->current_token_text);
+        TRACE(t, "DEBUG: Token = MULTIPLICIDAD (%s)\n", t->current_token_text);
         return MULTIPLICIDAD;
     }
     
     /* Check for legal domain */
-    if (starts_with(current_token_text, "derecho-")) {
-        yylval.string = strdup(current_token_text);
-        printf("DEBUG: Token = DOMINIO_LEGAL (%s)\n", current_token_text);
+    if (starts_with(t->current_token_text, "derecho-")) {
+        value->string = strdup(t->current_token_text);
+        TRACE(t, "DEBUG: Token = DOMINIO_LEGAL (%s)\n", t->current_token_text);
         return DOMINIO_LEGAL;
     }
     
     /* Check for institution name (starts with capital letter) */
-    if (isupper(current_token_text[0])) {
-        yylval.string = strdup(current_token_text);
-        printf("DEBUG: Token = NOMBRE_INSTITUCION (%s)\n", current_token_text);
+    if (isupper(t->current_token_text[0])) {
+        value->string = strdup(t->current_token_text);
+        TRACE(t, "DEBUG: Token = NOMBRE_INSTITUCION (%s)\n", t->current_token_text);
         return NOMBRE_INSTITUCION;
     }
     
-    /* Check for role */
-    if (starts_with(current_token_text, "el-") || 
-        starts_with(current_token_text, "la-") ||
-        match_keyword(current_token_text, "comprador") ||
-        match_keyword(current_token_text, "vendedor") ||
-        match_keyword(current_token_text, "arrendador") ||
-        match_keyword(current_token_text, "arrendatario") ||
-        match_keyword(current_token_text, "acreedor") ||
-        match_keyword(current_token_text, "deudor") ||
-        match_keyword(current_token_text, "juez") ||
-        match_keyword(current_token_text, "quejoso") ||
-        match_keyword(current_token_text, "autoridad") ||
-        match_keyword(current_token_text, "trabajador") ||
-        match_keyword(current_token_text, "empleador") ||
-        match_keyword(current_token_text, "trabajador") ||
-        match_keyword(current_token_text, "parte1") ||
-        match_keyword(current_token_text, "parte2")) {
+    /* Check for role: el-/la- words, or one probe of the configuration's role lexicon */
+    if (starts_with(t->current_token_text, "el-") || 
+        starts_with(t->current_token_text, "la-") ||
+        config_is_role_word(t->current_token_text)) {
         
-        yylval.string = strdup(current_token_text);
-        printf("DEBUG: Token = ROL (%s)\n", current_token_text);
+        value->string = strdup(t->current_token_text);
+        TRACE(t, "DEBUG: Token = ROL (%s)\n", t->current_token_text);
         return ROL;
     }
     
     /* Check for institution name (starts with capital letter) */
-    if (isupper(current_token_text[0])) {
-        yylval.string = strdup(current_token_text);
+    if (isupper(t->current_token_text[0])) {
+        value->string = strdup(t->current_token_text);
         return NOMBRE_INSTITUCION;
     }
     
+    /* Only a word no exact match took may be a misspelled keyword, and only if what follows fits one */
+    int k = fuzzy_keyword(t->current_token_text);
+    if (k >= 0) {
+        t->candidate = fuzzy_keywords[k].token;
+        if (!t->lookahead && followed_as_keyword(t, k)) {
+            t->correction = fuzzy_keywords[k].keyword;
+            TRACE(t, "DEBUG: Reading %s as keyword %s\n", t->current_token_text, t->correction);
+            return t->candidate;
+        }
+    }
+    
 /* Default: it's a string */
-    yylval.string = strdup(current_token_text);
-    printf("DEBUG: Token = STRING (%s)\n", current_token_text);
+    value->string = strdup(t->current_token_text);
+    TRACE(t, "DEBUG: Token = STRING (%s)\n", t->current_token_text);
     return STRING;
 }
 
 /**
  * Get current line number
  */
-int tokenizer_get_line() {
-    return current_line;
+int tokenizer_get_line(const Tokenizer* t) {
+    return t->current_line;
 }
 
 /**
  * Get current column number
  */
-int tokenizer_get_column() {
-    return current_column;
+int tokenizer_get_column(const Tokenizer* t) {
+    return t->current_column;
 }
 
 /**
  * Get the text of the current token
  */
-const char* tokenizer_get_text() {
-    return current_token_text;
+const char* tokenizer_get_text(const Tokenizer* t) {
+    return t->current_token_text;
+}
+
+/**
+ * Get the keyword the current token was corrected to
+ */
+const char* tokenizer_get_correction(const Tokenizer* t) {
+    return t->correction;
 }
@@ -11,47 +11,91 @@
 #include <stdbool.h>
 
 /**
- * Initialize the tokenizer with an input file
+ * Tokenizer state for one input
+ * 
+ * Each parse owns its tokenizer, so several inputs can be tokenized
+ * concurrently from different threads.
+ */
+typedef struct tokenizer Tokenizer;
+
+/* Semantic value type of the Bison parser (schema_parser.tab.h) */
+union YYSTYPE;
+
+/**
+ * Create a tokenizer for an input file
  * 
  * @param input_file File to tokenize
- * @return true if initialization succeeded, false otherwise
+ * @param trace Stream receiving a trace of the tokens read, or NULL for none
+ * @return The tokenizer, or NULL if the input is empty or on allocation failure
  */
-bool tokenizer_init(FILE* input_file);
+Tokenizer* tokenizer_create(FILE* input_file, FILE* trace);
 
 /**
- * Clean up resources used by the tokenizer
+ * Create a tokenizer for a part of a larger input
+ * 
+ * @param input_file File holding the part
+ * @param trace Stream receiving a trace of the tokens read, or NULL for none
+ * @param first_line Line number of the part's first line in the whole input
+ * @return The tokenizer, or NULL if the input is empty or on allocation failure
  */
-void tokenizer_cleanup(void);
+Tokenizer* tokenizer_create_at(FILE* input_file, FILE* trace, int first_line);
+
+/**
+ * Free a tokenizer
+ * 
+ * @param tokenizer Tokenizer to free
+ */
+void tokenizer_free(Tokenizer* tokenizer);
 
 /**
  * Get the next token from the input stream
  * 
- * This function is designed to be used as yylex() by Bison
+ * This function backs yylex() of the Bison parser
  * 
- * @return The type of the next token
+ * @param tokenizer The tokenizer
+ * @param value Receives the token's semantic value
+ * @return The type of the next token (0 at end of input)
  */
-int yylex(void);
+int tokenizer_next(Tokenizer* tokenizer, union YYSTYPE* value);
 
 /**
  * Get current line number
  * 
+ * @param tokenizer The tokenizer
  * @return Current line number
  */
-int tokenizer_get_line(void);
+int tokenizer_get_line(const Tokenizer* tokenizer);
 
 /**
  * Get current column number
  * 
+ * @param tokenizer The tokenizer
  * @return Current column number
  */
-int tokenizer_get_column(void);
+int tokenizer_get_column(const Tokenizer* tokenizer);
 
 /**
  * Get the text of the current token
  * 
+ * @param tokenizer The tokenizer
  * @return Text of the current token
  */
-const char* tokenizer_get_text(void);
+const char* tokenizer_get_text(const Tokenizer* tokenizer);
+
+/**
+ * Get the keyword the current token was corrected to
+ * 
+ * A word that is no token but lies within one or two edits of a keyword
+ * (e.g., "violacón", "evidenica", "tiene-derecho") is read as that
+ * keyword when the next token on its line may follow the keyword (a
+ * STRING after "evidencia", a NUMBER after "regla"); otherwise it stays
+ * a STRING, so text such as "debe hecha que actua ..." reads as before.
+ * tokenizer_get_text() still returns the word as written.
+ * 
+ * @param tokenizer The tokenizer
+ * @return The keyword, or NULL if the current token was read as written
+ */
+const char* tokenizer_get_correction(const Tokenizer* tokenizer);
 
 /**
  * Check if a word is a noise word (to be ignored)
@@ -0,0 +1,45 @@
+/**
+ * embed_config.c
+ *
+ * Build tool: compiles a JSON configuration file into a C source file
+ * with constant, pre-hashed lookup tables (config_default.c), which is
+ * linked into savigny as the configuration used when no -c is given
+ *
+ * Usage: embed_config schema_config.json config_default.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "config_tables.h"
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s config.json output.c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ConfigTables* tables = config_tables_load(argv[1]);
+    if (tables == NULL) {
+        fprintf(stderr, "Error: Failed to load configuration from %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* output = fopen(argv[2], "w");
+    if (output == NULL) {
+        fprintf(stderr, "Error: Failed to open output file %s\n", argv[2]);
+        config_tables_free(tables);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = config_tables_write_source(tables, output, argv[1]);
+    ok = fclose(output) == 0 && ok;
+    config_tables_free(tables);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write %s\n", argv[2]);
+        remove(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,423 @@
+/**
+ * json_stream.c
+ *
+ * Implementation of the streaming JSON reader
+ */
+
+#include "json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Size of the input window read from the file at a time */
+#define JSON_STREAM_CHUNK 65536
+
+/* Maximum nesting depth of objects and arrays */
+#define JSON_STREAM_MAX_DEPTH 256
+
+/* Reader state */
+struct json_stream {
+    FILE* file;
+    char chunk[JSON_STREAM_CHUNK];
+    size_t chunk_length;
+    size_t chunk_position;
+    bool at_eof;
+
+    /* Decoded text of the last key/string/number */
+    char* text;
+    size_t text_length;
+    size_t text_capacity;
+
+    /* Container stack: '{' or '[' per level */
+    char stack[JSON_STREAM_MAX_DEPTH];
+    int depth;
+    bool expect_key;
+
+    int line;
+    const char* error;
+};
+
+/**
+ * Refill the input window; returns false at end of input
+ */
+static bool refill(JsonStream* stream) {
+    if (stream->at_eof) {
+        return false;
+    }
+
+    stream->chunk_length = fread(stream->chunk, 1, JSON_STREAM_CHUNK, stream->file);
+    stream->chunk_position = 0;
+
+    if (stream->chunk_length == 0) {
+        stream->at_eof = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Peek at the next input byte without consuming it (-1 at end of input)
+ */
+static int peek_char(JsonStream* stream) {
+    if (stream->chunk_position >= stream->chunk_length && !refill(stream)) {
+        return -1;
+    }
+    return (unsigned char)stream->chunk[stream->chunk_position];
+}
+
+/**
+ * Consume the next input byte (-1 at end of input)
+ */
+static int next_char(JsonStream* stream) {
+    int c = peek_char(stream);
+    if (c >= 0) {
+        stream->chunk_position++;
+        if (c == '\n') {
+            stream->line++;
+        }
+    }
+    return c;
+}
+
+/**
+ * Record an error and return the error token
+ */
+static JsonToken fail(JsonStream* stream, const char* message) {
+    if (stream->error == NULL) {
+        stream->error = message;
+    }
+    return JSON_TOK_ERROR;
+}
+
+/**
+ * Append a byte to the token text buffer
+ */
+static bool text_append(JsonStream* stream, char c) {
+    if (stream->text_length + 1 >= stream->text_capacity) {
+        size_t capacity = stream->text_capacity * 2;
+        char* text = (char*)realloc(stream->text, capacity);
+        if (text == NULL) {
+            return false;
+        }
+        stream->text = text;
+        stream->text_capacity = capacity;
+    }
+
+    stream->text[stream->text_length++] = c;
+    stream->text[stream->text_length] = '\0';
+    return true;
+}
+
+/**
+ * Append a Unicode code point to the token text as UTF-8
+ */
+static bool text_append_utf8(JsonStream* stream, unsigned long code) {
+    if (code < 0x80) {
+        return text_append(stream, (char)code);
+    } else if (code < 0x800) {
+        return text_append(stream, (char)(0xC0 | (code >> 6))) &&
+               text_append(stream, (char)(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        return text_append(stream, (char)(0xE0 | (code >> 12))) &&
+               text_append(stream, (char)(0x80 | ((code >> 6) & 0x3F))) &&
+               text_append(stream, (char)(0x80 | (code & 0x3F)));
+    }
+    return text_append(stream, (char)(0xF0 | (code >> 18))) &&
+           text_append(stream, (char)(0x80 | ((code >> 12) & 0x3F))) &&
+           text_append(stream, (char)(0x80 | ((code >> 6) & 0x3F))) &&
+           text_append(stream, (char)(0x80 | (code & 0x3F)));
+}
+
+/**
+ * Read four hex digits of a \u escape
+ */
+static bool read_hex4(JsonStream* stream, unsigned long* code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = next_char(stream);
+        if (c < 0 || !isxdigit(c)) {
+            return false;
+        }
+        *code = (*code << 4) | (unsigned long)(isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+    }
+    return true;
+}
+
+/**
+ * Read a string body (opening quote already consumed) into the text buffer
+ */
+static bool read_string(JsonStream* stream) {
+    stream->text_length = 0;
+    stream->text[0] = '\0';
+
+    for (;;) {
+        int c = next_char(stream);
+        if (c < 0) {
+            return false;
+        }
+        if (c == '"') {
+            return true;
+        }
+        if (c != '\\') {
+            if (!text_append(stream, (char)c)) {
+                return false;
+            }
+            continue;
+        }
+
+        /* Escape sequence */
+        c = next_char(stream);
+        bool ok = true;
+        switch (c) {
+            case '"':  ok = text_append(stream, '"'); break;
+            case '\\': ok = text_append(stream, '\\'); break;
+            case '/':  ok = text_append(stream, '/'); break;
+            case 'b':  ok = text_append(stream, '\b'); break;
+            case 'f':  ok = text_append(stream, '\f'); break;
+            case 'n':  ok = text_append(stream, '\n'); break;
+            case 'r':  ok = text_append(stream, '\r'); break;
+            case 't':  ok = text_append(stream, '\t'); break;
+            case 'u': {
+                unsigned long code;
+                if (!read_hex4(stream, &code)) {
+                    return false;
+                }
+                /* Combine UTF-16 surrogate pairs */
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    unsigned long low;
+                    if (next_char(stream) != '\\' || next_char(stream) != 'u' ||
+                        !read_hex4(stream, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                ok = text_append_utf8(stream, code);
+                break;
+            }
+            default:
+                return false;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Read a bare literal (true, false, null) and check it matches
+ */
+static bool read_literal(JsonStream* stream, const char* literal) {
+    for (const char* p = literal; *p; p++) {
+        if (next_char(stream) != *p) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Create a streaming reader
+ */
+JsonStream* json_stream_open(FILE* file) {
+    if (file == NULL) {
+        return NULL;
+    }
+
+    JsonStream* stream = (JsonStream*)malloc(sizeof(JsonStream));
+    if (stream == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    stream->file = file;
+    stream->chunk_length = 0;
+    stream->chunk_position = 0;
+    stream->at_eof = false;
+    stream->text_capacity = 256;
+    stream->text_length = 0;
+    stream->text = (char*)malloc(stream->text_capacity);
+    stream->depth = 0;
+    stream->expect_key = false;
+    stream->line = 1;
+    stream->error = NULL;
+
+    if (stream->text == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(stream);
+        return NULL;
+    }
+    stream->text[0] = '\0';
+
+    return stream;
+}
+
+/**
+ * Release a streaming reader
+ */
+void json_stream_close(JsonStream* stream) {
+    if (stream == NULL) {
+        return;
+    }
+    free(stream->text);
+    free(stream);
+}
+
+/**
+ * Read the next token
+ */
+JsonToken json_stream_next(JsonStream* stream) {
+    if (stream->error != NULL) {
+        return JSON_TOK_ERROR;
+    }
+
+    for (;;) {
+        int c = next_char(stream);
+
+        switch (c) {
+            case -1:
+                if (stream->depth != 0) {
+                    return fail(stream, "unexpected end of input");
+                }
+                return JSON_TOK_EOF;
+
+            case ' ': case '\t': case '\r': case '\n':
+                continue;
+
+            case ':':
+                if (stream->depth == 0 || stream->stack[stream->depth - 1] != '{') {
+                    return fail(stream, "unexpected ':'");
+                }
+                continue;
+
+            case ',':
+                if (stream->depth == 0) {
+                    return fail(stream, "unexpected ','");
+                }
+                stream->expect_key = (stream->stack[stream->depth - 1] == '{');
+                continue;
+
+            case '{':
+            case '[':
+                if (stream->depth >= JSON_STREAM_MAX_DEPTH) {
+                    return fail(stream, "nesting too deep");
+                }
+                stream->stack[stream->depth++] = (char)c;
+                stream->expect_key = (c == '{');
+                return c == '{' ? JSON_TOK_OBJECT_BEGIN : JSON_TOK_ARRAY_BEGIN;
+
+            case '}':
+            case ']':
+                if (stream->depth == 0 ||
+                    stream->stack[stream->depth - 1] != (c == '}' ? '{' : '[')) {
+                    return fail(stream, "mismatched bracket");
+                }
+                stream->depth--;
+                stream->expect_key = false;
+                return c == '}' ? JSON_TOK_OBJECT_END : JSON_TOK_ARRAY_END;
+
+            case '"': {
+                bool is_key = stream->expect_key;
+                if (!read_string(stream)) {
+                    return fail(stream, "invalid string");
+                }
+                stream->expect_key = false;
+                return is_key ? JSON_TOK_KEY : JSON_TOK_STRING;
+            }
+
+            case 't':
+                stream->expect_key = false;
+                return read_literal(stream, "rue") ? JSON_TOK_TRUE : fail(stream, "invalid literal");
+            case 'f':
+                stream->expect_key = false;
+                return read_literal(stream, "alse") ? JSON_TOK_FALSE : fail(stream, "invalid literal");
+            case 'n':
+                stream->expect_key = false;
+                return read_literal(stream, "ull") ? JSON_TOK_NULL : fail(stream, "invalid literal");
+
+            default:
+                if (c == '-' || isdigit(c)) {
+                    stream->text_length = 0;
+                    stream->text[0] = '\0';
+                    text_append(stream, (char)c);
+
+                    int p = peek_char(stream);
+                    while (p >= 0 && (isdigit(p) || p == '.' || p == 'e' || p == 'E' ||
+                                      p == '+' || p == '-')) {
+                        if (!text_append(stream, (char)next_char(stream))) {
+                            return fail(stream, "out of memory");
+                        }
+                        p = peek_char(stream);
+                    }
+
+                    stream->expect_key = false;
+                    return JSON_TOK_NUMBER;
+                }
+                return fail(stream, "unexpected character");
+        }
+    }
+}
+
+/**
+ * Get the decoded token text
+ */
+const char* json_stream_text(const JsonStream* stream) {
+    return stream->text;
+}
+
+/**
+ * Get the token text length
+ */
+size_t json_stream_length(const JsonStream* stream) {
+    return stream->text_length;
+}
+
+/**
+ * Skip the remainder of a value
+ */
+bool json_stream_skip(JsonStream* stream, JsonToken first) {
+    if (first == JSON_TOK_ERROR || first == JSON_TOK_EOF) {
+        return false;
+    }
+
+    if (first != JSON_TOK_OBJECT_BEGIN && first != JSON_TOK_ARRAY_BEGIN) {
+        return true;
+    }
+
+    int nesting = 1;
+    while (nesting > 0) {
+        JsonToken token = json_stream_next(stream);
+        switch (token) {
+            case JSON_TOK_ERROR:
+            case JSON_TOK_EOF:
+                return false;
+            case JSON_TOK_OBJECT_BEGIN:
+            case JSON_TOK_ARRAY_BEGIN:
+                nesting++;
+                break;
+            case JSON_TOK_OBJECT_END:
+            case JSON_TOK_ARRAY_END:
+                nesting--;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Get the current line number
+ */
+int json_stream_line(const JsonStream* stream) {
+    return stream->line;
+}
+
+/**
+ * Get the last error message
+ */
+const char* json_stream_error(const JsonStream* stream) {
+    return stream->error;
+}
@@ -0,0 +1,110 @@
+/**
+ * json_stream.h
+ *
+ * Streaming (pull-style) JSON reader used to load large legal context
+ * files without building a full document tree in memory
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Token types produced by the streaming reader
+ */
+typedef enum {
+    JSON_TOK_ERROR,        // Malformed input or I/O error
+    JSON_TOK_EOF,          // End of input
+    JSON_TOK_OBJECT_BEGIN, // {
+    JSON_TOK_OBJECT_END,   // }
+    JSON_TOK_ARRAY_BEGIN,  // [
+    JSON_TOK_ARRAY_END,    // ]
+    JSON_TOK_KEY,          // Member name inside an object
+    JSON_TOK_STRING,       // String value
+    JSON_TOK_NUMBER,       // Number value (text available as-is)
+    JSON_TOK_TRUE,         // true
+    JSON_TOK_FALSE,        // false
+    JSON_TOK_NULL          // null
+} JsonToken;
+
+/**
+ * Opaque streaming reader state
+ */
+typedef struct json_stream JsonStream;
+
+/**
+ * Create a streaming reader over an open file
+ *
+ * The file is read in fixed-size chunks; it is not closed by the reader.
+ *
+ * @param file File to read from
+ * @return A new reader, or NULL on allocation failure
+ */
+JsonStream* json_stream_open(FILE* file);
+
+/**
+ * Release a streaming reader
+ *
+ * @param stream Reader to release
+ */
+void json_stream_close(JsonStream* stream);
+
+/**
+ * Read the next token
+ *
+ * @param stream Reader
+ * @return The type of the next token
+ */
+JsonToken json_stream_next(JsonStream* stream);
+
+/**
+ * Get the decoded text of the last KEY, STRING or NUMBER token
+ *
+ * The returned buffer is owned by the reader and is overwritten by the
+ * next call to json_stream_next().
+ *
+ * @param stream Reader
+ * @return NUL-terminated UTF-8 text
+ */
+const char* json_stream_text(const JsonStream* stream);
+
+/**
+ * Get the length in bytes of the last token text
+ *
+ * @param stream Reader
+ * @return Length of the text returned by json_stream_text()
+ */
+size_t json_stream_length(const JsonStream* stream);
+
+/**
+ * Skip the remainder of a value whose first token has just been read
+ *
+ * For scalars this is a no-op; for objects and arrays every token up to
+ * the matching close bracket is consumed without being stored.
+ *
+ * @param stream Reader
+ * @param first The token that started the value
+ * @return true on success, false on malformed input
+ */
+bool json_stream_skip(JsonStream* stream, JsonToken first);
+
+/**
+ * Get the current line number (for error messages)
+ *
+ * @param stream Reader
+ * @return 1-based line number
+ */
+int json_stream_line(const JsonStream* stream);
+
+/**
+ * Get the last error message
+ *
+ * @param stream Reader
+ * @return Error description, or NULL if no error occurred
+ */
+const char* json_stream_error(const JsonStream* stream);
+
+#endif /* JSON_STREAM_H */
@@ -0,0 +1,310 @@
+/**
+ * json_writer.c
+ *
+ * Implementation of the streaming JSON writer
+ *
+ * Strings are escaped with a 256-entry table and copied in runs between
+ * the bytes that need escaping, so plain text costs one table lookup per
+ * byte and a memcpy per run.
+ */
+
+#include "json_writer.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of the output buffer of a file writer */
+#define JSON_WRITER_CHUNK 65536
+
+/* Initial size of the buffer of an in-memory writer */
+#define JSON_WRITER_INITIAL 4096
+
+/* Escape of each byte: 0 to copy it, 'u' for \u00XX, else the letter after the backslash */
+static const char escape_table[256] = {
+    [0x00 ... 0x07] = 'u', ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', [0x0b] = 'u',
+    ['\f'] = 'f', ['\r'] = 'r', [0x0e ... 0x1f] = 'u',
+    ['"'] = '"', ['\\'] = '\\'
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Writer state */
+struct json_writer {
+    FILE* file;                 // NULL for an in-memory writer
+    char* buffer;
+    size_t length;
+    size_t capacity;
+    bool need_comma;            // A value was written at the current level
+    bool failed;                // A write or allocation has failed
+};
+
+/**
+ * Write the buffer out to the file
+ */
+static void drain(JsonWriter* writer) {
+    if (writer->length > 0 && !writer->failed &&
+        fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length) {
+        writer->failed = true;
+    }
+    writer->length = 0;
+}
+
+/**
+ * Make room for at least size more bytes; false if that is impossible
+ */
+static bool reserve(JsonWriter* writer, size_t size) {
+    if (writer->capacity - writer->length >= size) {
+        return true;
+    }
+
+    if (writer->file != NULL) {
+        drain(writer);
+        return writer->capacity >= size;
+    }
+
+    size_t capacity = writer->capacity;
+    while (capacity - writer->length < size) {
+        capacity *= 2;
+    }
+    char* buffer = (char*)realloc(writer->buffer, capacity);
+    if (buffer == NULL) {
+        writer->failed = true;
+        return false;
+    }
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return true;
+}
+
+/**
+ * Append raw bytes, writing large runs straight through to the file
+ */
+static void append(JsonWriter* writer, const char* data, size_t size) {
+    if (!reserve(writer, size)) {
+        if (writer->file != NULL && !writer->failed && fwrite(data, 1, size, writer->file) != size) {
+            writer->failed = true;
+        }
+        return;
+    }
+    memcpy(writer->buffer + writer->length, data, size);
+    writer->length += size;
+}
+
+/**
+ * Append one byte
+ */
+static inline void append_char(JsonWriter* writer, char c) {
+    if (writer->length < writer->capacity || reserve(writer, 1)) {
+        writer->buffer[writer->length++] = c;
+    }
+}
+
+/**
+ * Start a value, separating it from the previous one at the same level
+ */
+static inline void begin_value(JsonWriter* writer) {
+    if (writer->need_comma) {
+        append_char(writer, ',');
+    }
+    writer->need_comma = true;
+}
+
+/**
+ * Create a streaming writer
+ */
+JsonWriter* json_writer_open(FILE* file) {
+    JsonWriter* writer = (JsonWriter*)calloc(1, sizeof(JsonWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    writer->file = file;
+    writer->capacity = file != NULL ? JSON_WRITER_CHUNK : JSON_WRITER_INITIAL;
+    writer->buffer = (char*)malloc(writer->capacity);
+    if (writer->buffer == NULL) {
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**
+ * Flush and release a writer
+ */
+bool json_writer_close(JsonWriter* writer) {
+    if (writer == NULL) {
+        return true;
+    }
+
+    bool ok = json_writer_flush(writer);
+    free(writer->buffer);
+    free(writer);
+    return ok;
+}
+
+/**
+ * Write buffered output to the file
+ */
+bool json_writer_flush(JsonWriter* writer) {
+    if (writer->file != NULL) {
+        drain(writer);
+        if (fflush(writer->file) != 0) {
+            writer->failed = true;
+        }
+    }
+    return !writer->failed;
+}
+
+/**
+ * Get the output of an in-memory writer
+ */
+const char* json_writer_data(const JsonWriter* writer, size_t* length) {
+    *length = writer->length;
+    return writer->buffer;
+}
+
+/**
+ * Discard the buffered output and start a new document
+ */
+void json_writer_reset(JsonWriter* writer) {
+    writer->length = 0;
+    writer->need_comma = false;
+}
+
+/**
+ * Open an object
+ */
+void json_writer_begin_object(JsonWriter* writer) {
+    begin_value(writer);
+    append_char(writer, '{');
+    writer->need_comma = false;
+}
+
+/**
+ * Close an object
+ */
+void json_writer_end_object(JsonWriter* writer) {
+    append_char(writer, '}');
+    writer->need_comma = true;
+}
+
+/**
+ * Open an array
+ */
+void json_writer_begin_array(JsonWriter* writer) {
+    begin_value(writer);
+    append_char(writer, '[');
+    writer->need_comma = false;
+}
+
+/**
+ * Close an array
+ */
+void json_writer_end_array(JsonWriter* writer) {
+    append_char(writer, ']');
+    writer->need_comma = true;
+}
+
+/**
+ * Write the name of the next object member
+ */
+void json_writer_key(JsonWriter* writer, const char* key) {
+    begin_value(writer);
+    append_char(writer, '"');
+    append(writer, key, strlen(key));
+    append(writer, "\":", 2);
+    writer->need_comma = false;
+}
+
+/**
+ * Write a string value of a given length
+ */
+void json_writer_string_n(JsonWriter* writer, const char* text, size_t length) {
+    begin_value(writer);
+    append_char(writer, '"');
+
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    while (p < end) {
+        const unsigned char* run = p;
+        while (p < end && escape_table[*p] == 0) {
+            p++;
+        }
+        if (p > run) {
+            append(writer, (const char*)run, (size_t)(p - run));
+        }
+        if (p == end) {
+            break;
+        }
+
+        char escape = escape_table[*p];
+        if (escape == 'u') {
+            char sequence[6] = { '\\', 'u', '0', '0', hex_digits[*p >> 4], hex_digits[*p & 0xf] };
+            append(writer, sequence, sizeof(sequence));
+        } else {
+            char sequence[2] = { '\\', escape };
+            append(writer, sequence, sizeof(sequence));
+        }
+        p++;
+    }
+
+    append_char(writer, '"');
+}
+
+/**
+ * Write a string value
+ */
+void json_writer_string(JsonWriter* writer, const char* text) {
+    if (text == NULL) {
+        json_writer_null(writer);
+    } else {
+        json_writer_string_n(writer, text, strlen(text));
+    }
+}
+
+/**
+ * Write an integer value
+ */
+void json_writer_int(JsonWriter* writer, int64_t value) {
+    char digits[24];
+    int position = sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    do {
+        digits[--position] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[--position] = '-';
+    }
+
+    begin_value(writer);
+    append(writer, digits + position, sizeof(digits) - position);
+}
+
+/**
+ * Write a boolean value
+ */
+void json_writer_bool(JsonWriter* writer, bool value) {
+    begin_value(writer);
+    if (value) {
+        append(writer, "true", 4);
+    } else {
+        append(writer, "false", 5);
+    }
+}
+
+/**
+ * Write null
+ */
+void json_writer_null(JsonWriter* writer) {
+    begin_value(writer);
+    append(writer, "null", 4);
+}
+
+/**
+ * End a top-level value with a newline
+ */
+void json_writer_newline(JsonWriter* writer) {
+    append_char(writer, '\n');
+    writer->need_comma = false;
+}
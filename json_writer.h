@@ -0,0 +1,118 @@
+/**
+ * json_writer.h
+ *
+ * Streaming JSON writer: values are escaped and appended to a buffer as
+ * they are produced, with no document tree, and the buffer is flushed
+ * to a file when it fills (or kept in memory)
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Opaque streaming writer state
+ */
+typedef struct json_writer JsonWriter;
+
+/**
+ * Create a streaming writer
+ *
+ * With a file, output is buffered and written out in fixed-size chunks;
+ * the file is not closed by the writer. Without one, the whole output is
+ * kept in memory (see json_writer_data()).
+ *
+ * @param file File to write to, or NULL to write to memory
+ * @return A new writer, or NULL on allocation failure
+ */
+JsonWriter* json_writer_open(FILE* file);
+
+/**
+ * Flush and release a writer
+ *
+ * @param writer Writer to release
+ * @return true if everything written reached the file, false on I/O error
+ */
+bool json_writer_close(JsonWriter* writer);
+
+/**
+ * Write buffered output to the file
+ *
+ * @param writer Writer
+ * @return true on success, false if a write has failed
+ */
+bool json_writer_flush(JsonWriter* writer);
+
+/**
+ * Get the output of an in-memory writer
+ *
+ * @param writer Writer
+ * @param length Receives the length in bytes
+ * @return The output (owned by the writer, not NUL-terminated)
+ */
+const char* json_writer_data(const JsonWriter* writer, size_t* length);
+
+/**
+ * Discard the buffered output and start a new document
+ *
+ * @param writer Writer
+ */
+void json_writer_reset(JsonWriter* writer);
+
+/**
+ * Open and close objects and arrays
+ *
+ * @param writer Writer
+ */
+void json_writer_begin_object(JsonWriter* writer);
+void json_writer_end_object(JsonWriter* writer);
+void json_writer_begin_array(JsonWriter* writer);
+void json_writer_end_array(JsonWriter* writer);
+
+/**
+ * Write the name of the next object member
+ *
+ * @param writer Writer
+ * @param key Member name (written as-is: it must not need escaping)
+ */
+void json_writer_key(JsonWriter* writer, const char* key);
+
+/**
+ * Write a string value
+ *
+ * @param writer Writer
+ * @param text UTF-8 text, or NULL to write null
+ */
+void json_writer_string(JsonWriter* writer, const char* text);
+
+/**
+ * Write a string value of a given length
+ *
+ * @param writer Writer
+ * @param text UTF-8 text (may contain NUL bytes)
+ * @param length Length in bytes
+ */
+void json_writer_string_n(JsonWriter* writer, const char* text, size_t length);
+
+/**
+ * Write scalar values
+ *
+ * @param writer Writer
+ * @param value The value
+ */
+void json_writer_int(JsonWriter* writer, int64_t value);
+void json_writer_bool(JsonWriter* writer, bool value);
+void json_writer_null(JsonWriter* writer);
+
+/**
+ * End a top-level value with a newline (for one document per line)
+ *
+ * @param writer Writer
+ */
+void json_writer_newline(JsonWriter* writer);
+
+#endif /* JSON_WRITER_H */
@@ -0,0 +1,463 @@
+/**
+ * kelsen_optimizer.c
+ *
+ * Implementation of the Kelsen program optimizer
+ *
+ * The pass works on the text the generator wrote. Every line is either
+ * a declaration ("kind name = body;") or kept verbatim. Declarations
+ * are hash-consed in dependency order (strings, then assets, whose
+ * bodies name strings and subjects, then clauses), each merged one
+ * pointing at the first declaration with the same body. A mark phase
+ * from the clauses, facts and agendas then finds what is still used,
+ * and the program is written back with references renamed.
+ */
+
+#include "kelsen_optimizer.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kinds of declaration */
+typedef enum {
+    DECL_NONE,                  // Not a declaration (comment, blank line, anything else)
+    DECL_STRING,
+    DECL_SUBJECT,
+    DECL_ASSET,
+    DECL_CLAUSE,
+    DECL_FACT,
+    DECL_AGENDA
+} DeclKind;
+
+static const struct {
+    const char* keyword;
+    DeclKind kind;
+} decl_keywords[] = {
+    { "string", DECL_STRING },
+    { "subject", DECL_SUBJECT },
+    { "asset", DECL_ASSET },
+    { "clause", DECL_CLAUSE },
+    { "fact", DECL_FACT },
+    { "agenda", DECL_AGENDA }
+};
+
+/* One line of the program */
+typedef struct {
+    const char* start;
+    size_t length;              // Without the newline
+    DeclKind kind;
+    const char* name;
+    size_t name_length;
+    const char* body;           // Between "=" and the final ";", trimmed
+    size_t body_length;
+    int canonical;              // Line this declaration merges into (itself if none)
+    bool root;                  // Kept whatever references it (clauses, facts, agendas, redefinitions)
+    bool reached;
+} Line;
+
+/* Open-addressing map from text spans to line indexes */
+typedef struct {
+    const char** keys;
+    size_t* key_lengths;
+    int* values;
+    size_t mask;
+} SpanMap;
+
+/* Growable output buffer */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} Output;
+
+/**
+ * Hash a span (FNV-1a)
+ */
+static uint64_t hash_span(const char* text, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Create a map with room for count keys
+ */
+static bool span_map_init(SpanMap* map, size_t count) {
+    size_t size = 16;
+    while (size < count * 2) {
+        size <<= 1;
+    }
+    map->keys = (const char**)calloc(size, sizeof(const char*));
+    map->key_lengths = (size_t*)calloc(size, sizeof(size_t));
+    map->values = (int*)calloc(size, sizeof(int));
+    map->mask = size - 1;
+    return map->keys != NULL && map->key_lengths != NULL && map->values != NULL;
+}
+
+/**
+ * Free a map (not the keys)
+ */
+static void span_map_free(SpanMap* map) {
+    free((void*)map->keys);
+    free(map->key_lengths);
+    free(map->values);
+}
+
+/**
+ * Look a key up, adding it with a value if absent
+ *
+ * @return The value stored for the key (value itself if it was added)
+ */
+static int span_map_intern(SpanMap* map, const char* key, size_t length, int value) {
+    size_t slot = hash_span(key, length) & map->mask;
+    while (map->keys[slot] != NULL) {
+        if (map->key_lengths[slot] == length && memcmp(map->keys[slot], key, length) == 0) {
+            return map->values[slot];
+        }
+        slot = (slot + 1) & map->mask;
+    }
+    map->keys[slot] = key;
+    map->key_lengths[slot] = length;
+    map->values[slot] = value;
+    return value;
+}
+
+/**
+ * Look a key up
+ *
+ * @return The value, or -1 if absent
+ */
+static int span_map_find(const SpanMap* map, const char* key, size_t length) {
+    size_t slot = hash_span(key, length) & map->mask;
+    while (map->keys[slot] != NULL) {
+        if (map->key_lengths[slot] == length && memcmp(map->keys[slot], key, length) == 0) {
+            return map->values[slot];
+        }
+        slot = (slot + 1) & map->mask;
+    }
+    return -1;
+}
+
+/**
+ * Append bytes to the output
+ */
+static void output_append(Output* output, const char* data, size_t length) {
+    if (output->length + length + 1 > output->capacity) {
+        size_t capacity = output->capacity > 0 ? output->capacity : 4096;
+        while (output->length + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(output->data, capacity);
+        if (grown == NULL) {
+            output->failed = true;
+            return;
+        }
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    output->data[output->length] = '\0';
+}
+
+static bool is_identifier_start(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool is_identifier_char(char c) {
+    return is_identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+/**
+ * Split a line into kind, name and body if it is a declaration
+ */
+static void parse_declaration(Line* line) {
+    const char* p = line->start;
+    const char* end = line->start + line->length;
+    line->kind = DECL_NONE;
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+    DeclKind kind = DECL_NONE;
+    for (size_t i = 0; i < sizeof(decl_keywords) / sizeof(decl_keywords[0]); i++) {
+        size_t length = strlen(decl_keywords[i].keyword);
+        if ((size_t)(end - p) > length && memcmp(p, decl_keywords[i].keyword, length) == 0 &&
+            (p[length] == ' ' || p[length] == '\t')) {
+            kind = decl_keywords[i].kind;
+            p += length;
+            break;
+        }
+    }
+    if (kind == DECL_NONE) {
+        return;
+    }
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    const char* name = p;
+    while (p < end && is_identifier_char(*p)) p++;
+    if (p == name || !is_identifier_start(*name)) {
+        return;
+    }
+    size_t name_length = (size_t)(p - name);
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p == end || *p != '=') {
+        return;
+    }
+    p++;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+    const char* body_end = end;
+    while (body_end > p && (body_end[-1] == ' ' || body_end[-1] == '\t' || body_end[-1] == '\r')) body_end--;
+    if (body_end == p || body_end[-1] != ';') {
+        return;
+    }
+    body_end--;
+
+    line->kind = kind;
+    line->name = name;
+    line->name_length = name_length;
+    line->body = p;
+    line->body_length = (size_t)(body_end - p);
+}
+
+/**
+ * Find the declaration a name refers to, after merging (-1 if undeclared)
+ */
+static int resolve(const SpanMap* names, const Line* lines, const char* name, size_t length) {
+    int index = span_map_find(names, name, length);
+    return index >= 0 ? lines[index].canonical : -1;
+}
+
+/**
+ * Find the next identifier of a body, skipping string literals and numbers
+ *
+ * @param cursor Position to scan from; advanced past the identifier
+ * @param end End of the body
+ * @param length Receives the length of the identifier
+ * @return The identifier, or NULL at the end of the body
+ */
+static const char* next_identifier(const char** cursor, const char* end, size_t* length) {
+    const char* p = *cursor;
+    while (p < end) {
+        if (*p == '"') {
+            for (p++; p < end && *p != '"'; p++) {
+                if (*p == '\\' && p + 1 < end) p++;
+            }
+            if (p < end) p++;
+        } else if (is_identifier_start(*p)) {
+            const char* name = p;
+            while (p < end && is_identifier_char(*p)) p++;
+            *cursor = p;
+            *length = (size_t)(p - name);
+            return name;
+        } else if (*p >= '0' && *p <= '9') {
+            while (p < end && is_identifier_char(*p)) p++;
+        } else {
+            p++;
+        }
+    }
+    *cursor = p;
+    return NULL;
+}
+
+/**
+ * Write a declaration body with references renamed to their canonical declarations
+ */
+static void write_body(Output* output, const SpanMap* names, const Line* lines, const char* body, size_t length) {
+    const char* cursor = body;
+    const char* end = body + length;
+    const char* copied = body;
+    const char* name;
+    size_t name_length;
+
+    while ((name = next_identifier(&cursor, end, &name_length)) != NULL) {
+        int target = resolve(names, lines, name, name_length);
+        const Line* declaration = target >= 0 ? &lines[target] : NULL;
+        if (declaration != NULL && (declaration->name_length != name_length ||
+                                    memcmp(declaration->name, name, name_length) != 0)) {
+            output_append(output, copied, (size_t)(name - copied));
+            output_append(output, declaration->name, declaration->name_length);
+            copied = cursor;
+        }
+    }
+    output_append(output, copied, (size_t)(end - copied));
+}
+
+/**
+ * Merge declarations of one kind that have the same body once references are renamed
+ *
+ * @return Number of declarations merged, or -1 on allocation failure
+ */
+static long merge_kind(Line* lines, size_t count, const SpanMap* names, DeclKind kind, char*** keys, size_t* key_count) {
+    SpanMap bodies;
+    if (!span_map_init(&bodies, count)) {
+        span_map_free(&bodies);
+        return -1;
+    }
+
+    long merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        Line* line = &lines[i];
+        if (line->kind != kind || line->root != (kind == DECL_CLAUSE) || line->canonical != (int)i) {
+            continue;
+        }
+
+        /* Strings refer to nothing; other bodies are compared after renaming */
+        const char* key = line->body;
+        size_t key_length = line->body_length;
+        if (kind != DECL_STRING) {
+            Output normalized = { NULL, 0, 0, false };
+            write_body(&normalized, names, lines, line->body, line->body_length);
+            if (normalized.failed || normalized.data == NULL) {
+                free(normalized.data);
+                span_map_free(&bodies);
+                return -1;
+            }
+            (*keys)[(*key_count)++] = normalized.data;
+            key = normalized.data;
+            key_length = normalized.length;
+        }
+
+        int first = span_map_intern(&bodies, key, key_length, (int)i);
+        if (first != (int)i) {
+            line->canonical = first;
+            merged++;
+        }
+    }
+
+    span_map_free(&bodies);
+    return merged;
+}
+
+/**
+ * Optimize a Kelsen program
+ */
+char* kelsen_optimize(const char* program, KelsenOptimizerStats* stats) {
+    KelsenOptimizerStats result;
+    memset(&result, 0, sizeof(result));
+    result.bytes_before = strlen(program);
+
+    size_t count = 0;
+    for (const char* p = program; *p; p++) {
+        count += *p == '\n';
+    }
+    count++;
+
+    Line* lines = (Line*)calloc(count, sizeof(Line));
+    int* worklist = (int*)malloc(count * sizeof(int));
+    char** keys = (char**)malloc(count * sizeof(char*));
+    size_t key_count = 0;
+    SpanMap names = { NULL, NULL, NULL, 0 };
+    Output output = { NULL, 0, 0, false };
+    bool ok = lines != NULL && worklist != NULL && keys != NULL && span_map_init(&names, count);
+
+    if (ok) {
+        /* Split into lines; the first declaration of a name owns it */
+        size_t index = 0;
+        for (const char* p = program; index < count; index++) {
+            const char* newline = strchr(p, '\n');
+            Line* line = &lines[index];
+            line->start = p;
+            line->length = newline != NULL ? (size_t)(newline - p) : strlen(p);
+            line->canonical = (int)index;
+            parse_declaration(line);
+
+            if (line->kind != DECL_NONE) {
+                result.declarations_before++;
+                line->root = line->kind == DECL_CLAUSE || line->kind == DECL_FACT || line->kind == DECL_AGENDA;
+                if (span_map_intern(&names, line->name, line->name_length, (int)index) != (int)index) {
+                    line->root = true;
+                }
+            }
+            p = newline != NULL ? newline + 1 : p + line->length;
+        }
+
+        /* Assets name strings, clauses name assets: merge in that order */
+        long strings = merge_kind(lines, count, &names, DECL_STRING, &keys, &key_count);
+        long assets = strings >= 0 ? merge_kind(lines, count, &names, DECL_ASSET, &keys, &key_count) : -1;
+        long clauses = assets >= 0 ? merge_kind(lines, count, &names, DECL_CLAUSE, &keys, &key_count) : -1;
+        ok = clauses >= 0;
+        result.strings_merged = strings > 0 ? (size_t)strings : 0;
+        result.assets_merged = assets > 0 ? (size_t)assets : 0;
+        result.clauses_merged = clauses > 0 ? (size_t)clauses : 0;
+    }
+
+    if (ok) {
+        /* Mark everything the kept roots reach */
+        size_t pending = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (lines[i].kind != DECL_NONE && lines[i].root && lines[i].canonical == (int)i) {
+                lines[i].reached = true;
+                worklist[pending++] = (int)i;
+            }
+        }
+        while (pending > 0) {
+            const Line* line = &lines[worklist[--pending]];
+            const char* cursor = line->body;
+            const char* end = line->body + line->body_length;
+            const char* name;
+            size_t name_length;
+            while ((name = next_identifier(&cursor, end, &name_length)) != NULL) {
+                int target = resolve(&names, lines, name, name_length);
+                if (target >= 0 && !lines[target].reached) {
+                    lines[target].reached = true;
+                    worklist[pending++] = target;
+                }
+            }
+        }
+
+        /* Write back what is kept */
+        for (size_t i = 0; i < count; i++) {
+            const Line* line = &lines[i];
+            const char* newline = i + 1 < count ? "\n" : "";
+            if (line->kind == DECL_NONE) {
+                output_append(&output, line->start, line->length);
+                output_append(&output, newline, strlen(newline));
+                continue;
+            }
+            if (line->canonical != (int)i) {
+                continue;
+            }
+            if (!line->reached) {
+                result.unreferenced++;
+                continue;
+            }
+
+            const char* body_end = line->body + line->body_length;
+            output_append(&output, line->start, (size_t)(line->body - line->start));
+            write_body(&output, &names, lines, line->body, line->body_length);
+            output_append(&output, body_end, (size_t)(line->start + line->length - body_end));
+            output_append(&output, newline, strlen(newline));
+            result.declarations_after++;
+        }
+        if (output.data == NULL) {
+            output_append(&output, "", 0);
+        }
+        ok = !output.failed;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(output.data);
+        output.data = NULL;
+    } else {
+        result.bytes_after = output.length;
+        if (stats != NULL) {
+            *stats = result;
+        }
+    }
+
+    for (size_t i = 0; i < key_count; i++) {
+        free(keys[i]);
+    }
+    span_map_free(&names);
+    free(keys);
+    free(worklist);
+    free(lines);
+    return output.data;
+}
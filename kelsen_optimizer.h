@@ -0,0 +1,43 @@
+/**
+ * kelsen_optimizer.h
+ *
+ * Optimization pass over generated Kelsen programs: merges identical
+ * strings, assets and clauses and drops declarations nothing refers to,
+ * so the downstream solver has fewer symbols to work with
+ */
+
+#ifndef KELSEN_OPTIMIZER_H
+#define KELSEN_OPTIMIZER_H
+
+#include <stddef.h>
+
+/**
+ * What an optimization pass did
+ */
+typedef struct {
+    size_t declarations_before;
+    size_t declarations_after;
+    size_t bytes_before;
+    size_t bytes_after;
+    size_t strings_merged;          // Strings with the same text as an earlier one
+    size_t assets_merged;           // Assets identical to an earlier one once strings are merged
+    size_t clauses_merged;          // Clauses identical to an earlier one
+    size_t unreferenced;            // Strings, subjects and assets no clause, fact or agenda reaches
+} KelsenOptimizerStats;
+
+/**
+ * Optimize a Kelsen program
+ *
+ * The program is read one declaration per line, as the code generator
+ * writes it. Clauses, facts and agendas are kept (minus duplicate
+ * clauses); strings, subjects and assets are kept if one of those
+ * reaches them. References to merged declarations are renamed to the
+ * first of their kind. Comments and blank lines are kept as they are.
+ *
+ * @param program The program
+ * @param stats Receives what was done (may be NULL)
+ * @return The optimized program (free with free()), or NULL on error
+ */
+char* kelsen_optimize(const char* program, KelsenOptimizerStats* stats);
+
+#endif /* KELSEN_OPTIMIZER_H */
@@ -0,0 +1,1070 @@
+/**
+ * lsp_server.c
+ *
+ * Implementation of the language server
+ *
+ * Each open file is a SchemaDocument, so an edit reparses only the
+ * units it touches. On top of it the server keeps an index of the
+ * document's norms (in document order, and hashed by number), rebuilt
+ * from the units' nodes the first time it is needed after an edit;
+ * reference checks, go-to-definition and hover all answer from it.
+ *
+ * Context annotations are the one expensive answer (a search of the
+ * legal context), so they are cached across edits and documents, keyed
+ * by what they depend on: the institution and the norm's role, action
+ * and scope.
+ */
+
+#define _GNU_SOURCE
+#include "lsp_server.h"
+#include "context_manager.h"
+#include "json_writer.h"
+#include "schema_document.h"
+#include "schema_types.h"
+#include <cJSON.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define LSP_SOURCE "savigny"
+#define LSP_NORM_REFERENCE "NORM_REFERENCE:"
+#define LSP_HOVER_CACHE 4096            // Annotations cached before the cache is cleared
+#define LSP_MAX_MESSAGE (64 << 20)      // Largest message body accepted
+
+/* JSON-RPC error codes */
+#define LSP_INVALID_PARAMS -32602
+#define LSP_METHOD_NOT_FOUND -32601
+#define LSP_SERVER_NOT_INITIALIZED -32002
+
+/* LSP diagnostic severities */
+#define LSP_SEVERITY_ERROR 1
+#define LSP_SEVERITY_WARNING 2
+
+/**
+ * A norm of a document with its line in the whole text
+ */
+typedef struct {
+    Norm* norm;
+    int line;
+} IndexedNorm;
+
+/**
+ * An open file
+ */
+typedef struct {
+    char* uri;
+    int version;
+    SchemaDocument* document;
+    IndexedNorm* norms;             // Norms in document order
+    int norm_count;
+    int norm_capacity;
+    int* numbers;                   // Hash of norm numbers: position in norms + 1, or 0
+    int number_capacity;            // Power of two
+    bool indexed;                   // The index matches the text
+    bool index_failed;              // Allocation failure while indexing
+} LspDocument;
+
+/**
+ * A cached context annotation
+ */
+typedef struct {
+    char* key;                      // Institution, role, action and scope, or NULL if free
+    char* text;                     // Markdown of the annotation
+} HoverEntry;
+
+/**
+ * Server state
+ */
+typedef struct {
+    FILE* output;
+    JsonWriter* writer;             // Message being built
+    LspDocument** documents;
+    int document_count;
+    int document_capacity;
+    bool utf8;                      // Positions count bytes (else UTF-16 code units)
+    bool initialized;
+    bool shutdown;
+    HoverEntry* hover;              // Open-addressed, 2 * LSP_HOVER_CACHE entries
+    int hover_count;
+} LspServer;
+
+/* ---- Messages ---- */
+
+/** Read one message body (NULL at end of input) */
+static char* read_message(FILE* input) {
+    char header[256];
+    long length = -1;
+    bool ended = false;
+
+    while (fgets(header, sizeof(header), input) != NULL) {
+        if (header[0] == '\r' || header[0] == '\n') {
+            if (length >= 0) {
+                ended = true;
+                break;
+            }
+            continue;
+        }
+        if (strncasecmp(header, "Content-Length:", 15) == 0) {
+            length = strtol(header + 15, NULL, 10);
+        }
+    }
+    if (!ended || length < 0 || length > LSP_MAX_MESSAGE) {
+        if (ended) {
+            fprintf(stderr, "Error: Message of %ld bytes is too large\n", length);
+        }
+        return NULL;
+    }
+
+    char* body = malloc((size_t)length + 1);
+    if (body == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    if (fread(body, 1, (size_t)length, input) != (size_t)length) {
+        free(body);
+        return NULL;
+    }
+    body[length] = '\0';
+    return body;
+}
+
+/** Write the message built in the server's writer */
+static void send_message(LspServer* server) {
+    size_t length;
+    const char* data = json_writer_data(server->writer, &length);
+
+    fprintf(server->output, "Content-Length: %zu\r\n\r\n", length);
+    fwrite(data, 1, length, server->output);
+    fflush(server->output);
+    json_writer_reset(server->writer);
+}
+
+/** Write a request id (a number or a string) */
+static void write_id(JsonWriter* writer, const cJSON* id) {
+    if (cJSON_IsString(id)) {
+        json_writer_string(writer, id->valuestring);
+    } else if (cJSON_IsNumber(id)) {
+        json_writer_int(writer, (int64_t)id->valuedouble);
+    } else {
+        json_writer_null(writer);
+    }
+}
+
+/** Start a response; the caller writes the result and calls end_response() */
+static void begin_response(LspServer* server, const cJSON* id) {
+    JsonWriter* writer = server->writer;
+
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "jsonrpc");
+    json_writer_string(writer, "2.0");
+    json_writer_key(writer, "id");
+    write_id(writer, id);
+    json_writer_key(writer, "result");
+}
+
+static void end_response(LspServer* server) {
+    json_writer_end_object(server->writer);
+    send_message(server);
+}
+
+static void send_error(LspServer* server, const cJSON* id, int code, const char* message) {
+    JsonWriter* writer = server->writer;
+
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "jsonrpc");
+    json_writer_string(writer, "2.0");
+    json_writer_key(writer, "id");
+    write_id(writer, id);
+    json_writer_key(writer, "error");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "code");
+    json_writer_int(writer, code);
+    json_writer_key(writer, "message");
+    json_writer_string(writer, message);
+    json_writer_end_object(writer);
+    json_writer_end_object(writer);
+    send_message(server);
+}
+
+/* ---- Positions ---- */
+
+/** Length in bytes of the UTF-8 sequence starting with a byte */
+static int sequence_length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if ((lead & 0xE0) == 0xC0) return 2;
+    if ((lead & 0xF0) == 0xE0) return 3;
+    if ((lead & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+/** Advance over a number of characters of a line (stopping at its end) */
+static const char* advance_characters(const LspServer* server, const char* p, const char* end, int characters) {
+    while (characters > 0 && p < end && *p != '\n' && *p != '\r') {
+        int length = sequence_length((unsigned char)*p);
+        if (p + length > end) {
+            length = (int)(end - p);
+        }
+        characters -= server->utf8 ? length : (length == 4 ? 2 : 1);
+        p += length;
+    }
+    return p;
+}
+
+/** Count the characters between two points of a line */
+static int count_characters(const LspServer* server, const char* p, const char* end) {
+    int characters = 0;
+
+    while (p < end) {
+        int length = sequence_length((unsigned char)*p);
+        characters += server->utf8 ? length : (length == 4 ? 2 : 1);
+        p += length;
+    }
+    return characters;
+}
+
+/** Byte offset of an LSP position */
+static bool position_offset(const LspServer* server, const LspDocument* document,
+                            const cJSON* position, size_t* offset) {
+    const cJSON* line = cJSON_GetObjectItemCaseSensitive(position, "line");
+    const cJSON* character = cJSON_GetObjectItemCaseSensitive(position, "character");
+    size_t length;
+    const char* text = schema_document_text(document->document, &length);
+    size_t start;
+
+    if (!cJSON_IsNumber(line) || !cJSON_IsNumber(character) || line->valueint < 0 ||
+        !schema_document_line_offset(document->document, line->valueint + 1, &start)) {
+        return false;
+    }
+    *offset = (size_t)(advance_characters(server, text + start, text + length, character->valueint) - text);
+    return true;
+}
+
+/** Write a range covering a line (numbered from 1) */
+static void write_line_range(LspServer* server, const LspDocument* document, int line) {
+    JsonWriter* writer = server->writer;
+    size_t length;
+    const char* text = schema_document_text(document->document, &length);
+    size_t start;
+    int end_character = 0;
+
+    if (line < 1) {
+        line = 1;
+    }
+    if (schema_document_line_offset(document->document, line, &start)) {
+        const char* end = text + start;
+        while (end < text + length && *end != '\n' && *end != '\r') {
+            end++;
+        }
+        end_character = count_characters(server, text + start, end);
+    }
+
+    json_writer_key(writer, "range");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "start");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "line");
+    json_writer_int(writer, line - 1);
+    json_writer_key(writer, "character");
+    json_writer_int(writer, 0);
+    json_writer_end_object(writer);
+    json_writer_key(writer, "end");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "line");
+    json_writer_int(writer, line - 1);
+    json_writer_key(writer, "character");
+    json_writer_int(writer, end_character);
+    json_writer_end_object(writer);
+    json_writer_end_object(writer);
+}
+
+/* ---- Documents ---- */
+
+static LspDocument* find_document(LspServer* server, const char* uri) {
+    for (int i = 0; i < server->document_count; i++) {
+        if (strcmp(server->documents[i]->uri, uri) == 0) {
+            return server->documents[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_document(LspDocument* document) {
+    schema_document_free(document->document);
+    free(document->norms);
+    free(document->numbers);
+    free(document->uri);
+    free(document);
+}
+
+/** Get the document a request's textDocument parameter names */
+static LspDocument* document_param(LspServer* server, const cJSON* params) {
+    const cJSON* text_document = cJSON_GetObjectItemCaseSensitive(params, "textDocument");
+    const cJSON* uri = cJSON_GetObjectItemCaseSensitive(text_document, "uri");
+
+    return cJSON_IsString(uri) ? find_document(server, uri->valuestring) : NULL;
+}
+
+static unsigned number_hash(int number) {
+    return (unsigned)number * 2654435761u;
+}
+
+static void index_norm(void* user, Norm* norm, int line) {
+    LspDocument* document = user;
+
+    if (document->norm_count == document->norm_capacity) {
+        int capacity = document->norm_capacity > 0 ? document->norm_capacity * 2 : 64;
+        IndexedNorm* norms = realloc(document->norms, (size_t)capacity * sizeof(IndexedNorm));
+        if (norms == NULL) {
+            document->index_failed = true;
+            return;
+        }
+        document->norms = norms;
+        document->norm_capacity = capacity;
+    }
+    document->norms[document->norm_count].norm = norm;
+    document->norms[document->norm_count].line = line;
+    document->norm_count++;
+}
+
+/** Rebuild the norm index if the text changed since it was built */
+static bool index_document(LspDocument* document) {
+    if (document->indexed) {
+        return true;
+    }
+
+    document->norm_count = 0;
+    document->index_failed = false;
+    schema_document_visit_norms(document->document, index_norm, document);
+
+    int capacity = 16;
+    while (capacity < document->norm_count * 2) {
+        capacity *= 2;
+    }
+    if (capacity > document->number_capacity) {
+        int* numbers = realloc(document->numbers, (size_t)capacity * sizeof(int));
+        if (numbers == NULL) {
+            document->index_failed = true;
+        } else {
+            document->numbers = numbers;
+            document->number_capacity = capacity;
+        }
+    }
+    if (document->index_failed) {
+        fprintf(stderr, "Memory allocation error\n");
+        document->norm_count = 0;
+        return false;
+    }
+
+    /* The first norm with a number is the one references resolve to */
+    unsigned mask = (unsigned)document->number_capacity - 1;
+    memset(document->numbers, 0, (size_t)document->number_capacity * sizeof(int));
+    for (int i = 0; i < document->norm_count; i++) {
+        int number = document->norms[i].norm->number;
+        unsigned slot = number_hash(number) & mask;
+        while (document->numbers[slot] != 0 &&
+               document->norms[document->numbers[slot] - 1].norm->number != number) {
+            slot = (slot + 1) & mask;
+        }
+        if (document->numbers[slot] == 0) {
+            document->numbers[slot] = i + 1;
+        }
+    }
+    document->indexed = true;
+    return true;
+}
+
+/** Find the norm a number refers to (the index must be built) */
+static const IndexedNorm* find_norm(const LspDocument* document, int number) {
+    if (document->number_capacity == 0) {
+        return NULL;
+    }
+    unsigned mask = (unsigned)document->number_capacity - 1;
+    unsigned slot = number_hash(number) & mask;
+    while (document->numbers[slot] != 0) {
+        const IndexedNorm* indexed = &document->norms[document->numbers[slot] - 1];
+        if (indexed->norm->number == number) {
+            return indexed;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/* ---- Diagnostics ---- */
+
+typedef struct {
+    LspServer* server;
+    LspDocument* document;
+} DiagnosticWriter;
+
+static void write_diagnostic(DiagnosticWriter* out, int severity, int line, const char* message) {
+    JsonWriter* writer = out->server->writer;
+
+    json_writer_begin_object(writer);
+    write_line_range(out->server, out->document, line);
+    json_writer_key(writer, "severity");
+    json_writer_int(writer, severity);
+    json_writer_key(writer, "source");
+    json_writer_string(writer, LSP_SOURCE);
+    json_writer_key(writer, "message");
+    json_writer_string(writer, message);
+    json_writer_end_object(writer);
+}
+
+static void parser_diagnostic(void* user, ParseSeverity severity, int line, const char* message) {
+    write_diagnostic(user, severity == PARSE_ERROR ? LSP_SEVERITY_ERROR : LSP_SEVERITY_WARNING,
+                     line, message);
+}
+
+/** Publish the diagnostics of a document (none once it is closed) */
+static void publish_diagnostics(LspServer* server, LspDocument* document, bool closed) {
+    JsonWriter* writer = server->writer;
+    DiagnosticWriter out = { server, document };
+
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "jsonrpc");
+    json_writer_string(writer, "2.0");
+    json_writer_key(writer, "method");
+    json_writer_string(writer, "textDocument/publishDiagnostics");
+    json_writer_key(writer, "params");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "uri");
+    json_writer_string(writer, document->uri);
+    if (!closed) {
+        json_writer_key(writer, "version");
+        json_writer_int(writer, document->version);
+    }
+    json_writer_key(writer, "diagnostics");
+    json_writer_begin_array(writer);
+    if (!closed) {
+        schema_document_report(document->document, parser_diagnostic, &out);
+
+        /* Conditions on other norms that no norm defines */
+        if (index_document(document)) {
+            for (int i = 0; i < document->norm_count; i++) {
+                const IndexedNorm* indexed = &document->norms[i];
+                for (Condition* condition = indexed->norm->condition; condition != NULL;
+                     condition = condition->next) {
+                    /* A compound condition holds one reference per rule it names */
+                    const char* reference = condition->description;
+                    while ((reference = strstr(reference, LSP_NORM_REFERENCE)) != NULL) {
+                        char* end;
+                        int number = (int)strtol(reference + sizeof(LSP_NORM_REFERENCE) - 1, &end, 10);
+                        reference = end;
+                        if (find_norm(document, number) == NULL) {
+                            char message[128];
+                            snprintf(message, sizeof(message), "Norm %d refers to regla %d, which no norm defines",
+                                     indexed->norm->number, number);
+                            write_diagnostic(&out, LSP_SEVERITY_WARNING, indexed->line, message);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+    json_writer_end_object(writer);
+    send_message(server);
+}
+
+/* ---- References ---- */
+
+static bool is_word_byte(unsigned char c) {
+    return isalnum(c) || c >= 0x80 || c == '-' || c == '_';
+}
+
+static bool is_number(const char* start, const char* end) {
+    if (start == end) {
+        return false;
+    }
+    for (const char* p = start; p < end; p++) {
+        if (!isdigit((unsigned char)*p)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool word_is(const char* start, const char* end, const char* word) {
+    size_t length = strlen(word);
+    return (size_t)(end - start) == length && strncasecmp(start, word, length) == 0;
+}
+
+/** Find the word before a point of the same line */
+static bool previous_word(const char* line_start, const char* point, const char** start, const char** end) {
+    const char* p = point;
+    while (p > line_start && (p[-1] == ' ' || p[-1] == '\t')) {
+        p--;
+    }
+    *end = p;
+    while (p > line_start && is_word_byte((unsigned char)p[-1])) {
+        p--;
+    }
+    *start = p;
+    return *start < *end;
+}
+
+/**
+ * Get the norm number a reference at an offset names: the number or the
+ * keyword of "regla N", or the number of "violación de N"
+ */
+static int reference_at(const char* text, size_t length, size_t offset) {
+    const char* end_of_text = text + length;
+    const char* point = text + offset;
+
+    /* The word under the point, or the one just before it */
+    if ((point == end_of_text || !is_word_byte((unsigned char)*point)) &&
+        point > text && is_word_byte((unsigned char)point[-1])) {
+        point--;
+    }
+    if (point >= end_of_text || !is_word_byte((unsigned char)*point)) {
+        return -1;
+    }
+
+    const char* line_start = point;
+    while (line_start > text && line_start[-1] != '\n') {
+        line_start--;
+    }
+    const char* start = point;
+    while (start > line_start && is_word_byte((unsigned char)start[-1])) {
+        start--;
+    }
+    const char* end = point;
+    while (end < end_of_text && is_word_byte((unsigned char)*end)) {
+        end++;
+    }
+
+    const char* before_start;
+    const char* before_end;
+    if (is_number(start, end)) {
+        if (!previous_word(line_start, start, &before_start, &before_end)) {
+            return -1;
+        }
+        if (word_is(before_start, before_end, "regla")) {
+            return atoi(start);
+        }
+        const char* violation_start;
+        const char* violation_end;
+        if (word_is(before_start, before_end, "de") &&
+            previous_word(line_start, before_start, &violation_start, &violation_end) &&
+            (word_is(violation_start, violation_end, "violación") ||
+             word_is(violation_start, violation_end, "violacion"))) {
+            return atoi(start);
+        }
+        return -1;
+    }
+
+    if (word_is(start, end, "regla")) {
+        const char* number = end;
+        while (number < end_of_text && (*number == ' ' || *number == '\t')) {
+            number++;
+        }
+        const char* number_end = number;
+        while (number_end < end_of_text && isdigit((unsigned char)*number_end)) {
+            number_end++;
+        }
+        if (is_number(number, number_end)) {
+            return atoi(number);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the norm whose text holds a line: the last norm starting at or
+ * before it, unless a blank line lies between
+ */
+static const IndexedNorm* norm_at_line(const LspDocument* document, int line) {
+    int low = 0, high = document->norm_count;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (document->norms[middle].line <= line) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0) {
+        return NULL;
+    }
+
+    const IndexedNorm* indexed = &document->norms[low - 1];
+    size_t length;
+    const char* text = schema_document_text(document->document, &length);
+    size_t start, end;
+    if (!schema_document_line_offset(document->document, indexed->line, &start) ||
+        !schema_document_line_offset(document->document, line, &end)) {
+        return NULL;
+    }
+    for (const char* p = text + start; p < text + end; p++) {
+        if (*p != '\n') {
+            continue;
+        }
+        const char* q = p + 1;
+        while (q < text + end && (*q == ' ' || *q == '\t' || *q == '\r')) {
+            q++;
+        }
+        if (q < text + end && *q == '\n') {
+            return NULL;
+        }
+    }
+    return indexed;
+}
+
+/* ---- Hover ---- */
+
+static const char* deontic_keyword(DeonticOperator deontic) {
+    switch (deontic) {
+        case DEONTIC_OBLIGATION: return "debe";
+        case DEONTIC_PROHIBITION: return "no-debe";
+        case DEONTIC_PRIVILEGE: return "puede";
+        case DEONTIC_CLAIM_RIGHT: return "tiene-derecho-a";
+    }
+    return "";
+}
+
+static unsigned text_hash(const char* text) {
+    unsigned hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)text; *p != '\0'; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static void clear_hover_cache(LspServer* server) {
+    for (int i = 0; i < 2 * LSP_HOVER_CACHE; i++) {
+        free(server->hover[i].key);
+        free(server->hover[i].text);
+        server->hover[i].key = NULL;
+        server->hover[i].text = NULL;
+    }
+    server->hover_count = 0;
+}
+
+/** Build the markdown of a norm's context annotation */
+static char* annotation_text(const char* institution, Norm* norm) {
+    ContextAnnotation* annotation = context_annotate_norm(institution, norm);
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out;
+
+    if (annotation == NULL) {
+        return NULL;
+    }
+    out = open_memstream(&text, &size);
+    if (out == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        context_free_annotations(annotation, 1);
+        return NULL;
+    }
+    fprintf(out, "Role %s in context mappings.",
+            annotation->valid ? "found" : "not found");
+    if (annotation->mapped_role != NULL) {
+        fprintf(out, " Maps to `%s` in `%s`.", annotation->mapped_role, institution);
+    }
+    if (annotation->related != NULL) {
+        fprintf(out, "\n\n```\n%s", annotation->related);
+        size_t related = strlen(annotation->related);
+        if (related > 0 && annotation->related[related - 1] != '\n') {
+            fputc('\n', out);
+        }
+        fputs("```", out);
+    }
+    fclose(out);
+    context_free_annotations(annotation, 1);
+    return text;
+}
+
+/** Get a norm's context annotation from the cache, searching the context on a miss */
+static const char* cached_annotation(LspServer* server, const char* institution, Norm* norm) {
+    char* key = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&key, &size);
+
+    if (out == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    fprintf(out, "%s\x1f%s\x1f%s\x1f%s", institution, norm->role, norm->action,
+            norm->scope != NULL ? norm->scope->description : "");
+    fclose(out);
+
+    unsigned mask = 2 * LSP_HOVER_CACHE - 1;
+    unsigned slot = text_hash(key) & mask;
+    while (server->hover[slot].key != NULL) {
+        if (strcmp(server->hover[slot].key, key) == 0) {
+            free(key);
+            return server->hover[slot].text;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    char* text = annotation_text(institution, norm);
+    if (text == NULL) {
+        free(key);
+        return NULL;
+    }
+    if (server->hover_count == LSP_HOVER_CACHE) {
+        clear_hover_cache(server);
+        slot = text_hash(key) & mask;
+    }
+    server->hover[slot].key = key;
+    server->hover[slot].text = text;
+    server->hover_count++;
+    return text;
+}
+
+/** Write the markdown describing a norm */
+static void write_norm_markdown(LspServer* server, LspDocument* document, const IndexedNorm* indexed) {
+    Norm* norm = indexed->norm;
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+
+    if (out == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        json_writer_string(server->writer, "");
+        return;
+    }
+    fprintf(out, "**Regla %d** (line %d)\n\n`%s` **%s** %s", norm->number, indexed->line,
+            norm->role, deontic_keyword(norm->deontic), norm->action);
+    if (norm->scope != NULL) {
+        fprintf(out, " (%s)", norm->scope->description);
+    }
+    for (Condition* condition = norm->condition; condition != NULL; condition = condition->next) {
+        /* Each norm reference reads as the rule it names */
+        const char* text = condition->description;
+        const char* reference;
+        fputs("\n\n- si ", out);
+        while ((reference = strstr(text, LSP_NORM_REFERENCE)) != NULL) {
+            fprintf(out, "%.*sregla ", (int)(reference - text), text);
+            text = reference + sizeof(LSP_NORM_REFERENCE) - 1;
+        }
+        fputs(text, out);
+    }
+
+    const char* institution = schema_document_institution(document->document);
+    if (institution != NULL && context_is_initialized()) {
+        const char* annotation = cached_annotation(server, institution, norm);
+        if (annotation != NULL) {
+            fprintf(out, "\n\n---\n\n%s", annotation);
+        }
+    }
+    fclose(out);
+    json_writer_string_n(server->writer, text, size);
+    free(text);
+}
+
+/* ---- Requests ---- */
+
+static void handle_initialize(LspServer* server, const cJSON* id, const cJSON* params) {
+    JsonWriter* writer = server->writer;
+    const cJSON* capabilities = cJSON_GetObjectItemCaseSensitive(params, "capabilities");
+    const cJSON* general = cJSON_GetObjectItemCaseSensitive(capabilities, "general");
+    const cJSON* encodings = cJSON_GetObjectItemCaseSensitive(general, "positionEncodings");
+    const cJSON* encoding;
+
+    server->utf8 = false;
+    cJSON_ArrayForEach(encoding, encodings) {
+        if (cJSON_IsString(encoding) && strcmp(encoding->valuestring, "utf-8") == 0) {
+            server->utf8 = true;
+        }
+    }
+    server->initialized = true;
+
+    begin_response(server, id);
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "capabilities");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "positionEncoding");
+    json_writer_string(writer, server->utf8 ? "utf-8" : "utf-16");
+    json_writer_key(writer, "textDocumentSync");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "openClose");
+    json_writer_bool(writer, true);
+    json_writer_key(writer, "change");
+    json_writer_int(writer, 2);         // Incremental
+    json_writer_end_object(writer);
+    json_writer_key(writer, "hoverProvider");
+    json_writer_bool(writer, true);
+    json_writer_key(writer, "definitionProvider");
+    json_writer_bool(writer, true);
+    json_writer_end_object(writer);
+    json_writer_key(writer, "serverInfo");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, LSP_SOURCE);
+    json_writer_end_object(writer);
+    json_writer_end_object(writer);
+    end_response(server);
+}
+
+/** Find the norm a position refers to or lies in */
+static const IndexedNorm* norm_at_position(LspServer* server, LspDocument* document, const cJSON* params) {
+    const cJSON* position = cJSON_GetObjectItemCaseSensitive(params, "position");
+    size_t offset, length;
+    const char* text = schema_document_text(document->document, &length);
+
+    if (!position_offset(server, document, position, &offset) || !index_document(document)) {
+        return NULL;
+    }
+    int number = reference_at(text, length, offset);
+    if (number >= 0) {
+        return find_norm(document, number);
+    }
+    return norm_at_line(document, cJSON_GetObjectItemCaseSensitive(position, "line")->valueint + 1);
+}
+
+static void handle_definition(LspServer* server, const cJSON* id, const cJSON* params) {
+    JsonWriter* writer = server->writer;
+    LspDocument* document = document_param(server, params);
+    const cJSON* position = cJSON_GetObjectItemCaseSensitive(params, "position");
+    const IndexedNorm* target = NULL;
+    size_t offset, length;
+
+    if (document == NULL) {
+        send_error(server, id, LSP_INVALID_PARAMS, "Document is not open");
+        return;
+    }
+    const char* text = schema_document_text(document->document, &length);
+    if (position_offset(server, document, position, &offset) && index_document(document)) {
+        int number = reference_at(text, length, offset);
+        if (number >= 0) {
+            target = find_norm(document, number);
+        }
+    }
+
+    begin_response(server, id);
+    if (target == NULL) {
+        json_writer_null(writer);
+    } else {
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "uri");
+        json_writer_string(writer, document->uri);
+        write_line_range(server, document, target->line);
+        json_writer_end_object(writer);
+    }
+    end_response(server);
+}
+
+static void handle_hover(LspServer* server, const cJSON* id, const cJSON* params) {
+    JsonWriter* writer = server->writer;
+    LspDocument* document = document_param(server, params);
+
+    if (document == NULL) {
+        send_error(server, id, LSP_INVALID_PARAMS, "Document is not open");
+        return;
+    }
+
+    /* Linking attaches scopes written at the start of the next unit */
+    if (schema_document_error_count(document->document) == 0) {
+        schema_document_schema(document->document);
+    }
+    const IndexedNorm* target = norm_at_position(server, document, params);
+
+    begin_response(server, id);
+    if (target == NULL) {
+        json_writer_null(writer);
+    } else {
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "contents");
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "kind");
+        json_writer_string(writer, "markdown");
+        json_writer_key(writer, "value");
+        write_norm_markdown(server, document, target);
+        json_writer_end_object(writer);
+        write_line_range(server, document, target->line);
+        json_writer_end_object(writer);
+    }
+    end_response(server);
+}
+
+/* ---- Notifications ---- */
+
+static void handle_did_open(LspServer* server, const cJSON* params) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(params, "textDocument");
+    const cJSON* uri = cJSON_GetObjectItemCaseSensitive(item, "uri");
+    const cJSON* version = cJSON_GetObjectItemCaseSensitive(item, "version");
+    const cJSON* text = cJSON_GetObjectItemCaseSensitive(item, "text");
+
+    if (!cJSON_IsString(uri) || !cJSON_IsString(text)) {
+        return;
+    }
+
+    LspDocument* document = find_document(server, uri->valuestring);
+    if (document != NULL) {
+        /* Opened again: start over from the new text */
+        SchemaDocument* replacement = schema_document_create(text->valuestring, strlen(text->valuestring));
+        if (replacement == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return;
+        }
+        schema_document_free(document->document);
+        document->document = replacement;
+    } else {
+        if (server->document_count == server->document_capacity) {
+            int capacity = server->document_capacity > 0 ? server->document_capacity * 2 : 8;
+            LspDocument** documents = realloc(server->documents, (size_t)capacity * sizeof(LspDocument*));
+            if (documents == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                return;
+            }
+            server->documents = documents;
+            server->document_capacity = capacity;
+        }
+        document = calloc(1, sizeof(LspDocument));
+        if (document == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return;
+        }
+        document->uri = strdup(uri->valuestring);
+        document->document = schema_document_create(text->valuestring, strlen(text->valuestring));
+        if (document->uri == NULL || document->document == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            free_document(document);
+            return;
+        }
+        server->documents[server->document_count++] = document;
+    }
+    document->version = cJSON_IsNumber(version) ? version->valueint : 0;
+    document->indexed = false;
+    publish_diagnostics(server, document, false);
+}
+
+static void handle_did_change(LspServer* server, const cJSON* params) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(params, "textDocument");
+    const cJSON* version = cJSON_GetObjectItemCaseSensitive(item, "version");
+    const cJSON* changes = cJSON_GetObjectItemCaseSensitive(params, "contentChanges");
+    LspDocument* document = document_param(server, params);
+    const cJSON* change;
+
+    if (document == NULL) {
+        return;
+    }
+    cJSON_ArrayForEach(change, changes) {
+        const cJSON* range = cJSON_GetObjectItemCaseSensitive(change, "range");
+        const cJSON* text = cJSON_GetObjectItemCaseSensitive(change, "text");
+        size_t start, end;
+
+        if (!cJSON_IsString(text)) {
+            continue;
+        }
+        if (range == NULL) {
+            schema_document_text(document->document, &end);
+            start = 0;
+        } else if (!position_offset(server, document, cJSON_GetObjectItemCaseSensitive(range, "start"), &start) ||
+                   !position_offset(server, document, cJSON_GetObjectItemCaseSensitive(range, "end"), &end) ||
+                   end < start) {
+            fprintf(stderr, "Warning: Ignoring a change outside %s\n", document->uri);
+            continue;
+        }
+        if (!schema_document_edit(document->document, start, end - start,
+                                  text->valuestring, strlen(text->valuestring))) {
+            fprintf(stderr, "Warning: Could not apply a change to %s\n", document->uri);
+        }
+    }
+    document->version = cJSON_IsNumber(version) ? version->valueint : document->version;
+    document->indexed = false;
+    publish_diagnostics(server, document, false);
+}
+
+static void handle_did_close(LspServer* server, const cJSON* params) {
+    LspDocument* document = document_param(server, params);
+
+    if (document == NULL) {
+        return;
+    }
+    publish_diagnostics(server, document, true);
+    for (int i = 0; i < server->document_count; i++) {
+        if (server->documents[i] == document) {
+            server->documents[i] = server->documents[--server->document_count];
+            break;
+        }
+    }
+    free_document(document);
+}
+
+/* ---- Server ---- */
+
+/**
+ * Serve language server requests until the client exits
+ */
+bool lsp_serve(FILE* input, FILE* output) {
+    LspServer server;
+    char* body;
+    bool exited = false;
+
+    memset(&server, 0, sizeof(server));
+    server.output = output;
+    server.writer = json_writer_open(NULL);
+    server.hover = calloc(2 * LSP_HOVER_CACHE, sizeof(HoverEntry));
+    if (server.writer == NULL || server.hover == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        if (server.writer != NULL) {
+            json_writer_close(server.writer);
+        }
+        free(server.hover);
+        return false;
+    }
+
+    while (!exited && (body = read_message(input)) != NULL) {
+        cJSON* message = cJSON_Parse(body);
+        free(body);
+        if (message == NULL) {
+            fprintf(stderr, "Warning: Ignoring a message that is not JSON\n");
+            continue;
+        }
+
+        const cJSON* id = cJSON_GetObjectItemCaseSensitive(message, "id");
+        const cJSON* method = cJSON_GetObjectItemCaseSensitive(message, "method");
+        const cJSON* params = cJSON_GetObjectItemCaseSensitive(message, "params");
+        const char* name = cJSON_IsString(method) ? method->valuestring : "";
+
+        if (strcmp(name, "exit") == 0) {
+            exited = true;
+        } else if (id == NULL) {
+            /* Notifications; those the server does not know are ignored */
+            if (!server.initialized || server.shutdown) {
+                /* Only exit is allowed */
+            } else if (strcmp(name, "textDocument/didOpen") == 0) {
+                handle_did_open(&server, params);
+            } else if (strcmp(name, "textDocument/didChange") == 0) {
+                handle_did_change(&server, params);
+            } else if (strcmp(name, "textDocument/didClose") == 0) {
+                handle_did_close(&server, params);
+            }
+        } else if (method == NULL) {
+            /* A response to a request of ours; the server sends none */
+        } else if (strcmp(name, "initialize") == 0) {
+            handle_initialize(&server, id, params);
+        } else if (!server.initialized) {
+            send_error(&server, id, LSP_SERVER_NOT_INITIALIZED, "Server not initialized");
+        } else if (strcmp(name, "shutdown") == 0) {
+            server.shutdown = true;
+            begin_response(&server, id);
+            json_writer_null(server.writer);
+            end_response(&server);
+        } else if (strcmp(name, "textDocument/definition") == 0) {
+            handle_definition(&server, id, params);
+        } else if (strcmp(name, "textDocument/hover") == 0) {
+            handle_hover(&server, id, params);
+        } else {
+            send_error(&server, id, LSP_METHOD_NOT_FOUND, "Method not found");
+        }
+        cJSON_Delete(message);
+    }
+
+    for (int i = 0; i < server.document_count; i++) {
+        free_document(server.documents[i]);
+    }
+    free(server.documents);
+    clear_hover_cache(&server);
+    free(server.hover);
+    json_writer_close(server.writer);
+    return server.shutdown;
+}
@@ -0,0 +1,37 @@
+/**
+ * lsp_server.h
+ *
+ * Language server for schema files: speaks the Language Server Protocol
+ * (JSON-RPC messages with Content-Length headers) over a pair of
+ * streams, keeping each open file as an incrementally parsed document
+ */
+
+#ifndef LSP_SERVER_H
+#define LSP_SERVER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/**
+ * Serve language server requests until the client exits
+ *
+ * Open files are kept as documents (see schema_document.h) that edits
+ * reparse in part, with an index of their norms rebuilt when the text
+ * changes. The server publishes diagnostics after each change: the
+ * parser's (unknown roles and domains with suggestions, syntax errors)
+ * and references to rules that no norm defines. It answers
+ * go-to-definition for "regla N" and "violación de N" references and
+ * hover with a norm's clauses and, when a legal context is loaded, its
+ * context annotation. Annotations are cached by the norm's contents, so
+ * norms an edit does not change are not searched again.
+ *
+ * The calling thread's configuration and context are used throughout;
+ * nothing but protocol messages is written to the output.
+ *
+ * @param input Stream the client writes to (usually stdin)
+ * @param output Stream the client reads (usually stdout)
+ * @return true if the client shut the server down before exiting
+ */
+bool lsp_serve(FILE* input, FILE* output);
+
+#endif /* LSP_SERVER_H */
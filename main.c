@@ -7,170 +7,348 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "schema_types.h"
 #include "config_validator.h"
 #include "custom_tokenizer.h"
 #include "context_manager.h" // New inclusion for context support
+#include "context_store.h"
+#include "batch.h"
+#include "schema_image.h"
+#include "schema_json.h"
+#include "kelsen_optimizer.h"
+#include "parser_defs.h"
+#include "parallel_parser.h"
+#include "lsp_server.h"
 
-/* Function prototype from the Bison parser */
-extern Schema* parse_schema(FILE* input);
+/**
+ * Output formats of a transpilation
+ */
+typedef enum {
+    EMIT_KELSEN,        // Kelsen code (default)
+    EMIT_AST,           // Binary schema image, loadable in place of the schema text
+    EMIT_JSON,          // JSON document with the parsed schema and the parse diagnostics
+    EMIT_NDJSON         // Batch mode: Kelsen files plus one JSON record per input on stdout
+} EmitFormat;
 
 /**
  * Print usage information
  */
 void print_usage(const char* program_name) {
-    printf("Usage: %s [options] input_file [output_file]\n\n", program_name);
+    printf("Usage: %s [options] input_file [output_file]\n", program_name);
+    printf("       %s --batch [options] input_file...\n", program_name);
+    printf("       %s --compile-context context.json snapshot.ctx\n", program_name);
+    printf("       %s --lsp [-c FILE] [-x FILE]\n\n", program_name);
     printf("Options:\n");
     printf("  -h, --help       Display this help message\n");
     printf("  -v, --verbose    Enable verbose output\n");
-    printf("  -c, --config FILE  Specify configuration file (default: schema_config.json)\n");
-    printf("  -x, --context FILE Specify legal context file\n");  // New option
+    printf("  -c, --config FILE  Specify configuration file (default: built-in configuration)\n");
+    printf("  -x, --context FILE Specify legal context file (JSON or compiled snapshot)\n");  // New option
+    printf("  -a, --annotate     Append context annotations for each norm (needs -x)\n");
+    printf("  -j, --jobs N       Worker threads for parsing and annotation (default: one per CPU)\n");
+    printf("  -w, --watch        Keep running: re-transpile when the input changes and reload\n");
+    printf("                     the configuration and context when they change or on SIGHUP\n");
+    printf("  -b, --batch        Transpile every input file foo.txt to foo.kelsen, overlapping\n");
+    printf("                     reading, parsing, generation, writing and validation\n");
+    printf("  --no-validate      Do not run kelsen on the files written in batch mode\n");
+    printf("  --emit=FORMAT      Output format: kelsen (default); ast, a binary parsed schema\n");
+    printf("                     that can be given back as input_file to skip parsing; or json,\n");
+    printf("                     the parsed schema and the parse diagnostics. With --batch:\n");
+    printf("                     kelsen (default) or ndjson, one status record per file on stdout\n");
+    printf("  --inline-code      Include the Kelsen code in each NDJSON record\n");
+    printf("  -O, --optimize     Merge duplicate strings, assets and clauses and drop\n");
+    printf("                     declarations nothing refers to in the Kelsen code\n");
+    printf("  --parallel-parse   Split each large input where norms and paragraphs begin\n");
+    printf("                     and parse the pieces on several threads\n");
+    printf("  --compile-context IN OUT  Compile a legal context file into a binary snapshot\n");
+    printf("  --lsp              Run as a language server for editors on stdin and stdout\n");
     printf("\n");
     printf("If output_file is not specified, output is written to stdout.\n");
 }
 
 /**
- * Main function
+ * Compile a legal context JSON file into a binary snapshot
  */
-int main(int argc, char** argv) {
-    /* Default options */
-    int verbose = 0;
-    char* input_filename = NULL;
-    char* output_filename = NULL;
-    char* config_filename = "schema_config.json";
-    char* context_filename = NULL;  // Default: no context file
-    
-    /* Parse command-line arguments */
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
-            print_usage(argv[0]);
-            return EXIT_SUCCESS;
-        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
-            verbose = 1;
-        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--config") == 0) {
-            if (i + 1 < argc) {
-                config_filename = argv[++i];
-            } else {
-                fprintf(stderr, "Error: Missing argument for %s\n", argv[i]);
-                print_usage(argv[0]);
-                return EXIT_FAILURE;
-            }
-        } else if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--context") == 0) {
-            if (i + 1 < argc) {
-                context_filename = argv[++i];
-            } else {
-                fprintf(stderr, "Error: Missing argument for %s\n", argv[i]);
-                print_usage(argv[0]);
-                return EXIT_FAILURE;
-            }
-        } else if (input_filename == NULL) {
-            input_filename = argv[i];
-        } else if (output_filename == NULL) {
-            output_filename = argv[i];
-        } else {
-            fprintf(stderr, "Error: Too many arguments\n");
-            print_usage(argv[0]);
-            return EXIT_FAILURE;
-        }
+static int compile_context(const char* input, const char* output, int verbose) {
+    ContextStore* store = context_store_load(input);
+    if (store == NULL) {
+        fprintf(stderr, "Error: Failed to load legal context from %s\n", input);
+        return EXIT_FAILURE;
     }
-    
-    /* Check if input file is specified */
-    if (input_filename == NULL) {
-        fprintf(stderr, "Error: No input file specified\n");
-        print_usage(argv[0]);
+
+    bool ok = context_store_save(store, output);
+    if (ok && verbose) {
+        printf("Compiled %u sources and %u norms into %s (%u bytes)\n",
+               store->source_count, store->norm_count, output, store->image_size);
+    }
+
+    context_store_free(store);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Load a schema image written by --emit=ast
+ */
+static Schema* load_schema_image(const char* input_filename, int verbose) {
+    if (verbose) {
+        printf("Loading AST from %s...\n", input_filename);
+    }
+
+    SchemaImage* image = schema_image_open(input_filename);
+    if (image == NULL) {
+        return NULL;
+    }
+
+    Schema* schema = schema_image_load(image);
+    schema_image_close(image);
+    return schema;
+}
+
+/**
+ * Write a schema image to the output file, or stdout
+ */
+static int emit_schema_image(const Schema* schema, const char* output_filename, int verbose) {
+    FILE* output_file = output_filename != NULL ? fopen(output_filename, "wb") : stdout;
+    if (output_file == NULL) {
+        fprintf(stderr, "Error: Failed to open output file %s\n", output_filename);
         return EXIT_FAILURE;
     }
-    
-    /* Initialize configuration validator */
-    if (!config_init(config_filename)) {
-        fprintf(stderr, "Error: Failed to load configuration from %s\n", config_filename);
+
+    bool ok = schema_image_write(schema, output_file);
+    if (output_file != stdout) {
+        ok = fclose(output_file) == 0 && ok;
+    } else {
+        ok = fflush(stdout) == 0 && ok;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write AST\n");
         return EXIT_FAILURE;
     }
-    
-    /* Initialize context manager if a context file was specified */
-    if (context_filename != NULL) {
-        if (!legal_context_init(context_filename)) {
-            fprintf(stderr, "Error: Failed to load legal context from %s\n", context_filename);
-            config_cleanup();
-            return EXIT_FAILURE;
-        }
-        
-        if (verbose) {
-            printf("Legal context loaded from %s\n", context_filename);
+    if (verbose && output_filename != NULL) {
+        printf("AST written to %s\n", output_filename);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Write the parsed schema and its diagnostics as JSON to the output file, or stdout
+ */
+static int emit_schema_json(const char* input_filename, const Schema* schema,
+                            const SchemaDiagnostics* diagnostics, const char* output_filename, int verbose) {
+    FILE* output_file = output_filename != NULL ? fopen(output_filename, "w") : stdout;
+    if (output_file == NULL) {
+        fprintf(stderr, "Error: Failed to open output file %s\n", output_filename);
+        return EXIT_FAILURE;
+    }
+
+    JsonWriter* writer = json_writer_open(output_file);
+    if (writer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        if (output_file != stdout) {
+            fclose(output_file);
         }
+        return EXIT_FAILURE;
+    }
+
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "file");
+    json_writer_string(writer, input_filename);
+    json_writer_key(writer, "status");
+    json_writer_string(writer, schema != NULL ? "ok" : "error");
+    json_writer_key(writer, "schema");
+    if (schema != NULL) {
+        schema_json_write(writer, schema);
+    } else {
+        json_writer_null(writer);
+    }
+    json_writer_key(writer, "diagnostics");
+    schema_json_write_diagnostics(writer, diagnostics);
+    json_writer_end_object(writer);
+    json_writer_newline(writer);
+
+    bool ok = json_writer_close(writer);
+    if (output_file != stdout) {
+        ok = fclose(output_file) == 0 && ok;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write JSON\n");
+        return EXIT_FAILURE;
+    }
+    if (verbose && output_filename != NULL) {
+        printf("JSON written to %s\n", output_filename);
+    }
+    return schema != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Parse a schema file on several threads, reading it through a mapping
+ */
+static Schema* parse_file_parallel(FILE* input_file, const ParseOptions* options, int jobs) {
+    struct stat info;
+    if (fstat(fileno(input_file), &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        return parse_schema_with(input_file, options);
+    }
+    
+    void* text = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(input_file), 0);
+    if (text == MAP_FAILED) {
+        return parse_schema_with(input_file, options);
     }
     
+    Schema* schema = parse_schema_parallel((const char*)text, (size_t)info.st_size, options, jobs);
+    munmap(text, (size_t)info.st_size);
+    return schema;
+}
+
+/**
+ * Transpile with the configuration and context already pinned
+ */
+static int transpile_pinned(const char* input_filename, const char* output_filename, EmitFormat emit,
+                            bool with_context, int annotate, int optimize, int parallel_parse, int jobs,
+                            int verbose) {
     /* Open input file */
     FILE* input_file = fopen(input_filename, "r");
     if (input_file == NULL) {
         fprintf(stderr, "Error: Failed to open input file %s\n", input_filename);
-        if (context_filename != NULL) {
-            legal_context_cleanup();
-        }
-        config_cleanup();
         return EXIT_FAILURE;
     }
     
-    if (verbose) {
-        printf("Parsing schema from %s...\n", input_filename);
-    }
+    /* An AST image is loaded as it is; anything else is schema text */
+    char magic[sizeof(SCHEMA_IMAGE_MAGIC) - 1];
+    size_t magic_length = fread(magic, 1, sizeof(magic), input_file);
+    Schema* schema;
+    SchemaDiagnostics diagnostics = { NULL, 0, 0, 0 };
     
-    /* Parse schema */
-    Schema* schema = parse_schema(input_file);
+    if (schema_image_detect(magic, magic_length)) {
+        fclose(input_file);
+        schema = load_schema_image(input_filename, verbose);
+    } else {
+        rewind(input_file);
+        
+        if (verbose) {
+            printf("Parsing schema from %s...\n", input_filename);
+        }
+        
+        /*
+         * Parse schema; the trace would mix into a JSON document or image
+         * written to stdout, and for JSON diagnostics go into the document
+         */
+        ParseOptions options = { stdout, NULL, NULL };
+        if (emit == EMIT_JSON || emit == EMIT_AST) {
+            options.trace = NULL;
+        }
+        if (emit == EMIT_JSON) {
+            options.diagnostic = schema_diagnostics_collect;
+            options.user = &diagnostics;
+        }
+        if (parallel_parse) {
+            schema = parse_file_parallel(input_file, &options, jobs);
+        } else {
+            schema = parse_schema_with(input_file, &options);
+        }
+        
+        /* Close input file */
+        fclose(input_file);
+    }
     
-    /* Close input file */
-    fclose(input_file);
+    if (emit == EMIT_JSON) {
+        int status = emit_schema_json(input_filename, schema, &diagnostics, output_filename, verbose);
+        schema_diagnostics_clear(&diagnostics);
+        free_schema(schema);
+        return status;
+    }
     
     /* Check if parsing succeeded */
     if (schema == NULL) {
         fprintf(stderr, "Error: Failed to parse schema\n");
-        if (context_filename != NULL) {
-            legal_context_cleanup();
-        }
-        config_cleanup();
         return EXIT_FAILURE;
     }
     
+    if (emit == EMIT_AST) {
+        int status = emit_schema_image(schema, output_filename, verbose);
+        free_schema(schema);
+        return status;
+    }
+    
     if (verbose) {
         printf("Successfully parsed schema\n");
         printf("Generating Kelsen code...\n");
     }
 
+    /* Plain code is written straight into the output file, with no buffer in between */
+    bool mapped = output_filename != NULL && !with_context && !optimize;
+    
     /* Generate Kelsen code with context if available */
-    char* kelsen_code;
-    if (context_filename != NULL) {
+    char* kelsen_code = NULL;
+    if (mapped) {
+        if (!generate_kelsen_code_to_file(schema, output_filename)) {
+            free_schema(schema);
+            return EXIT_FAILURE;
+        }
+    } else if (with_context) {
         kelsen_code = generate_kelsen_code_with_context(schema);
     } else {
         kelsen_code = generate_kelsen_code(schema);
     }
 
-    if (kelsen_code == NULL) {
-        fprintf(stderr, "Error: Failed to generate Kelsen code\n");
-        if (context_filename != NULL) {
-            legal_context_cleanup();
+    /* Append per-norm context annotations if requested */
+    if (kelsen_code != NULL && annotate && with_context) {
+        char* annotations = generate_context_annotations(schema, jobs);
+        if (annotations != NULL) {
+            char* combined = (char*)realloc(kelsen_code, strlen(kelsen_code) + strlen(annotations) + 1);
+            if (combined != NULL) {
+                strcat(combined, annotations);
+                kelsen_code = combined;
+            }
+            free(annotations);
+        }
+    }
+
+    /* Optimize the complete program, annotations included */
+    if (kelsen_code != NULL && optimize) {
+        KelsenOptimizerStats stats;
+        char* optimized = kelsen_optimize(kelsen_code, &stats);
+        free(kelsen_code);
+        kelsen_code = optimized;
+        if (optimized != NULL) {
+            fprintf(stderr, "Optimized Kelsen code: %zu -> %zu declarations, %zu -> %zu bytes "
+                    "(%zu strings, %zu assets and %zu clauses merged, %zu unreferenced removed)\n",
+                    stats.declarations_before, stats.declarations_after, stats.bytes_before, stats.bytes_after,
+                    stats.strings_merged, stats.assets_merged, stats.clauses_merged, stats.unreferenced);
         }
+    }
+
+    if (verbose && with_context) {
+        printf("Legal sources loaded: %u of %u\n",
+               context_store_loaded_sources(context_get_store()), context_get_store()->source_count);
+    }
+
+    if (kelsen_code == NULL && !mapped) {
+        fprintf(stderr, "Error: Failed to generate Kelsen code\n");
         free_schema(schema);
-        config_cleanup();
         return EXIT_FAILURE;
     }
 
     /* Output Kelsen code */
     if (output_filename != NULL) {
-        FILE* output_file = fopen(output_filename, "w");
-        if (output_file == NULL) {
-            fprintf(stderr, "Error: Failed to open output file %s\n", output_filename);
-            free(kelsen_code);
-            if (context_filename != NULL) {
-                legal_context_cleanup();
+        if (!mapped) {
+            FILE* output_file = fopen(output_filename, "w");
+            if (output_file == NULL) {
+                fprintf(stderr, "Error: Failed to open output file %s\n", output_filename);
+                free(kelsen_code);
+                free_schema(schema);
+                return EXIT_FAILURE;
             }
-            free_schema(schema);
-            config_cleanup();
-            return EXIT_FAILURE;
+            
+            fputs(kelsen_code, output_file);
+            fclose(output_file);
         }
         
-        fputs(kelsen_code, output_file);
-        fclose(output_file);
-        
         if (verbose) {
             printf("Kelsen code written to %s\n", output_filename);
         }
@@ -193,15 +371,402 @@ int main(int argc, char** argv) {
         }
     } else {
         printf("%s", kelsen_code);
+        fflush(stdout);
     }
     
     /* Clean up */
     free(kelsen_code);
     free_schema(schema);
+    
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Parse one schema and write its Kelsen code
+ * 
+ * The configuration and context are pinned for the whole run, so a
+ * reload published meanwhile only affects the next run.
+ */
+static int transpile(const char* input_filename, const char* output_filename, EmitFormat emit,
+                     bool with_context, int annotate, int optimize, int parallel_parse, int jobs, int verbose) {
+    config_pin();
+    context_pin();
+    int status = transpile_pinned(input_filename, output_filename, emit, with_context, annotate, optimize,
+                                  parallel_parse, jobs, verbose);
+    context_unpin();
+    config_unpin();
+    return status;
+}
+
+/* Interval between checks for changed files in watch mode */
+#define WATCH_INTERVAL_MS 250
+
+/* Set by the signal handlers in watch mode */
+static volatile sig_atomic_t reload_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * Handle SIGHUP: ask for a reload
+ */
+static void request_reload(int sig) {
+    (void)sig;
+    reload_requested = 1;
+}
+
+/**
+ * Handle SIGINT and SIGTERM: ask to stop watching
+ */
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Modification stamp of a watched file */
+typedef struct {
+    struct timespec mtime;
+    off_t size;
+} FileStamp;
+
+/**
+ * Get the current stamp of a file (zero if absent)
+ */
+static FileStamp file_stamp(const char* path) {
+    FileStamp stamp = { { 0, 0 }, -1 };
+    struct stat info;
+    if (path != NULL && stat(path, &info) == 0) {
+        stamp.mtime = info.st_mtim;
+        stamp.size = info.st_size;
+    }
+    return stamp;
+}
+
+/**
+ * Check whether a file changed since its stamp, updating the stamp
+ */
+static bool file_changed(FileStamp* stamp, const char* path) {
+    FileStamp now = file_stamp(path);
+    bool changed = now.mtime.tv_sec != stamp->mtime.tv_sec || now.mtime.tv_nsec != stamp->mtime.tv_nsec ||
+                   now.size != stamp->size;
+    *stamp = now;
+    return changed;
+}
+
+/* A reload of the configuration and legal context, run in the background */
+typedef struct {
+    const char* config_filename;        // NULL for the built-in configuration
+    const char* context_filename;
+    bool ok;
+    double milliseconds;        // Reload latency, from the start of the rebuild to publication
+    int done;                   // Set when the reload has finished (read atomically)
+} ReloadJob;
+
+/**
+ * Rebuild and publish the configuration and legal context
+ */
+static void* reload_worker(void* arg) {
+    ReloadJob* job = (ReloadJob*)arg;
+    struct timespec start, end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    job->ok = (job->config_filename == NULL || config_init(job->config_filename)) &&
+              (job->context_filename == NULL || legal_context_init(job->context_filename));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    job->milliseconds = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * Transpile, then keep watching the input, configuration and context
+ * 
+ * Reloads run on a background thread and are published atomically, so
+ * a transpilation started meanwhile finishes on the snapshots it began
+ * with. The program is transpiled again once a reload is published.
+ */
+static int watch(const char* input_filename, const char* output_filename, EmitFormat emit,
+                 const char* config_filename, const char* context_filename, int annotate, int optimize,
+                 int parallel_parse, int jobs, int verbose) {
+    signal(SIGHUP, request_reload);
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    
+    FileStamp input_stamp = file_stamp(input_filename);
+    FileStamp config_stamp = file_stamp(config_filename);
+    FileStamp context_stamp = file_stamp(context_filename);
+    
+    transpile(input_filename, output_filename, emit, context_filename != NULL, annotate, optimize,
+              parallel_parse, jobs, verbose);
+    fprintf(stderr, "Watching %s for changes (SIGHUP reloads the configuration and context)\n", input_filename);
+    
+    ReloadJob job;
+    pthread_t reloader;
+    bool reloading = false;
+    bool joinable = false;
+    bool reload_pending = false;
+    int reload_count = 0;
+    double reload_max_ms = 0;
+    
+    while (!stop_requested) {
+        struct timespec interval = { 0, WATCH_INTERVAL_MS * 1000000L };
+        nanosleep(&interval, NULL);
+        
+        bool input_changed = file_changed(&input_stamp, input_filename);
+        bool config_changed = file_changed(&config_stamp, config_filename);
+        bool context_changed = context_filename != NULL && file_changed(&context_stamp, context_filename);
+        if (config_changed || context_changed || reload_requested) {
+            reload_requested = 0;
+            reload_pending = true;
+        }
+        
+        /* Collect a finished reload */
+        if (reloading && __atomic_load_n(&job.done, __ATOMIC_ACQUIRE)) {
+            if (joinable) {
+                pthread_join(reloader, NULL);
+            }
+            reloading = false;
+            
+            if (job.ok) {
+                reload_count++;
+                if (job.milliseconds > reload_max_ms) {
+                    reload_max_ms = job.milliseconds;
+                }
+                fprintf(stderr, "Reload %d published in %.2f ms (max %.2f ms)\n",
+                        reload_count, job.milliseconds, reload_max_ms);
+                input_changed = true;
+            } else {
+                fprintf(stderr, "Error: Reload failed; keeping the current configuration and context\n");
+            }
+        }
+        
+        /* Start a reload; only one runs at a time */
+        if (reload_pending && !reloading) {
+            reload_pending = false;
+            job.config_filename = config_filename;
+            job.context_filename = context_filename;
+            job.done = 0;
+            reloading = true;
+            joinable = pthread_create(&reloader, NULL, reload_worker, &job) == 0;
+            if (!joinable) {
+                reload_worker(&job);
+            }
+        }
+        
+        if (input_changed) {
+            if (verbose) {
+                printf("Transpiling %s...\n", input_filename);
+            }
+            transpile(input_filename, output_filename, emit, context_filename != NULL, annotate, optimize,
+              parallel_parse, jobs, verbose);
+        }
+    }
+    
+    if (reloading && joinable) {
+        pthread_join(reloader, NULL);
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char** argv) {
+    /* Default options */
+    int verbose = 0;
+    char* input_filename = NULL;
+    char* output_filename = NULL;
+    char* config_filename = NULL;  // Default: built-in configuration
+    char* context_filename = NULL;  // Default: no context file
+    int annotate = 0;
+    int jobs = 0;  // 0 = one worker per online CPU
+    int watch_mode = 0;
+    int batch_mode = 0;
+    int validate = 1;
+    EmitFormat emit = EMIT_KELSEN;
+    int inline_code = 0;
+    int optimize = 0;
+    int parallel_parse = 0;
+    int lsp_mode = 0;
+    char* compile_input = NULL;
+    char* compile_output = NULL;
+    
+    /* Positional arguments: input [output], or every input in batch mode */
+    char** files = (char**)malloc(argc * sizeof(char*));
+    int file_count = 0;
+    if (files == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return EXIT_FAILURE;
+    }
+    
+    /* Parse command-line arguments */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--config") == 0) {
+            if (i + 1 < argc) {
+                config_filename = argv[++i];
+            } else {
+                fprintf(stderr, "Error: Missing argument for %s\n", argv[i]);
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--context") == 0) {
+            if (i + 1 < argc) {
+                context_filename = argv[++i];
+            } else {
+                fprintf(stderr, "Error: Missing argument for %s\n", argv[i]);
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--annotate") == 0) {
+            annotate = 1;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 < argc) {
+                jobs = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: Missing argument for %s\n", argv[i]);
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--watch") == 0) {
+            watch_mode = 1;
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0) {
+            batch_mode = 1;
+        } else if (strcmp(argv[i], "--no-validate") == 0) {
+            validate = 0;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "kelsen") == 0) {
+                emit = EMIT_KELSEN;
+            } else if (strcmp(argv[i] + 7, "ast") == 0) {
+                emit = EMIT_AST;
+            } else if (strcmp(argv[i] + 7, "json") == 0) {
+                emit = EMIT_JSON;
+            } else if (strcmp(argv[i] + 7, "ndjson") == 0) {
+                emit = EMIT_NDJSON;
+            } else {
+                fprintf(stderr, "Error: Unknown output format %s\n", argv[i] + 7);
+                print_usage(argv[0]);
+                free(files);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--inline-code") == 0) {
+            inline_code = 1;
+        } else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0) {
+            optimize = 1;
+        } else if (strcmp(argv[i], "--parallel-parse") == 0) {
+            parallel_parse = 1;
+        } else if (strcmp(argv[i], "--lsp") == 0) {
+            lsp_mode = 1;
+        } else if (strcmp(argv[i], "--compile-context") == 0) {
+            if (i + 2 < argc) {
+                compile_input = argv[++i];
+                compile_output = argv[++i];
+            } else {
+                fprintf(stderr, "Error: --compile-context needs an input and an output file\n");
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            files[file_count++] = argv[i];
+        }
+    }
+    
+    if (lsp_mode && (batch_mode || watch_mode || file_count > 0)) {
+        fprintf(stderr, "Error: --lsp takes no input files and cannot be combined with --batch or --watch\n");
+        free(files);
+        return EXIT_FAILURE;
+    } else if (!batch_mode) {
+        if (emit == EMIT_NDJSON) {
+            fprintf(stderr, "Error: --emit=ndjson needs --batch\n");
+            free(files);
+            return EXIT_FAILURE;
+        }
+        if (file_count > 2) {
+            fprintf(stderr, "Error: Too many arguments\n");
+            print_usage(argv[0]);
+            free(files);
+            return EXIT_FAILURE;
+        }
+        input_filename = file_count > 0 ? files[0] : NULL;
+        output_filename = file_count > 1 ? files[1] : NULL;
+    } else if (watch_mode) {
+        fprintf(stderr, "Error: --batch cannot be combined with --watch\n");
+        free(files);
+        return EXIT_FAILURE;
+    } else if (emit != EMIT_KELSEN && emit != EMIT_NDJSON) {
+        fprintf(stderr, "Error: --batch only writes Kelsen code and NDJSON records\n");
+        free(files);
+        return EXIT_FAILURE;
+    } else if (file_count > 0) {
+        input_filename = files[0];
+    }
+    
+    /* Compiling a context snapshot needs no schema or configuration */
+    if (compile_input != NULL) {
+        free(files);
+        return compile_context(compile_input, compile_output, verbose);
+    }
+    
+    /* Check if input file is specified */
+    if (input_filename == NULL && !lsp_mode) {
+        fprintf(stderr, "Error: No input file specified\n");
+        print_usage(argv[0]);
+        free(files);
+        return EXIT_FAILURE;
+    }
+    
+    /* Initialize configuration validator */
+    if (config_filename == NULL) {
+        if (!config_init_default()) {
+            fprintf(stderr, "Error: Failed to load the built-in configuration\n");
+            free(files);
+            return EXIT_FAILURE;
+        }
+    } else if (!config_init(config_filename)) {
+        fprintf(stderr, "Error: Failed to load configuration from %s\n", config_filename);
+        free(files);
+        return EXIT_FAILURE;
+    }
+    
+    /* Initialize context manager if a context file was specified */
+    if (context_filename != NULL) {
+        if (!legal_context_init(context_filename)) {
+            fprintf(stderr, "Error: Failed to load legal context from %s\n", context_filename);
+            config_cleanup();
+            free(files);
+            return EXIT_FAILURE;
+        }
+        
+        if (verbose && !lsp_mode) {
+            printf("Legal context loaded from %s\n", context_filename);
+        }
+    }
+    
+    int status;
+    if (lsp_mode) {
+        status = lsp_serve(stdin, stdout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (batch_mode) {
+        BatchOptions batch = { files, file_count, context_filename != NULL, annotate != 0, validate != 0, jobs,
+                               emit == EMIT_NDJSON, inline_code != 0, optimize != 0, parallel_parse != 0 };
+        status = batch_run(&batch) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (watch_mode) {
+        status = watch(input_filename, output_filename, emit, config_filename, context_filename,
+                       annotate, optimize, parallel_parse, jobs, verbose);
+    } else {
+        status = transpile(input_filename, output_filename, emit, context_filename != NULL,
+                           annotate, optimize, parallel_parse, jobs, verbose);
+    }
+    
+    /* Clean up */
     if (context_filename != NULL) {
         legal_context_cleanup();
     }
     config_cleanup();
+    free(files);
     
-    return EXIT_SUCCESS;
+    return status;
 }
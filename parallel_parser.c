@@ -0,0 +1,273 @@
+/**
+ * parallel_parser.c
+ *
+ * Implementation of the parallel parse of one large schema
+ *
+ * The unit scan only looks at line starts, so it costs a small fraction
+ * of tokenizing the text. A cut can only go wrong by landing inside a
+ * unit, and then a piece fails to parse and the whole text is parsed
+ * again in one piece. Tokens never span lines, so the pieces are
+ * tokenized as in the whole text.
+ */
+
+#include "parallel_parser.h"
+#include "config_validator.h"
+#include "schema_json.h"
+#include "schema_units.h"
+#include "task_scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Smallest piece worth a task of its own */
+#define PARSE_MIN_PIECE 16384
+
+/* Pieces per scheduler worker, so pieces of uneven cost still balance */
+#define PARSE_PIECES_PER_WORKER 4
+
+/* One piece of the text and the result of parsing it */
+typedef struct {
+    const char* text;
+    size_t length;
+    int first_line;                 // Line number of the piece's first line
+    const char* institution;        // Institution of the schema, for role checks
+    SharedSnapshot* config;         // Configuration of the calling thread
+    Schema* schema;                 // Partial schema, NULL if the piece did not parse
+    char* leading_scope;            // Scope for the last norm of the pieces before
+    SchemaDiagnostics diagnostics;  // Held until the pieces before have reported
+} ParsePiece;
+
+/* Ends of the lists of the schema being assembled */
+typedef struct {
+    Norm* last_norm;
+    Norm** norms;
+    Violation** violations;
+    LegalFact** facts;
+    Agenda** agendas;
+} ListEnds;
+
+/**
+ * Parse one piece, holding back its diagnostics
+ */
+static void parse_piece(ParsePiece* piece, bool declaration) {
+    ParseOptions options = { NULL, schema_diagnostics_collect, &piece->diagnostics };
+    FILE* input = fmemopen((void*)piece->text, piece->length, "r");
+    if (input != NULL) {
+        piece->schema = parse_schema_part(input, &options, piece->first_line, declaration, &piece->leading_scope);
+        fclose(input);
+    }
+}
+
+/**
+ * Task: parse a piece of norms, violations, facts and agendas
+ */
+static void parse_piece_task(void* arg) {
+    ParsePiece* piece = (ParsePiece*)arg;
+
+    /* Swap rather than pin: a worker may run this while helping with another file */
+    SharedSnapshot* previous = config_use(piece->config);
+    config_set_current_institution(piece->institution);
+    parse_piece(piece, false);
+    config_set_current_institution(NULL);
+    config_use(previous);
+}
+
+/**
+ * Release what a piece holds
+ */
+static void free_piece(ParsePiece* piece) {
+    schema_diagnostics_clear(&piece->diagnostics);
+    free(piece->leading_scope);
+    free_schema(piece->schema);
+}
+
+/**
+ * Deliver the held diagnostics of a piece
+ */
+static void report_piece(const ParsePiece* piece, const ParseOptions* options) {
+    for (int i = 0; i < piece->diagnostics.count; i++) {
+        const SchemaDiagnostic* diagnostic = &piece->diagnostics.items[i];
+        parse_report(options, diagnostic->severity, diagnostic->line, diagnostic->message);
+    }
+}
+
+/**
+ * Advance the ends to the last nodes of the assembled lists
+ */
+static void find_ends(ListEnds* ends) {
+    while (*ends->norms != NULL) {
+        ends->last_norm = *ends->norms;
+        ends->norms = &ends->last_norm->next;
+    }
+    while (*ends->violations != NULL) {
+        ends->violations = &(*ends->violations)->next;
+    }
+    while (*ends->facts != NULL) {
+        ends->facts = &(*ends->facts)->next;
+    }
+    while (*ends->agendas != NULL) {
+        ends->agendas = &(*ends->agendas)->next;
+    }
+}
+
+/**
+ * Move the lists of a partial schema to the ends of the assembled lists
+ */
+static void append_lists(ListEnds* ends, Schema* part, char* leading_scope) {
+    /* Without a norm before it the scope is dropped, as in a serial parse */
+    if (leading_scope != NULL && ends->last_norm != NULL) {
+        add_scope_to_norm(ends->last_norm, leading_scope);
+    }
+    *ends->norms = part->norms;
+    *ends->violations = part->violations;
+    *ends->facts = part->facts;
+    *ends->agendas = part->agendas;
+    part->norms = NULL;
+    part->violations = NULL;
+    part->facts = NULL;
+    part->agendas = NULL;
+    find_ends(ends);
+}
+
+/**
+ * Parse the whole text in one piece
+ */
+static Schema* parse_whole(const char* text, size_t length, const ParseOptions* options) {
+    FILE* input = length > 0 ? fmemopen((void*)text, length, "r") : NULL;
+    if (input == NULL) {
+        fprintf(stderr, "Failed to initialize tokenizer\n");
+        return NULL;
+    }
+
+    Schema* schema = parse_schema_with(input, options);
+    fclose(input);
+    return schema;
+}
+
+/**
+ * Parse a schema held in memory on several threads
+ */
+Schema* parse_schema_parallel(const char* text, size_t length, const ParseOptions* options, int threads) {
+    /* The institution declaration runs up to the first boundary */
+    UnitScan scan;
+    unit_scan_start(&scan, text, length, 1);
+    if (!unit_scan_next(&scan)) {
+        return parse_whole(text, length, options);
+    }
+    size_t body_length = length - (size_t)(scan.position - text);
+    size_t most_pieces = body_length / PARSE_MIN_PIECE;
+
+    /* Inside a task the pieces go to the caller's pool, where idle workers steal them */
+    TaskScheduler* scheduler = task_scheduler_current();
+    TaskScheduler* own_scheduler = NULL;
+    if (scheduler == NULL) {
+        if (threads <= 0) {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = online > 0 ? (int)online : 1;
+        }
+        if ((size_t)threads > most_pieces) {
+            threads = (int)most_pieces;
+        }
+        if (threads > 1) {
+            own_scheduler = task_scheduler_create(threads);
+            scheduler = own_scheduler;
+        }
+    }
+
+    size_t piece_count = scheduler != NULL ? (size_t)task_scheduler_workers(scheduler) * PARSE_PIECES_PER_WORKER : 0;
+    if (piece_count > most_pieces) {
+        piece_count = most_pieces;
+    }
+    ParsePiece* pieces = piece_count >= 2 ? (ParsePiece*)calloc(piece_count + 1, sizeof(ParsePiece)) : NULL;
+    if (pieces == NULL) {
+        task_scheduler_destroy(own_scheduler);
+        return parse_whole(text, length, options);
+    }
+
+    /* pieces[0] is the declaration; the body is cut at the first boundary past each share */
+    pieces[0].text = text;
+    pieces[0].length = (size_t)(scan.position - text);
+    pieces[0].first_line = 1;
+
+    size_t share = body_length / piece_count;
+    size_t count = 1;
+    const char* start = scan.position;
+    int start_line = scan.line;
+    while (unit_scan_next(&scan)) {
+        if ((size_t)(scan.position - start) >= share && count < piece_count) {
+            pieces[count].text = start;
+            pieces[count].length = (size_t)(scan.position - start);
+            pieces[count].first_line = start_line;
+            count++;
+            start = scan.position;
+            start_line = scan.line;
+        }
+    }
+    pieces[count].text = start;
+    pieces[count].length = (size_t)(text + length - start);
+    pieces[count].first_line = start_line;
+    count++;
+
+    /* The declaration sets the institution the other pieces check roles against */
+    parse_piece(&pieces[0], true);
+    bool ok = pieces[0].schema != NULL;
+
+    if (ok) {
+        SharedSnapshot* config = config_acquire();
+        TaskGroup group;
+        task_group_init(&group);
+        for (size_t i = 1; i < count; i++) {
+            pieces[i].institution = pieces[0].schema->institution.name;
+            pieces[i].config = config;
+            task_spawn(scheduler, &group, parse_piece_task, &pieces[i]);
+        }
+        task_group_wait(scheduler, &group, 0);
+        task_group_destroy(&group);
+        shared_snapshot_release(config);
+
+        UnitSection section = UNIT_NO_SECTION;
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = pieces[i].schema != NULL && unit_follows(pieces[i].schema, &section);
+        }
+    }
+    config_set_current_institution(NULL);
+    task_scheduler_destroy(own_scheduler);
+
+    /*
+     * A piece that does not parse may have been cut inside a unit; for
+     * sections out of order the serial parse reports where
+     */
+    if (!ok) {
+        for (size_t i = 0; i < count; i++) {
+            free_piece(&pieces[i]);
+        }
+        free(pieces);
+        return parse_whole(text, length, options);
+    }
+
+    /* Join the pieces in document order */
+    Schema* schema = pieces[0].schema;
+    pieces[0].schema = NULL;
+    ListEnds ends = { NULL, &schema->norms, &schema->violations, &schema->facts, &schema->agendas };
+    find_ends(&ends);
+    for (size_t i = 0; i < count; i++) {
+        report_piece(&pieces[i], options);
+        if (pieces[i].schema != NULL) {
+            append_lists(&ends, pieces[i].schema, pieces[i].leading_scope);
+        }
+        free_piece(&pieces[i]);
+    }
+    free(pieces);
+
+    if (options->trace != NULL) {
+        fprintf(options->trace, "Successfully parsed schema\n");
+    }
+
+    /* Complete the schema with the default norms of its legal domain */
+    int defaults = config_add_default_norms(schema);
+    if (defaults > 0 && options->trace != NULL) {
+        fprintf(options->trace, "Added %d default norms for %s\n", defaults, schema->institution.legal_domain);
+    }
+
+    return schema;
+}
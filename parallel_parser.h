@@ -0,0 +1,40 @@
+/**
+ * parallel_parser.h
+ *
+ * Parallel parse of one large schema: the text is split where norms and
+ * paragraphs begin, the pieces are parsed on scheduler workers, and the
+ * partial lists are joined into one schema in document order
+ */
+
+#ifndef PARALLEL_PARSER_H
+#define PARALLEL_PARSER_H
+
+#include <stddef.h>
+#include "parser_defs.h"
+
+/**
+ * Parse a schema held in memory on several threads
+ *
+ * A scan of the text finds where its units begin (see schema_units.h).
+ * The institution declaration is parsed first; the rest is cut at unit
+ * starts into pieces of similar size that are parsed as tasks with
+ * their own tokenizer and parser state, using the calling thread's
+ * configuration. From a scheduler worker the tasks go to its
+ * pool; from any other thread a pool is started for the parse. Line
+ * numbers refer to the whole text, and diagnostics are delivered on the
+ * calling thread in document order.
+ *
+ * The result is the schema parse_schema_with() would build. Text too
+ * small to be worth splitting, or a split that does not parse, is
+ * parsed in one piece instead. When the text is split the token trace
+ * is not written, only the summary lines.
+ *
+ * @param text Schema text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @param options Trace and diagnostic options
+ * @param threads Threads to use when not called from a scheduler worker (0 = one per online CPU)
+ * @return The parsed schema, or NULL on error
+ */
+Schema* parse_schema_parallel(const char* text, size_t length, const ParseOptions* options, int threads);
+
+#endif /* PARALLEL_PARSER_H */
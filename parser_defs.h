@@ -1,26 +1,93 @@
 /**
  * parser_defs.h
  * 
- * Shared definitions between the parser and tokenizer
+ * Shared definitions between the parser and its callers
  */
 
 #ifndef PARSER_DEFS_H
 #define PARSER_DEFS_H
 
+#include <stdio.h>
+#include <stdbool.h>
 #include "schema_types.h"
 
-#define YYSTYPE_IS_DECLARED 1
-typedef union YYSTYPE YYSTYPE;
+/**
+ * Severity of a parse diagnostic
+ */
+typedef enum {
+    PARSE_WARNING,              // Suspicious input that was accepted (e.g., unknown role)
+    PARSE_ERROR                 // Syntax error; the parse fails
+} ParseSeverity;
 
-/* Semantic value union - must match the %union in schema_parser.y */
-union YYSTYPE {
-    char *string;
-    int number;
-    DeonticOperator deontic;
-    ComplianceType compliance;
-};
+/**
+ * Callback receiving parse diagnostics
+ * 
+ * @param user User data from the parse options
+ * @param severity Severity of the diagnostic
+ * @param line Input line the parser was on
+ * @param message Message text (no trailing newline)
+ */
+typedef void (*ParseDiagnosticFn)(void* user, ParseSeverity severity, int line, const char* message);
 
-/* Global yylval that will be set by the tokenizer and read by the parser */
-extern YYSTYPE yylval;
+/**
+ * Options for one parse
+ */
+typedef struct {
+    FILE* trace;                    // Stream receiving a token trace, or NULL for none
+    ParseDiagnosticFn diagnostic;   // Diagnostic callback, or NULL to print to stderr
+    void* user;                     // User data passed to the callback
+} ParseOptions;
+
+/**
+ * Parse a schema, tracing tokens to stdout and printing diagnostics to stderr
+ * 
+ * @param input File to parse
+ * @return The parsed schema, or NULL on error
+ */
+Schema* parse_schema(FILE* input);
+
+/**
+ * Parse a schema with explicit options
+ * 
+ * The parser keeps no global state, so different threads may parse at
+ * the same time. Validation uses the calling thread's configuration.
+ * 
+ * @param input File to parse
+ * @param options Trace and diagnostic options
+ * @return The parsed schema, or NULL on error
+ */
+Schema* parse_schema_with(FILE* input, const ParseOptions* options);
+
+/**
+ * Parse part of a schema
+ * 
+ * With a declaration the part starts with the institution declaration,
+ * which becomes the calling thread's current institution (see
+ * config_set_current_institution()). Without one the part holds only
+ * norms, violations, facts and agendas, and its roles are checked
+ * against the current institution, which the caller sets. Default norms
+ * are not added and the current institution is left as it is.
+ * 
+ * @param input File holding the part
+ * @param options Trace and diagnostic options
+ * @param first_line Line number of the part's first line in the whole schema
+ * @param declaration Whether the part starts with the institution declaration
+ * @param leading_scope Receives the scope of the part's first norm, which the
+ *        grammar gives to the norm before it, or NULL (free with free());
+ *        may be NULL
+ * @return The partial schema, or NULL on error
+ */
+Schema* parse_schema_part(FILE* input, const ParseOptions* options, int first_line, bool declaration,
+                          char** leading_scope);
+
+/**
+ * Deliver a diagnostic as the parser does
+ * 
+ * @param options Options naming the diagnostic callback (NULL callback prints to stderr)
+ * @param severity Severity of the diagnostic
+ * @param line Input line the diagnostic refers to
+ * @param message Message text (no trailing newline)
+ */
+void parse_report(const ParseOptions* options, ParseSeverity severity, int line, const char* message);
 
 #endif /* PARSER_DEFS_H */
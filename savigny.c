@@ -0,0 +1,323 @@
+/**
+ * savigny.c
+ *
+ * Implementation of the embeddable C API
+ *
+ * Configurations and contexts are the same reference-counted snapshots
+ * the command-line tool publishes; each call makes the calling thread use
+ * the handles' snapshots for its duration, so the modules underneath see
+ * per-call state instead of process-wide globals.
+ */
+
+#define _GNU_SOURCE
+#include "savigny.h"
+#include "config_validator.h"
+#include "context_manager.h"
+#include "kelsen_optimizer.h"
+#include "parser_defs.h"
+#include "schema_document.h"
+#include "schema_types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sv_config {
+    SharedSnapshot* snapshot;
+};
+
+struct sv_context {
+    SharedSnapshot* snapshot;
+};
+
+struct sv_schema {
+    Schema* schema;
+    SharedSnapshot* config;     // Configuration the schema was parsed with (code generation reads it too)
+};
+
+struct sv_document {
+    SharedSnapshot* config;
+    SchemaDocument* document;
+    sv_schema view;             // Handle on the document's schema
+};
+
+/* Caller's diagnostic callback, adapted to the parser's */
+typedef struct {
+    sv_diagnostic_fn diagnostic;
+    void* user;
+} DiagnosticTarget;
+
+/**
+ * Wrap a configuration snapshot in a handle
+ */
+static sv_config* wrap_config(SharedSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    sv_config* config = (sv_config*)malloc(sizeof(sv_config));
+    if (config == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        shared_snapshot_release(snapshot);
+        return NULL;
+    }
+
+    config->snapshot = snapshot;
+    return config;
+}
+
+/**
+ * Load a configuration from a JSON file
+ */
+sv_config* sv_config_from_file(const char* path) {
+    return path != NULL ? wrap_config(config_snapshot_load(path)) : NULL;
+}
+
+/**
+ * Load a configuration from JSON text
+ */
+sv_config* sv_config_from_buffer(const char* json, size_t length) {
+    return json != NULL ? wrap_config(config_snapshot_parse(json, length)) : NULL;
+}
+
+/**
+ * Get the configuration compiled into the library
+ */
+sv_config* sv_config_builtin(void) {
+    return wrap_config(config_snapshot_builtin());
+}
+
+/**
+ * Free a configuration
+ */
+void sv_config_free(sv_config* config) {
+    if (config == NULL) {
+        return;
+    }
+    shared_snapshot_release(config->snapshot);
+    free(config);
+}
+
+/**
+ * Load a legal context (JSON or compiled snapshot)
+ */
+sv_context* sv_context_open(const char* path) {
+    SharedSnapshot* snapshot = path != NULL ? context_snapshot_load(path) : NULL;
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    sv_context* context = (sv_context*)malloc(sizeof(sv_context));
+    if (context == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        shared_snapshot_release(snapshot);
+        return NULL;
+    }
+
+    context->snapshot = snapshot;
+    return context;
+}
+
+/**
+ * Free a legal context
+ */
+void sv_context_free(sv_context* context) {
+    if (context == NULL) {
+        return;
+    }
+    shared_snapshot_release(context->snapshot);
+    free(context);
+}
+
+/**
+ * Forward a parse diagnostic to the caller's callback
+ */
+static void forward_diagnostic(void* user, ParseSeverity severity, int line, const char* message) {
+    DiagnosticTarget* target = (DiagnosticTarget*)user;
+    if (target->diagnostic != NULL) {
+        target->diagnostic(target->user, severity == PARSE_ERROR ? SV_ERROR : SV_WARNING, line, message);
+    }
+}
+
+/**
+ * Parse a schema from text
+ */
+sv_schema* sv_schema_parse(const sv_config* config, const char* text, size_t length,
+                           sv_diagnostic_fn diagnostic, void* user) {
+    if (config == NULL || text == NULL || length == 0) {
+        return NULL;
+    }
+
+    FILE* input = fmemopen((void*)text, length, "r");
+    if (input == NULL) {
+        return NULL;
+    }
+
+    DiagnosticTarget target = { diagnostic, user };
+    ParseOptions options = { NULL, forward_diagnostic, &target };
+
+    SharedSnapshot* previous = config_use(config->snapshot);
+    Schema* parsed = parse_schema_with(input, &options);
+    config_use(previous);
+    fclose(input);
+
+    if (parsed == NULL) {
+        return NULL;
+    }
+
+    sv_schema* schema = (sv_schema*)malloc(sizeof(sv_schema));
+    if (schema == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free_schema(parsed);
+        return NULL;
+    }
+
+    schema->schema = parsed;
+    schema->config = shared_snapshot_retain(config->snapshot);
+    return schema;
+}
+
+/**
+ * Free a parsed schema
+ */
+void sv_schema_free(sv_schema* schema) {
+    if (schema == NULL) {
+        return;
+    }
+    free_schema(schema->schema);
+    shared_snapshot_release(schema->config);
+    free(schema);
+}
+
+/**
+ * Generate the Kelsen code of a schema into a sink
+ */
+bool sv_emit(const sv_schema* schema, const sv_context* context, unsigned flags, sv_sink_fn sink, void* user) {
+    if (schema == NULL || sink == NULL) {
+        return false;
+    }
+
+    /* Asset types and clause shapes come from the configuration's classifier */
+    SharedSnapshot* previous_config = config_use(schema->config);
+    char* code;
+    if (context != NULL) {
+        SharedSnapshot* previous = context_use(context->snapshot);
+        code = generate_kelsen_code_with_context(schema->schema);
+
+        /* Annotate on the calling thread; services bring their own parallelism */
+        if (code != NULL && (flags & SV_EMIT_ANNOTATE)) {
+            char* annotations = generate_context_annotations(schema->schema, 1);
+            if (annotations != NULL) {
+                char* combined = (char*)realloc(code, strlen(code) + strlen(annotations) + 1);
+                if (combined != NULL) {
+                    strcat(combined, annotations);
+                    code = combined;
+                }
+                free(annotations);
+            }
+        }
+
+        context_use(previous);
+    } else {
+        code = generate_kelsen_code(schema->schema);
+    }
+
+    if (code != NULL && (flags & SV_EMIT_OPTIMIZE)) {
+        char* optimized = kelsen_optimize(code, NULL);
+        free(code);
+        code = optimized;
+    }
+
+    config_use(previous_config);
+    if (code == NULL) {
+        return false;
+    }
+
+    bool ok = sink(user, code, strlen(code));
+    free(code);
+    return ok;
+}
+
+/**
+ * Open a schema for editing
+ */
+sv_document* sv_document_open(const sv_config* config, const char* text, size_t length) {
+    if (config == NULL || (text == NULL && length > 0)) {
+        return NULL;
+    }
+
+    sv_document* document = (sv_document*)calloc(1, sizeof(sv_document));
+    if (document == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    SharedSnapshot* previous = config_use(config->snapshot);
+    document->document = schema_document_create(text, length);
+    config_use(previous);
+
+    if (document->document == NULL) {
+        free(document);
+        return NULL;
+    }
+
+    document->config = shared_snapshot_retain(config->snapshot);
+    return document;
+}
+
+/**
+ * Replace part of a document's text
+ */
+bool sv_document_edit(sv_document* document, size_t offset, size_t deleted,
+                      const char* inserted, size_t inserted_length) {
+    if (document == NULL || (inserted == NULL && inserted_length > 0)) {
+        return false;
+    }
+
+    SharedSnapshot* previous = config_use(document->config);
+    bool ok = schema_document_edit(document->document, offset, deleted, inserted, inserted_length);
+    config_use(previous);
+    return ok;
+}
+
+/**
+ * Deliver the diagnostics of a document's current text in document order
+ */
+int sv_document_diagnostics(const sv_document* document, sv_diagnostic_fn diagnostic, void* user) {
+    if (document == NULL) {
+        return 0;
+    }
+
+    if (diagnostic != NULL) {
+        DiagnosticTarget target = { diagnostic, user };
+        schema_document_report(document->document, forward_diagnostic, &target);
+    }
+    return schema_document_error_count(document->document);
+}
+
+/**
+ * Get the schema of a document's current text
+ */
+const sv_schema* sv_document_schema(sv_document* document) {
+    if (document == NULL) {
+        return NULL;
+    }
+
+    /* Default norms are added here, with the document's configuration */
+    SharedSnapshot* previous = config_use(document->config);
+    document->view.schema = schema_document_schema(document->document);
+    document->view.config = document->config;
+    config_use(previous);
+    return document->view.schema != NULL ? &document->view : NULL;
+}
+
+/**
+ * Free a document
+ */
+void sv_document_free(sv_document* document) {
+    if (document == NULL) {
+        return;
+    }
+    schema_document_free(document->document);
+    shared_snapshot_release(document->config);
+    free(document);
+}
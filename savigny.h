@@ -0,0 +1,227 @@
+/**
+ * savigny.h
+ *
+ * Embeddable C API of the Kelsen schema transpiler (libsavigny)
+ *
+ * Everything a transpilation needs is held in opaque handles: a
+ * configuration, an optional legal context and a parsed schema. Handles
+ * are immutable once created, so any number of threads may share them
+ * and call these functions at the same time; nothing is written to
+ * stdout, and parse diagnostics go to the caller's callback. The one
+ * exception is a document, which changes with each edit and must be used
+ * by one thread at a time.
+ */
+
+#ifndef SAVIGNY_H
+#define SAVIGNY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Validation configuration (institutions, types, domains, roles)
+ */
+typedef struct sv_config sv_config;
+
+/**
+ * Loaded legal context database
+ */
+typedef struct sv_context sv_context;
+
+/**
+ * Parsed schema
+ */
+typedef struct sv_schema sv_schema;
+
+/**
+ * Schema being edited, reparsed incrementally
+ */
+typedef struct sv_document sv_document;
+
+/**
+ * Severity of a parse diagnostic
+ */
+typedef enum {
+    SV_WARNING,                 // Suspicious input that was accepted (e.g., unknown role)
+    SV_ERROR                    // Syntax error; the parse fails
+} sv_severity;
+
+/**
+ * Callback receiving parse diagnostics
+ *
+ * @param user User data given to sv_schema_parse()
+ * @param severity Severity of the diagnostic
+ * @param line Input line the parser was on
+ * @param message Message text (no trailing newline)
+ */
+typedef void (*sv_diagnostic_fn)(void* user, sv_severity severity, int line, const char* message);
+
+/**
+ * Output sink for emitted code
+ *
+ * @param user User data given to sv_emit()
+ * @param data Bytes to write (not terminated)
+ * @param length Number of bytes
+ * @return true to continue, false to abort the emit
+ */
+typedef bool (*sv_sink_fn)(void* user, const char* data, size_t length);
+
+/**
+ * Emit flags
+ */
+#define SV_EMIT_ANNOTATE 0x1    // Append per-norm context annotations (needs a context)
+#define SV_EMIT_OPTIMIZE 0x2    // Merge duplicate declarations and drop unreferenced ones
+
+/**
+ * Load a configuration from a JSON file
+ *
+ * @param path Path to the configuration file
+ * @return The configuration, or NULL on error
+ */
+sv_config* sv_config_from_file(const char* path);
+
+/**
+ * Load a configuration from JSON text
+ *
+ * @param json Configuration text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @return The configuration, or NULL on error
+ */
+sv_config* sv_config_from_buffer(const char* json, size_t length);
+
+/**
+ * Get the configuration compiled into the library
+ *
+ * The tables are constant data generated at build time, so this does no
+ * I/O or parsing.
+ *
+ * @return The configuration, or NULL on allocation failure
+ */
+sv_config* sv_config_builtin(void);
+
+/**
+ * Free a configuration
+ *
+ * No other thread may be using the configuration; schemas parsed with
+ * it remain valid.
+ *
+ * @param config Configuration to free
+ */
+void sv_config_free(sv_config* config);
+
+/**
+ * Load a legal context (JSON or compiled snapshot)
+ *
+ * @param path Path to the context file
+ * @return The context, or NULL on error
+ */
+sv_context* sv_context_open(const char* path);
+
+/**
+ * Free a legal context
+ *
+ * No other thread may be using the context.
+ *
+ * @param context Context to free
+ */
+void sv_context_free(sv_context* context);
+
+/**
+ * Parse a schema from text
+ *
+ * @param config Configuration to validate against (the schema keeps its own reference)
+ * @param text Schema text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @param diagnostic Diagnostic callback, or NULL to discard diagnostics
+ * @param user User data passed to the callback
+ * @return The schema, or NULL if it could not be parsed
+ */
+sv_schema* sv_schema_parse(const sv_config* config, const char* text, size_t length,
+                           sv_diagnostic_fn diagnostic, void* user);
+
+/**
+ * Free a parsed schema
+ *
+ * @param schema Schema to free
+ */
+void sv_schema_free(sv_schema* schema);
+
+/**
+ * Generate the Kelsen code of a schema into a sink
+ *
+ * The code is generated with the configuration the schema was parsed
+ * with, which classifies its assets and clauses.
+ *
+ * @param schema The schema
+ * @param context Legal context to enhance the code with, or NULL
+ * @param flags SV_EMIT_* flags
+ * @param sink Output sink
+ * @param user User data passed to the sink
+ * @return true on success, false on error or if the sink aborted
+ */
+bool sv_emit(const sv_schema* schema, const sv_context* context, unsigned flags, sv_sink_fn sink, void* user);
+
+/**
+ * Open a schema for editing
+ *
+ * The text is split into top-level units (the institution declaration,
+ * each norm, each violation, fact or agenda paragraph) that are parsed
+ * on their own, so later edits only reparse the units they touch.
+ *
+ * @param config Configuration to validate against (the document keeps its own reference)
+ * @param text Schema text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @return The document (also when the text has errors), or NULL on error
+ */
+sv_document* sv_document_open(const sv_config* config, const char* text, size_t length);
+
+/**
+ * Replace part of a document's text
+ *
+ * @param document The document
+ * @param offset Byte offset of the edit
+ * @param deleted Number of bytes removed at the offset
+ * @param inserted Text inserted in their place (need not be terminated)
+ * @param inserted_length Length of the inserted text in bytes
+ * @return false if the range is outside the text or on error (the document is unchanged)
+ */
+bool sv_document_edit(sv_document* document, size_t offset, size_t deleted,
+                      const char* inserted, size_t inserted_length);
+
+/**
+ * Deliver the diagnostics of a document's current text in document order
+ *
+ * @param document The document
+ * @param diagnostic Diagnostic callback, or NULL to only count errors
+ * @param user User data passed to the callback
+ * @return Number of errors
+ */
+int sv_document_diagnostics(const sv_document* document, sv_diagnostic_fn diagnostic, void* user);
+
+/**
+ * Get the schema of a document's current text
+ *
+ * Nodes parsed from units an edit did not touch are kept across it.
+ *
+ * @param document The document
+ * @return The schema (owned by the document, valid until the next edit),
+ *         or NULL while the text has errors
+ */
+const sv_schema* sv_document_schema(sv_document* document);
+
+/**
+ * Free a document
+ *
+ * @param document Document to free
+ */
+void sv_document_free(sv_document* document);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SAVIGNY_H */
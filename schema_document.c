@@ -0,0 +1,763 @@
+/**
+ * schema_document.c
+ *
+ * Implementation of the incremental parse of a schema being edited
+ *
+ * Each unit owns the nodes parsed from it as a partial schema whose
+ * lists end at the unit. Linking the schema only sets the next pointer
+ * of each unit's last nodes, and a unit cuts those pointers before it is
+ * freed, so units can be replaced without touching their neighbours.
+ *
+ * A blank line inside a norm also looks like a boundary to the unit
+ * scan. A unit that does not parse is therefore joined with the
+ * paragraphs after it, up to the next norm, until it does, and failing
+ * that, if it starts no norm, with the unit before it. The decision only
+ * depends on the text from the previous unit's start, which is what lets
+ * an edit stop at any unit boundary it did not move once the unit after
+ * it parsed.
+ */
+
+#include "schema_document.h"
+#include "config_validator.h"
+#include "schema_json.h"
+#include "schema_units.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Initial size of the text buffer */
+#define DOCUMENT_INITIAL_TEXT 4096
+
+/* Initial capacity of the unit array */
+#define DOCUMENT_INITIAL_UNITS 64
+
+/* Most scanned units joined into one when a unit does not parse alone */
+#define DOCUMENT_MAX_JOINED 4
+
+/* One unit of the text and the nodes parsed from it */
+typedef struct {
+    size_t offset;                  // Start of the unit in the text
+    size_t length;
+    int line;                       // Line number of the unit's first line
+    Schema* part;                   // Nodes of the unit, NULL if it did not parse
+    char* leading_scope;            // Scope the grammar gives to the last norm before the unit
+    SchemaDiagnostics diagnostics;  // Lines counted from the unit's first line
+    Norm* last_norm;                // Last node of each of the part's lists, or NULL
+    Violation* last_violation;
+    LegalFact* last_fact;
+    Agenda* last_agenda;
+    UnitSection section_before;     // Last section of the units before it
+    bool misordered;                // Starts with a section before that one
+} DocumentUnit;
+
+/* Where the unit scan found a unit */
+typedef struct {
+    size_t offset;
+    int line;
+    bool norm;                      // The unit starts with a norm number
+} UnitStart;
+
+/* Units parsed from an edited region of the text */
+typedef struct {
+    UnitStart* starts;
+    int start_count;
+    DocumentUnit* units;
+    int count;
+    bool cut_short;                 // A unit could not be joined with units past the region
+} RegionUnits;
+
+/* A schema being edited */
+struct schema_document {
+    char* text;
+    size_t length;
+    size_t capacity;
+    DocumentUnit* units;
+    int unit_count;
+    int unit_capacity;
+    int diagnostic_count;           // Diagnostics of all units
+    int error_count;                // Error diagnostics of all units
+    int failed_units;               // Units that did not parse
+    int misordered_units;           // Units whose sections are out of order
+    int reparsed;                   // Units parsed by the last edit
+    Schema* schema;                 // Schema linked from the units
+    Norm* defaults;                 // Default norms added to it, owned by the document
+    bool linked;                    // The schema is up to date with the units
+};
+
+/**
+ * Count the newlines in a range of text
+ */
+static int count_lines(const char* text, size_t length) {
+    int lines = 0;
+    const char* end = text + length;
+    while ((text = (const char*)memchr(text, '\n', end - text)) != NULL) {
+        lines++;
+        text++;
+    }
+    return lines;
+}
+
+/**
+ * Find the unit holding a text offset (the last unit starting at or before it)
+ */
+static int unit_at(const SchemaDocument* document, size_t offset) {
+    int low = 0;
+    int high = document->unit_count - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (document->units[middle].offset <= offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/**
+ * Parse a unit, recording its nodes, list ends and diagnostics
+ */
+static void parse_unit(const SchemaDocument* document, DocumentUnit* unit, bool declaration) {
+    ParseOptions options = { NULL, schema_diagnostics_collect, &unit->diagnostics };
+    FILE* input = fmemopen(document->text + unit->offset, unit->length, "r");
+    if (input != NULL) {
+        unit->part = parse_schema_part(input, &options, 1, declaration, &unit->leading_scope);
+        fclose(input);
+    }
+    if (unit->part == NULL) {
+        return;
+    }
+
+    for (Norm* norm = unit->part->norms; norm != NULL; norm = norm->next) {
+        unit->last_norm = norm;
+    }
+    for (Violation* violation = unit->part->violations; violation != NULL; violation = violation->next) {
+        unit->last_violation = violation;
+    }
+    for (LegalFact* fact = unit->part->facts; fact != NULL; fact = fact->next) {
+        unit->last_fact = fact;
+    }
+    for (Agenda* agenda = unit->part->agendas; agenda != NULL; agenda = agenda->next) {
+        unit->last_agenda = agenda;
+    }
+}
+
+/**
+ * Release what a unit holds, keeping its place in the text
+ */
+static void clear_unit(DocumentUnit* unit) {
+    /* Cut the links into the units after it before freeing the lists */
+    if (unit->last_norm != NULL) {
+        unit->last_norm->next = NULL;
+    }
+    if (unit->last_violation != NULL) {
+        unit->last_violation->next = NULL;
+    }
+    if (unit->last_fact != NULL) {
+        unit->last_fact->next = NULL;
+    }
+    if (unit->last_agenda != NULL) {
+        unit->last_agenda->next = NULL;
+    }
+
+    free_schema(unit->part);
+    free(unit->leading_scope);
+    schema_diagnostics_clear(&unit->diagnostics);
+
+    size_t offset = unit->offset;
+    size_t length = unit->length;
+    int line = unit->line;
+    memset(unit, 0, sizeof(*unit));
+    unit->offset = offset;
+    unit->length = length;
+    unit->line = line;
+}
+
+/**
+ * Add a unit's diagnostics and state to the document's counts (or take them away)
+ */
+static void count_unit(SchemaDocument* document, const DocumentUnit* unit, int sign) {
+    document->diagnostic_count += sign * unit->diagnostics.count;
+    document->error_count += sign * unit->diagnostics.error_count;
+    document->failed_units += sign * (unit->part == NULL);
+    document->misordered_units += sign * unit->misordered;
+}
+
+/**
+ * Free the default norms added when the schema was last linked
+ */
+static void free_defaults(SchemaDocument* document) {
+    Norm* norm = document->defaults;
+    while (norm != NULL) {
+        Norm* next = norm->next;
+        norm->next = NULL;
+        Schema* holder = create_schema();
+        if (holder == NULL) {
+            break;
+        }
+        holder->norms = norm;
+        free_schema(holder);
+        norm = next;
+    }
+    document->defaults = NULL;
+}
+
+/**
+ * Get the institution name the units' roles are checked against
+ */
+static const char* institution_of(const SchemaDocument* document) {
+    if (document->unit_count == 0 || document->units[0].part == NULL) {
+        return NULL;
+    }
+    return document->units[0].part->institution.name;
+}
+
+/**
+ * Make sure the text buffer and unit array can hold an edit's result
+ */
+static bool reserve(SchemaDocument* document, size_t length, int units) {
+    if (length + 1 > document->capacity) {
+        size_t capacity = document->capacity > 0 ? document->capacity : DOCUMENT_INITIAL_TEXT;
+        while (capacity < length + 1) {
+            capacity *= 2;
+        }
+        char* text = (char*)realloc(document->text, capacity);
+        if (text == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return false;
+        }
+        document->text = text;
+        document->capacity = capacity;
+    }
+
+    if (units > document->unit_capacity) {
+        int capacity = document->unit_capacity > 0 ? document->unit_capacity : DOCUMENT_INITIAL_UNITS;
+        while (capacity < units) {
+            capacity *= 2;
+        }
+        DocumentUnit* array = (DocumentUnit*)realloc(document->units, capacity * sizeof(DocumentUnit));
+        if (array == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return false;
+        }
+        document->units = array;
+        document->unit_capacity = capacity;
+    }
+    return true;
+}
+
+/**
+ * Mark the units whose sections come before those of the units before them
+ *
+ * Starts at the first changed unit and stops at the first unchanged one
+ * that sees the same section before it as it did before the edit.
+ */
+static void check_order(SchemaDocument* document, int from, int changed) {
+    UnitSection section = UNIT_NO_SECTION;
+    if (from > 0) {
+        const DocumentUnit* previous = &document->units[from - 1];
+        section = previous->section_before;
+        if (previous->part != NULL) {
+            unit_follows(previous->part, &section);
+        }
+    }
+
+    for (int i = from; i < document->unit_count; i++) {
+        DocumentUnit* unit = &document->units[i];
+        if (i >= changed && unit->section_before == section) {
+            break;
+        }
+        document->misordered_units -= unit->misordered;
+        unit->section_before = section;
+        unit->misordered = unit->part != NULL && !unit_follows(unit->part, &section);
+        document->misordered_units += unit->misordered;
+    }
+}
+
+/**
+ * Free the units parsed from a region
+ */
+static void free_region(RegionUnits* region) {
+    for (int i = 0; i < region->count; i++) {
+        clear_unit(&region->units[i]);
+    }
+    free(region->units);
+    free(region->starts);
+    memset(region, 0, sizeof(*region));
+}
+
+/**
+ * Scan a region of the text for units and parse them
+ *
+ * The region starts at a unit boundary; at_end tells whether it runs to
+ * the end of the text, so a unit that does not parse may be joined with
+ * every scanned unit after it. It is joined with the region's unit
+ * before it last.
+ */
+static bool parse_region(const SchemaDocument* document, size_t start, size_t end, int line,
+                         bool declaration, bool at_end, RegionUnits* region) {
+    memset(region, 0, sizeof(*region));
+    if (end == start) {
+        return true;
+    }
+
+    int capacity = count_lines(document->text + start, end - start) + 1;
+    region->starts = (UnitStart*)malloc(capacity * sizeof(UnitStart));
+    region->units = (DocumentUnit*)calloc(capacity, sizeof(DocumentUnit));
+    if (region->starts == NULL || region->units == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free_region(region);
+        return false;
+    }
+
+    UnitScan scan;
+    unit_scan_start(&scan, document->text + start, end - start, line);
+    do {
+        UnitStart* found = &region->starts[region->start_count++];
+        found->offset = (size_t)(scan.position - document->text);
+        found->line = scan.line;
+        found->norm = scan.norm;
+    } while (unit_scan_next(&scan));
+
+    int i = 0;
+    while (i < region->start_count) {
+        DocumentUnit* unit = &region->units[region->count++];
+        unit->offset = region->starts[i].offset;
+        unit->line = region->starts[i].line;
+        unit->length = (i + 1 < region->start_count ? region->starts[i + 1].offset : end) - unit->offset;
+        parse_unit(document, unit, declaration && i == 0);
+
+        /* Join a unit that does not parse with the paragraphs after it */
+        int joined = 1;
+        while (unit->part == NULL && joined < DOCUMENT_MAX_JOINED) {
+            if (i + joined == region->start_count) {
+                region->cut_short = !at_end;
+                break;
+            }
+            if (region->starts[i + joined].norm) {
+                break;
+            }
+            joined++;
+
+            DocumentUnit attempt;
+            memset(&attempt, 0, sizeof(attempt));
+            attempt.offset = unit->offset;
+            attempt.line = unit->line;
+            attempt.length = (i + joined < region->start_count ? region->starts[i + joined].offset : end) -
+                             attempt.offset;
+            parse_unit(document, &attempt, declaration && i == 0);
+            if (attempt.part != NULL) {
+                clear_unit(unit);
+                *unit = attempt;
+            } else {
+                clear_unit(&attempt);
+            }
+        }
+
+        /* A paragraph that still does not parse and starts no norm may continue the unit before it */
+        if (unit->part == NULL && !region->starts[i].norm && region->count > 1 &&
+            region->units[region->count - 2].part != NULL) {
+            DocumentUnit* previous = &region->units[region->count - 2];
+            DocumentUnit attempt;
+            memset(&attempt, 0, sizeof(attempt));
+            attempt.offset = previous->offset;
+            attempt.line = previous->line;
+            attempt.length = unit->offset + unit->length - previous->offset;
+            parse_unit(document, &attempt, declaration && region->count == 2);
+            if (attempt.part != NULL) {
+                clear_unit(previous);
+                *previous = attempt;
+                clear_unit(unit);
+                region->count--;
+                unit = previous;
+                joined = 1;
+            } else {
+                clear_unit(&attempt);
+            }
+        }
+
+        /* A declaration that fails part way may have set the institution already */
+        if (declaration && unit == &region->units[0]) {
+            config_set_current_institution(unit->part != NULL ? unit->part->institution.name : NULL);
+        }
+        i += unit->part != NULL ? joined : 1;
+    }
+    return true;
+}
+
+/**
+ * Parse a schema into a document
+ */
+SchemaDocument* schema_document_create(const char* text, size_t length) {
+    SchemaDocument* document = (SchemaDocument*)calloc(1, sizeof(SchemaDocument));
+    if (document == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    document->schema = create_schema();
+    if (document->schema == NULL || !reserve(document, 0, 0) ||
+        !schema_document_edit(document, 0, 0, text, length)) {
+        schema_document_free(document);
+        return NULL;
+    }
+    return document;
+}
+
+/**
+ * Replace part of the text and reparse the units the edit touches
+ */
+bool schema_document_edit(SchemaDocument* document, size_t offset, size_t deleted,
+                          const char* inserted, size_t inserted_length) {
+    if (offset > document->length || deleted > document->length - offset) {
+        return false;
+    }
+
+    /*
+     * The units touched, one on each side whose boundary the edit may
+     * move, and the units before that did not parse, which may join
+     * with the edited text now
+     */
+    int first = 0;
+    int last = -1;
+    if (document->unit_count > 0) {
+        first = unit_at(document, offset);
+        if (first > 0) {
+            first--;
+        }
+        while (first > 0 && document->units[first - 1].part == NULL) {
+            first--;
+        }
+        last = unit_at(document, offset + deleted);
+        if (last + 1 < document->unit_count) {
+            last++;
+        }
+    }
+    size_t start = document->unit_count > 0 ? document->units[first].offset : 0;
+    int start_line = document->unit_count > 0 ? document->units[first].line : 1;
+
+    /* The removed text is kept to undo the edit if parsing runs out of memory */
+    size_t new_length = document->length - deleted + inserted_length;
+    char* removed = deleted > 0 ? (char*)malloc(deleted) : NULL;
+    if ((deleted > 0 && removed == NULL) || !reserve(document, new_length, 0)) {
+        if (deleted > 0 && removed == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+        }
+        free(removed);
+        return false;
+    }
+    int line_delta = count_lines(inserted, inserted_length) - count_lines(document->text + offset, deleted);
+    char* old_institution = institution_of(document) != NULL ? strdup(institution_of(document)) : NULL;
+
+    /* Apply the edit to the text */
+    if (deleted > 0) {
+        memcpy(removed, document->text + offset, deleted);
+    }
+    memmove(document->text + offset + inserted_length, document->text + offset + deleted,
+            document->length - offset - deleted);
+    if (inserted_length > 0) {
+        memcpy(document->text + offset, inserted, inserted_length);
+    }
+    size_t old_length = document->length;
+    document->length = new_length;
+    document->text[new_length] = '\0';
+
+    /*
+     * Parse the region, taking in the next unit while a unit there needs
+     * it to join with, or while it did not parse and may continue the
+     * region's last unit
+     */
+    config_set_current_institution(first > 0 ? institution_of(document) : NULL);
+    RegionUnits region;
+    bool ok;
+    for (;;) {
+        size_t old_end = last + 1 < document->unit_count ? document->units[last + 1].offset : old_length;
+        bool at_end = last + 1 >= document->unit_count;
+        ok = parse_region(document, start, old_end - deleted + inserted_length, start_line, first == 0,
+                          at_end, &region);
+        bool continued = !at_end && document->units[last + 1].part == NULL;
+        if (!ok || (!region.cut_short && !continued)) {
+            break;
+        }
+        free_region(&region);
+        last++;
+    }
+    int old_count = last - first + 1;
+    ok = ok && reserve(document, new_length, document->unit_count - old_count + region.count);
+
+    if (!ok) {
+        if (region.units != NULL) {
+            free_region(&region);
+        }
+        memmove(document->text + offset + deleted, document->text + offset + inserted_length,
+                new_length - offset - inserted_length);
+        if (deleted > 0) {
+            memcpy(document->text + offset, removed, deleted);
+        }
+        document->length = old_length;
+        document->text[old_length] = '\0';
+        config_set_current_institution(NULL);
+        free(old_institution);
+        free(removed);
+        return false;
+    }
+    free(removed);
+
+    /* Replace the old units of the region with the new ones */
+    for (int i = first; i <= last; i++) {
+        count_unit(document, &document->units[i], -1);
+        clear_unit(&document->units[i]);
+    }
+    int tail = document->unit_count - (last + 1);
+    if (region.count != old_count) {
+        memmove(&document->units[first + region.count], &document->units[last + 1], tail * sizeof(DocumentUnit));
+    }
+    document->unit_count += region.count - old_count;
+    for (int i = first + region.count; i < document->unit_count; i++) {
+        document->units[i].offset = document->units[i].offset - deleted + inserted_length;
+        document->units[i].line += line_delta;
+    }
+    for (int i = 0; i < region.count; i++) {
+        document->units[first + i] = region.units[i];
+        count_unit(document, &region.units[i], 1);
+    }
+    document->reparsed = region.count;
+    free(region.units);
+    free(region.starts);
+
+    /* Role checks of the other units depend on the institution's name */
+    const char* institution = institution_of(document);
+    bool renamed = (old_institution == NULL) != (institution == NULL) ||
+                   (institution != NULL && strcmp(old_institution, institution) != 0);
+    int changed = first + region.count;
+    if (first == 0 && renamed) {
+        config_set_current_institution(institution);
+        changed = document->unit_count;
+        for (int i = region.count; i < document->unit_count; i++) {
+            DocumentUnit* unit = &document->units[i];
+            count_unit(document, unit, -1);
+            clear_unit(unit);
+            parse_unit(document, unit, false);
+            count_unit(document, unit, 1);
+            document->reparsed++;
+        }
+    }
+    config_set_current_institution(NULL);
+    free(old_institution);
+
+    check_order(document, first, changed);
+    document->linked = false;
+    return true;
+}
+
+/**
+ * Get the current text of a document
+ */
+const char* schema_document_text(const SchemaDocument* document, size_t* length) {
+    *length = document->length;
+    return document->text;
+}
+
+/**
+ * Deliver the diagnostics of a document in document order
+ */
+void schema_document_report(const SchemaDocument* document, ParseDiagnosticFn diagnostic, void* user) {
+    int remaining = document->diagnostic_count + document->misordered_units;
+    for (int i = 0; i < document->unit_count && remaining > 0; i++) {
+        const DocumentUnit* unit = &document->units[i];
+        remaining -= unit->diagnostics.count + unit->misordered;
+
+        /* Reported where the serial parse stops, on the unit's first token */
+        if (unit->misordered) {
+            diagnostic(user, PARSE_ERROR, unit->line, "syntax error");
+        }
+        for (int j = 0; j < unit->diagnostics.count; j++) {
+            const SchemaDiagnostic* item = &unit->diagnostics.items[j];
+            diagnostic(user, item->severity, unit->line + item->line - 1, item->message);
+        }
+    }
+}
+
+/**
+ * Visit the norms of every unit that parses, in document order
+ */
+void schema_document_visit_norms(const SchemaDocument* document, DocumentNormFn visit, void* user) {
+    for (int i = 0; i < document->unit_count; i++) {
+        const DocumentUnit* unit = &document->units[i];
+        if (unit->last_norm == NULL) {
+            continue;
+        }
+
+        /* The unit's list runs on into the next unit's once linked */
+        for (Norm* norm = unit->part->norms; ; norm = norm->next) {
+            visit(user, norm, unit->line + norm->line - 1);
+            if (norm == unit->last_norm) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Find where a line starts in the text
+ */
+bool schema_document_line_offset(const SchemaDocument* document, int line, size_t* offset) {
+    if (line < 1) {
+        return false;
+    }
+
+    /* The last unit starting at or before the line */
+    size_t position = 0;
+    int current = 1;
+    int low = 0;
+    int high = document->unit_count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (document->units[middle].line <= line) {
+            position = document->units[middle].offset;
+            current = document->units[middle].line;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    while (current < line) {
+        const char* newline = (const char*)memchr(document->text + position, '\n', document->length - position);
+        if (newline == NULL) {
+            return false;
+        }
+        position = (size_t)(newline - document->text) + 1;
+        current++;
+    }
+    *offset = position;
+    return true;
+}
+
+/**
+ * Get the institution a document declares
+ */
+const char* schema_document_institution(const SchemaDocument* document) {
+    return institution_of(document);
+}
+
+/**
+ * Get the number of syntax errors in a document
+ */
+int schema_document_error_count(const SchemaDocument* document) {
+    return document->error_count + document->misordered_units;
+}
+
+/**
+ * Get the number of units the last edit parsed
+ */
+int schema_document_reparsed(const SchemaDocument* document) {
+    return document->reparsed;
+}
+
+/**
+ * Give a norm a scope (or none), keeping the one it has if it is the same
+ */
+static void set_scope(Norm* norm, char* description) {
+    if (norm->scope != NULL && description != NULL && strcmp(norm->scope->description, description) == 0) {
+        return;
+    }
+    if (description != NULL) {
+        add_scope_to_norm(norm, description);
+    } else if (norm->scope != NULL) {
+        free(norm->scope->description);
+        free(norm->scope);
+        norm->scope = NULL;
+    }
+}
+
+/**
+ * Link the units' nodes into the document's schema
+ */
+static void link_schema(SchemaDocument* document) {
+    Schema* schema = document->schema;
+    const Institution* institution = &document->units[0].part->institution;
+    set_institution(schema, institution->name, institution->type, institution->multiplicity,
+                    institution->legal_domain);
+    free_defaults(document);
+
+    Norm** norms = &schema->norms;
+    Violation** violations = &schema->violations;
+    LegalFact** facts = &schema->facts;
+    Agenda** agendas = &schema->agendas;
+    Norm* last_norm = NULL;
+
+    for (int i = 0; i < document->unit_count; i++) {
+        DocumentUnit* unit = &document->units[i];
+        if (unit->last_norm != NULL) {
+            /* A scope written after a unit's first norm goes to the norm before it */
+            if (last_norm != NULL) {
+                set_scope(last_norm, unit->leading_scope);
+            }
+            *norms = unit->part->norms;
+            norms = &unit->last_norm->next;
+            last_norm = unit->last_norm;
+        }
+        if (unit->last_violation != NULL) {
+            *violations = unit->part->violations;
+            violations = &unit->last_violation->next;
+        }
+        if (unit->last_fact != NULL) {
+            *facts = unit->part->facts;
+            facts = &unit->last_fact->next;
+        }
+        if (unit->last_agenda != NULL) {
+            *agendas = unit->part->agendas;
+            agendas = &unit->last_agenda->next;
+        }
+    }
+    *norms = NULL;
+    *violations = NULL;
+    *facts = NULL;
+    *agendas = NULL;
+    if (last_norm != NULL) {
+        set_scope(last_norm, NULL);
+    }
+
+    /* Default norms follow the last norm of the text */
+    config_add_default_norms(schema);
+    document->defaults = *norms;
+    document->linked = true;
+}
+
+/**
+ * Get the schema of a document
+ */
+Schema* schema_document_schema(SchemaDocument* document) {
+    if (document->unit_count == 0 || document->failed_units > 0 || document->misordered_units > 0) {
+        return NULL;
+    }
+    if (!document->linked) {
+        link_schema(document);
+    }
+    return document->schema;
+}
+
+/**
+ * Free a document and its schema
+ */
+void schema_document_free(SchemaDocument* document) {
+    if (document == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < document->unit_count; i++) {
+        clear_unit(&document->units[i]);
+    }
+    free_defaults(document);
+    if (document->schema != NULL) {
+        document->schema->norms = NULL;
+        document->schema->violations = NULL;
+        document->schema->facts = NULL;
+        document->schema->agendas = NULL;
+        free_schema(document->schema);
+    }
+    free(document->units);
+    free(document->text);
+    free(document);
+}
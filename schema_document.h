@@ -0,0 +1,152 @@
+/**
+ * schema_document.h
+ *
+ * Incremental parse of a schema being edited: the text is kept as a
+ * sequence of units (see schema_units.h), each parsed on its own, so an
+ * edit re-tokenizes and reparses only the units around it
+ */
+
+#ifndef SCHEMA_DOCUMENT_H
+#define SCHEMA_DOCUMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "parser_defs.h"
+
+/**
+ * A schema being edited
+ */
+typedef struct schema_document SchemaDocument;
+
+/**
+ * Parse a schema into a document
+ *
+ * Units are parsed with the calling thread's configuration, here and on
+ * every edit. Since each unit is parsed on its own, an error in one unit
+ * does not hide errors in later ones. A unit that does not parse alone
+ * is joined with up to three paragraphs after it (a norm written across
+ * blank lines), and a unit whose section comes before those of the units
+ * before it gets the syntax error the serial parse stops with.
+ *
+ * @param text Schema text (need not be terminated)
+ * @param length Length of the text in bytes
+ * @return The document (also when the text does not parse), or NULL on allocation failure
+ */
+SchemaDocument* schema_document_create(const char* text, size_t length);
+
+/**
+ * Replace part of the text and reparse the units the edit touches
+ *
+ * The units around the edit are scanned for boundaries again and
+ * reparsed; the others keep their nodes and diagnostics and are only
+ * moved. A change of the institution's name reparses every unit, since
+ * role checks depend on it.
+ *
+ * @param document The document
+ * @param offset Byte offset of the edit
+ * @param deleted Number of bytes removed at the offset
+ * @param inserted Text inserted in their place (need not be terminated)
+ * @param inserted_length Length of the inserted text in bytes
+ * @return false if the range is outside the text or on allocation failure (the document is unchanged)
+ */
+bool schema_document_edit(SchemaDocument* document, size_t offset, size_t deleted,
+                          const char* inserted, size_t inserted_length);
+
+/**
+ * Get the current text of a document
+ *
+ * @param document The document
+ * @param length Receives the length of the text in bytes
+ * @return The text (terminated), valid until the next edit
+ */
+const char* schema_document_text(const SchemaDocument* document, size_t* length);
+
+/**
+ * Deliver the diagnostics of a document in document order
+ *
+ * @param document The document
+ * @param diagnostic Callback receiving each diagnostic, with its line in the whole text
+ * @param user User data passed to the callback
+ */
+void schema_document_report(const SchemaDocument* document, ParseDiagnosticFn diagnostic, void* user);
+
+/**
+ * Callback receiving the norms of a document
+ *
+ * @param user User data given to schema_document_visit_norms()
+ * @param norm The norm
+ * @param line Line of the norm's number in the whole text
+ */
+typedef void (*DocumentNormFn)(void* user, Norm* norm, int line);
+
+/**
+ * Visit the norms of every unit that parses, in document order
+ *
+ * Unlike schema_document_schema() this works while other units have
+ * errors. Default norms are not visited.
+ *
+ * @param document The document
+ * @param visit Callback receiving each norm
+ * @param user User data passed to the callback
+ */
+void schema_document_visit_norms(const SchemaDocument* document, DocumentNormFn visit, void* user);
+
+/**
+ * Find where a line starts in the text
+ *
+ * The search starts at the unit holding the line, so only that unit's
+ * lines are counted.
+ *
+ * @param document The document
+ * @param line Line number (from 1)
+ * @param offset Receives the byte offset of the line's first character
+ * @return false if the text has fewer lines
+ */
+bool schema_document_line_offset(const SchemaDocument* document, int line, size_t* offset);
+
+/**
+ * Get the institution a document declares
+ *
+ * @param document The document
+ * @return Name of the institution, or NULL while the declaration does not parse
+ */
+const char* schema_document_institution(const SchemaDocument* document);
+
+/**
+ * Get the number of syntax errors in a document
+ *
+ * @param document The document
+ * @return Number of error diagnostics
+ */
+int schema_document_error_count(const SchemaDocument* document);
+
+/**
+ * Get the number of units the last edit parsed
+ *
+ * @param document The document
+ * @return Units parsed by the last edit (or by the creation)
+ */
+int schema_document_reparsed(const SchemaDocument* document);
+
+/**
+ * Get the schema of a document
+ *
+ * The schema is linked together from the units' nodes on the first call
+ * after an edit, and default norms are added with the calling thread's
+ * configuration. Nodes of units an edit does not touch are the same
+ * objects before and after it; default norms are built anew.
+ *
+ * @param document The document
+ * @return The schema (owned by the document, valid until the next edit),
+ *         or NULL if some unit does not parse
+ */
+Schema* schema_document_schema(SchemaDocument* document);
+
+/**
+ * Free a document and its schema
+ *
+ * @param document Document to free
+ */
+void schema_document_free(SchemaDocument* document);
+
+#endif /* SCHEMA_DOCUMENT_H */
@@ -0,0 +1,662 @@
+/**
+ * schema_image.c
+ *
+ * Implementation of the schema image
+ *
+ * An image is a header followed by one section per table, each aligned
+ * to 8 bytes, with the string pool last. Building sizes every table from
+ * the schema first, so the image is a single allocation; the pool only
+ * shrinks, because equal strings (roles, mostly) are stored once.
+ */
+
+#include "schema_image.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Alignment of every section within the image */
+#define SCHEMA_IMAGE_ALIGN 8
+
+/* Written by the producer, so a reader can tell a foreign byte order */
+#define SCHEMA_IMAGE_BYTE_ORDER 0x01020304u
+
+/* Sections of the image, in file order (the string pool last) */
+enum {
+    SECTION_INSTITUTION,
+    SECTION_NORMS,
+    SECTION_VIOLATIONS,
+    SECTION_FACTS,
+    SECTION_AGENDAS,
+    SECTION_LISTS,
+    SECTION_NUMBERS,
+    SECTION_STRINGS,
+    SECTION_COUNT
+};
+
+/* Size of one item of each section (the string pool counts bytes) */
+static const size_t section_item_size[SECTION_COUNT] = {
+    sizeof(SchemaImageInstitution), sizeof(SchemaImageNorm), sizeof(SchemaImageViolation),
+    sizeof(SchemaImageFact), sizeof(SchemaImageAgenda), sizeof(SchemaStr), sizeof(int32_t), 1
+};
+
+typedef struct {
+    uint32_t offset;              // Byte offset from the start of the image
+    uint32_t count;               // Number of items
+} SchemaImageSection;
+
+typedef struct {
+    char magic[8];                // SCHEMA_IMAGE_MAGIC
+    uint32_t version;             // SCHEMA_IMAGE_VERSION
+    uint32_t byte_order;          // SCHEMA_IMAGE_BYTE_ORDER as written by the producer
+    uint32_t total_size;          // Size of the whole image in bytes
+    uint32_t section_count;       // SECTION_COUNT
+    uint64_t content_hash;        // FNV-1a hash of everything after the header
+    SchemaImageSection sections[SECTION_COUNT];
+} SchemaImageHeader;
+
+/* Builder state: the tables being filled and the string intern table */
+typedef struct {
+    char* image;
+    SchemaImageNorm* norms;
+    SchemaImageViolation* violations;
+    SchemaImageFact* facts;
+    SchemaImageAgenda* agendas;
+    SchemaStr* lists;
+    int32_t* numbers;
+    char* strings;
+    uint32_t counts[SECTION_COUNT];
+    uint32_t* slots;              // Open-addressing table of pool offsets (0 = empty)
+    uint32_t slot_mask;
+} ImageBuilder;
+
+/**
+ * Round a section size up to the image alignment
+ */
+static size_t align_section(size_t size) {
+    return (size + (SCHEMA_IMAGE_ALIGN - 1)) & ~(size_t)(SCHEMA_IMAGE_ALIGN - 1);
+}
+
+/**
+ * Hash a string (FNV-1a)
+ */
+static uint32_t hash_string(const char* text) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Add a string to the pool, reusing an equal one already there
+ */
+static SchemaStr intern(ImageBuilder* builder, const char* text) {
+    if (text == NULL) {
+        return 0;
+    }
+
+    uint32_t slot = hash_string(text) & builder->slot_mask;
+    while (builder->slots[slot] != 0) {
+        if (strcmp(builder->strings + builder->slots[slot], text) == 0) {
+            return builder->slots[slot];
+        }
+        slot = (slot + 1) & builder->slot_mask;
+    }
+
+    uint32_t offset = builder->counts[SECTION_STRINGS];
+    size_t length = strlen(text) + 1;
+    memcpy(builder->strings + offset, text, length);
+    builder->counts[SECTION_STRINGS] += (uint32_t)length;
+    builder->slots[slot] = offset;
+    return offset;
+}
+
+/**
+ * Count a string for sizing (pool bytes and intern slots)
+ */
+static void count_string(const char* text, size_t* bytes, uint32_t* strings) {
+    if (text != NULL) {
+        *bytes += strlen(text) + 1;
+        (*strings)++;
+    }
+}
+
+/**
+ * Serialize a schema into an image
+ */
+void* schema_image_build(const Schema* schema, size_t* size) {
+    /* Pass 1: size every table, and the pool as if no string repeated */
+    uint32_t counts[SECTION_COUNT] = { 1 };
+    size_t pool_bytes = 1;
+    uint32_t string_count = 0;
+
+    count_string(schema->institution.name, &pool_bytes, &string_count);
+    count_string(schema->institution.legal_domain, &pool_bytes, &string_count);
+    for (const Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        counts[SECTION_NORMS]++;
+        count_string(norm->role, &pool_bytes, &string_count);
+        count_string(norm->action, &pool_bytes, &string_count);
+        if (norm->scope != NULL) {
+            count_string(norm->scope->description, &pool_bytes, &string_count);
+        }
+        for (const Condition* condition = norm->condition; condition != NULL; condition = condition->next) {
+            counts[SECTION_LISTS]++;
+            count_string(condition->description, &pool_bytes, &string_count);
+        }
+    }
+    for (const Violation* violation = schema->violations; violation != NULL; violation = violation->next) {
+        counts[SECTION_VIOLATIONS]++;
+        for (const ViolationRef* ref = violation->violated_norms; ref != NULL; ref = ref->next) {
+            counts[SECTION_NUMBERS]++;
+        }
+        count_string(violation->role, &pool_bytes, &string_count);
+        count_string(violation->consequence, &pool_bytes, &string_count);
+    }
+    for (const LegalFact* fact = schema->facts; fact != NULL; fact = fact->next) {
+        counts[SECTION_FACTS]++;
+        count_string(fact->description, &pool_bytes, &string_count);
+        count_string(fact->evidence, &pool_bytes, &string_count);
+    }
+    for (const Agenda* agenda = schema->agendas; agenda != NULL; agenda = agenda->next) {
+        counts[SECTION_AGENDAS]++;
+        count_string(agenda->requesting_role, &pool_bytes, &string_count);
+        count_string(agenda->institution, &pool_bytes, &string_count);
+        count_string(agenda->beneficiary_role, &pool_bytes, &string_count);
+        for (const NormRemedy* remedy = agenda->norm_remedies; remedy != NULL; remedy = remedy->next) {
+            counts[SECTION_LISTS]++;
+            count_string(remedy->description, &pool_bytes, &string_count);
+        }
+    }
+
+    size_t offsets[SECTION_COUNT];
+    size_t total = align_section(sizeof(SchemaImageHeader));
+    for (int i = 0; i < SECTION_STRINGS; i++) {
+        offsets[i] = total;
+        total += align_section((size_t)counts[i] * section_item_size[i]);
+    }
+    offsets[SECTION_STRINGS] = total;
+    total += pool_bytes;
+
+    if (total > UINT32_MAX) {
+        fprintf(stderr, "Schema too large for an AST image\n");
+        return NULL;
+    }
+
+    uint32_t slot_count = 1;
+    while (slot_count < string_count * 2 + 1) {
+        slot_count <<= 1;
+    }
+
+    ImageBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.image = (char*)calloc(1, align_section(total));
+    builder.slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+    if (builder.image == NULL || builder.slots == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(builder.image);
+        free(builder.slots);
+        return NULL;
+    }
+    builder.slot_mask = slot_count - 1;
+    builder.strings = builder.image + offsets[SECTION_STRINGS];
+    builder.counts[SECTION_STRINGS] = 1;            // Offset 0 is the absent string
+
+    /* Pass 2: fill the tables in schema order */
+    SchemaImageInstitution* institution = (SchemaImageInstitution*)(builder.image + offsets[SECTION_INSTITUTION]);
+    institution->name = intern(&builder, schema->institution.name);
+    institution->type = (uint32_t)schema->institution.type;
+    institution->multiplicity = (uint32_t)schema->institution.multiplicity;
+    institution->legal_domain = intern(&builder, schema->institution.legal_domain);
+
+    SchemaImageNorm* norms = (SchemaImageNorm*)(builder.image + offsets[SECTION_NORMS]);
+    SchemaImageViolation* violations = (SchemaImageViolation*)(builder.image + offsets[SECTION_VIOLATIONS]);
+    SchemaImageFact* facts = (SchemaImageFact*)(builder.image + offsets[SECTION_FACTS]);
+    SchemaImageAgenda* agendas = (SchemaImageAgenda*)(builder.image + offsets[SECTION_AGENDAS]);
+    SchemaStr* lists = (SchemaStr*)(builder.image + offsets[SECTION_LISTS]);
+    int32_t* numbers = (int32_t*)(builder.image + offsets[SECTION_NUMBERS]);
+    uint32_t list_count = 0;
+    uint32_t number_count = 0;
+
+    for (const Norm* norm = schema->norms; norm != NULL; norm = norm->next, norms++) {
+        norms->number = norm->number;
+        norms->deontic = (uint32_t)norm->deontic;
+        norms->role = intern(&builder, norm->role);
+        norms->action = intern(&builder, norm->action);
+        if (norm->scope != NULL) {
+            norms->flags |= SCHEMA_IMAGE_HAS_SCOPE;
+            norms->scope = intern(&builder, norm->scope->description);
+        }
+        norms->conditions = list_count;
+        for (const Condition* condition = norm->condition; condition != NULL; condition = condition->next) {
+            lists[list_count++] = intern(&builder, condition->description);
+        }
+        norms->condition_count = list_count - norms->conditions;
+    }
+    for (const Violation* violation = schema->violations; violation != NULL; violation = violation->next, violations++) {
+        violations->norms = number_count;
+        for (const ViolationRef* ref = violation->violated_norms; ref != NULL; ref = ref->next) {
+            numbers[number_count++] = ref->norm_number;
+        }
+        violations->norm_count = number_count - violations->norms;
+        violations->role = intern(&builder, violation->role);
+        violations->deontic = (uint32_t)violation->deontic;
+        violations->consequence = intern(&builder, violation->consequence);
+    }
+    for (const LegalFact* fact = schema->facts; fact != NULL; fact = fact->next, facts++) {
+        facts->description = intern(&builder, fact->description);
+        facts->evidence = intern(&builder, fact->evidence);
+    }
+    for (const Agenda* agenda = schema->agendas; agenda != NULL; agenda = agenda->next, agendas++) {
+        agendas->requesting_role = intern(&builder, agenda->requesting_role);
+        agendas->compliance = (uint32_t)agenda->compliance;
+        agendas->institution = intern(&builder, agenda->institution);
+        agendas->beneficiary_role = intern(&builder, agenda->beneficiary_role);
+        agendas->flags = agenda->is_essential ? SCHEMA_IMAGE_ESSENTIAL : 0;
+        agendas->remedies = list_count;
+        for (const NormRemedy* remedy = agenda->norm_remedies; remedy != NULL; remedy = remedy->next) {
+            lists[list_count++] = intern(&builder, remedy->description);
+        }
+        agendas->remedy_count = list_count - agendas->remedies;
+    }
+    free(builder.slots);
+
+    /* Interning only shrinks the pool, which is last, so trim the tail */
+    counts[SECTION_STRINGS] = builder.counts[SECTION_STRINGS];
+    total = offsets[SECTION_STRINGS] + counts[SECTION_STRINGS];
+
+    SchemaImageHeader* header = (SchemaImageHeader*)builder.image;
+    memcpy(header->magic, SCHEMA_IMAGE_MAGIC, sizeof(header->magic));
+    header->version = SCHEMA_IMAGE_VERSION;
+    header->byte_order = SCHEMA_IMAGE_BYTE_ORDER;
+    header->total_size = (uint32_t)total;
+    header->section_count = SECTION_COUNT;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        header->sections[i].offset = (uint32_t)offsets[i];
+        header->sections[i].count = counts[i];
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = align_section(sizeof(SchemaImageHeader)); i < total; i++) {
+        hash ^= (unsigned char)builder.image[i];
+        hash *= 1099511628211ull;
+    }
+    header->content_hash = hash;
+
+    char* image = (char*)realloc(builder.image, total);
+    *size = total;
+    return image != NULL ? image : builder.image;
+}
+
+/**
+ * Write a schema's image to a file
+ */
+bool schema_image_write(const Schema* schema, FILE* output) {
+    size_t size;
+    void* image = schema_image_build(schema, &size);
+    if (image == NULL) {
+        return false;
+    }
+
+    bool ok = fwrite(image, 1, size, output) == size;
+    free(image);
+    return ok;
+}
+
+/**
+ * Check whether a buffer starts with the image magic number
+ */
+bool schema_image_detect(const void* data, size_t size) {
+    return size >= sizeof(SCHEMA_IMAGE_MAGIC) - 1 &&
+           memcmp(data, SCHEMA_IMAGE_MAGIC, sizeof(SCHEMA_IMAGE_MAGIC) - 1) == 0;
+}
+
+/**
+ * Point a view's tables into an image, checking the header and section extents
+ */
+static bool attach_image(SchemaImage* view, const void* image, size_t size) {
+    const SchemaImageHeader* header = (const SchemaImageHeader*)image;
+
+    if (size < sizeof(SchemaImageHeader) || (uintptr_t)image % SCHEMA_IMAGE_ALIGN != 0 ||
+        memcmp(header->magic, SCHEMA_IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SCHEMA_IMAGE_VERSION ||
+        header->byte_order != SCHEMA_IMAGE_BYTE_ORDER ||
+        header->total_size != size ||
+        header->section_count != SECTION_COUNT) {
+        return false;
+    }
+
+    const char* base = (const char*)image;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        uint64_t offset = header->sections[i].offset;
+        uint64_t bytes = (uint64_t)header->sections[i].count * section_item_size[i];
+        if (offset % SCHEMA_IMAGE_ALIGN != 0 || offset + bytes > size) {
+            return false;
+        }
+    }
+
+    /* One institution; the pool starts with the absent string and ends terminated */
+    const SchemaImageSection* strings = &header->sections[SECTION_STRINGS];
+    if (header->sections[SECTION_INSTITUTION].count != 1 || strings->count == 0 ||
+        base[strings->offset] != '\0' || base[strings->offset + strings->count - 1] != '\0') {
+        return false;
+    }
+
+    view->strings = base + strings->offset;
+    view->strings_size = strings->count;
+    view->lists = (const SchemaStr*)(base + header->sections[SECTION_LISTS].offset);
+    view->list_count = header->sections[SECTION_LISTS].count;
+    view->numbers = (const int32_t*)(base + header->sections[SECTION_NUMBERS].offset);
+    view->number_count = header->sections[SECTION_NUMBERS].count;
+    view->institution = (const SchemaImageInstitution*)(base + header->sections[SECTION_INSTITUTION].offset);
+    view->norms = (const SchemaImageNorm*)(base + header->sections[SECTION_NORMS].offset);
+    view->norm_count = header->sections[SECTION_NORMS].count;
+    view->violations = (const SchemaImageViolation*)(base + header->sections[SECTION_VIOLATIONS].offset);
+    view->violation_count = header->sections[SECTION_VIOLATIONS].count;
+    view->facts = (const SchemaImageFact*)(base + header->sections[SECTION_FACTS].offset);
+    view->fact_count = header->sections[SECTION_FACTS].count;
+    view->agendas = (const SchemaImageAgenda*)(base + header->sections[SECTION_AGENDAS].offset);
+    view->agenda_count = header->sections[SECTION_AGENDAS].count;
+
+    view->image = image;
+    view->image_size = size;
+    return true;
+}
+
+/**
+ * View an image held in memory
+ */
+SchemaImage* schema_image_view(const void* image, size_t size) {
+    SchemaImage* view = (SchemaImage*)calloc(1, sizeof(SchemaImage));
+    if (view == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    if (!attach_image(view, image, size)) {
+        fprintf(stderr, "Invalid AST image\n");
+        free(view);
+        return NULL;
+    }
+    return view;
+}
+
+/**
+ * Map an image file read-only
+ */
+SchemaImage* schema_image_open(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening AST image: %s\n", filename);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > UINT32_MAX) {
+        fprintf(stderr, "Invalid AST image: %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "Error mapping AST image: %s\n", filename);
+        return NULL;
+    }
+
+    SchemaImage* view = (SchemaImage*)calloc(1, sizeof(SchemaImage));
+    if (view == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        munmap(image, size);
+        return NULL;
+    }
+
+    if (!attach_image(view, image, size)) {
+        fprintf(stderr, "Invalid AST image: %s\n", filename);
+        munmap(image, size);
+        free(view);
+        return NULL;
+    }
+
+    view->mapped = true;
+    return view;
+}
+
+/**
+ * Release a view, unmapping its image if it was mapped from a file
+ */
+void schema_image_close(SchemaImage* image) {
+    if (image == NULL) {
+        return;
+    }
+    if (image->mapped) {
+        munmap((void*)image->image, image->image_size);
+    }
+    free(image);
+}
+
+/**
+ * Resolve a string reference
+ */
+const char* schema_image_str(const SchemaImage* image, SchemaStr ref) {
+    return ref != 0 && ref < image->strings_size ? image->strings + ref : NULL;
+}
+
+/**
+ * Check that a string reference is inside the pool (0 is the absent string)
+ */
+static bool valid_ref(const SchemaImage* image, SchemaStr ref) {
+    return ref < image->strings_size;
+}
+
+/**
+ * Check that a string reference names a string of the pool
+ */
+static bool present_ref(const SchemaImage* image, SchemaStr ref) {
+    return ref != 0 && ref < image->strings_size;
+}
+
+/**
+ * Check the records of an image before loading it
+ *
+ * The loader sizes its nodes from the table counts, so the ranges must
+ * tile their tables exactly, as schema_image_build() writes them: norm
+ * conditions first and agenda remedies after them in the string list
+ * table, violated norms in the number table, each range starting where
+ * the previous one ends. Enumerations must hold values of their type,
+ * and every string the parser always sets must be in the pool.
+ */
+static bool check_records(const SchemaImage* image) {
+    const SchemaImageInstitution* institution = image->institution;
+    if (institution->type > INST_LEGAL_FACT || institution->multiplicity > MULT_SINGLE ||
+        !present_ref(image, institution->name) || !present_ref(image, institution->legal_domain)) {
+        return false;
+    }
+
+    /* Conditions and remedies are all strings */
+    for (uint32_t i = 0; i < image->list_count; i++) {
+        if (!present_ref(image, image->lists[i])) {
+            return false;
+        }
+    }
+
+    uint64_t list = 0;
+    for (uint32_t i = 0; i < image->norm_count; i++) {
+        const SchemaImageNorm* norm = &image->norms[i];
+        bool has_scope = (norm->flags & SCHEMA_IMAGE_HAS_SCOPE) != 0;
+        if (norm->deontic > DEONTIC_CLAIM_RIGHT || norm->conditions != list ||
+            !present_ref(image, norm->role) || !present_ref(image, norm->action) ||
+            !(has_scope ? present_ref(image, norm->scope) : valid_ref(image, norm->scope))) {
+            return false;
+        }
+        list += norm->condition_count;
+        if (list > image->list_count) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < image->agenda_count; i++) {
+        const SchemaImageAgenda* agenda = &image->agendas[i];
+        if (agenda->compliance > COMPLIANCE_BREACHED || agenda->remedies != list ||
+            !present_ref(image, agenda->requesting_role) || !present_ref(image, agenda->institution) ||
+            !present_ref(image, agenda->beneficiary_role)) {
+            return false;
+        }
+        list += agenda->remedy_count;
+        if (list > image->list_count) {
+            return false;
+        }
+    }
+
+    uint64_t number = 0;
+    for (uint32_t i = 0; i < image->violation_count; i++) {
+        const SchemaImageViolation* violation = &image->violations[i];
+        if (violation->deontic > DEONTIC_CLAIM_RIGHT || violation->norms != number ||
+            !present_ref(image, violation->role) || !present_ref(image, violation->consequence)) {
+            return false;
+        }
+        number += violation->norm_count;
+        if (number > image->number_count) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < image->fact_count; i++) {
+        if (!present_ref(image, image->facts[i].description) || !present_ref(image, image->facts[i].evidence)) {
+            return false;
+        }
+    }
+
+    return list == image->list_count && number == image->number_count;
+}
+
+/**
+ * Rebuild a schema from an image
+ */
+Schema* schema_image_load(const SchemaImage* image) {
+    if (!check_records(image)) {
+        fprintf(stderr, "Invalid AST image\n");
+        return NULL;
+    }
+
+    uint32_t scope_count = 0;
+    uint32_t condition_count = 0;
+    for (uint32_t i = 0; i < image->norm_count; i++) {
+        scope_count += (image->norms[i].flags & SCHEMA_IMAGE_HAS_SCOPE) != 0;
+        condition_count += image->norms[i].condition_count;
+    }
+
+    /* Nodes first (all pointer-aligned), then a private copy of the string pool */
+    size_t size = sizeof(Schema) +
+                  image->norm_count * sizeof(Norm) +
+                  scope_count * sizeof(Scope) +
+                  condition_count * sizeof(Condition) +
+                  image->violation_count * sizeof(Violation) +
+                  image->number_count * sizeof(ViolationRef) +
+                  image->fact_count * sizeof(LegalFact) +
+                  image->agenda_count * sizeof(Agenda) +
+                  (image->list_count - condition_count) * sizeof(NormRemedy) +
+                  image->strings_size;
+
+    char* block = (char*)calloc(1, size);
+    if (block == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    Schema* schema = (Schema*)block;
+    Norm* norms = (Norm*)(schema + 1);
+    Scope* scopes = (Scope*)(norms + image->norm_count);
+    Condition* conditions = (Condition*)(scopes + scope_count);
+    Violation* violations = (Violation*)(conditions + condition_count);
+    ViolationRef* refs = (ViolationRef*)(violations + image->violation_count);
+    LegalFact* facts = (LegalFact*)(refs + image->number_count);
+    Agenda* agendas = (Agenda*)(facts + image->fact_count);
+    NormRemedy* remedies = (NormRemedy*)(agendas + image->agenda_count);
+    char* strings = (char*)(remedies + (image->list_count - condition_count));
+    memcpy(strings, image->strings, image->strings_size);
+
+#define STR(ref) ((ref) != 0 && (ref) < image->strings_size ? strings + (ref) : NULL)
+
+    schema->packed = true;
+    schema->institution.name = STR(image->institution->name);
+    schema->institution.type = (InstitutionType)image->institution->type;
+    schema->institution.multiplicity = (Multiplicity)image->institution->multiplicity;
+    schema->institution.legal_domain = STR(image->institution->legal_domain);
+
+    for (uint32_t i = 0; i < image->norm_count; i++) {
+        const SchemaImageNorm* record = &image->norms[i];
+        Norm* norm = &norms[i];
+        norm->number = record->number;
+        norm->role = STR(record->role);
+        norm->deontic = (DeonticOperator)record->deontic;
+        norm->action = STR(record->action);
+        if (record->flags & SCHEMA_IMAGE_HAS_SCOPE) {
+            scopes->description = STR(record->scope);
+            norm->scope = scopes++;
+        }
+        for (uint32_t c = 0; c < record->condition_count; c++) {
+            conditions->description = STR(image->lists[record->conditions + c]);
+            conditions->next = c + 1 < record->condition_count ? conditions + 1 : NULL;
+            if (c == 0) {
+                norm->condition = conditions;
+            }
+            conditions++;
+        }
+        norm->next = i + 1 < image->norm_count ? &norms[i + 1] : NULL;
+    }
+
+    for (uint32_t i = 0; i < image->violation_count; i++) {
+        const SchemaImageViolation* record = &image->violations[i];
+        Violation* violation = &violations[i];
+        for (uint32_t n = 0; n < record->norm_count; n++) {
+            refs->norm_number = image->numbers[record->norms + n];
+            refs->next = n + 1 < record->norm_count ? refs + 1 : NULL;
+            if (n == 0) {
+                violation->violated_norms = refs;
+            }
+            refs++;
+        }
+        violation->role = STR(record->role);
+        violation->deontic = (DeonticOperator)record->deontic;
+        violation->consequence = STR(record->consequence);
+        violation->next = i + 1 < image->violation_count ? &violations[i + 1] : NULL;
+    }
+
+    for (uint32_t i = 0; i < image->fact_count; i++) {
+        facts[i].description = STR(image->facts[i].description);
+        facts[i].evidence = STR(image->facts[i].evidence);
+        facts[i].next = i + 1 < image->fact_count ? &facts[i + 1] : NULL;
+    }
+
+    for (uint32_t i = 0; i < image->agenda_count; i++) {
+        const SchemaImageAgenda* record = &image->agendas[i];
+        Agenda* agenda = &agendas[i];
+        agenda->requesting_role = STR(record->requesting_role);
+        agenda->compliance = (ComplianceType)record->compliance;
+        agenda->institution = STR(record->institution);
+        agenda->beneficiary_role = STR(record->beneficiary_role);
+        agenda->is_essential = (record->flags & SCHEMA_IMAGE_ESSENTIAL) != 0;
+        for (uint32_t r = 0; r < record->remedy_count; r++) {
+            remedies->description = STR(image->lists[record->remedies + r]);
+            remedies->next = r + 1 < record->remedy_count ? remedies + 1 : NULL;
+            if (r == 0) {
+                agenda->norm_remedies = remedies;
+            }
+            remedies++;
+        }
+        agenda->next = i + 1 < image->agenda_count ? &agendas[i + 1] : NULL;
+    }
+
+#undef STR
+
+    schema->norms = image->norm_count > 0 ? norms : NULL;
+    schema->violations = image->violation_count > 0 ? violations : NULL;
+    schema->facts = image->fact_count > 0 ? facts : NULL;
+    schema->agendas = image->agenda_count > 0 ? agendas : NULL;
+    return schema;
+}
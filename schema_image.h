@@ -0,0 +1,192 @@
+/**
+ * schema_image.h
+ *
+ * Compact binary image of a parsed schema (the AST written by
+ * --emit=ast), so code generation and analysis can start from a cached
+ * parse instead of tokenizing and parsing the schema text again
+ */
+
+#ifndef SCHEMA_IMAGE_H
+#define SCHEMA_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "schema_types.h"
+
+/**
+ * Reference to a string in the image's string pool (0 = absent)
+ */
+typedef uint32_t SchemaStr;
+
+/**
+ * Record flags
+ */
+#define SCHEMA_IMAGE_HAS_SCOPE  0x1     // Norm: a scope descriptor is present
+#define SCHEMA_IMAGE_ESSENTIAL  0x1     // Agenda: "lo esencial" was used
+
+/**
+ * Institution declaration
+ */
+typedef struct {
+    SchemaStr name;
+    uint32_t type;                      // InstitutionType
+    uint32_t multiplicity;              // Multiplicity
+    SchemaStr legal_domain;
+} SchemaImageInstitution;
+
+/**
+ * Norm, in schema order
+ */
+typedef struct {
+    int32_t number;
+    uint32_t deontic;                   // DeonticOperator
+    SchemaStr role;
+    SchemaStr action;
+    SchemaStr scope;                    // Scope description (see SCHEMA_IMAGE_HAS_SCOPE)
+    uint32_t flags;
+    uint32_t conditions;                // First condition in the string list table
+    uint32_t condition_count;
+} SchemaImageNorm;
+
+/**
+ * Violation, in schema order
+ */
+typedef struct {
+    uint32_t norms;                     // First violated norm number in the number table
+    uint32_t norm_count;
+    SchemaStr role;
+    uint32_t deontic;                   // DeonticOperator
+    SchemaStr consequence;
+} SchemaImageViolation;
+
+/**
+ * Legal fact, in schema order
+ */
+typedef struct {
+    SchemaStr description;
+    SchemaStr evidence;
+} SchemaImageFact;
+
+/**
+ * Agenda, in schema order
+ */
+typedef struct {
+    SchemaStr requesting_role;
+    uint32_t compliance;                // ComplianceType
+    SchemaStr institution;
+    SchemaStr beneficiary_role;
+    uint32_t flags;
+    uint32_t remedies;                  // First norm/remedy in the string list table
+    uint32_t remedy_count;
+} SchemaImageAgenda;
+
+/**
+ * A schema image, in memory or mapped from a file
+ *
+ * Like the context snapshot, the image is position-independent: lists
+ * are index ranges into shared tables and strings are pool offsets, so
+ * it is written out as-is and read back in place.
+ */
+typedef struct {
+    const char* strings;                // String pool (offset 0 is the absent string)
+    uint32_t strings_size;
+    const SchemaStr* lists;             // Conditions and norm/remedies
+    uint32_t list_count;
+    const int32_t* numbers;             // Violated norm numbers
+    uint32_t number_count;
+    const SchemaImageInstitution* institution;
+    const SchemaImageNorm* norms;
+    uint32_t norm_count;
+    const SchemaImageViolation* violations;
+    uint32_t violation_count;
+    const SchemaImageFact* facts;
+    uint32_t fact_count;
+    const SchemaImageAgenda* agendas;
+    uint32_t agenda_count;
+
+    const void* image;                  // Backing image
+    size_t image_size;
+    bool mapped;                        // Image is a read-only file mapping (unmapped on close)
+} SchemaImage;
+
+/**
+ * Image file identification
+ */
+#define SCHEMA_IMAGE_MAGIC "SVASTIMG"
+#define SCHEMA_IMAGE_VERSION 1
+
+/**
+ * Serialize a schema into an image
+ *
+ * @param schema The schema
+ * @param size Receives the image size in bytes
+ * @return The image (free with free()), or NULL on error
+ */
+void* schema_image_build(const Schema* schema, size_t* size);
+
+/**
+ * Write a schema's image to a file
+ *
+ * @param schema The schema
+ * @param output File to write to
+ * @return true on success, false on error
+ */
+bool schema_image_write(const Schema* schema, FILE* output);
+
+/**
+ * Check whether a buffer starts with the image magic number
+ *
+ * @param data Buffer
+ * @param size Size of the buffer in bytes
+ * @return true if it looks like a schema image
+ */
+bool schema_image_detect(const void* data, size_t size);
+
+/**
+ * View an image held in memory
+ *
+ * @param image The image (must stay valid, and 8-byte aligned, while the view is used)
+ * @param size Size of the image in bytes
+ * @return The view (free with schema_image_close()), or NULL if the image is invalid
+ */
+SchemaImage* schema_image_view(const void* image, size_t size);
+
+/**
+ * Map an image file read-only
+ *
+ * @param filename Path of the image file
+ * @return The view (free with schema_image_close()), or NULL on error
+ */
+SchemaImage* schema_image_open(const char* filename);
+
+/**
+ * Release a view, unmapping its image if it was mapped from a file
+ *
+ * @param image View to release
+ */
+void schema_image_close(SchemaImage* image);
+
+/**
+ * Resolve a string reference
+ *
+ * @param image The image
+ * @param ref String reference
+ * @return The string, or NULL if the reference is absent
+ */
+const char* schema_image_str(const SchemaImage* image, SchemaStr ref);
+
+/**
+ * Rebuild a schema from an image
+ *
+ * The schema, all of its nodes and strings are laid out in one
+ * allocation (free_schema() releases it). The result must not be
+ * modified.
+ *
+ * @param image The image
+ * @return The schema, or NULL on error
+ */
+Schema* schema_image_load(const SchemaImage* image);
+
+#endif /* SCHEMA_IMAGE_H */
@@ -0,0 +1,224 @@
+/**
+ * schema_json.c
+ *
+ * Implementation of the JSON export of schemas and diagnostics
+ */
+
+#include "schema_json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Prefix the grammar gives conditions that refer to another norm */
+#define NORM_REFERENCE_PREFIX "NORM_REFERENCE:"
+
+static const char* const deontic_names[] = { "obligation", "prohibition", "privilege", "claim_right" };
+static const char* const institution_type_names[] = { "contract", "procedure", "legal_act", "legal_fact" };
+static const char* const multiplicity_names[] = { "multiple", "single" };
+static const char* const compliance_names[] = { "fulfilled", "breached" };
+
+/**
+ * Look up the name of an enum value (NULL if out of range)
+ */
+static const char* enum_name(const char* const* names, size_t count, int value) {
+    return value >= 0 && (size_t)value < count ? names[value] : NULL;
+}
+
+#define ENUM_NAME(names, value) enum_name(names, sizeof(names) / sizeof(names[0]), (int)(value))
+
+/**
+ * Parse diagnostic callback that appends to a SchemaDiagnostics
+ */
+void schema_diagnostics_collect(void* user, ParseSeverity severity, int line, const char* message) {
+    SchemaDiagnostics* diagnostics = (SchemaDiagnostics*)user;
+
+    if (diagnostics->count == diagnostics->capacity) {
+        int capacity = diagnostics->capacity > 0 ? diagnostics->capacity * 2 : 8;
+        SchemaDiagnostic* items = (SchemaDiagnostic*)realloc(diagnostics->items, capacity * sizeof(SchemaDiagnostic));
+        if (items == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return;
+        }
+        diagnostics->items = items;
+        diagnostics->capacity = capacity;
+    }
+
+    char* copy = strdup(message);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return;
+    }
+
+    SchemaDiagnostic* diagnostic = &diagnostics->items[diagnostics->count++];
+    diagnostic->severity = severity;
+    diagnostic->line = line;
+    diagnostic->message = copy;
+    if (severity == PARSE_ERROR) {
+        diagnostics->error_count++;
+    }
+}
+
+/**
+ * Release the diagnostics of a list and empty it
+ */
+void schema_diagnostics_clear(SchemaDiagnostics* diagnostics) {
+    for (int i = 0; i < diagnostics->count; i++) {
+        free(diagnostics->items[i].message);
+    }
+    free(diagnostics->items);
+    memset(diagnostics, 0, sizeof(*diagnostics));
+}
+
+/**
+ * Write one norm
+ */
+static void write_norm(JsonWriter* writer, const Norm* norm) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "number");
+    json_writer_int(writer, norm->number);
+    json_writer_key(writer, "role");
+    json_writer_string(writer, norm->role);
+    json_writer_key(writer, "deontic");
+    json_writer_string(writer, ENUM_NAME(deontic_names, norm->deontic));
+    json_writer_key(writer, "action");
+    json_writer_string(writer, norm->action);
+    json_writer_key(writer, "scope");
+    json_writer_string(writer, norm->scope != NULL ? norm->scope->description : NULL);
+
+    json_writer_key(writer, "conditions");
+    json_writer_begin_array(writer);
+    for (const Condition* condition = norm->condition; condition != NULL; condition = condition->next) {
+        const char* description = condition->description != NULL ? condition->description : "";
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "type");
+        if (strncmp(description, NORM_REFERENCE_PREFIX, sizeof(NORM_REFERENCE_PREFIX) - 1) == 0) {
+            json_writer_string(writer, "norm");
+            json_writer_key(writer, "norm");
+            json_writer_int(writer, atoi(description + sizeof(NORM_REFERENCE_PREFIX) - 1));
+        } else {
+            json_writer_string(writer, "text");
+            json_writer_key(writer, "description");
+            json_writer_string(writer, condition->description);
+        }
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+}
+
+/**
+ * Write one violation
+ */
+static void write_violation(JsonWriter* writer, const Violation* violation) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "norms");
+    json_writer_begin_array(writer);
+    for (const ViolationRef* ref = violation->violated_norms; ref != NULL; ref = ref->next) {
+        json_writer_int(writer, ref->norm_number);
+    }
+    json_writer_end_array(writer);
+    json_writer_key(writer, "role");
+    json_writer_string(writer, violation->role);
+    json_writer_key(writer, "deontic");
+    json_writer_string(writer, ENUM_NAME(deontic_names, violation->deontic));
+    json_writer_key(writer, "consequence");
+    json_writer_string(writer, violation->consequence);
+    json_writer_end_object(writer);
+}
+
+/**
+ * Write one agenda
+ */
+static void write_agenda(JsonWriter* writer, const Agenda* agenda) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "requesting_role");
+    json_writer_string(writer, agenda->requesting_role);
+    json_writer_key(writer, "compliance");
+    json_writer_string(writer, ENUM_NAME(compliance_names, agenda->compliance));
+    json_writer_key(writer, "institution");
+    json_writer_string(writer, agenda->institution);
+    json_writer_key(writer, "beneficiary_role");
+    json_writer_string(writer, agenda->beneficiary_role);
+    json_writer_key(writer, "essential");
+    json_writer_bool(writer, agenda->is_essential);
+    json_writer_key(writer, "remedies");
+    json_writer_begin_array(writer);
+    for (const NormRemedy* remedy = agenda->norm_remedies; remedy != NULL; remedy = remedy->next) {
+        json_writer_string(writer, remedy->description);
+    }
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+}
+
+/**
+ * Write a schema as a JSON object
+ */
+void schema_json_write(JsonWriter* writer, const Schema* schema) {
+    json_writer_begin_object(writer);
+
+    json_writer_key(writer, "institution");
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, schema->institution.name);
+    json_writer_key(writer, "type");
+    json_writer_string(writer, ENUM_NAME(institution_type_names, schema->institution.type));
+    json_writer_key(writer, "multiplicity");
+    json_writer_string(writer, ENUM_NAME(multiplicity_names, schema->institution.multiplicity));
+    json_writer_key(writer, "legal_domain");
+    json_writer_string(writer, schema->institution.legal_domain);
+    json_writer_end_object(writer);
+
+    json_writer_key(writer, "norms");
+    json_writer_begin_array(writer);
+    for (const Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        write_norm(writer, norm);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_key(writer, "violations");
+    json_writer_begin_array(writer);
+    for (const Violation* violation = schema->violations; violation != NULL; violation = violation->next) {
+        write_violation(writer, violation);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_key(writer, "facts");
+    json_writer_begin_array(writer);
+    for (const LegalFact* fact = schema->facts; fact != NULL; fact = fact->next) {
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "description");
+        json_writer_string(writer, fact->description);
+        json_writer_key(writer, "evidence");
+        json_writer_string(writer, fact->evidence);
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_key(writer, "agendas");
+    json_writer_begin_array(writer);
+    for (const Agenda* agenda = schema->agendas; agenda != NULL; agenda = agenda->next) {
+        write_agenda(writer, agenda);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_end_object(writer);
+}
+
+/**
+ * Write diagnostics as a JSON array
+ */
+void schema_json_write_diagnostics(JsonWriter* writer, const SchemaDiagnostics* diagnostics) {
+    json_writer_begin_array(writer);
+    for (int i = 0; i < diagnostics->count; i++) {
+        const SchemaDiagnostic* diagnostic = &diagnostics->items[i];
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "severity");
+        json_writer_string(writer, diagnostic->severity == PARSE_ERROR ? "error" : "warning");
+        json_writer_key(writer, "line");
+        json_writer_int(writer, diagnostic->line);
+        json_writer_key(writer, "message");
+        json_writer_string(writer, diagnostic->message);
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+}
@@ -0,0 +1,74 @@
+/**
+ * schema_json.h
+ *
+ * JSON export of parsed schemas and their parse diagnostics (the output
+ * of --emit=json), written through the streaming JSON writer
+ */
+
+#ifndef SCHEMA_JSON_H
+#define SCHEMA_JSON_H
+
+#include <stdbool.h>
+#include "json_writer.h"
+#include "parser_defs.h"
+#include "schema_types.h"
+
+/**
+ * One parse diagnostic
+ */
+typedef struct {
+    ParseSeverity severity;
+    int line;
+    char* message;
+} SchemaDiagnostic;
+
+/**
+ * Diagnostics collected during a parse
+ */
+typedef struct {
+    SchemaDiagnostic* items;
+    int count;
+    int capacity;
+    int error_count;
+} SchemaDiagnostics;
+
+/**
+ * Parse diagnostic callback that appends to a SchemaDiagnostics
+ *
+ * Pass it as ParseOptions.diagnostic with the list as the user data.
+ *
+ * @param user The SchemaDiagnostics to append to
+ * @param severity Severity of the diagnostic
+ * @param line Input line the parser was on
+ * @param message Message text
+ */
+void schema_diagnostics_collect(void* user, ParseSeverity severity, int line, const char* message);
+
+/**
+ * Release the diagnostics of a list and empty it
+ *
+ * @param diagnostics The list
+ */
+void schema_diagnostics_clear(SchemaDiagnostics* diagnostics);
+
+/**
+ * Write a schema as a JSON object
+ *
+ * Norms keep their order and numbers; violations refer to norms by
+ * number. A condition is {"type": "text", "description": ...} or, for a
+ * reference to another norm, {"type": "norm", "norm": N}.
+ *
+ * @param writer Writer, positioned where a value may appear
+ * @param schema The schema
+ */
+void schema_json_write(JsonWriter* writer, const Schema* schema);
+
+/**
+ * Write diagnostics as a JSON array of {"severity", "line", "message"}
+ *
+ * @param writer Writer, positioned where a value may appear
+ * @param diagnostics The diagnostics
+ */
+void schema_json_write_diagnostics(JsonWriter* writer, const SchemaDiagnostics* diagnostics);
+
+#endif /* SCHEMA_JSON_H */
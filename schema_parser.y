@@ -1,20 +1,37 @@
+%code requires {
+#include "parser_defs.h"
+#include "custom_tokenizer.h"
+
+/* State of one parse */
+typedef struct parse_state {
+    Schema* schema;                 // Schema being built
+    Tokenizer* tokenizer;
+    const ParseOptions* options;
+    int start_token;                // Token returned before the input, or 0
+    int token;                      // Last token returned to the parser
+    char* leading_scope;            // Scope met before any norm was added
+} ParseState;
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include "schema_types.h"
 #include "config_validator.h"
-#include "custom_tokenizer.h"
+%}
 
+%code {
 /* Function declarations */
-void yyerror(const char *s);
-extern int yylex();
-extern int tokenizer_get_line();
-extern const char* tokenizer_get_text();
+static int yylex(YYSTYPE* value, YYLTYPE* location, ParseState* state);
+static void yyerror(YYLTYPE* location, ParseState* state, const char *s);
+static void parse_warning(ParseState* state, const char* format, ...);
+}
 
-/* Global schema being built */
-Schema* current_schema;
-%}
+%define api.pure full
+%locations
+%param {ParseState* state}
 
 %union {
     char *string;
@@ -50,6 +67,7 @@ Schema* current_schema;
 %token ADJUDIQUE
 %token LO_ESENCIAL
 %token LO_SIGUIENTE
+%token SECTION_START
 
 %type <deontic> deontic_op
 %type <string> action
@@ -58,13 +76,23 @@ Schema* current_schema;
 %type <string> scope
 %type <compliance> compliance_type
 
+/* Strings dropped by error recovery or left on the stack by a failed parse */
+%destructor { free($$); } <string>
+
 %%
 
+input
+    : schema
+    | SECTION_START norm_list violation_list fact_list agenda_list
+    ;
+
 schema
     : institution_decl norm_list violation_list fact_list agenda_list
     {
         /* Schema parsing successful */
-        printf("Successfully parsed schema\n");
+        if (state->options->trace != NULL) {
+            fprintf(state->options->trace, "Successfully parsed schema\n");
+        }
     }
     ;
 
@@ -79,25 +107,30 @@ institution_decl
         if (!config_is_valid_institution($2)) {
             const char* suggestion = config_suggest_institution($2);
             if (suggestion) {
-                fprintf(stderr, "Warning: Unknown institution '%s', did you mean '%s'?\n", 
+                parse_warning(state, "Unknown institution '%s', did you mean '%s'?", 
                         $2, suggestion);
                 free($2);
                 $2 = strdup(suggestion);
             } else {
-                fprintf(stderr, "Warning: Unknown institution '%s'\n", $2);
+                parse_warning(state, "Unknown institution '%s'", $2);
             }
         }
         
         if (!config_is_valid_type($3)) {
-            fprintf(stderr, "Warning: Unknown institution type '%s'\n", $3);
+            parse_warning(state, "Unknown institution type '%s'", $3);
         }
         
         if (!config_is_valid_domain($5)) {
-            fprintf(stderr, "Warning: Unknown legal domain '%s'\n", $5);
+            const char* suggestion = config_suggest_domain($5);
+            if (suggestion) {
+                parse_warning(state, "Unknown legal domain '%s', did you mean '%s'?", $5, suggestion);
+            } else {
+                parse_warning(state, "Unknown legal domain '%s'", $5);
+            }
         }
         
         /* Set institution and save context */
-        set_institution(current_schema, $2, type, mult, $5);
+        set_institution(state->schema, $2, type, mult, $5);
         config_set_current_institution($2);
         
         free($2); free($3); free($4); free($5);
@@ -116,7 +149,7 @@ norm
         if (!config_is_valid_role($2)) {
             const char* suggestion = config_suggest_role($2);
             if (suggestion) {
-                fprintf(stderr, "Warning: Role '%s' may not be valid for this institution, did you mean '%s'?\n", 
+                parse_warning(state, "Role '%s' may not be valid for this institution, did you mean '%s'?", 
                         $2, suggestion);
                 free($2);
                 $2 = strdup(suggestion);
@@ -125,7 +158,10 @@ norm
         
         /* Create and add norm to schema */
         Norm* norm = create_norm($1, $2, $3, $4);
-        add_norm_to_schema(current_schema, norm);
+        if (norm != NULL) {
+            norm->line = @1.first_line;
+        }
+        add_norm_to_schema(state->schema, norm);
         
         free($2); free($4);
     }
@@ -135,7 +171,7 @@ norm
         if (!config_is_valid_role($4)) {
             const char* suggestion = config_suggest_role($4);
             if (suggestion) {
-                fprintf(stderr, "Warning: Role '%s' may not be valid for this institution, did you mean '%s'?\n", 
+                parse_warning(state, "Role '%s' may not be valid for this institution, did you mean '%s'?", 
                         $4, suggestion);
                 free($4);
                 $4 = strdup(suggestion);
@@ -144,12 +180,15 @@ norm
         
         /* Create norm */
         Norm* norm = create_norm($1, $4, $5, $6);
+        if (norm != NULL) {
+            norm->line = @1.first_line;
+        }
         
         /* Add condition */
         add_condition_to_norm(norm, $3);
         
         /* Add to schema */
-        add_norm_to_schema(current_schema, norm);
+        add_norm_to_schema(state->schema, norm);
         
         free($3); free($4); free($6);
     }
@@ -159,7 +198,7 @@ norm
         if (!config_is_valid_role($5)) {
             const char* suggestion = config_suggest_role($5);
             if (suggestion) {
-                fprintf(stderr, "Warning: Role '%s' may not be valid for this institution, did you mean '%s'?\n", 
+                parse_warning(state, "Role '%s' may not be valid for this institution, did you mean '%s'?", 
                         $5, suggestion);
                 free($5);
                 $5 = strdup(suggestion);
@@ -168,14 +207,17 @@ norm
         
         /* Create norm */
         Norm* norm = create_norm($1, $5, $6, $7);
+        if (norm != NULL) {
+            norm->line = @1.first_line;
+        }
         
         /* Add reference to other norm as condition */
         char condition_text[64];
         snprintf(condition_text, sizeof(condition_text), "NORM_REFERENCE:%d", $4);
-        add_condition_to_norm(norm, strdup(condition_text));
+        add_condition_to_norm(norm, condition_text);
         
         /* Add to schema */
-        add_norm_to_schema(current_schema, norm);
+        add_norm_to_schema(state->schema, norm);
         
         free($5); free($7);
     }
@@ -230,12 +272,16 @@ scope_opt
     | ACTUA_SOBRE scope
     {
         /* Get the last norm added and add scope to it */
-        Norm* last_norm = current_schema->norms;
+        Norm* last_norm = state->schema->norms;
         if (last_norm != NULL) {
             while (last_norm->next != NULL) {
                 last_norm = last_norm->next;
             }
             add_scope_to_norm(last_norm, $2);
+        } else if (state->leading_scope == NULL) {
+            /* Kept for the caller: in a section it belongs to the last norm of the section before */
+            state->leading_scope = $2;
+            $2 = NULL;
         }
         free($2);
     }
@@ -257,7 +303,7 @@ violation
         if (!config_is_valid_role($4)) {
             const char* suggestion = config_suggest_role($4);
             if (suggestion) {
-                fprintf(stderr, "Warning: Role '%s' may not be valid for this institution, did you mean '%s'?\n", 
+                parse_warning(state, "Role '%s' may not be valid for this institution, did you mean '%s'?", 
                         $4, suggestion);
                 free($4);
                 $4 = strdup(suggestion);
@@ -266,7 +312,7 @@ violation
         
         /* Create and add violation to schema */
         Violation* viol = create_violation($2, $4, $5, $6);
-        add_violation_to_schema(current_schema, viol);
+        add_violation_to_schema(state->schema, viol);
         
         free($4); free($6);
     }
@@ -276,7 +322,7 @@ violation
         if (!config_is_valid_role($7)) {
             const char* suggestion = config_suggest_role($7);
             if (suggestion) {
-                fprintf(stderr, "Warning: Role '%s' may not be valid for this institution, did you mean '%s'?\n", 
+                parse_warning(state, "Role '%s' may not be valid for this institution, did you mean '%s'?", 
                         $7, suggestion);
                 free($7);
                 $7 = strdup(suggestion);
@@ -285,7 +331,7 @@ violation
         
         /* Create and add compound violation to schema */
         Violation* viol = create_compound_violation($2, $5, $7, $8, $9);
-        add_violation_to_schema(current_schema, viol);
+        add_violation_to_schema(state->schema, viol);
         
         free($7); free($9);
     }
@@ -301,7 +347,7 @@ fact
     {
         /* Create and add legal fact to schema */
         LegalFact* fact = create_legal_fact($2, $4);
-        add_fact_to_schema(current_schema, fact);
+        add_fact_to_schema(state->schema, fact);
         
         free($2); free($4);
     }
@@ -309,7 +355,7 @@ fact
     {
         /* Create and add legal fact to schema */
         LegalFact* fact = create_legal_fact($2, $3);
-        add_fact_to_schema(current_schema, fact);
+        add_fact_to_schema(state->schema, fact);
         
         free($2); free($3);
     }
@@ -325,17 +371,17 @@ agenda
     {
         /* Validate roles */
         if (!config_is_valid_role($1)) {
-            fprintf(stderr, "Warning: Role '%s' may not be valid for this institution\n", $1);
+            parse_warning(state, "Role '%s' may not be valid for this institution", $1);
         }
         
         if (!config_is_valid_role($7)) {
-            fprintf(stderr, "Warning: Role '%s' may not be valid for this institution\n", $7);
+            parse_warning(state, "Role '%s' may not be valid for this institution", $7);
         }
         
         /* Create agenda */
         Agenda* agenda = create_agenda($1, $4, $5, $7);
         set_agenda_essential(agenda, true);
-        add_agenda_to_schema(current_schema, agenda);
+        add_agenda_to_schema(state->schema, agenda);
         
         free($1); free($5); free($7);
     }
@@ -343,11 +389,11 @@ agenda
     {
         /* Validate roles */
         if (!config_is_valid_role($1)) {
-            fprintf(stderr, "Warning: Role '%s' may not be valid for this institution\n", $1);
+            parse_warning(state, "Role '%s' may not be valid for this institution", $1);
         }
         
         if (!config_is_valid_role($7)) {
-            fprintf(stderr, "Warning: Role '%s' may not be valid for this institution\n", $7);
+            parse_warning(state, "Role '%s' may not be valid for this institution", $7);
         }
         
         /* Create agenda */
@@ -357,7 +403,7 @@ agenda
         /* Add remedy */
         add_norm_remedy_to_agenda(agenda, $9);
         
-        add_agenda_to_schema(current_schema, agenda);
+        add_agenda_to_schema(state->schema, agenda);
         
         free($1); free($5); free($7); free($9);
     }
@@ -370,37 +416,146 @@ compliance_type
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Parse error at line %d: %s\n", tokenizer_get_line(), s);
+/**
+ * Get the next token for the parser
+ */
+static int yylex(YYSTYPE* value, YYLTYPE* location, ParseState* state) {
+    /* A section starts with a token of its own instead of an institution */
+    int token = state->start_token;
+    if (token != 0) {
+        state->start_token = 0;
+    } else {
+        token = tokenizer_next(state->tokenizer, value);
+        const char* keyword = tokenizer_get_correction(state->tokenizer);
+        if (keyword != NULL) {
+            parse_warning(state, "Unknown word '%s' read as '%s'", tokenizer_get_text(state->tokenizer), keyword);
+        }
+    }
+    state->token = token;
+
+    /* Tokens never span lines */
+    location->first_line = location->last_line = tokenizer_get_line(state->tokenizer);
+    location->first_column = location->last_column = 0;
+    return token;
+}
+
+/**
+ * Deliver a diagnostic through the callback, or print it to stderr
+ */
+void parse_report(const ParseOptions* options, ParseSeverity severity, int line, const char* message) {
+    if (options->diagnostic != NULL) {
+        options->diagnostic(options->user, severity, line, message);
+    } else if (severity == PARSE_ERROR) {
+        fprintf(stderr, "Parse error at line %d: %s\n", line, message);
+    } else {
+        fprintf(stderr, "Warning: %s\n", message);
+    }
+}
+
+/**
+ * Report a diagnostic at the current line
+ */
+static void report(ParseState* state, ParseSeverity severity, const char* message) {
+    parse_report(state->options, severity, tokenizer_get_line(state->tokenizer), message);
+}
+
+/**
+ * Report a warning about accepted input
+ */
+static void parse_warning(ParseState* state, const char* format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    
+    report(state, PARSE_WARNING, message);
+}
+
+/**
+ * Report a syntax error
+ */
+static void yyerror(YYLTYPE* location, ParseState* state, const char *s) {
+    /* A word the tokenizer did not take for a role may be a misspelled one */
+    if (state->token == STRING) {
+        const char* word = tokenizer_get_text(state->tokenizer);
+        const char* suggestion = strlen(word) >= 4 && strchr(word, ' ') == NULL ?
+                                 config_suggest_role(word) : NULL;
+        if (suggestion != NULL) {
+            char message[1024];
+            snprintf(message, sizeof(message), "%s: unknown role '%s', did you mean '%s'?", s, word, suggestion);
+            report(state, PARSE_ERROR, message);
+            return;
+        }
+    }
+    report(state, PARSE_ERROR, s);
 }
 
 /* Main function to parse a schema */
 Schema* parse_schema(FILE* input) {
+    ParseOptions options = { stdout, NULL, NULL };
+    return parse_schema_with(input, &options);
+}
+
+/**
+ * Parse a schema with explicit options
+ */
+Schema* parse_schema_with(FILE* input, const ParseOptions* options) {
+    /* Parse schema; the institution recorded for role checks is not kept */
+    Schema* schema = parse_schema_part(input, options, 1, true, NULL);
+    config_set_current_institution(NULL);
+    if (schema == NULL) {
+        return NULL;
+    }
+    
+    /* Complete the schema with the default norms of its legal domain */
+    int defaults = config_add_default_norms(schema);
+    if (defaults > 0 && options->trace != NULL) {
+        fprintf(options->trace, "Added %d default norms for %s\n", defaults, schema->institution.legal_domain);
+    }
+    
+    return schema;
+}
+
+/**
+ * Parse part of a schema
+ */
+Schema* parse_schema_part(FILE* input, const ParseOptions* options, int first_line, bool declaration,
+                          char** leading_scope) {
+    ParseState state = { NULL, NULL, options, declaration ? 0 : SECTION_START, 0, NULL };
+    
     /* Initialize tokenizer */
-    if (!tokenizer_init(input)) {
+    state.tokenizer = tokenizer_create_at(input, options->trace, first_line);
+    if (state.tokenizer == NULL) {
         fprintf(stderr, "Failed to initialize tokenizer\n");
         return NULL;
     }
     
     /* Initialize schema */
-    current_schema = create_schema();
-    if (!current_schema) {
+    state.schema = create_schema();
+    if (!state.schema) {
         fprintf(stderr, "Failed to create schema\n");
-        tokenizer_cleanup();
+        tokenizer_free(state.tokenizer);
         return NULL;
     }
     
     /* Parse schema */
-    int result = yyparse();
+    int result = yyparse(&state);
     
     /* Clean up tokenizer */
-    tokenizer_cleanup();
+    tokenizer_free(state.tokenizer);
     
     /* Handle parse result */
     if (result != 0) {
-        free_schema(current_schema);
+        free(state.leading_scope);
+        free_schema(state.schema);
         return NULL;
     }
     
-    return current_schema;
+    if (leading_scope != NULL) {
+        *leading_scope = state.leading_scope;
+    } else {
+        free(state.leading_scope);
+    }
+    return state.schema;
 }
@@ -9,6 +9,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "context_manager.h"
 #include "config_validator.h"
 #include <cJSON.h> 
@@ -46,6 +52,7 @@ Schema* create_schema() {
     schema->violations = NULL;
     schema->facts = NULL;
     schema->agendas = NULL;
+    schema->packed = false;
     
     return schema;
 }
@@ -58,6 +65,12 @@ void free_schema(Schema* schema) {
         return;
     }
     
+    /* A loaded AST image is a single block */
+    if (schema->packed) {
+        free(schema);
+        return;
+    }
+    
     /* Free institution fields */
     free(schema->institution.name);
     free(schema->institution.legal_domain);
@@ -160,6 +173,7 @@ Norm* create_norm(int number, char* role, DeonticOperator deontic, char* action)
     norm->action = safe_strdup(action);
     norm->scope = NULL;
     norm->condition = NULL;
+    norm->line = 0;
     norm->next = NULL;
     
     return norm;
@@ -501,8 +515,35 @@ static const char* institution_type_to_string(InstitutionType type) {
 /* Add this function to schema_types.c */
 
 /**
- * Helper function to sanitize a string for the Kelsen parser
- * Removes problematic characters like $ signs and other non-alphanumeric chars
+ * Helper function to sanitize a character for the Kelsen parser
+ * Returns '\0' for characters to drop (like $ signs), ' ' for brackets
+ */
+static char sanitize_char(char c) {
+    /* Skip problematic characters: $, ", ', special punctuation */
+    if (c == '$' || 
+        c == '"' || 
+        c == '\'' ||
+        c == ',' ||
+        c == ';' ||
+        c == '{' ||
+        c == '%' ||
+        c == '}') {
+        return '\0';
+    }
+    
+    /* Replace some problematic characters with spaces */
+    if (c == '(' || 
+        c == ')' ||
+        c == '[' ||
+        c == ']') {
+        return ' ';
+    }
+    
+    return c;
+}
+
+/**
+ * Copy a string with the characters the Kelsen parser rejects removed (or made spaces)
  */
 static char* sanitize_for_kelsen(const char* input) {
     if (input == NULL) {
@@ -516,28 +557,10 @@ static char* sanitize_for_kelsen(const char* input) {
     
     int i, j;
     for (i = 0, j = 0; input[i] != '\0'; i++) {
-        /* Skip problematic characters: $, ", ', special punctuation */
-        if (input[i] == '$' || 
-            input[i] == '"' || 
-            input[i] == '\'' ||
-            input[i] == ',' ||
-            input[i] == ';' ||
-            input[i] == '{' ||
-            input[i] == '%' ||
-            input[i] == '}') {
-            continue;
-        }
-        
-        /* Replace some problematic characters with spaces */
-        if (input[i] == '(' || 
-            input[i] == ')' ||
-            input[i] == '[' ||
-            input[i] == ']') {
-            output[j++] = ' ';
-            continue;
+        char c = sanitize_char(input[i]);
+        if (c != '\0') {
+            output[j++] = c;
         }
-        
-        output[j++] = input[i];
     }
     output[j] = '\0';
     
@@ -545,9 +568,8 @@ static char* sanitize_for_kelsen(const char* input) {
 }
 
 
-/* Array to store string names */
-#define MAX_NORMS 100
-static char norm_string_names[MAX_NORMS][128];
+/* Size of a generated string name (30 characters of action, then _N) */
+#define STRING_NAME_SIZE 64
 
 /* Function to generate distinctive string names */
 static void generate_distinctive_string_name(char* dest, const char* action, int norm_index) {
@@ -570,27 +592,142 @@ static void generate_distinctive_string_name(char* dest, const char* action, int
     sprintf(dest + j, "_%d", norm_index);
 }
 
-/* Function to initialize all string names */
-static void initialize_string_names(Schema* schema) {
-    /* Clear the array */
-    memset(norm_string_names, 0, sizeof(norm_string_names));
+/* Most distinct roles that get a subject declaration */
+#define MAX_ROLES 20
+
+/**
+ * Output of the Kelsen code generator
+ * 
+ * Every byte is counted; bytes past the capacity are dropped, so a
+ * first pass with no buffer measures the exact size of the second.
+ */
+typedef struct {
+    char* data;                 // NULL when only measuring
+    size_t capacity;
+    size_t length;              // Bytes generated so far, stored or not
+} KelsenOutput;
+
+/**
+ * Append bytes to the output
+ */
+static void kelsen_write(KelsenOutput* out, const char* text, size_t length) {
+    if (out->length < out->capacity) {
+        size_t room = out->capacity - out->length;
+        memcpy(out->data + out->length, text, length < room ? length : room);
+    }
+    out->length += length;
+}
+
+/**
+ * Append formatted text to the output
+ * 
+ * Only %s (NULL prints as "(null)"), %d and %% are supported, which is
+ * all the generator uses; nothing is allocated or terminated.
+ */
+static void kelsen_printf(KelsenOutput* out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
     
-    /* Generate all string names */
-    Norm* norm = schema->norms;
-    int norm_index = 1;
+    const char* literal = format;
+    for (const char* p = format; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        kelsen_write(out, literal, (size_t)(p - literal));
+        p++;
+        
+        if (*p == 's') {
+            const char* text = va_arg(args, const char*);
+            if (text == NULL) {
+                text = "(null)";
+            }
+            kelsen_write(out, text, strlen(text));
+        } else if (*p == 'd') {
+            int value = va_arg(args, int);
+            char digits[12];
+            int position = sizeof(digits);
+            unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+            do {
+                digits[--position] = (char)('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude > 0);
+            if (value < 0) {
+                digits[--position] = '-';
+            }
+            kelsen_write(out, digits + position, sizeof(digits) - position);
+        } else {
+            kelsen_write(out, p, 1);
+        }
+        literal = p + 1;
+    }
+    kelsen_write(out, literal, strlen(literal));
     
-    while (norm != NULL && norm_index <= MAX_NORMS) {
-        if (norm->action) {
-            generate_distinctive_string_name(norm_string_names[norm_index-1], norm->action, norm_index);
+    va_end(args);
+}
+
+/**
+ * Append a string with sanitize_for_kelsen() applied, without copying it
+ */
+static void kelsen_write_sanitized(KelsenOutput* out, const char* text) {
+    const char* run = text;
+    for (const char* p = text; *p; p++) {
+        char c = sanitize_char(*p);
+        if (c != *p) {
+            kelsen_write(out, run, (size_t)(p - run));
+            if (c != '\0') {
+                kelsen_write(out, &c, 1);
+            }
+            run = p + 1;
         }
-        norm_index++;
-        norm = norm->next;
     }
+    kelsen_write(out, run, strlen(run));
 }
 
+/**
+ * Add a role to a list unless it is NULL, already listed or the list is full
+ * 
+ * @return The new number of roles
+ */
+static int add_role(const char** roles, int role_count, const char* role) {
+    if (role == NULL || role_count >= MAX_ROLES) {
+        return role_count;
+    }
+    
+    for (int i = 0; i < role_count; i++) {
+        if (strcmp(roles[i], role) == 0) {
+            return role_count;
+        }
+    }
+    
+    roles[role_count] = role;
+    return role_count + 1;
+}
 
 /**
- * Updated generate_kelsen_code function for proper Kelsen syntax
+ * Collect the distinct roles of a schema (norms, violations, then agendas)
+ * 
+ * @return Number of roles (at most MAX_ROLES); they point into the schema
+ */
+static int collect_roles(const Schema* schema, const char** roles) {
+    int role_count = 0;
+    
+    for (const Norm* norm = schema->norms; norm != NULL; norm = norm->next) {
+        role_count = add_role(roles, role_count, norm->role);
+    }
+    for (const Violation* viol = schema->violations; viol != NULL; viol = viol->next) {
+        role_count = add_role(roles, role_count, viol->role);
+    }
+    for (const Agenda* agenda = schema->agendas; agenda != NULL; agenda = agenda->next) {
+        role_count = add_role(roles, role_count, agenda->requesting_role);
+        role_count = add_role(roles, role_count, agenda->beneficiary_role);
+    }
+    
+    return role_count;
+}
+
+
+/**
+ * Write the Kelsen code of a schema (generate_kelsen_code() and friends)
  * 
  * This function maps our schema representation to the formal Kelsen
  * programming language format according to the comprehensive construction guide.
@@ -599,26 +736,14 @@ static void initialize_string_names(Schema* schema) {
  * 1. Proper encoding handling for string manipulation
  * 2. Improved conditional norm mapping using AND operators
  * 3. Correct asset type assignment based on scope
+ * 
+ * It allocates nothing and depends only on the schema and the resolved
+ * roles, so running it twice gives the same bytes: once to measure,
+ * once to fill a buffer of exactly that size.
  */
-
-char* generate_kelsen_code(Schema* schema) {
-    if (schema == NULL) {
-        return NULL;
-    }
-    
-    initialize_string_names(schema);
-    
-    /* Allocate buffer for output */
-    char* buffer = (char*)malloc(20000 * sizeof(char));
-    if (buffer == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        return NULL;
-    }
-    
-    int pos = 0;
-    
+static void write_kelsen_code(Schema* schema, const char** roles, int role_count, KelsenOutput* out) {
     /* Step 1: Generate string definitions for action strings */
-    pos += sprintf(buffer + pos, "// String definitions for actions\n");
+    kelsen_printf(out, "// String definitions for actions\n");
     
     /* Generate the base contract string */
     const char* inst_name = schema->institution.name;
@@ -632,7 +757,7 @@ char* generate_kelsen_code(Schema* schema) {
         inst_name_lower[i] = '\0';
     }
     
-    pos += sprintf(buffer + pos, "string %s = \"acuerda %s\";\n", 
+    kelsen_printf(out, "string %s = \"acuerda %s\";\n", 
                   inst_name_lower, inst_name_lower);
     
     /* Generate action strings for each norm */
@@ -641,104 +766,24 @@ char* generate_kelsen_code(Schema* schema) {
 
 	while (norm != NULL) {
 		if (norm->action) {
-		    char* sanitized_action = sanitize_for_kelsen(norm->action);
-		    pos += sprintf(buffer + pos, "string %s = \"%s\";\n", 
-		                  norm_string_names[norm_index-1], sanitized_action);
-		    free(sanitized_action);
+		    char string_name[STRING_NAME_SIZE];
+		    generate_distinctive_string_name(string_name, norm->action, norm_index);
+		    kelsen_printf(out, "string %s = \"", string_name);
+		    kelsen_write_sanitized(out, norm->action);
+		    kelsen_printf(out, "\";\n");
 		}
 		
 		norm_index++;
 		norm = norm->next;
 	}
     
-    pos += sprintf(buffer + pos, "\n");
+    kelsen_printf(out, "\n");
     
     /* Step 2: Generate subject declarations */
-    pos += sprintf(buffer + pos, "// Subject declarations\n");
+    kelsen_printf(out, "// Subject declarations\n");
     
-    /* Find unique roles in the schema */
-    char* roles[20]; /* Array to hold up to 20 unique roles */
-    int role_count = 0;
-    
-    /* Look for roles in norms */
-    norm = schema->norms;
-    while (norm != NULL && role_count < 20) {
-        if (norm->role) {
-            bool found = false;
-            for (int i = 0; i < role_count; i++) {
-                if (roles[i] && strcmp(roles[i], norm->role) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                roles[role_count] = strdup(norm->role);
-                role_count++;
-            }
-        }
-        
-        norm = norm->next;
-    }
-    
-    /* Look for roles in violations */
-    Violation* viol = schema->violations;
-    while (viol != NULL && role_count < 20) {
-        if (viol->role) {
-            bool found = false;
-            for (int i = 0; i < role_count; i++) {
-                if (roles[i] && strcmp(roles[i], viol->role) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                roles[role_count] = strdup(viol->role);
-                role_count++;
-            }
-        }
-        
-        viol = viol->next;
-    }
-    
-    /* Look for roles in agendas */
-    Agenda* agenda = schema->agendas;
-    while (agenda != NULL && role_count < 20) {
-        /* Check requesting role */
-        if (agenda->requesting_role) {
-            bool found = false;
-            for (int i = 0; i < role_count; i++) {
-                if (roles[i] && strcmp(roles[i], agenda->requesting_role) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                roles[role_count] = strdup(agenda->requesting_role);
-                role_count++;
-            }
-        }
-        
-        /* Check beneficiary role */
-        if (agenda->beneficiary_role) {
-            bool found = false;
-            for (int i = 0; i < role_count; i++) {
-                if (roles[i] && strcmp(roles[i], agenda->beneficiary_role) == 0) {
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (!found) {
-                roles[role_count] = strdup(agenda->beneficiary_role);
-                role_count++;
-            }
-        }
-        
-        agenda = agenda->next;
-    }
+    Violation* viol;
+    Agenda* agenda;
     
     /* Generate subject declarations for each role */
     for (int i = 0; i < role_count; i++) {
@@ -752,15 +797,15 @@ char* generate_kelsen_code(Schema* schema) {
             }
             role_upper[j] = '\0';
             
-            pos += sprintf(buffer + pos, "subject %s = \"Placeholder %s\", \"Placeholder address\", 12345678, \"placeholder%s@example.com\";\n", 
+            kelsen_printf(out, "subject %s = \"Placeholder %s\", \"Placeholder address\", 12345678, \"placeholder%s@example.com\";\n", 
                           role_upper, roles[i], roles[i]);
         }
     }
     
-    pos += sprintf(buffer + pos, "\n");
+    kelsen_printf(out, "\n");
     
     /* Step 3: Generate the base contract asset */
-    pos += sprintf(buffer + pos, "// Base contract asset\n");
+    kelsen_printf(out, "// Base contract asset\n");
     
     /* Define default subject roles for the contract */
     char first_role_upper[128] = "PLACEHOLDER";
@@ -791,11 +836,11 @@ char* generate_kelsen_code(Schema* schema) {
         asset_name[127] = '\0';
     }
     
-    pos += sprintf(buffer + pos, "asset %s = Service, +, %s, %s, %s;\n\n", 
+    kelsen_printf(out, "asset %s = Service, +, %s, %s, %s;\n\n", 
                   asset_name, first_role_upper, inst_name_lower, second_role_upper);
     
     /* Step 4: Generate assets for each norm */
-    pos += sprintf(buffer + pos, "// Norm assets\n");
+    kelsen_printf(out, "// Norm assets\n");
     
     norm = schema->norms;
     norm_index = 1;
@@ -837,32 +882,26 @@ char* generate_kelsen_code(Schema* schema) {
 		    bool is_property = false;
 		    
 		    if (norm->scope) {
-		        /* If scope contains "inmueble" or similar terms, it might be Property */
-		        if (strstr(norm->scope->description, "inmueble") ||
-		            strstr(norm->scope->description, "propiedad")) {
+		        /* Scope keywords ("inmueble", ...) make it Property; one pass finds every category */
+		        uint32_t scope_categories = config_classify(norm->scope->description);
+		        if (scope_categories & config_get_category("inmueble")) {
 		            /* For Property, the format should NOT include the operator */
-		            type = "Property";
-		            if (strstr(norm->scope->description, "inmueble")) {
-		                type = "Property, NM";  /* Non-movable property */
-		            } else {
-		                type = "Property, M";   /* Movable property */
-		            }
+		            type = "Property, NM";  /* Non-movable property */
+		            is_property = true;
+		        } else if (scope_categories & config_get_category("mueble")) {
+		            type = "Property, M";   /* Movable property */
 		            is_property = true;
-		        } else if (strstr(norm->scope->description, "pago")) {
-		            /* Special case for payment - this is a service not property */
-		            type = "Service";
 		        }
 		        
 		        /* If action is an omission, use negative operator (for Service only) */
-		        if (!is_property && (strstr(norm->action, "no ") ||
-		            strstr(norm->action, "abstenerse") ||
-		            strstr(norm->action, "evitar"))) {
+		        if (!is_property && (config_classify(norm->action) & config_get_category("omision"))) {
 		            operator = "-";
 		        }
 		    }
 		    
 		    /* Find the string name for this action */
-        	const char* string_name = norm_string_names[norm_index-1];
+		    char string_name[STRING_NAME_SIZE];
+		    generate_distinctive_string_name(string_name, norm->action, norm_index);
 		    
 		    /* Find the target subject (default to the other main role) */
 		    char target_role_upper[128] = "PLACEHOLDER";
@@ -889,12 +928,12 @@ char* generate_kelsen_code(Schema* schema) {
 		    /* Generate the asset declaration with the correct format */
 		    if (is_property) {
 		        /* Property format doesn't include operator */
-		        pos += sprintf(buffer + pos, "asset %sAsset%d = %s, %s, %s, %s;\n", 
+		        kelsen_printf(out, "asset %sAsset%d = %s, %s, %s, %s;\n", 
 		                      asset_name, norm_index, type, role_upper, 
 		                      string_name, target_role_upper);
 		    } else {
 		        /* Service format includes operator */
-		        pos += sprintf(buffer + pos, "asset %sAsset%d = %s, %s, %s, %s, %s;\n", 
+		        kelsen_printf(out, "asset %sAsset%d = %s, %s, %s, %s, %s;\n", 
 		                      asset_name, norm_index, type, operator, role_upper, 
 		                      string_name, target_role_upper);
 		    }
@@ -957,35 +996,35 @@ char* generate_kelsen_code(Schema* schema) {
 						}
 						
 						/* Create a clause that depends on the referenced norm's asset */
-						pos += sprintf(buffer + pos, "clause norm%d = { %s AND %sAsset%d, %s(%sAsset%d) };\n", 
+						kelsen_printf(out, "clause norm%d = { %s AND %sAsset%d, %s(%sAsset%d) };\n", 
 						              norm_index, schema->institution.name, ref_asset_name, 
 						              referenced_norm, deontic, asset_name, norm_index);
 					} else {
 						/* Fallback if referenced norm not found */
-						pos += sprintf(buffer + pos, "clause norm%d = { %s, %s(%sAsset%d) };\n", 
+						kelsen_printf(out, "clause norm%d = { %s, %s(%sAsset%d) };\n", 
 						              norm_index, schema->institution.name, deontic, 
 						              asset_name, norm_index);
 					}
 				} else {
 					/* Regular text condition - existing code */
-					pos += sprintf(buffer + pos, "// Conditional norm\n");
+					kelsen_printf(out, "// Conditional norm\n");
 					
 					/* Create a string definition for the condition */
-					pos += sprintf(buffer + pos, "string condition%d = \"%s\";\n", 
+					kelsen_printf(out, "string condition%d = \"%s\";\n", 
 						          norm_index, norm->condition->description);
 					
 					/* Create a condition asset using the defined string and appropriate subjects */
-					pos += sprintf(buffer + pos, "asset Condition%d = Service, +, %s, condition%d, %s;\n", 
+					kelsen_printf(out, "asset Condition%d = Service, +, %s, condition%d, %s;\n", 
 						          norm_index, role_upper, norm_index, target_role_upper);
 					
 					/* Create the clause using AND to combine the base condition with the conditional asset */
-					pos += sprintf(buffer + pos, "clause norm%d = { %s AND Condition%d, %s(%sAsset%d) };\n", 
+					kelsen_printf(out, "clause norm%d = { %s AND Condition%d, %s(%sAsset%d) };\n", 
 						          norm_index, schema->institution.name, norm_index, deontic, 
 						          asset_name, norm_index);
 				}
 			} else {
 				/* Regular norms - existing code */
-				pos += sprintf(buffer + pos, "clause norm%d = { %s, %s(%sAsset%d) };\n", 
+				kelsen_printf(out, "clause norm%d = { %s, %s(%sAsset%d) };\n", 
 						      norm_index, schema->institution.name, deontic, 
 						      asset_name, norm_index);
 			}
@@ -995,12 +1034,12 @@ char* generate_kelsen_code(Schema* schema) {
 		norm = norm->next;
 	}
     
-    pos += sprintf(buffer + pos, "\n");
+    kelsen_printf(out, "\n");
     
     /* Step 6: Generate violation clauses */
 
 	if (schema->violations != NULL) {
-		pos += sprintf(buffer + pos, "// Violation clauses\n");
+		kelsen_printf(out, "// Violation clauses\n");
 		
 		viol = schema->violations;
 		int viol_count = 1;
@@ -1054,7 +1093,7 @@ char* generate_kelsen_code(Schema* schema) {
 		            sprintf(viol_string_name, "violation_string_%d", viol_count);
 		            
 		            /* Create string for the consequence - use a unique name */
-		            pos += sprintf(buffer + pos, "string %s = \"%s\";\n", 
+		            kelsen_printf(out, "string %s = \"%s\";\n", 
 		                          viol_string_name, viol->consequence);
 		            
 		            /* Convert violation role to uppercase */
@@ -1092,7 +1131,7 @@ char* generate_kelsen_code(Schema* schema) {
 		            }
 		            
 		            /* Create the consequence asset - use the string variable */
-		            pos += sprintf(buffer + pos, "asset %sConsequence%d = Service, +, %s, %s, %s;\n", 
+		            kelsen_printf(out, "asset %sConsequence%d = Service, +, %s, %s, %s;\n", 
 		                          cons_asset_name, viol_count, role_upper, viol_string_name, target_role_upper);
 		            
 		            /* Map deontic operator */
@@ -1118,13 +1157,13 @@ char* generate_kelsen_code(Schema* schema) {
 		            char violation_clause_name[128] = {0};
 		            sprintf(violation_clause_name, "viol_clause_%d", viol_count);
 		            
-		            pos += sprintf(buffer + pos, "clause %s = { not(%sAsset%d), %s(%sConsequence%d) };\n", 
+		            kelsen_printf(out, "clause %s = { not(%sAsset%d), %s(%sConsequence%d) };\n", 
 		                          violation_clause_name, norm_asset_name, vref->norm_number, deontic, 
 		                          cons_asset_name, viol_count);
 		        }
 		    } else {
 		        /* Compound violation with multiple norm references */
-		        pos += sprintf(buffer + pos, "// Compound violation for norms %d and %d\n", 
+		        kelsen_printf(out, "// Compound violation for norms %d and %d\n", 
 		                      vref->norm_number, vref->next->norm_number);
 		        
 		        /* Create asset for the consequence */
@@ -1149,7 +1188,7 @@ char* generate_kelsen_code(Schema* schema) {
 		        sprintf(compound_string_name, "compound_violation_string_%d", viol_count);
 		        
 		        /* Create string for the consequence with unique name */
-		        pos += sprintf(buffer + pos, "string %s = \"%s\";\n", 
+		        kelsen_printf(out, "string %s = \"%s\";\n", 
 		                      compound_string_name, viol->consequence);
 		        
 		        /* Convert violation role to uppercase */
@@ -1187,7 +1226,7 @@ char* generate_kelsen_code(Schema* schema) {
 		        }
 		        
 		        /* Create the consequence asset with unique string reference */
-		        pos += sprintf(buffer + pos, "asset %sCompoundConsequence%d = Service, +, %s, %s, %s;\n", 
+		        kelsen_printf(out, "asset %sCompoundConsequence%d = Service, +, %s, %s, %s;\n", 
 		                      cons_asset_name, viol_count, role_upper, compound_string_name, target_role_upper);
 		        
 		        /* Map deontic operator */
@@ -1256,7 +1295,7 @@ char* generate_kelsen_code(Schema* schema) {
 		        sprintf(compound_clause_name, "compound_viol_clause_%d", viol_count);
 		        
 		        /* Create the compound violation clause */
-		        pos += sprintf(buffer + pos, "clause %s = { not(%sAsset%d) AND not(%sAsset%d), %s(%sCompoundConsequence%d) };\n", 
+		        kelsen_printf(out, "clause %s = { not(%sAsset%d) AND not(%sAsset%d), %s(%sCompoundConsequence%d) };\n", 
 		                      compound_clause_name, norm1_asset_name, vref->norm_number, 
 		                      norm2_asset_name, vref->next->norm_number, 
 		                      deontic, cons_asset_name, viol_count);
@@ -1266,12 +1305,12 @@ char* generate_kelsen_code(Schema* schema) {
 		    viol = viol->next;
 		}
 		
-		pos += sprintf(buffer + pos, "\n");
+		kelsen_printf(out, "\n");
 	}
     
     /* Step 7: Generate facts */
     if (schema->facts != NULL) {
-        pos += sprintf(buffer + pos, "// Facts\n");
+        kelsen_printf(out, "// Facts\n");
         
         LegalFact* fact = schema->facts;
         int fact_count = 1;
@@ -1282,12 +1321,14 @@ char* generate_kelsen_code(Schema* schema) {
             
             if (fact->description) {
     			
-    			char* sanitized_desc = sanitize_for_kelsen(fact->description);
-                
-                strncpy(fact_id, sanitized_desc, 127);
-                fact_id[127] = '\0';
-                
-                free(sanitized_desc);
+                /* Sanitized description, without a copy of the whole text */
+                int length = 0;
+                for (const char* p = fact->description; *p && length < 127; p++) {
+                    char c = sanitize_char(*p);
+                    if (c != '\0') {
+                        fact_id[length++] = c;
+                    }
+                }
                 
                 /* Convert spaces to underscores and uppercase */
                 for (int i = 0; fact_id[i]; i++) {
@@ -1343,7 +1384,7 @@ char* generate_kelsen_code(Schema* schema) {
                 }
                 
                 /* Generate the fact */
-                pos += sprintf(buffer + pos, "fact %s = %s, \"%s\", \"%s\";\n", 
+                kelsen_printf(out, "fact %s = %s, \"%s\", \"%s\";\n", 
                               fact_id, related_asset, fact->description, fact->evidence);
             }
             
@@ -1351,12 +1392,12 @@ char* generate_kelsen_code(Schema* schema) {
             fact = fact->next;
         }
         
-        pos += sprintf(buffer + pos, "\n");
+        kelsen_printf(out, "\n");
     }
     
     /* Step 8: Generate agendas */
     if (schema->agendas != NULL) {
-        pos += sprintf(buffer + pos, "// Agendas\n");
+        kelsen_printf(out, "// Agendas\n");
         
         agenda = schema->agendas;
         int agenda_count = 1;
@@ -1391,10 +1432,10 @@ char* generate_kelsen_code(Schema* schema) {
                 char* agenda_type = agenda->compliance == COMPLIANCE_FULFILLED ? "FULFILL" : "BREACH";
                 
                 /* Start agenda */
-                pos += sprintf(buffer + pos, "agenda %s = %s {", agenda_id, agenda_type);
+                kelsen_printf(out, "agenda %s = %s {", agenda_id, agenda_type);
                 
                 /* Add base contract asset */
-                pos += sprintf(buffer + pos, "%s", schema->institution.name);
+                kelsen_printf(out, "%s", schema->institution.name);
                 
                 /* If essential, add all norm assets */
                 if (agenda->is_essential) {
@@ -1418,7 +1459,7 @@ char* generate_kelsen_code(Schema* schema) {
                                 asset_name[0] = toupper((unsigned char)asset_name[0]);
                             }
                             
-                            pos += sprintf(buffer + pos, ", %sAsset%d", asset_name, i);
+                            kelsen_printf(out, ", %sAsset%d", asset_name, i);
                         }
                         
                         i++;
@@ -1430,14 +1471,14 @@ char* generate_kelsen_code(Schema* schema) {
                     
                     while (remedy != NULL) {
                         if (remedy->description) {
-                            pos += sprintf(buffer + pos, ",\n    // %s", remedy->description);
+                            kelsen_printf(out, ",\n    // %s", remedy->description);
                         }
                         remedy = remedy->next;
                     }
                 }
                 
                 /* End agenda */
-                pos += sprintf(buffer + pos, "};\n");
+                kelsen_printf(out, "};\n");
             }
             
             agenda_count++;
@@ -1445,31 +1486,183 @@ char* generate_kelsen_code(Schema* schema) {
         }
     }
     
-    /* Free the role array */
-    for (int i = 0; i < role_count; i++) {
-        if (roles[i]) {
-            free(roles[i]);
-        }
+}
+
+/**
+ * Generate the Kelsen code of a schema into a caller-provided buffer
+ */
+size_t generate_kelsen_code_into(Schema* schema, char* buffer, size_t size) {
+    if (schema == NULL) {
+        return 0;
+    }
+    
+    const char* roles[MAX_ROLES];
+    int role_count = collect_roles(schema, roles);
+    
+    KelsenOutput out = { buffer, size, 0 };
+    write_kelsen_code(schema, roles, role_count, &out);
+    return out.length;
+}
+
+/**
+ * Generate the Kelsen code of a schema
+ */
+char* generate_kelsen_code(Schema* schema) {
+    if (schema == NULL) {
+        return NULL;
     }
     
+    const char* roles[MAX_ROLES];
+    int role_count = collect_roles(schema, roles);
+    
+    /* Measure, then emit into a buffer of exactly that size */
+    KelsenOutput out = { NULL, 0, 0 };
+    write_kelsen_code(schema, roles, role_count, &out);
+    
+    char* buffer = (char*)malloc(out.length + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    
+    out = (KelsenOutput){ buffer, out.length, 0 };
+    write_kelsen_code(schema, roles, role_count, &out);
+    buffer[out.length] = '\0';
     return buffer;
 }
 
+/**
+ * Write the generated Kelsen code of a schema through a stream, closing it
+ */
+static bool write_kelsen_stream(Schema* schema, FILE* file, const char* filename) {
+    char* code = generate_kelsen_code(schema);
+    bool ok = code != NULL && fwrite(code, 1, strlen(code), file) == strlen(code);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write output file %s: %s\n", filename, strerror(errno));
+    }
+    free(code);
+    return ok;
+}
+
+/**
+ * Generate the Kelsen code of a schema straight into a file
+ */
+bool generate_kelsen_code_to_file(Schema* schema, const char* filename) {
+    if (schema == NULL) {
+        return false;
+    }
+    
+    /* The file is only truncated once it is known how it will be written */
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        FILE* file = fopen(filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Error: Failed to open output file %s: %s\n", filename, strerror(errno));
+            return false;
+        }
+        return write_kelsen_stream(schema, file, filename);
+    }
+    
+    /* Devices, pipes and FIFOs cannot be sized or mapped, so they are streamed */
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        FILE* file = fdopen(fd, "w");
+        if (file == NULL) {
+            close(fd);
+            fprintf(stderr, "Error: Failed to open output file %s: %s\n", filename, strerror(errno));
+            return false;
+        }
+        return write_kelsen_stream(schema, file, filename);
+    }
+    
+    const char* roles[MAX_ROLES];
+    int role_count = collect_roles(schema, roles);
+    
+    KelsenOutput out = { NULL, 0, 0 };
+    write_kelsen_code(schema, roles, role_count, &out);
+    size_t length = out.length;
+    
+    /* Size the file to the code and write it through a shared mapping */
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)length) == 0 &&
+        (length == 0 ||
+         (map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED)) {
+        bool ok = true;
+        if (length > 0) {
+            out = (KelsenOutput){ (char*)map, length, 0 };
+            write_kelsen_code(schema, roles, role_count, &out);
+            munmap(map, length);
+        }
+        if (close(fd) != 0) {
+            fprintf(stderr, "Error: Failed to write output file %s: %s\n", filename, strerror(errno));
+            ok = false;
+        }
+        return ok;
+    }
+    
+    /* Fall back to writing the code from the start of the file */
+    FILE* file = fdopen(fd, "w");
+    if (file == NULL) {
+        close(fd);
+        fprintf(stderr, "Error: Failed to open output file %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    bool ok = write_kelsen_stream(schema, file, filename);
+    if (ok && info.st_size > (off_t)length && truncate(filename, (off_t)length) != 0) {
+        fprintf(stderr, "Error: Failed to size output file %s: %s\n", filename, strerror(errno));
+        ok = false;
+    }
+    return ok;
+}
+
 /**
  * legal_context.c
  * 
  * Implementation of legal context enhancement functions
  */
 
+/* Maximum number of context strings that get a definition */
+#define MAX_CONTEXT_STRINGS 50
 
- /* Third-party JSON parsing library */
-
-/* Legal context data */
-static cJSON* legal_context = NULL;
-
+/* A use of a context string's variable name inside an extension text */
+typedef struct {
+    size_t offset;              // Position in the text where the name goes
+    int slot;                   // String slot
+} ExtensionRef;
 
+/* Growable text with variable-name slots */
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+    ExtensionRef* refs;
+    int ref_count;
+    int ref_capacity;
+} ExtensionText;
 
+/* Institution-dependent part of the LEGAL CONTEXT EXTENSIONS section */
+typedef struct context_extension {
+    char* institution;          // Institution the section was built for
+    char** names;               // Base variable name of each string slot
+    int slot_count;
+    int slot_capacity;
+    ExtensionText strings;      // String definitions
+    ExtensionText assets;       // Per-source asset declarations
+    ExtensionText clauses;      // Obligation clauses
+} ContextExtension;
 
+/**
+ * Free the first `count` strings of an array and the array itself
+ */
+static void free_string_array(char** strings, int count) {
+    for (int i = 0; i < count; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+}
 
 /**
  * Convert a string to a variable name
@@ -1520,106 +1713,17 @@ static char* role_to_subject(const char* role) {
  * Determine asset type based on object description
  */
 static const char* determine_asset_type(const char* object) {
-    if (object == NULL) {
-        return "Service";
-    }
+    uint32_t categories = config_classify(object);
     
-    if (strstr(object, "inmueble") || 
-        strstr(object, "propiedad") || 
-        strstr(object, "bien")) {
+    if (categories & config_get_category("objeto-inmueble")) {
         return "Property, NM";  /* Non-movable property */
-    } else if (strstr(object, "documento") || 
-               strstr(object, "precio") || 
-               strstr(object, "pago")) {
+    } else if (categories & config_get_category("objeto-mueble")) {
         return "Property, M";   /* Movable property */
     }
     
     return "Service";
 }
 
-/**
- * Initialize the legal context module
- */
-bool legal_context_init(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Error opening legal context file: %s\n", filename);
-        return false;
-    }
-    
-    /* Get file size */
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    /* Read file content */
-    char* buffer = (char*)malloc(file_size + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        fclose(file);
-        return false;
-    }
-    
-    size_t read_size = fread(buffer, 1, file_size, file);
-    fclose(file);
-    
-    if (read_size != file_size) {
-        fprintf(stderr, "Error reading legal context file\n");
-        free(buffer);
-        return false;
-    }
-    
-    buffer[file_size] = '\0';
-    
-    /* Parse JSON */
-    legal_context = cJSON_Parse(buffer);
-    free(buffer);
-    
-    if (legal_context == NULL) {
-        fprintf(stderr, "Error parsing legal context file\n");
-        return false;
-    }
-    
-    return true;
-}
-
-/**
- * Clean up resources used by the legal context module
- */
-void legal_context_cleanup(void) {
-    if (legal_context != NULL) {
-        cJSON_Delete(legal_context);
-        legal_context = NULL;
-    }
-}
-
-/**
- * Check if legal context is initialized
- */
-bool context_is_initialized(void) {
-    return legal_context != NULL;
-}
-
-/**
- * Check if an institution is in the conditions list
- */
-static bool is_institution_in_conditions(cJSON* conditions, const char* institution) {
-    if (conditions == NULL || !cJSON_IsArray(conditions) || institution == NULL) {
-        return false;
-    }
-    
-    int size = cJSON_GetArraySize(conditions);
-    for (int i = 0; i < size; i++) {
-        cJSON* condition = cJSON_GetArrayItem(conditions, i);
-        if (cJSON_IsString(condition) && 
-            strcasecmp(condition->valuestring, institution) == 0) {
-            return true;
-        }
-    }
-    
-    return false;
-}
-
 /**
  * Get roles for an institution
  */
@@ -1635,30 +1739,19 @@ static void get_institution_roles(const char* institution, char** role1, char**
     *role1 = "parte1";
     *role2 = "parte2";
     
-    /* Get roles from config */
-    cJSON* roles = cJSON_GetObjectItem(legal_context, "roles");
-    if (roles == NULL) {
-        return;
-    }
-    
-    cJSON* inst_roles = cJSON_GetObjectItem(roles, institution);
-    if (inst_roles == NULL || !cJSON_IsArray(inst_roles)) {
+    /* Get roles from the context */
+    const ContextStore* store = context_get_store();
+    const ContextRoleList* inst_roles = context_store_find_roles(store, institution);
+    if (inst_roles == NULL) {
         return;
     }
     
-    int size = cJSON_GetArraySize(inst_roles);
-    if (size >= 1) {
-        cJSON* role = cJSON_GetArrayItem(inst_roles, 0);
-        if (cJSON_IsString(role)) {
-            *role1 = role->valuestring;
-        }
+    if (inst_roles->role_count >= 1) {
+        *role1 = (char*)context_store_str(store, store->refs[inst_roles->roles]);
     }
     
-    if (size >= 2) {
-        cJSON* role = cJSON_GetArrayItem(inst_roles, 1);
-        if (cJSON_IsString(role)) {
-            *role2 = role->valuestring;
-        }
+    if (inst_roles->role_count >= 2) {
+        *role2 = (char*)context_store_str(store, store->refs[inst_roles->roles + 1]);
     }
 }
 
@@ -1681,314 +1774,506 @@ static const char* map_role(const char* json_role, const char* institution,
     /* If no match, use given role */
     return json_role;
 }
-char* generate_kelsen_code_with_context(Schema* schema) {
-    if (schema == NULL) {
-        return NULL;
+/**
+ * Append formatted text to an extension text
+ */
+static bool ext_printf(ExtensionText* ext, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int needed = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    
+    if (needed < 0) {
+        va_end(args);
+        return false;
     }
     
-    /* Call the original code generation function */
-    char* base_code = generate_kelsen_code(schema);
-    if (base_code == NULL) {
-        return NULL;
+    if (ext->length + (size_t)needed + 1 > ext->capacity) {
+        size_t capacity = ext->capacity ? ext->capacity : 1024;
+        while (ext->length + (size_t)needed + 1 > capacity) {
+            capacity *= 2;
+        }
+        char* text = (char*)realloc(ext->text, capacity);
+        if (text == NULL) {
+            va_end(args);
+            return false;
+        }
+        ext->text = text;
+        ext->capacity = capacity;
     }
     
-    /* Check if context is available */
-    if (!context_is_initialized()) {
-        return base_code;
+    vsnprintf(ext->text + ext->length, (size_t)needed + 1, format, args);
+    va_end(args);
+    ext->length += (size_t)needed;
+    return true;
+}
+
+/**
+ * Mark the current position of an extension text as a use of a string slot
+ */
+static bool ext_slot(ExtensionText* ext, int slot) {
+    if (ext->ref_count == ext->ref_capacity) {
+        int capacity = ext->ref_capacity ? ext->ref_capacity * 2 : 32;
+        ExtensionRef* refs = (ExtensionRef*)realloc(ext->refs, (size_t)capacity * sizeof(ExtensionRef));
+        if (refs == NULL) {
+            return false;
+        }
+        ext->refs = refs;
+        ext->ref_capacity = capacity;
     }
     
-    /* Get institution name */
-    const char* institution = schema->institution.name;
-    if (institution == NULL) {
-        return base_code;
+    ext->refs[ext->ref_count].offset = ext->length;
+    ext->refs[ext->ref_count].slot = slot;
+    ext->ref_count++;
+    return true;
+}
+
+/**
+ * Size of an extension text once its slots are filled in
+ */
+static size_t ext_expanded_length(const ExtensionText* ext, char** names) {
+    size_t length = ext->length;
+    for (int i = 0; i < ext->ref_count; i++) {
+        length += strlen(names[ext->refs[i].slot]);
+    }
+    return length;
+}
+
+/**
+ * Copy an extension text to a buffer, filling in its slots
+ */
+static char* ext_expand(const ExtensionText* ext, char** names, char* out) {
+    size_t copied = 0;
+    for (int i = 0; i < ext->ref_count; i++) {
+        size_t literal = ext->refs[i].offset - copied;
+        memcpy(out, ext->text + copied, literal);
+        out += literal;
+        copied += literal;
+        
+        size_t name_length = strlen(names[ext->refs[i].slot]);
+        memcpy(out, names[ext->refs[i].slot], name_length);
+        out += name_length;
     }
     
-    /* Create a buffer for enhanced code - make it larger to account for annotations */
-    char* enhanced_code = (char*)malloc(strlen(base_code) + 20000);
-    if (enhanced_code == NULL) {
-        free(base_code);
-        return NULL;
+    memcpy(out, ext->text + copied, ext->length - copied);
+    return out + (ext->length - copied);
+}
+
+/**
+ * Free a cached context extension
+ */
+static void free_context_extension(ContextExtension* ext) {
+    if (ext == NULL) {
+        return;
     }
     
-    /* Copy the base code */
-    strcpy(enhanced_code, base_code);
-    int pos = strlen(base_code);
+    free_string_array(ext->names, ext->slot_count);
+    free(ext->institution);
     
-    /* Begin legal context section */
-    pos += sprintf(enhanced_code + pos, "\n// =========================================================================\n");
-    pos += sprintf(enhanced_code + pos, "// LEGAL CONTEXT EXTENSIONS\n");
-    pos += sprintf(enhanced_code + pos, "// =========================================================================\n\n");
+    ExtensionText* texts[3] = { &ext->strings, &ext->assets, &ext->clauses };
+    for (int i = 0; i < 3; i++) {
+        free(texts[i]->text);
+        free(texts[i]->refs);
+    }
+    free(ext);
+}
+
+/**
+ * Add a string slot (the base variable name for a context action)
+ */
+static int add_extension_slot(ContextExtension* ext, char* name) {
+    if (ext->slot_count == ext->slot_capacity) {
+        int capacity = ext->slot_capacity ? ext->slot_capacity * 2 : 32;
+        char** names = (char**)realloc(ext->names, (size_t)capacity * sizeof(char*));
+        if (names == NULL) {
+            return -1;
+        }
+        ext->names = names;
+        ext->slot_capacity = capacity;
+    }
+    
+    ext->names[ext->slot_count] = name;
+    return ext->slot_count++;
+}
+
+/**
+ * Build the institution-dependent part of the LEGAL CONTEXT EXTENSIONS section
+ *
+ * Every use of a context string's variable name is left as a slot, since
+ * the final name depends on collisions with the schema's own strings.
+ */
+static ContextExtension* build_context_extension(const ContextStore* store, const char* institution) {
+    ContextExtension* ext = (ContextExtension*)calloc(1, sizeof(ContextExtension));
+    if (ext == NULL) {
+        return NULL;
+    }
+    
+    ext->institution = strdup(institution);
+    bool ok = ext->institution != NULL &&
+              ext_printf(&ext->strings, "// String definitions for legal context actions\n");
     
     /* Get institution roles */
     char *inst_role1, *inst_role2;
     get_institution_roles(institution, &inst_role1, &inst_role2);
     
-    /* Track string definitions to avoid duplicates */
-    char string_definitions[50][128];
-    int string_count = 0;
+    /* Norms applicable to this institution, in document order */
+    const ContextPostingList* applicable = context_store_find_institution(store, institution);
+    uint32_t next = 0;
     
-    /* Buffer for string definitions */
-    char string_section[5000] = "// String definitions for legal context actions\n";
-    int string_pos = strlen(string_section);
-    
-    /* Buffer for assets */
-    char asset_section[10000] = "";
-    int asset_pos = 0;
-    
-    /* Buffer for clauses */
-    char clause_section[10000] = "";
-    int clause_pos = 0;
-    
-    /* Process sources */
-    cJSON* sources = cJSON_GetObjectItem(legal_context, "sources");
-    if (sources != NULL) {
-        /* Iterate through source_names */
-        cJSON* source_entry;
-        cJSON_ArrayForEach(source_entry, sources) {
-            /* Get source */
-            cJSON* source = cJSON_GetObjectItem(sources, source_entry->string);
-            if (source == NULL) continue;
+    /* Iterate through sources in document order */
+    for (uint32_t src = 0; ok && src < store->source_count; src++) {
+        const ContextSource* source = &store->sources[src];
+        const char* source_key = context_store_str(store, source->key);
+        
+        /* Source header */
+        ok = ext_printf(&ext->assets,
+                        "// -------------------------------------------------------------------------\n"
+                        "// Assets from %s\n"
+                        "// -------------------------------------------------------------------------\n\n",
+                        source_key);
+        
+        /* Get source name */
+        const char* source_name = context_store_str(store, source->nombre);
+        
+        /* Iterate through the source's applicable norms */
+        for (; ok && applicable != NULL && next < applicable->count; next++) {
+            const ContextNorm* norm = &store->norms[store->postings[applicable->first + next]];
+            if (norm->source != src) break;
+            context_store_load_source(store, src);
             
-            /* Source header */
-            asset_pos += sprintf(asset_section + asset_pos, 
-                               "// -------------------------------------------------------------------------\n");
-            asset_pos += sprintf(asset_section + asset_pos, 
-                               "// Assets from %s\n", source_entry->string);
-            asset_pos += sprintf(asset_section + asset_pos, 
-                               "// -------------------------------------------------------------------------\n\n");
+            /* Get norm id */
+            const char* norm_id = context_store_str(store, norm->id);
+            if (norm_id == NULL) continue;
             
-            /* Get source name and type */
-            cJSON* source_name = cJSON_GetObjectItem(source, "nombre");
-            cJSON* source_type = cJSON_GetObjectItem(source, "tipo");
+            /* Get norm structure */
+            if (!(norm->flags & CONTEXT_NORM_HAS_ESTRUCTURA)) continue;
             
-            /* Process norms */
-            cJSON* normas = cJSON_GetObjectItem(source, "normas");
-            if (normas == NULL) continue;
+            /* Get action */
+            const char* action = context_store_str(store, norm->accion);
+            if (action == NULL) continue;
             
-            /* Iterate through norm_names */
-            cJSON* norm_entry;
-            cJSON_ArrayForEach(norm_entry, normas) {
-                /* Get norm */
-                cJSON* norm = cJSON_GetObjectItem(normas, norm_entry->string);
-                if (norm == NULL) continue;
-                
-                /* Get norm id */
-                cJSON* norm_id = cJSON_GetObjectItem(norm, "id");
-                if (norm_id == NULL || !cJSON_IsString(norm_id)) continue;
-                
-                /* Get norm structure */
-                cJSON* estructura = cJSON_GetObjectItem(norm, "estructura");
-                if (estructura == NULL) continue;
-                
-                /* Get conditions */
-                cJSON* conditions = cJSON_GetObjectItem(estructura, "condiciones");
-                
-                /* Skip if not applicable to this institution */
-                if (conditions == NULL || 
-                    !is_institution_in_conditions(conditions, institution)) {
-                    continue;
+            /* One string slot per action; only the first ones get a definition */
+            char* var_name = string_to_var_name(action);
+            int slot = var_name != NULL ? add_extension_slot(ext, var_name) : -1;
+            if (slot < 0) {
+                free(var_name);
+                ok = false;
+                break;
+            }
+            
+            if (slot < MAX_CONTEXT_STRINGS) {
+                char* sanitized_action = sanitize_for_kelsen(action);
+                ok = ext_printf(&ext->strings, "string ") && ext_slot(&ext->strings, slot) &&
+                     ext_printf(&ext->strings, " = \"%s\";\n", sanitized_action);
+                free(sanitized_action);
+            }
+            
+            /* Get roles */
+            const char* activo = context_store_str(store, norm->activo);
+            const char* pasivo = context_store_str(store, norm->pasivo);
+            
+            /* Get deontic operator */
+            const char* deontico = context_store_str(store, norm->deontico);
+            const char* deontic_op = "OB";  /* Default to obligation */
+            
+            if (deontico != NULL) {
+                if (strcmp(deontico, "prohibicion") == 0) {
+                    deontic_op = "PR";
+                } else if (strcmp(deontico, "privilegio") == 0) {
+                    deontic_op = "PVG";
+                } else if (strcmp(deontico, "derecho") == 0) {
+                    deontic_op = "CR";
                 }
+            }
+            
+            /* Get object */
+            const char* object_type = determine_asset_type(context_store_str(store, norm->objeto));
+            
+            /* Get derivation */
+            const char* derivada = context_store_str(store, norm->derivada);
+            
+            /* Add source comment */
+            ok = ok && ext_printf(&ext->assets, "// Source: %s - %s\n",
+                                  source_name != NULL ? source_name : source_key, norm_id);
+            
+            /* Add derivation if present */
+            if (derivada != NULL) {
+                ok = ok && ext_printf(&ext->assets, "// Derived from: %s\n", derivada);
+            }
+            
+            /* Add context if present */
+            if (norm->flags & CONTEXT_NORM_HAS_CONTEXTO) {
+                ok = ok && ext_printf(&ext->assets, "// Context: ");
                 
-                /* Get action */
-                cJSON* action = cJSON_GetObjectItem(estructura, "accion");
-                if (action == NULL || !cJSON_IsString(action)) continue;
-                
-                /* Add string definition if not already defined */
-				/* Add string definition if not already defined */
-				bool string_exists = false;
-				char* var_name = string_to_var_name(action->valuestring);
-
-				/* First check if this string exists in the base code */
-				char *str_search = base_code;
-				char search_pattern[256];
-				sprintf(search_pattern, "string %s =", var_name);
-				if (strstr(str_search, search_pattern) != NULL) {
-					string_exists = true;
-				}
-
-				/* Then check our local tracking */
-				if (!string_exists) {
-					for (int i = 0; i < string_count; i++) {
-						if (strcmp(string_definitions[i], var_name) == 0) {
-							string_exists = true;
-							break;
-						}
-					}
-				}
-
-				/* If string exists, use legal_ prefix */
-				if (string_exists) {
-					char *legal_var_name = malloc(strlen(var_name) + 7);
-					sprintf(legal_var_name, "legal_%s", var_name);
-					free(var_name);
-					var_name = legal_var_name;
-					string_exists = false; /* Reset for tracking */
-				}
-
-				if (!string_exists && string_count < 50) {
-					/* Store string name */
-					strncpy(string_definitions[string_count], var_name, 127);
-					string_count++;
-					
-					/* Add string definition */
-					char* sanitized_action = sanitize_for_kelsen(action->valuestring);
-					string_pos += sprintf(string_section + string_pos, 
-								        "string %s = \"%s\";\n", 
-								        var_name, sanitized_action);
-					free(sanitized_action);
-				}
-                
-                /* Get roles */
-                cJSON* activo = cJSON_GetObjectItem(estructura, "activo");
-                cJSON* pasivo = cJSON_GetObjectItem(estructura, "pasivo");
-                
-                /* Get deontic operator */
-                cJSON* deontico = cJSON_GetObjectItem(estructura, "deontico");
-                const char* deontic_op = "OB";  /* Default to obligation */
-                
-                if (deontico != NULL && cJSON_IsString(deontico)) {
-                    if (strcmp(deontico->valuestring, "prohibicion") == 0) {
-                        deontic_op = "PR";
-                    } else if (strcmp(deontico->valuestring, "privilegio") == 0) {
-                        deontic_op = "PVG";
-                    } else if (strcmp(deontico->valuestring, "derecho") == 0) {
-                        deontic_op = "CR";
-                    }
+                for (uint32_t i = 0; i < norm->context_count; i++) {
+                    ok = ok && ext_printf(&ext->assets, "%s%s", i > 0 ? ", " : "",
+                                          context_store_str(store, store->refs[norm->contexts + i]));
                 }
+                ok = ok && ext_printf(&ext->assets, "\n");
+            }
+            
+            /* Add note about applicability */
+            ok = ok && ext_printf(&ext->assets, "// Note: Applies to %s (in conditions list)\n", institution);
+            
+            /* Process the roles based on our convention */
+            if (ok && activo != NULL && pasivo != NULL) {
                 
-                /* Get object */
-                cJSON* objeto = cJSON_GetObjectItem(estructura, "objeto");
-                const char* object_type = determine_asset_type(
-                    objeto != NULL && cJSON_IsString(objeto) ? objeto->valuestring : NULL);
+                /* Check if roles match institution roles */
+                const char* role1 = map_role(activo, institution, inst_role1, inst_role2);
+                const char* role2 = map_role(pasivo, institution, inst_role1, inst_role2);
                 
-                /* Get derivation */
-                cJSON* derivada = cJSON_GetObjectItem(norm, "derivadaDe");
+                /* Create asset name */
+                const char* norm_name = context_store_str(store, norm->key);
                 
-                /* Get context */
-                cJSON* contexto = cJSON_GetObjectItem(norm, "contexto");
+                /* Add asset for primary direction */
+                char* role1_subject = role_to_subject(role1);
+                char* role2_subject = role_to_subject(role2);
                 
-                /* Add source comment */
-                asset_pos += sprintf(asset_section + asset_pos, "// Source: %s - %s\n", 
-                                   source_name != NULL && cJSON_IsString(source_name) ? 
-                                   source_name->valuestring : source_entry->string,
-                                   norm_id->valuestring);
+                /* Property format doesn't include operator; Service format does */
+                const char* operator_part = strncmp(object_type, "Property", 8) == 0 ? "" : "+, ";
                 
-                /* Add derivation if present */
-                if (derivada != NULL && cJSON_IsString(derivada)) {
-                    asset_pos += sprintf(asset_section + asset_pos, "// Derived from: %s\n", 
-                                       derivada->valuestring);
-                }
+                /* Create asset */
+                ok = ext_printf(&ext->assets, "asset %sAsset = %s, %s%s, ",
+                                norm_name, object_type, operator_part, role1_subject) &&
+                     ext_slot(&ext->assets, slot) &&
+                     ext_printf(&ext->assets, ", %s;\n", role2_subject);
                 
-                /* Add context if present */
-                if (contexto != NULL && cJSON_IsArray(contexto)) {
-                    asset_pos += sprintf(asset_section + asset_pos, "// Context: ");
-                    
-                    int ctx_size = cJSON_GetArraySize(contexto);
-                    for (int i = 0; i < ctx_size; i++) {
-                        cJSON* ctx = cJSON_GetArrayItem(contexto, i);
-                        if (cJSON_IsString(ctx)) {
-                            asset_pos += sprintf(asset_section + asset_pos, "%s%s", 
-                                               i > 0 ? ", " : "", ctx->valuestring);
-                        }
-                    }
-                    asset_pos += sprintf(asset_section + asset_pos, "\n");
-                }
+                /* Add clause */
+                ok = ok && ext_printf(&ext->clauses, "clause %s_obligation = { %s, %s(%sAsset) };\n",
+                                      norm_name, institution, deontic_op, norm_name);
                 
-                /* Add note about applicability */
-                asset_pos += sprintf(asset_section + asset_pos, "// Note: Applies to %s (in conditions list)\n", 
-                                   institution);
+                /* If roles don't match expected institution roles, create reciprocal obligation */
+                bool roles_match = 
+                    (strcasecmp(role1, inst_role1) == 0 && strcasecmp(role2, inst_role2) == 0) ||
+                    (strcasecmp(role1, inst_role2) == 0 && strcasecmp(role2, inst_role1) == 0);
                 
-                /* Process the roles based on our convention */
-                if (activo != NULL && cJSON_IsString(activo) && 
-                    pasivo != NULL && cJSON_IsString(pasivo)) {
-                    
-                    /* Check if roles match institution roles */
-                    const char* role1 = map_role(activo->valuestring, institution, inst_role1, inst_role2);
-                    const char* role2 = map_role(pasivo->valuestring, institution, inst_role1, inst_role2);
-                    
-                    /* Create asset name */
-                    char asset_name[128];
-                    char *norm_name = norm_entry->string;
-                    
-                    /* Add asset for primary direction */
-                    char* role1_subject = role_to_subject(role1);
-                    char* role2_subject = role_to_subject(role2);
-                    
-                    /* Create asset - format depends on type */
-                    if (strncmp(object_type, "Property", 8) == 0) {
-                        /* Property format doesn't include operator */
-                        asset_pos += sprintf(asset_section + asset_pos, 
-                                           "asset %sAsset = %s, %s, %s, %s;\n", 
-                                           norm_name, object_type, role1_subject, var_name, role2_subject);
-                    } else {
-                        /* Service format includes operator */
-                        asset_pos += sprintf(asset_section + asset_pos, 
-                                           "asset %sAsset = %s, +, %s, %s, %s;\n", 
-                                           norm_name, object_type, role1_subject, var_name, role2_subject);
-                    }
-                    
-                    /* Add clause */
-                    clause_pos += sprintf(clause_section + clause_pos, 
-                                       "clause %s_obligation = { %s, %s(%sAsset) };\n", 
-                                       norm_name, institution, deontic_op, norm_name);
-                    
-                    /* If roles don't match expected institution roles, create reciprocal obligation */
-                    bool roles_match = 
-                        (strcasecmp(role1, inst_role1) == 0 && strcasecmp(role2, inst_role2) == 0) ||
-                        (strcasecmp(role1, inst_role2) == 0 && strcasecmp(role2, inst_role1) == 0);
+                if (!roles_match) {
+                    /* Add reciprocal asset */
+                    ok = ok && ext_printf(&ext->assets, "asset %sAsset_Reciprocal = %s, %s%s, ",
+                                          norm_name, object_type, operator_part, role2_subject) &&
+                         ext_slot(&ext->assets, slot) &&
+                         ext_printf(&ext->assets, ", %s;\n", role1_subject);
                     
-                    if (!roles_match) {
-                        /* Add reciprocal asset */
-                        if (strncmp(object_type, "Property", 8) == 0) {
-                            /* Property format doesn't include operator */
-                            asset_pos += sprintf(asset_section + asset_pos, 
-                                               "asset %sAsset_Reciprocal = %s, %s, %s, %s;\n", 
-                                               norm_name, object_type, role2_subject, var_name, role1_subject);
-                        } else {
-                            /* Service format includes operator */
-                            asset_pos += sprintf(asset_section + asset_pos, 
-                                               "asset %sAsset_Reciprocal = %s, +, %s, %s, %s;\n", 
-                                               norm_name, object_type, role2_subject, var_name, role1_subject);
-                        }
-                        
-                        /* Add reciprocal clause */
-                        clause_pos += sprintf(clause_section + clause_pos, 
-                                           "clause %s_obligation_reciprocal = { %s, %s(%sAsset_Reciprocal) };\n", 
-                                           norm_name, institution, deontic_op, norm_name);
-                    }
-                    
-                    /* Add newline */
-                    asset_pos += sprintf(asset_section + asset_pos, "\n");
-                    
-                    free(role1_subject);
-                    free(role2_subject);
+                    /* Add reciprocal clause */
+                    ok = ok && ext_printf(&ext->clauses,
+                                          "clause %s_obligation_reciprocal = { %s, %s(%sAsset_Reciprocal) };\n",
+                                          norm_name, institution, deontic_op, norm_name);
                 }
                 
-                free(var_name);
+                /* Add newline */
+                ok = ok && ext_printf(&ext->assets, "\n");
+                
+                free(role1_subject);
+                free(role2_subject);
             }
         }
     }
     
-    /* Combine sections */
-    if (string_count > 0) {
-        pos += sprintf(enhanced_code + pos, "%s\n", string_section);
+    if (!ok) {
+        free_context_extension(ext);
+        return NULL;
     }
     
-    if (asset_pos > 0) {
-        pos += sprintf(enhanced_code + pos, "%s", asset_section);
+    return ext;
+}
+
+/**
+ * Build the extension of an institution (derived-data callback)
+ */
+static void* build_extension_entry(const ContextStore* store, const char* institution) {
+    return build_context_extension(store, institution);
+}
+
+/**
+ * Free a cached extension (derived-data callback)
+ */
+static void free_extension_entry(void* data) {
+    free_context_extension((ContextExtension*)data);
+}
+
+/**
+ * Get the extension for an institution, built once per loaded context and configuration
+ */
+static const ContextExtension* get_context_extension(const char* institution) {
+    /* Asset types come from the configuration's classifier */
+    return (const ContextExtension*)context_get_derived(institution, config_snapshot_id(),
+                                                       build_extension_entry, free_extension_entry);
+}
+
+/**
+ * Pick the final variable name of each context string for one schema
+ *
+ * A name already defined by the base program, or by an earlier context
+ * string, gets the legal_ prefix.
+ */
+static char** resolve_extension_names(const ContextExtension* ext, const char* base_code) {
+    char** names = (char**)calloc(ext->slot_count > 0 ? ext->slot_count : 1, sizeof(char*));
+    if (names == NULL) {
+        return NULL;
     }
     
-    if (clause_pos > 0) {
-        pos += sprintf(enhanced_code + pos, 
-                      "// -------------------------------------------------------------------------\n");
-        pos += sprintf(enhanced_code + pos, "// Obligation clauses from legal sources\n");
-        pos += sprintf(enhanced_code + pos, 
-                      "// -------------------------------------------------------------------------\n\n");
-        pos += sprintf(enhanced_code + pos, "%s", clause_section);
+    /* Track string definitions to avoid duplicates */
+    const char* string_definitions[MAX_CONTEXT_STRINGS];
+    int string_count = 0;
+    
+    for (int slot = 0; slot < ext->slot_count; slot++) {
+        const char* var_name = ext->names[slot];
+        
+        /* First check if this string exists in the base code */
+        char search_pattern[256];
+        snprintf(search_pattern, sizeof(search_pattern), "string %s =", var_name);
+        bool string_exists = strstr(base_code, search_pattern) != NULL;
+        
+        /* Then check our local tracking */
+        for (int i = 0; i < string_count && !string_exists; i++) {
+            string_exists = strcmp(string_definitions[i], var_name) == 0;
+        }
+        
+        /* If string exists, use legal_ prefix */
+        names[slot] = (char*)malloc(strlen(var_name) + 7);
+        if (names[slot] == NULL) {
+            free_string_array(names, slot);
+            return NULL;
+        }
+        sprintf(names[slot], "%s%s", string_exists ? "legal_" : "", var_name);
+        
+        if (string_count < MAX_CONTEXT_STRINGS) {
+            string_definitions[string_count++] = names[slot];
+        }
     }
     
+    return names;
+}
+
+char* generate_kelsen_code_with_context(Schema* schema) {
+    if (schema == NULL) {
+        return NULL;
+    }
+    
+    /* Without a context (or an institution to look up) this is the plain code */
+    const char* institution = schema->institution.name;
+    if (!context_is_initialized() || institution == NULL) {
+        return generate_kelsen_code(schema);
+    }
+    
+    /* The institution-dependent text is built once per context and reused */
+    const ContextExtension* ext = get_context_extension(institution);
+    if (ext == NULL) {
+        return NULL;
+    }
+    
+    static const char section_header[] =
+        "\n// =========================================================================\n"
+        "// LEGAL CONTEXT EXTENSIONS\n"
+        "// =========================================================================\n\n";
+    static const char clause_header[] =
+        "// -------------------------------------------------------------------------\n"
+        "// Obligation clauses from legal sources\n"
+        "// -------------------------------------------------------------------------\n\n";
+    
+    /*
+     * One buffer for everything: the base code is measured, and the
+     * extension sized as if every name took the legal_ prefix, since
+     * which ones do depends on the base code
+     */
+    size_t base_length = generate_kelsen_code_into(schema, NULL, 0);
+    size_t total = base_length + strlen(section_header) + ext_expanded_length(&ext->assets, ext->names);
+    if (ext->slot_count > 0) {
+        total += ext_expanded_length(&ext->strings, ext->names) + 1;
+    }
+    if (ext->clauses.length > 0) {
+        total += strlen(clause_header) + ext_expanded_length(&ext->clauses, ext->names);
+    }
+    total += (ext->strings.ref_count + ext->assets.ref_count + ext->clauses.ref_count) * strlen("legal_");
+    
+    char* enhanced_code = (char*)malloc(total + 1);
+    if (enhanced_code == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    
+    generate_kelsen_code_into(schema, enhanced_code, base_length);
+    enhanced_code[base_length] = '\0';
+    
+    char** names = resolve_extension_names(ext, enhanced_code);
+    if (names == NULL) {
+        free(enhanced_code);
+        return NULL;
+    }
+    
+    /* Append the sections after the base code */
+    char* out = enhanced_code + base_length;
+    memcpy(out, section_header, strlen(section_header));
+    out += strlen(section_header);
+    
+    if (ext->slot_count > 0) {
+        out = ext_expand(&ext->strings, names, out);
+        *out++ = '\n';
+    }
+    
+    out = ext_expand(&ext->assets, names, out);
+    
+    if (ext->clauses.length > 0) {
+        memcpy(out, clause_header, strlen(clause_header));
+        out += strlen(clause_header);
+        out = ext_expand(&ext->clauses, names, out);
+    }
+    *out = '\0';
+    
     /* Clean up */
-    free(base_code);
+    free_string_array(names, ext->slot_count);
     
     return enhanced_code;
 }
+
+/**
+ * Generate the CONTEXT ANNOTATIONS section for a schema's norms
+ */
+char* generate_context_annotations(Schema* schema, int threads) {
+    if (schema == NULL || !context_is_initialized()) {
+        return NULL;
+    }
+    
+    int count = 0;
+    ContextAnnotation* annotations = context_annotate_schema(schema, threads, &count);
+    if (annotations == NULL) {
+        return NULL;
+    }
+    
+    ExtensionText text = { 0 };
+    bool ok = ext_printf(&text,
+                         "\n// =========================================================================\n"
+                         "// CONTEXT ANNOTATIONS\n"
+                         "// =========================================================================\n\n");
+    
+    int i = 0;
+    for (Norm* norm = schema->norms; ok && norm != NULL && i < count; norm = norm->next, i++) {
+        const ContextAnnotation* annotation = &annotations[i];
+        
+        ok = ext_printf(&text, "// Norm %d (%s): %s\n", norm->number,
+                        norm->role != NULL ? norm->role : "sin rol",
+                        annotation->valid ? "role found in context mappings" : "role not found in context mappings");
+        
+        if (ok && annotation->mapped_role != NULL && norm->role != NULL &&
+            strcmp(annotation->mapped_role, norm->role) != 0) {
+            ok = ext_printf(&text, "// Mapped role: %s\n", annotation->mapped_role);
+        }
+        
+        if (ok && annotation->related != NULL) {
+            ok = ext_printf(&text, "%s", annotation->related);
+        }
+        
+        ok = ok && ext_printf(&text, "\n");
+    }
+    
+    context_free_annotations(annotations, count);
+    
+    if (!ok) {
+        free(text.text);
+        return NULL;
+    }
+    
+    return text.text;
+}
@@ -71,6 +71,7 @@ typedef struct norm {
     char* action;               // Action description
     Scope* scope;               // Optional scope descriptor
     Condition* condition;       // Optional condition (for conditional norms)
+    int line;                   // Input line of the norm's number (0 if not parsed from text)
     struct norm* next;          // Next norm in the list
 } Norm;
 
@@ -142,6 +143,7 @@ typedef struct schema {
     Violation* violations;      // List of violations
     LegalFact* facts;           // List of legal facts
     Agenda* agendas;            // List of agendas
+    bool packed;                // Nodes and strings live in the schema's own allocation
 } Schema;
 
 /**
@@ -172,8 +174,38 @@ void set_institution(Schema* schema, char* name, InstitutionType type, Multiplic
 /**
  * Function prototype for Kelsen code generation
  */
-static void initialize_string_names(Schema* schema);
 char* generate_kelsen_code(Schema* schema);
+
+/**
+ * Generate the Kelsen code of a schema into a caller-provided buffer
+ *
+ * Like snprintf(), nothing past size bytes is written and the return
+ * value is the full length, so a call with a NULL buffer measures the
+ * code and a second one fills a buffer of that size. The code is not
+ * terminated. Nothing is allocated.
+ *
+ * @param schema The schema
+ * @param buffer Buffer to write to (may be NULL if size is 0)
+ * @param size Size of the buffer
+ * @return Length of the code in bytes
+ */
+size_t generate_kelsen_code_into(Schema* schema, char* buffer, size_t size);
+
+/**
+ * Generate the Kelsen code of a schema straight into a file
+ *
+ * The code is measured, the file is extended to that size and the code
+ * is written through a shared mapping of it, with no buffer in between.
+ * Targets that are not regular files, or cannot be sized or mapped, are
+ * written through a stream instead.
+ *
+ * @param schema The schema
+ * @param filename File to create or replace
+ * @return true on success, false on error
+ */
+bool generate_kelsen_code_to_file(Schema* schema, const char* filename);
+
 char* generate_kelsen_code_with_context(Schema* schema);
+char* generate_context_annotations(Schema* schema, int threads);
 static void generate_distinctive_string_name(char* dest, const char* action, int norm_index);
 #endif /* SCHEMA_TYPES_H */
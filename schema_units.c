@@ -0,0 +1,92 @@
+/**
+ * schema_units.c
+ *
+ * Implementation of the unit boundary scan
+ */
+
+#include "schema_units.h"
+#include <ctype.h>
+#include <string.h>
+
+/**
+ * Check whether a line holds only whitespace
+ */
+static bool is_blank_line(const char* line, const char* end) {
+    while (line < end && isspace((unsigned char)*line)) {
+        line++;
+    }
+    return line == end;
+}
+
+/**
+ * Check whether a line starts a numbered norm ("N. ...")
+ */
+static bool starts_norm(const char* line, const char* end) {
+    while (line < end && (*line == ' ' || *line == '\t')) {
+        line++;
+    }
+    const char* digits = line;
+    while (line < end && isdigit((unsigned char)*line)) {
+        line++;
+    }
+    return line > digits && line < end && *line == '.';
+}
+
+/**
+ * Start a scan at the beginning of a unit
+ */
+void unit_scan_start(UnitScan* scan, const char* text, size_t length, int line) {
+    scan->position = text;
+    scan->end = text + length;
+    scan->line = line;
+    scan->after_blank = true;
+    scan->norm = false;
+}
+
+/**
+ * Move the scan to the start of the next unit
+ */
+bool unit_scan_next(UnitScan* scan) {
+    bool passed_text = false;
+    while (scan->position < scan->end) {
+        const char* line = scan->position;
+        const char* newline = (const char*)memchr(line, '\n', scan->end - line);
+        const char* next = newline != NULL ? newline + 1 : scan->end;
+        bool blank = is_blank_line(line, next);
+
+        if (passed_text && !blank) {
+            scan->norm = starts_norm(line, next);
+            if (scan->after_blank || scan->norm) {
+                return true;
+            }
+        }
+
+        passed_text = passed_text || !blank;
+        scan->after_blank = blank;
+        scan->position = next;
+        scan->line++;
+    }
+    return false;
+}
+
+/**
+ * Check that a unit parsed on its own may follow the units before it
+ */
+bool unit_follows(const Schema* part, UnitSection* section) {
+    UnitSection first = part->norms != NULL ? UNIT_NORMS :
+                        part->violations != NULL ? UNIT_VIOLATIONS :
+                        part->facts != NULL ? UNIT_FACTS :
+                        part->agendas != NULL ? UNIT_AGENDAS : UNIT_NO_SECTION;
+    UnitSection last = part->agendas != NULL ? UNIT_AGENDAS :
+                       part->facts != NULL ? UNIT_FACTS :
+                       part->violations != NULL ? UNIT_VIOLATIONS :
+                       part->norms != NULL ? UNIT_NORMS : UNIT_NO_SECTION;
+    if (first == UNIT_NO_SECTION) {
+        return true;
+    }
+
+    /* Units after one out of order are checked against it, so one misplaced unit is one error */
+    bool follows = first >= *section;
+    *section = last;
+    return follows;
+}
@@ -0,0 +1,76 @@
+/**
+ * schema_units.h
+ *
+ * Boundaries of the top-level units of schema text: the institution
+ * declaration, then each numbered norm ("N. ...") and each paragraph
+ * after a blank line (violations, facts, agendas). Units can be parsed
+ * on their own, which the parallel and incremental parsers rely on.
+ */
+
+#ifndef SCHEMA_UNITS_H
+#define SCHEMA_UNITS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "schema_types.h"
+
+/**
+ * Position of a scan for unit boundaries
+ */
+typedef struct {
+    const char* position;           // Start of the line the scan is on
+    const char* end;
+    int line;                       // Number of that line
+    bool after_blank;               // The line before it is blank (or there is none)
+    bool norm;                      // The unit the scan is on starts with a norm number
+} UnitScan;
+
+/**
+ * Sections of a schema, in the order the grammar requires
+ */
+typedef enum {
+    UNIT_NO_SECTION,
+    UNIT_NORMS,
+    UNIT_VIOLATIONS,
+    UNIT_FACTS,
+    UNIT_AGENDAS
+} UnitSection;
+
+/**
+ * Start a scan at the beginning of a unit
+ *
+ * @param scan The scan
+ * @param text Text from the start of the unit
+ * @param length Length of the text in bytes
+ * @param line Line number of the unit's first line
+ */
+void unit_scan_start(UnitScan* scan, const char* text, size_t length, int line);
+
+/**
+ * Move the scan to the start of the next unit
+ *
+ * That is the next non-blank line that starts a numbered norm or
+ * follows a blank line. The line the scan is on, and any blank lines
+ * before text, are passed first, so the institution declaration at the
+ * start of a schema is one unit. Only line starts are looked at (one
+ * memchr per line).
+ *
+ * @param scan The scan
+ * @return true if the scan is on the next unit, false at the end of the text
+ */
+bool unit_scan_next(UnitScan* scan);
+
+/**
+ * Check that a unit parsed on its own may follow the units before it
+ *
+ * Each unit is parsed as a run of sections, so only the order across
+ * units is left to check: a unit may not start with a section that
+ * comes before the last section of the units before it.
+ *
+ * @param part Partial schema parsed from the unit
+ * @param section Last section of the units before it, advanced past the unit either way
+ * @return true if the unit may follow them
+ */
+bool unit_follows(const Schema* part, UnitSection* section);
+
+#endif /* SCHEMA_UNITS_H */
@@ -0,0 +1,85 @@
+/**
+ * shared_snapshot.c
+ *
+ * Implementation of reference-counted snapshots
+ */
+
+#include "shared_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Last snapshot id handed out */
+static uint64_t last_id = 0;
+
+/**
+ * Wrap data in a new snapshot holding one reference
+ */
+SharedSnapshot* shared_snapshot_create(void* data, void (*destroy)(void* data)) {
+    SharedSnapshot* snapshot = (SharedSnapshot*)malloc(sizeof(SharedSnapshot));
+    if (snapshot == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+
+    snapshot->data = data;
+    snapshot->destroy = destroy;
+    snapshot->refs = 1;
+    snapshot->id = __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+/**
+ * Take a reference to the published snapshot
+ */
+SharedSnapshot* shared_snapshot_acquire(SnapshotSlot* slot) {
+    pthread_mutex_lock(&slot->lock);
+    SharedSnapshot* snapshot = slot->current;
+    if (snapshot != NULL) {
+        __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&slot->lock);
+    return snapshot;
+}
+
+/**
+ * Take another reference to a snapshot already held
+ */
+SharedSnapshot* shared_snapshot_retain(SharedSnapshot* snapshot) {
+    __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+/**
+ * Drop a reference, destroying the snapshot with the last one
+ */
+void shared_snapshot_release(SharedSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+
+    if (__atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (snapshot->destroy != NULL) {
+            snapshot->destroy(snapshot->data);
+        }
+        free(snapshot);
+    }
+}
+
+/**
+ * Publish a snapshot, replacing the current one
+ */
+void shared_snapshot_publish(SnapshotSlot* slot, SharedSnapshot* snapshot) {
+    pthread_mutex_lock(&slot->lock);
+    SharedSnapshot* old = slot->current;
+    __atomic_store_n(&slot->current, snapshot, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&slot->lock);
+
+    shared_snapshot_release(old);
+}
+
+/**
+ * Get the published snapshot without taking a reference
+ */
+SharedSnapshot* shared_snapshot_peek(SnapshotSlot* slot) {
+    return __atomic_load_n(&slot->current, __ATOMIC_ACQUIRE);
+}
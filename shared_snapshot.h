@@ -0,0 +1,92 @@
+/**
+ * shared_snapshot.h
+ *
+ * Reference-counted immutable snapshots with atomic publication, used to
+ * swap configuration and legal context while work is in flight
+ */
+
+#ifndef SHARED_SNAPSHOT_H
+#define SHARED_SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * An immutable piece of data shared by reference count
+ */
+typedef struct shared_snapshot {
+    void* data;                       // Snapshot contents
+    void (*destroy)(void* data);      // Called when the last reference is released
+    int refs;                         // Reference count (updated atomically)
+    uint64_t id;                      // Unique among the snapshots created by the process
+} SharedSnapshot;
+
+/**
+ * The published snapshot of some kind of data
+ *
+ * The slot holds one reference to the current snapshot. Readers take
+ * their own reference; a publish swaps the pointer and drops the slot's
+ * reference to the old snapshot, which is destroyed once its last
+ * reader lets go.
+ */
+typedef struct {
+    SharedSnapshot* current;
+    pthread_mutex_t lock;             // Orders acquire against swap; held for a few instructions
+} SnapshotSlot;
+
+#define SNAPSHOT_SLOT_INIT { NULL, PTHREAD_MUTEX_INITIALIZER }
+
+/**
+ * Wrap data in a new snapshot holding one reference
+ *
+ * @param data Snapshot contents
+ * @param destroy Destructor for the contents
+ * @return The snapshot, or NULL on allocation failure (data is not destroyed)
+ */
+SharedSnapshot* shared_snapshot_create(void* data, void (*destroy)(void* data));
+
+/**
+ * Take a reference to the published snapshot
+ *
+ * @param slot The slot
+ * @return The snapshot (release it when done), or NULL if none is published
+ */
+SharedSnapshot* shared_snapshot_acquire(SnapshotSlot* slot);
+
+/**
+ * Take another reference to a snapshot already held
+ *
+ * @param snapshot The snapshot
+ * @return The same snapshot
+ */
+SharedSnapshot* shared_snapshot_retain(SharedSnapshot* snapshot);
+
+/**
+ * Drop a reference, destroying the snapshot with the last one
+ *
+ * @param snapshot The snapshot (NULL is ignored)
+ */
+void shared_snapshot_release(SharedSnapshot* snapshot);
+
+/**
+ * Publish a snapshot, replacing the current one
+ *
+ * The slot takes over the caller's reference. In-flight readers keep
+ * the old snapshot until they release it.
+ *
+ * @param slot The slot
+ * @param snapshot The new snapshot, or NULL to unpublish
+ */
+void shared_snapshot_publish(SnapshotSlot* slot, SharedSnapshot* snapshot);
+
+/**
+ * Get the published snapshot without taking a reference
+ *
+ * Only for callers that cannot race with a publish (single-threaded use).
+ *
+ * @param slot The slot
+ * @return The snapshot, or NULL if none is published
+ */
+SharedSnapshot* shared_snapshot_peek(SnapshotSlot* slot);
+
+#endif /* SHARED_SNAPSHOT_H */
@@ -0,0 +1,366 @@
+/**
+ * task_scheduler.c
+ *
+ * Implementation of the work-stealing task scheduler
+ *
+ * Each deque is a growable ring guarded by its own mutex: the owner
+ * pushes and pops at the bottom and thieves take from the top, so the
+ * locks are only contended while a worker is being robbed. Tasks here
+ * are whole files or batches of norms, which makes a lock per operation
+ * negligible next to the work itself.
+ */
+
+#define _GNU_SOURCE
+#include "task_scheduler.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Initial number of slots of a deque */
+#define TASK_DEQUE_INITIAL 64
+
+/* How long a waiting worker sleeps before looking for work again */
+#define TASK_WAIT_POLL_NS 1000000L
+
+/* A queued task */
+typedef struct {
+    TaskFn fn;
+    void* arg;
+    TaskGroup* group;
+} Task;
+
+/* Per-worker double-ended queue of tasks */
+typedef struct {
+    Task* slots;
+    int capacity;               // Power of two
+    int top;                    // Index of the oldest task (thieves take from here)
+    int count;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+/* One worker thread */
+typedef struct {
+    TaskScheduler* scheduler;
+    int index;
+    unsigned seed;              // Victim selection when stealing
+    pthread_t thread;
+    bool started;
+    TaskDeque deque;
+} TaskWorker;
+
+struct task_scheduler {
+    TaskWorker* workers;
+    int worker_count;
+    int next_victim;            // Deque for the next spawn from outside the pool (updated atomically)
+    int queued;                 // Tasks sitting in deques, briefly -1 while a push races a steal (under idle_lock)
+    bool stopping;              // Set by task_scheduler_destroy() (under idle_lock)
+    pthread_mutex_t idle_lock;
+    pthread_cond_t work_available;
+};
+
+/* Worker the calling thread is, if any */
+static __thread TaskWorker* current_worker = NULL;
+
+/**
+ * Append a task at the bottom of a deque
+ */
+static bool deque_push(TaskDeque* deque, Task task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = deque->capacity > 0 ? deque->capacity * 2 : TASK_DEQUE_INITIAL;
+        Task* slots = (Task*)malloc(capacity * sizeof(Task));
+        if (slots == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for (int i = 0; i < deque->count; i++) {
+            slots[i] = deque->slots[(deque->top + i) & (deque->capacity - 1)];
+        }
+        free(deque->slots);
+        deque->slots = slots;
+        deque->capacity = capacity;
+        deque->top = 0;
+    }
+    deque->slots[(deque->top + deque->count) & (deque->capacity - 1)] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+/**
+ * Take the newest task (owner side)
+ */
+static bool deque_pop(TaskDeque* deque, Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        deque->count--;
+        *task = deque->slots[(deque->top + deque->count) & (deque->capacity - 1)];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * Take the oldest task (thief side)
+ */
+static bool deque_steal(TaskDeque* deque, Task* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        *task = deque->slots[deque->top];
+        deque->top = (deque->top + 1) & (deque->capacity - 1);
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * Find a task for a worker: its own newest, else another worker's oldest
+ */
+static bool find_task(TaskScheduler* scheduler, TaskWorker* self, Task* task) {
+    bool found = false;
+    if (self != NULL && deque_pop(&self->deque, task)) {
+        found = true;
+    } else {
+        int count = scheduler->worker_count;
+        int start = self != NULL ? (int)(rand_r(&self->seed) % count) : 0;
+        for (int i = 0; i < count && !found; i++) {
+            TaskWorker* victim = &scheduler->workers[(start + i) % count];
+            if (victim != self) {
+                found = deque_steal(&victim->deque, task);
+            }
+        }
+    }
+
+    if (found) {
+        pthread_mutex_lock(&scheduler->idle_lock);
+        scheduler->queued--;
+        pthread_mutex_unlock(&scheduler->idle_lock);
+    }
+    return found;
+}
+
+/**
+ * Run a task and mark it finished in its group
+ */
+static void run_task(Task* task) {
+    task->fn(task->arg);
+
+    TaskGroup* group = task->group;
+    pthread_mutex_lock(&group->lock);
+    group->pending--;
+    pthread_cond_broadcast(&group->finished);
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Worker loop: run tasks until the scheduler stops
+ */
+static void* worker_main(void* arg) {
+    TaskWorker* self = (TaskWorker*)arg;
+    TaskScheduler* scheduler = self->scheduler;
+    current_worker = self;
+
+    for (;;) {
+        Task task;
+        if (find_task(scheduler, self, &task)) {
+            run_task(&task);
+            continue;
+        }
+
+        pthread_mutex_lock(&scheduler->idle_lock);
+        while (scheduler->queued <= 0 && !scheduler->stopping) {
+            pthread_cond_wait(&scheduler->work_available, &scheduler->idle_lock);
+        }
+        bool stop = scheduler->stopping && scheduler->queued <= 0;
+        pthread_mutex_unlock(&scheduler->idle_lock);
+        if (stop) {
+            break;
+        }
+    }
+
+    current_worker = NULL;
+    return NULL;
+}
+
+/**
+ * Start a scheduler
+ */
+TaskScheduler* task_scheduler_create(int workers) {
+    if (workers <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (int)online : 1;
+    }
+
+    TaskScheduler* scheduler = (TaskScheduler*)calloc(1, sizeof(TaskScheduler));
+    TaskWorker* pool = (TaskWorker*)calloc(workers, sizeof(TaskWorker));
+    if (scheduler == NULL || pool == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(scheduler);
+        free(pool);
+        return NULL;
+    }
+
+    scheduler->workers = pool;
+    scheduler->worker_count = workers;
+    pthread_mutex_init(&scheduler->idle_lock, NULL);
+    pthread_cond_init(&scheduler->work_available, NULL);
+
+    for (int i = 0; i < workers; i++) {
+        pool[i].scheduler = scheduler;
+        pool[i].index = i;
+        pool[i].seed = (unsigned)i * 2654435761u + 1;
+        pthread_mutex_init(&pool[i].deque.lock, NULL);
+    }
+
+    /* Threads start last, so they never see a half-built pool */
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pool[i].started = pthread_create(&pool[i].thread, NULL, worker_main, &pool[i]) == 0;
+        started += pool[i].started;
+    }
+
+    if (started == 0) {
+        fprintf(stderr, "Error: Failed to start worker threads\n");
+        task_scheduler_destroy(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+/**
+ * Stop the workers and free the scheduler
+ */
+void task_scheduler_destroy(TaskScheduler* scheduler) {
+    if (scheduler == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&scheduler->idle_lock);
+    scheduler->stopping = true;
+    pthread_cond_broadcast(&scheduler->work_available);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+
+    /* Every worker may still be stealing from every deque until it exits */
+    for (int i = 0; i < scheduler->worker_count; i++) {
+        if (scheduler->workers[i].started) {
+            pthread_join(scheduler->workers[i].thread, NULL);
+        }
+    }
+    for (int i = 0; i < scheduler->worker_count; i++) {
+        pthread_mutex_destroy(&scheduler->workers[i].deque.lock);
+        free(scheduler->workers[i].deque.slots);
+    }
+
+    pthread_mutex_destroy(&scheduler->idle_lock);
+    pthread_cond_destroy(&scheduler->work_available);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+/**
+ * Get the number of worker threads
+ */
+int task_scheduler_workers(const TaskScheduler* scheduler) {
+    return scheduler->worker_count;
+}
+
+/**
+ * Get the scheduler the calling thread works for
+ */
+TaskScheduler* task_scheduler_current(void) {
+    return current_worker != NULL ? current_worker->scheduler : NULL;
+}
+
+/**
+ * Initialize an empty task group
+ */
+void task_group_init(TaskGroup* group) {
+    group->pending = 0;
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->finished, NULL);
+}
+
+/**
+ * Destroy a task group with no pending tasks
+ */
+void task_group_destroy(TaskGroup* group) {
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->finished);
+}
+
+/**
+ * Spawn a task
+ */
+void task_spawn(TaskScheduler* scheduler, TaskGroup* group, TaskFn fn, void* arg) {
+    Task task = { fn, arg, group };
+
+    pthread_mutex_lock(&group->lock);
+    group->pending++;
+    pthread_mutex_unlock(&group->lock);
+
+    /* Workers keep their sub-tasks local; outside threads spread theirs */
+    TaskWorker* target = current_worker;
+    if (target == NULL || target->scheduler != scheduler) {
+        int index = __atomic_fetch_add(&scheduler->next_victim, 1, __ATOMIC_RELAXED);
+        target = &scheduler->workers[(unsigned)index % scheduler->worker_count];
+    }
+
+    if (!deque_push(&target->deque, task)) {
+        run_task(&task);
+        return;
+    }
+
+    pthread_mutex_lock(&scheduler->idle_lock);
+    scheduler->queued++;
+    pthread_cond_signal(&scheduler->work_available);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+}
+
+/**
+ * Wait until at most limit tasks of a group are pending
+ */
+void task_group_wait(TaskScheduler* scheduler, TaskGroup* group, int limit) {
+    TaskWorker* self = current_worker != NULL && current_worker->scheduler == scheduler ? current_worker : NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&group->lock);
+        if (group->pending <= limit) {
+            pthread_mutex_unlock(&group->lock);
+            return;
+        }
+
+        if (self == NULL) {
+            pthread_cond_wait(&group->finished, &group->lock);
+            pthread_mutex_unlock(&group->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&group->lock);
+
+        /* A worker helps instead of blocking, which also runs its own sub-tasks */
+        Task task;
+        if (find_task(scheduler, self, &task)) {
+            run_task(&task);
+            continue;
+        }
+
+        /* Everything left is running elsewhere; nap until some of it finishes */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += TASK_WAIT_POLL_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&group->lock);
+        if (group->pending > limit) {
+            pthread_cond_timedwait(&group->finished, &group->lock, &deadline);
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * task_scheduler.h
+ *
+ * Work-stealing task scheduler: a pool of worker threads, each with its
+ * own deque of tasks. A worker runs its newest task first and, when its
+ * deque is empty, steals the oldest task of another worker, so large
+ * jobs split into sub-tasks keep every core busy until the work drains.
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * A pool of worker threads
+ */
+typedef struct task_scheduler TaskScheduler;
+
+/**
+ * Work done by a task
+ *
+ * @param arg Argument given to task_spawn()
+ */
+typedef void (*TaskFn)(void* arg);
+
+/**
+ * A set of spawned tasks that can be waited for together
+ */
+typedef struct {
+    int pending;                // Tasks spawned but not finished (under lock)
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} TaskGroup;
+
+/**
+ * Start a scheduler
+ *
+ * @param workers Number of worker threads (0 = one per online CPU)
+ * @return The scheduler, or NULL if no worker could be started
+ */
+TaskScheduler* task_scheduler_create(int workers);
+
+/**
+ * Stop the workers and free the scheduler
+ *
+ * Every task group must have been waited for.
+ *
+ * @param scheduler Scheduler to free
+ */
+void task_scheduler_destroy(TaskScheduler* scheduler);
+
+/**
+ * Get the number of worker threads
+ *
+ * @param scheduler The scheduler
+ * @return Number of workers
+ */
+int task_scheduler_workers(const TaskScheduler* scheduler);
+
+/**
+ * Get the scheduler the calling thread works for
+ *
+ * Lets code running inside a task spawn sub-tasks on the same pool.
+ *
+ * @return The scheduler, or NULL if the caller is not a worker
+ */
+TaskScheduler* task_scheduler_current(void);
+
+/**
+ * Initialize an empty task group
+ *
+ * @param group The group
+ */
+void task_group_init(TaskGroup* group);
+
+/**
+ * Destroy a task group with no pending tasks
+ *
+ * @param group The group
+ */
+void task_group_destroy(TaskGroup* group);
+
+/**
+ * Spawn a task
+ *
+ * From a worker the task goes on that worker's deque; from any other
+ * thread the workers' deques are filled in turn. If the task cannot be
+ * queued it runs immediately on the calling thread.
+ *
+ * @param scheduler The scheduler
+ * @param group Group the task belongs to
+ * @param fn Work to do
+ * @param arg Argument passed to fn
+ */
+void task_spawn(TaskScheduler* scheduler, TaskGroup* group, TaskFn fn, void* arg);
+
+/**
+ * Wait until at most limit tasks of a group are pending
+ *
+ * A worker runs queued tasks while it waits, so tasks may wait for
+ * their own sub-tasks without tying up the pool.
+ *
+ * @param scheduler The scheduler the tasks were spawned on
+ * @param group The group
+ * @param limit Pending tasks to allow (0 waits for all of them)
+ */
+void task_group_wait(TaskScheduler* scheduler, TaskGroup* group, int limit);
+
+#endif /* TASK_SCHEDULER_H */
@@ -0,0 +1,13 @@
+Content-Length: 75
+
+{"jsonrpc":"2.0","id":1,"method":"initialize","params":{"capabilities":{}}}Content-Length: 52
+
+{"jsonrpc":"2.0","method":"initialized","params":{}}Content-Length: 575
+
+{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"file:///test_references.txt","languageId":"savigny","version":1,"text":"Institution Arrendamiento comienza como un contrato en que múltiples personas establecen dentro del derecho-patrimonial-privado dadas condiciones legales & forma requerida.\n\n1. Esta incluye la norma que el arrendatario debe \"pagar la renta\" que actua \"sobre un pago\".\n\n2. Esta incluye la norma que en-caso-que regla 1 y regla 9 el arrendador debe \"emitir recibo de pago\" que actua \"sobre un documento\".\n"}}}Content-Length: 154
+
+{"jsonrpc":"2.0","id":2,"method":"textDocument/hover","params":{"textDocument":{"uri":"file:///test_references.txt"},"position":{"line":4,"character":0}}}Content-Length: 44
+
+{"jsonrpc":"2.0","id":3,"method":"shutdown"}Content-Length: 33
+
+{"jsonrpc":"2.0","method":"exit"}
\ No newline at end of file